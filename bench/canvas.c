@@ -0,0 +1,237 @@
+/*************************************************************************//**
+ * 
+ * @file canvas.c
+ * 
+ * @brief Measures the bytes and time presenting a canvas takes when only
+ *      scattered cells change between frames, as on a dashboard updating a
+ *      few counters, when a log scrolls up, with and without scrolling the
+ *      terminal, and when styled labels are printed into it every frame.
+ * 
+ * The output goes to a sink counting the bytes. The bytes saved are those
+ * the cursor movements spared over absolute positioning.
+ * 
+ *****************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../include/termglyph.h"
+
+
+
+#define COLUMNS 200
+#define ROWS 60
+#define FRAMES 2000
+
+
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+
+static int count_write(void *ctx, const char *data, size_t length)
+{
+    (void)data;
+    *(size_t*)ctx += length;
+    return 0;
+}
+
+
+
+static uint32_t next_random(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+
+/**
+ * @brief Presents frames changing `changes` cells each: clusters of digits
+ *      a few columns apart, plus isolated cells anywhere.
+ * 
+ */
+static int run(tg_canvas *canvas, int changes)
+{
+    size_t bytes = 0;
+    tg_sink sink = { count_write, &bytes };
+    uint32_t state = 2463534242u;
+    tg_canvas_stats before;
+    tg_canvas_stats_get(canvas, &before);
+
+    double start = now_seconds();
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        for (int i = 0; i < changes; i++)
+        {
+            tg_canvas_cell cell = { '0' + next_random(&state) % 10,
+                TG_CELL_COLOR_DEFAULT, TG_CELL_COLOR_DEFAULT, 0 };
+            int x = (int)(next_random(&state) % COLUMNS);
+            int y = (int)(next_random(&state) % ROWS);
+            if (i % 2)
+            {
+                // Counters on a grid, so that changes share rows.
+                x = (x / 20) * 20 + 12 + (int)(next_random(&state) % 4);
+                y = (y / 4) * 4;
+            }
+            tg_canvas_set(canvas, x, y, &cell);
+        }
+        if (tg_canvas_present(canvas, &sink))
+        {
+            return 1;
+        }
+    }
+    double elapsed = now_seconds() - start;
+
+    tg_canvas_stats stats;
+    tg_canvas_stats_get(canvas, &stats);
+    fprintf(stderr, "%3d changes  %8.1f bytes/frame  %7.1f saved/frame  "
+        "%6.2f us/frame\n", changes, (double)bytes / FRAMES,
+        (double)(stats.bytes_saved - before.bytes_saved) / FRAMES,
+        elapsed * 1e6 / FRAMES);
+    return 0;
+}
+
+
+
+/**
+ * @brief Presents frames of a log tail: every frame, the rows above the
+ *      status line move up by one to three lines and new lines of text come
+ *      in at the bottom.
+ * 
+ */
+static int run_log(int scrolling)
+{
+    tg_canvas *canvas = tg_canvas_create(COLUMNS, ROWS);
+    if (!canvas)
+    {
+        return 1;
+    }
+    tg_canvas_set_scrolling(canvas, scrolling);
+
+    size_t bytes = 0;
+    tg_sink sink = { count_write, &bytes };
+    uint32_t state = 88172645u;
+    int failed = 0;
+    double start = now_seconds();
+    for (int frame = 0; frame < FRAMES && !failed; frame++)
+    {
+        int lines = 1 + (int)(next_random(&state) % 3);
+        for (int y = 0; y < ROWS - 1; y++)
+        {
+            for (int x = 0; x < COLUMNS; x++)
+            {
+                tg_canvas_cell cell = { ' ', TG_CELL_COLOR_DEFAULT,
+                    TG_CELL_COLOR_DEFAULT, 0 };
+                if (y + lines < ROWS - 1)
+                {
+                    tg_canvas_get(canvas, x, y + lines, &cell);
+                }
+                else if (x < 40 + (int)(next_random(&state) % 4) * 30)
+                {
+                    cell.codepoint = 'a' + next_random(&state) % 26;
+                }
+                tg_canvas_set(canvas, x, y, &cell);
+            }
+        }
+        failed = tg_canvas_present(canvas, &sink);
+    }
+    double elapsed = now_seconds() - start;
+
+    tg_canvas_stats stats;
+    tg_canvas_stats_get(canvas, &stats);
+    if (!failed)
+    {
+        fprintf(stderr, "log tail, scrolling %-3s  %8.1f bytes/frame  "
+            "%6.2f us/frame  (%lu scrolls)\n", scrolling ? "on" : "off",
+            (double)bytes / FRAMES, elapsed * 1e6 / FRAMES, stats.scrolls);
+    }
+    tg_canvas_free(canvas);
+    return failed;
+}
+
+
+
+/**
+ * @brief Presents frames of a dashboard printing all its labels every frame,
+ *      with styles and colors, though only their values change.
+ * 
+ */
+static int run_labels(void)
+{
+    tg_canvas *canvas = tg_canvas_create(COLUMNS, ROWS);
+    if (!canvas)
+    {
+        return 1;
+    }
+
+    size_t bytes = 0;
+    tg_sink sink = { count_write, &bytes };
+    uint32_t state = 521288629u;
+    int failed = 0;
+    double start = now_seconds();
+    for (int frame = 0; frame < FRAMES && !failed; frame++)
+    {
+        for (int y = 0; y < ROWS; y++)
+        {
+            for (int x = 0; x < COLUMNS; x += 40)
+            {
+                int value = (int)(next_random(&state) % 1000);
+                int color = value > 900 ? TG_RGB(255, 64, 64)
+                                        : TG_RGB(64, 200, 64);
+                failed |= tg_canvas_printf(canvas, x, y,
+                    "#if#osensor %02d.%d#0 #df%5.1f#0c %%",
+                    TG_INDEXED_COLOR_BRIGHT_BLACK, color, x / 40, y,
+                    value / 10.0) < 0;
+            }
+        }
+        failed |= tg_canvas_present(canvas, &sink);
+    }
+    double elapsed = now_seconds() - start;
+
+    if (!failed)
+    {
+        fprintf(stderr, "labels  %8.1f bytes/frame  %6.2f us/frame\n",
+            (double)bytes / FRAMES, elapsed * 1e6 / FRAMES);
+    }
+    tg_canvas_free(canvas);
+    return failed;
+}
+
+
+
+int main(void)
+{
+    tg_canvas *canvas = tg_canvas_create(COLUMNS, ROWS);
+    if (!canvas)
+    {
+        return 1;
+    }
+
+    // A static layout of labels, drawn once.
+    tg_canvas_cell label = { '.', TG_CELL_COLOR_INDEXED(8),
+        TG_CELL_COLOR_DEFAULT, 0 };
+    for (int y = 0; y < ROWS; y += 4)
+    {
+        tg_canvas_fill(canvas, 0, y, COLUMNS, 1, &label);
+    }
+    size_t bytes = 0;
+    tg_sink sink = { count_write, &bytes };
+    int failed = tg_canvas_present(canvas, &sink);
+
+    int changes[] = { 4, 16, 64, 256 };
+    for (size_t i = 0; i < sizeof(changes) / sizeof(int) && !failed; i++)
+    {
+        failed = run(canvas, changes[i]);
+    }
+
+    tg_canvas_free(canvas);
+    return failed || run_log(0) || run_log(1) || run_labels();
+}
@@ -0,0 +1,163 @@
+/*************************************************************************//**
+ * 
+ * @file delta.c
+ * 
+ * @brief Reports the bytes per frame of a mostly static clip rendered whole,
+ *      then as deltas with a few change thresholds.
+ * 
+ * The clip is a textured backdrop with a small sprite moving across it, and
+ * a light sensor noise on top, the kind of frames a screen capture or a
+ * fixed camera gives. The output goes to a sink counting the bytes.
+ * 
+ *****************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../include/termglyph.h"
+
+
+
+#define CLIP_WIDTH 320
+#define CLIP_HEIGHT 180
+#define CLIP_FRAMES 300
+#define SPRITE_SIZE 24
+
+
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+
+static int count_write(void *ctx, const char *data, size_t length)
+{
+    (void)data;
+    *(size_t*)ctx += length;
+    return 0;
+}
+
+
+
+/**
+ * @brief Draws frame `index` of the clip into `pixels`.
+ * 
+ */
+static void draw_frame(uint8_t *pixels, int index)
+{
+    uint32_t state = 2463534242u + (uint32_t)index * 2654435761u;
+    int sprite_x = (index * 3) % (CLIP_WIDTH - SPRITE_SIZE);
+    int sprite_y = CLIP_HEIGHT / 2
+                 + (index % 40 < 20 ? index % 20 : 20 - index % 20) - 10;
+
+    for (int y = 0; y < CLIP_HEIGHT; y++)
+    {
+        for (int x = 0; x < CLIP_WIDTH; x++)
+        {
+            uint8_t *pixel = pixels + 3 * ((size_t)y * CLIP_WIDTH + x);
+            pixel[0] = (uint8_t)(x * 255 / CLIP_WIDTH);
+            pixel[1] = (uint8_t)(y * 255 / CLIP_HEIGHT);
+            pixel[2] = (uint8_t)(((x / 16 + y / 16) & 1) ? 160 : 96);
+
+            // One pixel in 16 is off by a level or two.
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            if ((state & 15) == 0)
+            {
+                pixel[1] ^= (uint8_t)(state >> 8 & 3);
+            }
+
+            if (x >= sprite_x && x < sprite_x + SPRITE_SIZE &&
+                y >= sprite_y && y < sprite_y + SPRITE_SIZE)
+            {
+                pixel[0] = 240;
+                pixel[1] = 200;
+                pixel[2] = (uint8_t)(index * 5);
+            }
+        }
+    }
+}
+
+
+
+/**
+ * @brief Renders the clip, whole frames if `delta` is NULL, and reports the
+ *      bytes per frame.
+ * 
+ */
+static int run(const char *name, const uint8_t *clip, tg_delta *delta,
+    const tg_render_opts *opts, size_t full_bytes, size_t *bytes_out)
+{
+    size_t bytes = 0;
+    tg_sink sink = { count_write, &bytes };
+    size_t frame_size = 3 * (size_t)CLIP_WIDTH * CLIP_HEIGHT;
+
+    double start = now_seconds();
+    for (int i = 0; i < CLIP_FRAMES; i++)
+    {
+        tg_image image = { CLIP_WIDTH, CLIP_HEIGHT, 3 * CLIP_WIDTH,
+            TG_PIXEL_FORMAT_RGB8, clip + i * frame_size };
+        int result = delta ? tg_render_delta(&image, opts, delta, &sink)
+                           : tg_render(&image, opts, &sink);
+        if (result)
+        {
+            fprintf(stderr, "%s: rendering failed\n", name);
+            return 1;
+        }
+    }
+    double elapsed = now_seconds() - start;
+
+    fprintf(stderr, "%-16s %9.0f bytes/frame %6.2f ms/frame", name,
+        (double)bytes / CLIP_FRAMES, elapsed * 1e3 / CLIP_FRAMES);
+    if (full_bytes)
+    {
+        fprintf(stderr, "  %5.1f%% of whole frames",
+            100.0 * (double)bytes / (double)full_bytes);
+    }
+    fprintf(stderr, "\n");
+    *bytes_out = bytes;
+    return 0;
+}
+
+
+
+int main(void)
+{
+    size_t frame_size = 3 * (size_t)CLIP_WIDTH * CLIP_HEIGHT;
+    uint8_t *clip = (uint8_t*)malloc(frame_size * CLIP_FRAMES);
+    if (!clip)
+    {
+        return 1;
+    }
+    for (int i = 0; i < CLIP_FRAMES; i++)
+    {
+        draw_frame(clip + i * frame_size, i);
+    }
+
+    tg_render_opts opts = {0};
+    opts.mode = TG_RENDER_MODE_HALF_BLOCK;
+    opts.columns = 160;
+
+    static const int thresholds[] = { 0, 2, 4, 8 };
+    size_t full_bytes = 0;
+    size_t bytes = 0;
+    int failed = run("whole frames", clip, NULL, &opts, 0, &full_bytes);
+    for (size_t i = 0;
+         i < sizeof(thresholds) / sizeof(thresholds[0]) && !failed; i++)
+    {
+        tg_delta *delta = tg_delta_create(thresholds[i]);
+        char name[32];
+        snprintf(name, sizeof(name), "delta, t=%d", thresholds[i]);
+        failed = !delta || run(name, clip, delta, &opts, full_bytes, &bytes);
+        tg_delta_free(delta);
+    }
+
+    free(clip);
+    return failed;
+}
@@ -0,0 +1,83 @@
+/*************************************************************************//**
+ * 
+ * @file luma.c
+ * 
+ * @brief Times the luma kernels over every possible RGB color.
+ * 
+ * Their exactness is checked by the kernels test.
+ * 
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/internal.h"
+
+
+
+#define COLOR_COUNT (1u << 24)
+#define BENCH_ROUNDS 8
+
+
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+
+/**
+ * @brief Reports the throughput of a kernel.
+ * 
+ */
+static void time_kernel(const char *name, tg_luma_row_fn kernel,
+    const uint8_t *rgb, uint8_t *luma)
+{
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+    {
+        kernel(rgb, luma, COLOR_COUNT);
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("%-6s %8.1f Mpixel/s\n", name,
+        (double)COLOR_COUNT * BENCH_ROUNDS / elapsed / 1e6);
+}
+
+
+
+int main(void)
+{
+    uint8_t *rgb = (uint8_t*)malloc(3 * (size_t)COLOR_COUNT);
+    uint8_t *luma = (uint8_t*)malloc(COLOR_COUNT);
+    if (!rgb || !luma)
+    {
+        return 1;
+    }
+
+    for (uint32_t c = 0; c < COLOR_COUNT; c++)
+    {
+        rgb[3*c] = (uint8_t)(c >> 16);
+        rgb[3*c+1] = (uint8_t)(c >> 8);
+        rgb[3*c+2] = (uint8_t)c;
+    }
+
+    time_kernel("scalar", tg_luma_row_scalar, rgb, luma);
+#if TG_X86_KERNELS
+    if (tg_cpu_supports("sse2"))
+    {
+        time_kernel("sse2", tg_luma_row_sse2, rgb, luma);
+    }
+    if (tg_cpu_supports("avx2"))
+    {
+        time_kernel("avx2", tg_luma_row_avx2, rgb, luma);
+    }
+#endif
+
+    free(luma);
+    free(rgb);
+    return 0;
+}
@@ -0,0 +1,167 @@
+/*************************************************************************//**
+ * 
+ * @file mipmap.c
+ * 
+ * @brief Times the downsampling kernels, then rendering a large image at
+ *      terminal sizes, straight from the image and from its mipmap pyramid.
+ * 
+ * The exactness of the kernels is checked by the kernels test.
+ * 
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../include/termglyph.h"
+#include "../src/internal.h"
+
+
+
+#define ROW_PIXELS 65536
+#define BENCH_ROUNDS 200
+#define IMAGE_SIZE 4096
+#define RENDER_ROUNDS 20
+
+
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+
+static int count_write(void *ctx, const char *data, size_t length)
+{
+    (void)data;
+    *(size_t*)ctx += length;
+    return 0;
+}
+
+
+
+/**
+ * @brief Reports the throughput of a kernel.
+ * 
+ */
+static void time_kernel(const char *name, tg_downsample_row_fn kernel,
+    const uint8_t *top, const uint8_t *bottom, uint8_t *out)
+{
+    double start = now_seconds();
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+    {
+        kernel(top, bottom, out, ROW_PIXELS);
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("%-6s %8.1f Mpixel/s\n", name,
+        (double)ROW_PIXELS * BENCH_ROUNDS / elapsed / 1e6);
+}
+
+
+
+/**
+ * @brief Renders an image at a few sizes, either straight or through its
+ *      pyramid, and reports the time per render.
+ * 
+ */
+static int time_renders(const char *name, const tg_image *image,
+    tg_mipmap *mipmap)
+{
+    static const int sizes[] = { 40, 80, 160, 320 };
+    size_t bytes = 0;
+    tg_sink sink = { count_write, &bytes };
+
+    printf("%-8s", name);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        tg_render_opts opts = {0};
+        opts.mode = TG_RENDER_MODE_HALF_BLOCK;
+        opts.columns = sizes[s];
+        opts.threads = TG_THREADS_AUTO;
+
+        double start = now_seconds();
+        for (int i = 0; i < RENDER_ROUNDS; i++)
+        {
+            int result = mipmap ? tg_render_mipmap(mipmap, &opts, &sink)
+                                : tg_render(image, &opts, &sink);
+            if (result)
+            {
+                printf("\nrendering failed\n");
+                return 1;
+            }
+        }
+        double elapsed = now_seconds() - start;
+        printf("  %3d cols %8.3f ms", sizes[s],
+            elapsed * 1e3 / RENDER_ROUNDS);
+    }
+    printf("\n");
+    return 0;
+}
+
+
+
+int main(void)
+{
+    // Rows of 2 * ROW_PIXELS pixels.
+    size_t row_size = 8 * (size_t)ROW_PIXELS;
+    uint8_t *top = (uint8_t*)malloc(row_size);
+    uint8_t *bottom = (uint8_t*)malloc(row_size);
+    uint8_t *out = (uint8_t*)malloc(4 * (size_t)ROW_PIXELS);
+    size_t image_size = 3 * (size_t)IMAGE_SIZE * IMAGE_SIZE;
+    uint8_t *pixels = (uint8_t*)malloc(image_size);
+    if (!top || !bottom || !out || !pixels)
+    {
+        return 1;
+    }
+
+    uint32_t state = 2463534242u;
+    for (size_t i = 0; i < row_size; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        top[i] = (uint8_t)state;
+        bottom[i] = (uint8_t)(state >> 8);
+    }
+
+    time_kernel("scalar", tg_downsample_row_scalar, top, bottom, out);
+#if TG_X86_KERNELS
+    if (tg_cpu_supports("sse2"))
+    {
+        time_kernel("sse2", tg_downsample_row_sse2, top, bottom, out);
+    }
+    if (tg_cpu_supports("avx2"))
+    {
+        time_kernel("avx2", tg_downsample_row_avx2, top, bottom, out);
+    }
+#endif
+
+    for (size_t i = 0; i < image_size; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        pixels[i] = (uint8_t)(i % 3 == 2 ? state : i / (3 * IMAGE_SIZE));
+    }
+    tg_image image = { IMAGE_SIZE, IMAGE_SIZE, 3 * IMAGE_SIZE,
+        TG_PIXEL_FORMAT_RGB8, pixels };
+    tg_mipmap *mipmap = tg_mipmap_create(&image);
+
+    double start = now_seconds();
+    int failed = !mipmap || !tg_mipmap_level(mipmap,
+        tg_mipmap_level_count(mipmap) - 1, TG_THREADS_AUTO);
+    printf("pyramid built in %.3f ms\n", (now_seconds() - start) * 1e3);
+
+    failed = failed || time_renders("image", &image, NULL) ||
+             time_renders("mipmap", &image, mipmap);
+
+    tg_mipmap_free(mipmap);
+    free(pixels);
+    free(out);
+    free(bottom);
+    free(top);
+    return failed;
+}
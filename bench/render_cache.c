@@ -0,0 +1,137 @@
+/*************************************************************************//**
+ * 
+ * @file render_cache.c
+ * 
+ * @brief Compares rendering a photo-sized image through a rendered-output
+ *      cache missing it, with serving the output the cache stored, as a CLI
+ *      process showing the same image again would.
+ * 
+ * The cache lives in a fresh directory under /tmp, removed at the end. The
+ * output goes to a sink counting the bytes.
+ * 
+ *****************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/termglyph.h"
+
+
+
+#define IMAGE_WIDTH 1920
+#define IMAGE_HEIGHT 1080
+#define ROUNDS 50
+
+
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+
+static int count_write(void *ctx, const char *data, size_t length)
+{
+    (void)data;
+    *(size_t*)ctx += length;
+    return 0;
+}
+
+
+
+/**
+ * @brief Encodes a gradient with some noise as a binary PPM.
+ * 
+ */
+static uint8_t *make_ppm(size_t *length)
+{
+    char header[32];
+    int header_length = snprintf(header, sizeof(header), "P6\n%d %d\n255\n",
+        IMAGE_WIDTH, IMAGE_HEIGHT);
+    *length = (size_t)header_length + 3 * (size_t)IMAGE_WIDTH * IMAGE_HEIGHT;
+    uint8_t *ppm = (uint8_t*)malloc(*length);
+    if (!ppm)
+    {
+        return NULL;
+    }
+
+    memcpy(ppm, header, (size_t)header_length);
+    uint8_t *pixel = ppm + header_length;
+    uint32_t state = 2463534242u;
+    for (int y = 0; y < IMAGE_HEIGHT; y++)
+    {
+        for (int x = 0; x < IMAGE_WIDTH; x++)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            *pixel++ = (uint8_t)(x * 255 / IMAGE_WIDTH);
+            *pixel++ = (uint8_t)(y * 255 / IMAGE_HEIGHT);
+            *pixel++ = (uint8_t)(state & 255);
+        }
+    }
+    return ppm;
+}
+
+
+
+int main(void)
+{
+    size_t length = 0;
+    uint8_t *ppm = make_ppm(&length);
+    char directory[] = "/tmp/termglyph_bench_XXXXXX";
+    if (!ppm || !mkdtemp(directory))
+    {
+        free(ppm);
+        return 1;
+    }
+
+    tg_render_opts opts = {0};
+    opts.mode = TG_RENDER_MODE_HALF_BLOCK;
+    opts.columns = 200;
+    opts.threads = TG_THREADS_AUTO;
+
+    size_t bytes = 0;
+    tg_sink sink = { count_write, &bytes };
+    // A cache with no room never stores anything, so every render through
+    // it is a miss.
+    tg_render_cache *full = tg_render_cache_open(directory, 0);
+    tg_render_cache *cache = tg_render_cache_open(directory, 64 << 20);
+    int failed = !full || !cache;
+
+    double start = now_seconds();
+    for (int i = 0; i < ROUNDS && !failed; i++)
+    {
+        failed = tg_render_cached_mem(full, ppm, length, &opts, &sink);
+    }
+    double missed = now_seconds() - start;
+
+    start = now_seconds();
+    for (int i = 0; i < ROUNDS && !failed; i++)
+    {
+        failed = tg_render_cached_mem(cache, ppm, length, &opts, &sink);
+    }
+    double cached = now_seconds() - start;
+
+    if (!failed)
+    {
+        tg_render_cache_stats stats;
+        tg_render_cache_stats_get(cache, &stats);
+        fprintf(stderr, "miss %8.3f ms/image\n", missed * 1e3 / ROUNDS);
+        fprintf(stderr, "hit  %8.3f ms/image  (%lu hits, %lu misses)\n",
+            cached * 1e3 / ROUNDS, stats.hits, stats.misses);
+    }
+
+    char command[64];
+    snprintf(command, sizeof(command), "rm -rf %s", directory);
+    tg_render_cache_close(full);
+    tg_render_cache_close(cache);
+    free(ppm);
+    return system(command) || failed;
+}
@@ -0,0 +1,125 @@
+/*************************************************************************//**
+ * 
+ * @file threads.c
+ * 
+ * @brief Times tg_printppm_opts on a large noisy image with 1 to 16 threads.
+ * 
+ * Results are printed to stderr, since stdout is what gets redirected. That
+ * every thread count gives the same output is checked by the kernels test.
+ * 
+ *****************************************************************************/
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/termglyph.h"
+
+
+
+#define IMAGE_WIDTH 3000
+#define IMAGE_HEIGHT 2000
+
+
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+
+/**
+ * @brief Writes a P6 image of pseudo-random pixels, so that nearly every cell
+ *      needs its own color sequence.
+ * 
+ */
+static int write_noise_ppm(const char *path, int width, int height)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        return 1;
+    }
+
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    uint32_t state = 2463534242u;
+    for (long i = 0; i < 3L * width * height; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        fputc((int)(state & 0xff), f);
+    }
+
+    return fclose(f);
+}
+
+
+
+/**
+ * @brief Renders `image` into the file at `out` with the given thread count.
+ * 
+ * @return The elapsed time in seconds, or a negative value on failure.
+ */
+static double render_to(const char *image, const char *out, int threads)
+{
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (saved < 0 || fd < 0)
+    {
+        return -1;
+    }
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+
+    tg_render_opts opts = {0};
+    opts.threads = threads;
+
+    double start = now_seconds();
+    int result = tg_printppm_opts(image, &opts);
+    fflush(stdout);
+    double elapsed = now_seconds() - start;
+
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return result ? -1 : elapsed;
+}
+
+
+
+int main(void)
+{
+    char large_ppm[] = "/tmp/tg_bench_large_XXXXXX";
+    int fd = mkstemp(large_ppm);
+    if (fd < 0)
+    {
+        return 1;
+    }
+    close(fd);
+
+    int failed = write_noise_ppm(large_ppm, IMAGE_WIDTH, IMAGE_HEIGHT);
+    double base = 0;
+    for (int threads = 1; threads <= 16 && !failed; threads *= 2)
+    {
+        double elapsed = render_to(large_ppm, "/dev/null", threads);
+        if (elapsed < 0)
+        {
+            failed = 1;
+            break;
+        }
+        if (threads == 1)
+        {
+            base = elapsed;
+        }
+        fprintf(stderr, "%2d threads: %7.1f ms, speedup %.2fx\n",
+            threads, elapsed * 1e3, base / elapsed);
+    }
+
+    remove(large_ppm);
+    return failed;
+}
@@ -9,6 +9,13 @@
 #ifndef TERMGLYPH_H
 #define TERMGLYPH_H
 
+#include "termglyph/cache.h"
+#include "termglyph/canvas.h"
+#include "termglyph/image.h"
+#include "termglyph/integral.h"
+#include "termglyph/mipmap.h"
 #include "termglyph/print.h"
+#include "termglyph/render.h"
+#include "termglyph/video.h"
 
 #endif // TERMGLPYH_H
@@ -0,0 +1,245 @@
+/*************************************************************************//**
+ * 
+ * @file cache.h
+ * 
+ * @brief Caches sparing the work of rendering the same images again.
+ * 
+ *****************************************************************************/
+#ifndef TERMGLYPH_CACHE_H
+#define TERMGLYPH_CACHE_H
+
+#include <stddef.h>
+
+#include "image.h"
+#include "render.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/**
+ * @brief An in-process cache of decoded images, keyed by path.
+ * 
+ * An image is decoded on the first request for its path, then handed out
+ * from memory as long as the file keeps the same modification time and size,
+ * and is not replaced by another file; otherwise it is decoded again. When
+ * the images take more memory than the cache allows, the least recently
+ * requested ones are evicted.
+ * 
+ * Every function may be called from many threads at once. Images are never
+ * modified once cached, and an image handed out stays valid until it is
+ * released, even if it is evicted meanwhile.
+ * 
+ */
+typedef struct tg_image_cache tg_image_cache;
+
+
+
+/**
+ * @brief What happened to the requests made to an image cache.
+ * 
+ */
+typedef struct tg_image_cache_stats
+{
+    unsigned long hits;         /**< Requests served from memory. */
+    unsigned long misses;       /**< Requests which decoded the file. */
+    unsigned long evictions;    /**< Images evicted to fit the memory cap. */
+
+    /** Images dropped because their file changed. */
+    unsigned long invalidations;
+
+    size_t entries;             /**< Images in the cache. */
+    size_t bytes;               /**< Memory the cached images take. */
+} tg_image_cache_stats;
+
+
+
+/**
+ * @brief Creates an image cache.
+ * 
+ * @param max_bytes The memory the cached images may take, pixels and
+ *      bookkeeping included. Images larger than that on their own are still
+ *      decoded, but not kept.
+ * 
+ * @return The cache, or NULL on allocation failure.
+ */
+tg_image_cache *tg_image_cache_create(size_t max_bytes);
+
+
+
+/**
+ * @brief Frees an image cache. NULL is ignored.
+ * 
+ * Images still held stay valid, and are freed when released.
+ * 
+ */
+void tg_image_cache_free(tg_image_cache *cache);
+
+
+
+/**
+ * @brief Gets the decoded image of a file, from the cache if it has not
+ *      changed since it was cached.
+ * 
+ * The formats are the ones `tg_image_load` supports. stdin, as "-", is
+ * decoded every time, and never cached.
+ * 
+ * @param cache The cache.
+ * @param path Path to the image file.
+ * 
+ * @return The image, to be released with `tg_image_cache_release`, or NULL
+ *      on failure.
+ */
+const tg_image *tg_image_cache_get(tg_image_cache *cache, const char *path);
+
+
+
+/**
+ * @brief Releases an image handed out by `tg_image_cache_get`. NULL is
+ *      ignored.
+ * 
+ */
+void tg_image_cache_release(const tg_image *image);
+
+
+
+/**
+ * @brief Evicts every image from a cache. The statistics are kept.
+ * 
+ */
+void tg_image_cache_clear(tg_image_cache *cache);
+
+
+
+/**
+ * @brief Gets the statistics of a cache, as a consistent snapshot.
+ * 
+ */
+void tg_image_cache_stats_get(tg_image_cache *cache,
+    tg_image_cache_stats *stats);
+
+
+
+/**
+ * @brief Renders an image file to stdout, decoding it through a cache.
+ * 
+ * @param cache The cache.
+ * @param path Path to the image file.
+ * @param opts The render options, or NULL to use the default ones.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ */
+int tg_printimage_cached(tg_image_cache *cache, const char *path,
+    const tg_render_opts *opts);
+
+
+
+/**
+ * @brief A cache of rendered output on disk, shared by every process using
+ *      the same directory.
+ * 
+ * Entries are addressed by a hash of the encoded image bytes and of the
+ * render options that shape the output, the terminal size included when the
+ * options ask for it, so rendering the same image the same way again only
+ * takes mapping the stored escape sequences and writing them out at once.
+ * 
+ * Entries are written to a temporary file, then renamed into place, so that
+ * readers never see a partial one. When the entries take more space than
+ * the cache allows, the least recently used ones are deleted.
+ * 
+ */
+typedef struct tg_render_cache tg_render_cache;
+
+
+
+/**
+ * @brief What happened to the renders made through a rendered-output cache,
+ *      in this process.
+ * 
+ */
+typedef struct tg_render_cache_stats
+{
+    unsigned long hits;         /**< Renders served from the disk. */
+    unsigned long misses;       /**< Renders which decoded the image. */
+    unsigned long stores;       /**< Entries written to the disk. */
+    unsigned long evictions;    /**< Entries deleted to fit the size cap. */
+} tg_render_cache_stats;
+
+
+
+/**
+ * @brief Opens a rendered-output cache, creating its directory if needed.
+ * 
+ * @param directory The directory the entries are kept in. Its parent must
+ *      exist.
+ * @param max_bytes The space the entries may take on disk, enforced whenever
+ *      an entry is stored. Outputs larger than that on their own are still
+ *      rendered, but not stored.
+ * 
+ * @return The cache, or NULL on failure.
+ */
+tg_render_cache *tg_render_cache_open(const char *directory,
+    size_t max_bytes);
+
+
+
+/**
+ * @brief Closes a rendered-output cache. The entries stay on disk. NULL is
+ *      ignored.
+ * 
+ */
+void tg_render_cache_close(tg_render_cache *cache);
+
+
+
+/**
+ * @brief Renders an image file like `tg_render` would, reusing the output
+ *      stored in a cache for the same bytes and options.
+ * 
+ * The formats are the ones `tg_image_load` supports; "-" reads the image
+ * from stdin. The thread count is left out of the key, since it does not
+ * change the output.
+ * 
+ * @param cache The cache. It may be used by many threads at once.
+ * @param path Path to the image file.
+ * @param opts The render options, or NULL to use the default ones.
+ * @param sink The sink to write to, or NULL for stdout. It gets the whole
+ *      output in a single write.
+ * 
+ * @return 0 on success, non-zero value otherwise. Failing to store the
+ *      output is not an error.
+ */
+int tg_render_cached(tg_render_cache *cache, const char *path,
+    const tg_render_opts *opts, tg_sink *sink);
+
+
+
+/**
+ * @brief Like `tg_render_cached`, with the image file in memory.
+ * 
+ */
+int tg_render_cached_mem(tg_render_cache *cache, const void *data,
+    size_t length, const tg_render_opts *opts, tg_sink *sink);
+
+
+
+/**
+ * @brief Gets the statistics of a rendered-output cache.
+ * 
+ */
+void tg_render_cache_stats_get(tg_render_cache *cache,
+    tg_render_cache_stats *stats);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+
+#endif // TERMGLYPH_CACHE_H
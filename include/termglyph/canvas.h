@@ -0,0 +1,338 @@
+/*************************************************************************//**
+ * 
+ * @file canvas.h
+ * 
+ * @brief A grid of cells drawn in memory, then presented to the terminal by
+ *      redrawing only what changed.
+ * 
+ *****************************************************************************/
+#ifndef TERMGLYPH_CANVAS_H
+#define TERMGLYPH_CANVAS_H
+
+#include <stdint.h>
+
+#include "render.h"
+#include "text_attributes.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/**
+ * @name Cell colors.
+ * 
+ * @brief Colors of canvas cells, on 32 bits: the terminal default color, one
+ *      of the 256 indexed colors, or a 24-bit RGB color.
+ * 
+ * @{
+ */
+#define TG_CELL_COLOR_DEFAULT       0x00000000u
+#define TG_CELL_COLOR_INDEXED(i)    (0x01000000u | (uint32_t)(uint8_t)(i))
+#define TG_CELL_COLOR_RGB(r, g, b)  (0x02000000u | TG_RGB(r, g, b))
+/** @} */
+
+
+
+/**
+ * @name Cell styles.
+ * 
+ * @brief Bits of `tg_canvas_cell.style`, which can be combined.
+ * 
+ * @{
+ */
+#define TG_CELL_STYLE_BOLD              0x0001
+#define TG_CELL_STYLE_DIM               0x0002
+#define TG_CELL_STYLE_ITALIC            0x0004
+#define TG_CELL_STYLE_UNDERLINE         0x0008
+#define TG_CELL_STYLE_BLINKING          0x0010
+#define TG_CELL_STYLE_INVERSE           0x0020
+#define TG_CELL_STYLE_HIDDEN            0x0040
+#define TG_CELL_STYLE_STRIKETHROUGH     0x0080
+#define TG_CELL_STYLE_DOUBLE_UNDERLINE  0x0100
+/** @} */
+
+
+
+/**
+ * @name Synchronized update sequences.
+ * 
+ * @brief Begin and end of a synchronized update (DEC private mode 2026):
+ *      terminals supporting it keep showing the previous frame until the end
+ *      sequence arrives, instead of repainting halfway through the output.
+ *      Other terminals ignore both.
+ * 
+ * @{
+ */
+#define TG_SYNCHRONIZED_UPDATE_BEGIN    "\033[?2026h"
+#define TG_SYNCHRONIZED_UPDATE_END      "\033[?2026l"
+/** @} */
+
+
+
+/**
+ * @brief A cell of a canvas.
+ * 
+ */
+typedef struct tg_canvas_cell
+{
+    /**
+     * The Unicode code point shown, one column wide. 0, the control
+     * characters and code points not one column wide, such as CJK
+     * ideographs, most emoji and combining marks, are shown as a space.
+     */
+    uint32_t codepoint;
+    uint32_t fg;        /**< The foreground color. */
+    uint32_t bg;        /**< The background color. */
+    uint16_t style;     /**< The style bits. */
+} tg_canvas_cell;
+
+
+
+/**
+ * @brief A grid of cells covering the terminal from its top left corner.
+ * 
+ * Cells are stored as separate arrays of code points, foreground colors,
+ * background colors and styles, so that scanning one attribute over a row
+ * only touches that attribute. Writing a cell that differs from what it
+ * holds marks its row, and the span of columns around it, as dirty.
+ * 
+ * The canvas is double-buffered: next to the cells drawn into, it keeps a
+ * front buffer of the cells the terminal shows. Presenting the canvas
+ * assembles the whole frame in memory from the dirty cells that differ from
+ * the front buffer, writes it at once, then clears the marks.
+ * 
+ * A canvas is not synchronized: it must only be used by one thread at a
+ * time.
+ * 
+ */
+typedef struct tg_canvas tg_canvas;
+
+
+
+/**
+ * @brief What the presents of a canvas wrote, since it was created.
+ * 
+ */
+typedef struct tg_canvas_stats
+{
+    unsigned long frames;       /**< Presents which wrote a frame. */
+    unsigned long bytes;        /**< Bytes written. */
+    unsigned long cells;        /**< Cells drawn. */
+    unsigned long moves;        /**< Cursor movements between the cells. */
+    unsigned long scrolls;      /**< Scrolls of shifted rows. */
+
+    /**
+     * Bytes the cursor movements saved over moving the cursor with absolute
+     * positioning every time.
+     */
+    unsigned long bytes_saved;
+} tg_canvas_stats;
+
+
+
+/**
+ * @brief Creates a canvas of blank cells, all of them dirty, so that the
+ *      first present draws the whole canvas.
+ * 
+ * @param columns The number of columns, at least 1.
+ * @param rows The number of rows, at least 1.
+ * 
+ * @return The canvas, or NULL on failure.
+ */
+tg_canvas *tg_canvas_create(int columns, int rows);
+
+
+
+/**
+ * @brief Frees a canvas. NULL is ignored.
+ * 
+ */
+void tg_canvas_free(tg_canvas *canvas);
+
+
+
+/**
+ * @brief Resizes a canvas, keeping the cells that still fit. Every cell is
+ *      dirty afterwards, and the next present clears the screen first.
+ * 
+ * @return 0 on success, non-zero value otherwise, in which case the canvas
+ *      is left as it was.
+ */
+int tg_canvas_resize(tg_canvas *canvas, int columns, int rows);
+
+
+
+/**
+ * @brief Gets the size of a canvas.
+ * 
+ */
+void tg_canvas_size(const tg_canvas *canvas, int *columns, int *rows);
+
+
+
+/**
+ * @brief Writes a cell. Cells outside the canvas are ignored.
+ * 
+ */
+void tg_canvas_set(tg_canvas *canvas, int x, int y,
+    const tg_canvas_cell *cell);
+
+
+
+/**
+ * @brief Reads a cell.
+ * 
+ * @return 0 on success, non-zero value if the cell is outside the canvas.
+ */
+int tg_canvas_get(const tg_canvas *canvas, int x, int y,
+    tg_canvas_cell *cell);
+
+
+
+/**
+ * @brief Writes the same cell over a rectangle, clipped to the canvas.
+ * 
+ */
+void tg_canvas_fill(tg_canvas *canvas, int x, int y, int width, int height,
+    const tg_canvas_cell *cell);
+
+
+
+/**
+ * @brief Renders an image into a rectangle of a canvas.
+ * 
+ * The image is fitted into the rectangle as `tg_render` fits it into
+ * `columns` and `rows`, which are ignored, and drawn from its top left
+ * corner, in cells without styles; the cells of the rectangle it does not
+ * cover are left as they were. Cells falling outside the canvas are left
+ * out.
+ * 
+ * Images can be blitted from several threads at once into disjoint
+ * rectangles of the same canvas, such as the tiles of a dashboard, as long
+ * as no other function uses the canvas in the meantime.
+ * 
+ * @param canvas The canvas.
+ * @param x The column of the top left cell of the rectangle.
+ * @param y The row of the top left cell of the rectangle.
+ * @param width The number of columns of the rectangle, at least 1.
+ * @param height The number of rows of the rectangle, at least 1.
+ * @param image The image.
+ * @param opts The render options, or NULL to use the default ones.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ */
+int tg_canvas_blit_image(tg_canvas *canvas, int x, int y, int width,
+    int height, const tg_image *image, const tg_render_opts *opts);
+
+
+
+/**
+ * @brief Writes formatted text into a canvas from `(x, y)` on, with the
+ *      format string and arguments of `tg_printf`.
+ * 
+ * The extended specifiers set the colors and styles of the cells written
+ * after them instead of writing escape sequences, so that presenting only
+ * sends the attributes that changed. The text starts with the default
+ * attributes, and every code point takes a cell. A newline goes on from
+ * column `x` of the next row; other control characters, and code points not
+ * one column wide, are stored as a space. Cells falling outside the canvas
+ * are left out.
+ * 
+ * Format strings are parsed once and kept in a per thread cache, so labels
+ * drawn every frame only go through printf formatting.
+ * 
+ * @param canvas The canvas.
+ * @param x The column of the first cell.
+ * @param y The row of the first cell.
+ * @param format The format string, as taken by `tg_printf`.
+ * @param ... The color arguments, then the printf ones.
+ * 
+ * @return The number of cells written into the canvas, or -1 on failure.
+ */
+int tg_canvas_printf(tg_canvas *canvas, int x, int y, const char *format,
+    ...);
+
+
+
+/**
+ * @brief Blanks every cell of a canvas.
+ * 
+ */
+void tg_canvas_clear(tg_canvas *canvas);
+
+
+
+/**
+ * @brief Marks every cell of a canvas as dirty and forgets what the terminal
+ *      shows, for when it no longer shows what was presented, such as after
+ *      it was cleared. The next present draws every cell.
+ * 
+ */
+void tg_canvas_invalidate(tg_canvas *canvas);
+
+
+
+/**
+ * @brief Sets whether the frames of a canvas are wrapped in the
+ *      synchronized update sequences, so that terminals supporting them
+ *      show each frame whole. Off by default.
+ * 
+ */
+void tg_canvas_set_synchronized(tg_canvas *canvas, int enabled);
+
+
+
+/**
+ * @brief Sets whether presenting a canvas detects rows shifted up or down
+ *      since the last present, such as by a log scrolling, and scrolls them
+ *      on the terminal instead of drawing them again. Off by default.
+ * 
+ * Scrolling moves whole lines of the terminal, so it is only correct if the
+ * canvas spans its full width.
+ * 
+ */
+void tg_canvas_set_scrolling(tg_canvas *canvas, int enabled);
+
+
+
+/**
+ * @brief Draws the dirty cells of a canvas that differ from what the
+ *      terminal shows, and marks them clean.
+ * 
+ * If scrolling is enabled, rows shifted as a block are first scrolled into
+ * place within a scroll region. The cursor is then moved to each changed
+ * cell with whichever sequence takes the fewest bytes from where it is:
+ * absolute or relative positioning, a carriage return and line feeds, or
+ * writing again the cells in between. It is left after the last cell drawn.
+ * The attributes are reset at the end.
+ * 
+ * @param canvas The canvas.
+ * @param sink The sink to write to, or NULL for stdout. It gets the whole
+ *      frame in a single write, or none if nothing changed.
+ * 
+ * @return 0 on success, non-zero value otherwise, in which case every cell
+ *      is dirty, as if the canvas was invalidated.
+ */
+int tg_canvas_present(tg_canvas *canvas, tg_sink *sink);
+
+
+
+/**
+ * @brief Gets the statistics of a canvas.
+ * 
+ */
+void tg_canvas_stats_get(const tg_canvas *canvas, tg_canvas_stats *stats);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+
+#endif // TERMGLYPH_CANVAS_H
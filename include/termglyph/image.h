@@ -0,0 +1,113 @@
+/*************************************************************************//**
+ * 
+ * @file image.h
+ * 
+ * @brief Decoded images, which can be rendered many times.
+ * 
+ *****************************************************************************/
+#ifndef TERMGLYPH_IMAGE_H
+#define TERMGLYPH_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/**
+ * @brief Layouts of the pixels of an image.
+ * 
+ */
+typedef enum tg_pixel_format
+{
+    /** 3 bytes per pixel, red, green and blue. */
+    TG_PIXEL_FORMAT_RGB8,
+
+    /** 4 bytes per pixel, red, green, blue and alpha. Alpha is ignored. */
+    TG_PIXEL_FORMAT_RGBA8,
+
+    /** 1 byte per pixel, gray level. */
+    TG_PIXEL_FORMAT_GRAY8
+} tg_pixel_format;
+
+
+
+/**
+ * @brief An image in memory.
+ * 
+ * Images are either loaded by the library, like `tg_image_load_ppm` does, or
+ * filled in by the caller to describe pixels it owns; nothing else is needed
+ * to render them. The renderer never modifies an image, so the same image
+ * can be rendered by many threads at once.
+ * 
+ */
+typedef struct tg_image
+{
+    int width;                  /**< Width of the image in pixels. */
+    int height;                 /**< Height of the image in pixels. */
+    size_t stride;              /**< Distance in bytes between two rows. */
+    tg_pixel_format format;     /**< Layout of the pixels. */
+    const uint8_t *pixels;      /**< The first row of pixels. */
+} tg_image;
+
+
+
+/**
+ * @brief Gets the number of bytes a pixel takes in a pixel format.
+ * 
+ */
+size_t tg_pixel_format_size(tg_pixel_format format);
+
+
+
+/**
+ * @brief Decodes an image file, telling its format from its content.
+ * 
+ * The supported formats are Netpbm (P1 to P6 and PAM), QOI, BMP, TGA and
+ * farbfeld. The image is decoded into the RGB8 format, with rows packed one
+ * after the other.
+ * 
+ * @param path Path to the image file, or "-" to read the image from stdin.
+ * 
+ * @return The image, to be freed with `tg_image_free`, or NULL on failure.
+ */
+tg_image *tg_image_load(const char *path);
+
+
+
+/**
+ * @brief Decodes a Netpbm image file, P1 to P6 or PAM.
+ * 
+ * The image is decoded into the RGB8 format, with rows packed one after the
+ * other.
+ * 
+ * @param path Path to the image file, or "-" to read the image from stdin.
+ * 
+ * @return The image, to be freed with `tg_image_free`, or NULL on failure.
+ */
+tg_image *tg_image_load_ppm(const char *path);
+
+
+
+/**
+ * @brief Frees an image loaded by the library. NULL is ignored.
+ * 
+ * @warning Images filled in by the caller must not be passed to this
+ *      function.
+ */
+void tg_image_free(tg_image *image);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+
+#endif // TERMGLYPH_IMAGE_H
@@ -0,0 +1,113 @@
+/*************************************************************************//**
+ * 
+ * @file integral.h
+ * 
+ * @brief Integral images (summed-area tables), for rendering the same image
+ *      many times at arbitrary zoom levels.
+ * 
+ *****************************************************************************/
+#ifndef TERMGLYPH_INTEGRAL_H
+#define TERMGLYPH_INTEGRAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/**
+ * @brief An integral image: for every pixel, the per-channel sums of all the
+ *      pixels above and to the left of it.
+ * 
+ * Building it costs a pass over the image and 12 bytes per pixel, but then
+ * the average color of any rectangle takes four lookups per channel, however
+ * large the rectangle is. Rendering from it is thus as fast at any zoom
+ * level, and does not depend on the image resolution.
+ * 
+ * An integral image is never modified once built, so it can be shared
+ * between threads.
+ * 
+ */
+typedef struct tg_integral_image tg_integral_image;
+
+
+
+/**
+ * @brief Builds the integral image of RGB pixels in memory.
+ * 
+ * @param pixels The pixel data, 3 bytes per pixel.
+ * @param width The image width in pixels.
+ * @param height The image height in pixels.
+ * @param stride The distance in bytes between the start of two rows.
+ * 
+ * @return The integral image, or NULL on failure.
+ */
+tg_integral_image *tg_integral_image_create(const uint8_t *pixels, int width,
+    int height, size_t stride);
+
+
+
+/**
+ * @brief Builds the integral image of a Netpbm image file, P1 to P6 or
+ *      PAM.
+ * 
+ * The file is streamed, so the pixels themselves are never held in memory.
+ * 
+ * @param path Path to the image file, or "-" to read the image from stdin.
+ * 
+ * @return The integral image, or NULL on failure.
+ */
+tg_integral_image *tg_integral_image_load_ppm(const char *path);
+
+
+
+/**
+ * @brief Frees an integral image. NULL is ignored.
+ * 
+ */
+void tg_integral_image_free(tg_integral_image *integral);
+
+
+
+/**
+ * @brief Gets the size of the image an integral image was built from.
+ * 
+ * @param integral The integral image.
+ * @param width A pointer to int to store the width in.
+ * @param height A pointer to int to store the height in.
+ */
+void tg_integral_image_size(const tg_integral_image *integral, int *width,
+    int *height);
+
+
+
+/**
+ * @brief Computes the average color of a rectangle of pixels, rounded to
+ *      nearest.
+ * 
+ * @param integral The integral image.
+ * @param x Left edge of the rectangle.
+ * @param y Top edge of the rectangle.
+ * @param width Width of the rectangle, at least 1.
+ * @param height Height of the rectangle, at least 1.
+ * @param rgb The 3 bytes to store the average color in.
+ * 
+ * @warning The rectangle must lie within the image.
+ */
+void tg_integral_image_average(const tg_integral_image *integral, int x, 
+    int y, int width, int height, uint8_t rgb[3]);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+
+#endif // TERMGLYPH_INTEGRAL_H
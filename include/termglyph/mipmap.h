@@ -0,0 +1,113 @@
+/*************************************************************************//**
+ * 
+ * @file mipmap.h
+ * 
+ * @brief Mipmap pyramids, for rendering the same large image many times at
+ *      small sizes.
+ * 
+ *****************************************************************************/
+#ifndef TERMGLYPH_MIPMAP_H
+#define TERMGLYPH_MIPMAP_H
+
+#include "image.h"
+#include "render.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/**
+ * @brief A mipmap pyramid: an image, then copies of it halved in both
+ *      directions again and again, each pixel being the average of a 2x2 box
+ *      of the level above.
+ * 
+ * A render starts from the smallest level still at least as large as its
+ * output, so the resampler averages a few pixels per cell however large the
+ * image is. Where the summed-area table of `tg_integral_image` costs 12
+ * bytes per pixel, the levels together take a third of the pixels, 4 bytes
+ * each.
+ * 
+ * Levels are built on first use, by the threads the render options ask for,
+ * and kept alongside the image. Every function may be called from many
+ * threads at once.
+ * 
+ */
+typedef struct tg_mipmap tg_mipmap;
+
+
+
+/**
+ * @brief Creates the pyramid of an image, without building any level yet.
+ * 
+ * @param image The image, level 0 of the pyramid. It must stay unchanged and
+ *      outlive the pyramid.
+ * 
+ * @return The pyramid, or NULL on failure.
+ */
+tg_mipmap *tg_mipmap_create(const tg_image *image);
+
+
+
+/**
+ * @brief Frees a pyramid and its levels. The image is left alone. NULL is
+ *      ignored.
+ * 
+ */
+void tg_mipmap_free(tg_mipmap *mipmap);
+
+
+
+/**
+ * @brief Gets the number of levels of a pyramid, the image included. The
+ *      last level is less than 2 pixels wide or tall.
+ * 
+ */
+int tg_mipmap_level_count(const tg_mipmap *mipmap);
+
+
+
+/**
+ * @brief Gets a level of a pyramid, building it and the ones above it if
+ *      needed.
+ * 
+ * @param mipmap The pyramid.
+ * @param level The level, 0 being the image itself.
+ * @param threads The threads building the missing levels, as in
+ *      `tg_render_opts.threads`.
+ * 
+ * @return The level, in the RGBA8 format except level 0, valid as long as
+ *      the pyramid; or NULL if there is no such level, or on failure.
+ */
+const tg_image *tg_mipmap_level(tg_mipmap *mipmap, int level, int threads);
+
+
+
+/**
+ * @brief Renders an image like `tg_render` does, starting from the smallest
+ *      level of its pyramid at least as large as the output.
+ * 
+ * The output is the one of `tg_render` when no level but the image itself
+ * is large enough; otherwise it may differ by the rounding of the levels.
+ * 
+ * @param mipmap The pyramid.
+ * @param opts The render options, or NULL to use the default ones.
+ * @param sink The sink to write to, or NULL for stdout.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ */
+int tg_render_mipmap(tg_mipmap *mipmap, const tg_render_opts *opts,
+    tg_sink *sink);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+
+#endif // TERMGLYPH_MIPMAP_H
@@ -13,6 +13,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "integral.h"
+#include "render.h"
 #include "text_attributes.h"
 
 
@@ -122,17 +124,115 @@ extern "C" {
 int tg_printf(const char *format, ...);
 
 /**
- * @brief Converts a P6 ppm image into glyphs and prints them to stdout.
+ * @brief Converts a Netpbm image into glyphs and prints them to stdout.
  * 
- * @param path Path to the image file.
+ * All the Netpbm formats are supported: P1 to P6, in plain (ASCII) and
+ * binary form, and PAM (P7), with any maxval up to 65535. Binary samples
+ * take two big-endian bytes when maxval is above 255. The image is streamed
+ * one row at a time, so memory usage only depends on the image width, and
+ * the file does not need to be seekable.
  * 
- * @return 0 on success, non-zero value otherwise.
+ * @param path Path to the image file, or "-" to read the image from stdin.
  * 
- * @warning The presence of '#'-comments in the ppm file is not currently
- *      supported.
+ * @return 0 on success, non-zero value otherwise.
  */
 int tg_printppm(const char *path);
 
+/**
+ * @brief Like `tg_printppm`, with render options.
+ * 
+ * @param path Path to the image file, or "-" to read the image from stdin.
+ * 
+ * @param opts The render options, or NULL to use the default ones.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ */
+int tg_printppm_opts(const char *path, const tg_render_opts *opts);
+
+
+
+/**
+ * @brief Like `tg_printppm_opts`, with the image file in memory.
+ * 
+ * The pixel data is rendered where it is, without being copied.
+ * 
+ * @param data The image file.
+ * @param length The length of the image file in bytes.
+ * @param opts The render options, or NULL to use the default ones.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ */
+int tg_printppm_mem(const void *data, size_t length, 
+    const tg_render_opts *opts);
+
+
+
+/**
+ * @brief Like `tg_printppm_opts`, reading the image from a stdio stream.
+ * 
+ * The stream is read in blocks, so it may be left past the end of the
+ * image. It is not closed.
+ * 
+ * @param file The stream, opened in binary mode.
+ * @param opts The render options, or NULL to use the default ones.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ */
+int tg_printppm_file(FILE *file, const tg_render_opts *opts);
+
+
+
+/**
+ * @brief Like `tg_printppm_opts`, reading the image from a file descriptor,
+ *      from its current offset.
+ * 
+ * Regular files are mapped in memory and rendered in place, after which the
+ * offset is moved right after the image. Other descriptors, like pipes, are
+ * streamed in blocks, so they may be left past the end of the image. The
+ * descriptor is not closed.
+ * 
+ * @param fd The file descriptor.
+ * @param opts The render options, or NULL to use the default ones.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ */
+int tg_printppm_fd(int fd, const tg_render_opts *opts);
+
+
+
+/**
+ * @name Image printing functions.
+ * 
+ * @brief Like the `tg_printppm` family, for any supported format, told from
+ *      the image content: Netpbm (P1 to P6 and PAM), QOI, BMP, TGA and
+ *      farbfeld.
+ * 
+ * @{
+ */
+int tg_printimage(const char *path, const tg_render_opts *opts);
+int tg_printimage_mem(const void *data, size_t length,
+    const tg_render_opts *opts);
+int tg_printimage_file(FILE *file, const tg_render_opts *opts);
+int tg_printimage_fd(int fd, const tg_render_opts *opts);
+/** @} */
+
+/**
+ * @brief Converts an image into glyphs from its integral image, and prints
+ *      them to stdout.
+ * 
+ * The output is the same as rendering the original image with the same
+ * options, but each cell only takes a few lookups whatever its size, so
+ * re-rendering at other zoom levels or crop positions is cheap.
+ * 
+ * @param integral The integral image.
+ * 
+ * @param opts The render options, or NULL to use the default ones.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ */
+int tg_printintegral(const tg_integral_image *integral,
+    const tg_render_opts *opts);
+
 
 
 #ifdef __cplusplus
@@ -0,0 +1,385 @@
+/*************************************************************************//**
+ * 
+ * @file render.h
+ * 
+ * @brief Rendering of images into glyphs, and the options controlling it.
+ * 
+ *****************************************************************************/
+#ifndef TERMGLYPH_RENDER_H
+#define TERMGLYPH_RENDER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "image.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/**
+ * @brief Value for `tg_render_opts.threads` requesting one thread per online
+ *      CPU.
+ * 
+ */
+#define TG_THREADS_AUTO -1
+
+
+
+/**
+ * @brief Value for `tg_render_opts.columns` and `tg_render_opts.rows`
+ *      requesting the size of the terminal.
+ * 
+ */
+#define TG_SIZE_TERMINAL -1
+
+
+
+/**
+ * @brief Default value for `tg_render_opts.cell_aspect`, the ratio between
+ *      the height and the width of a cell in most terminal fonts.
+ * 
+ */
+#define TG_DEFAULT_CELL_ASPECT 2.0
+
+
+
+/**
+ * @brief How pixels are turned into cells.
+ * 
+ */
+typedef enum tg_render_mode
+{
+    /**
+     * One pixel per cell: the cell background takes the pixel color and the
+     * glyph is picked from a ramp of characters by the pixel luma.
+     */
+    TG_RENDER_MODE_ASCII = 0,
+
+    /** One pixel per cell, drawn as a blank cell of the pixel color. */
+    TG_RENDER_MODE_BLOCK,
+
+    /**
+     * Two vertically stacked pixels per cell, drawn as an upper half block
+     * whose foreground is the top pixel and background the bottom one. Cells
+     * are about twice as tall as wide, so this doubles the vertical
+     * resolution and makes pixels about square.
+     */
+    TG_RENDER_MODE_HALF_BLOCK
+} tg_render_mode;
+
+
+
+/**
+ * @brief The colors the output is allowed to use.
+ * 
+ */
+typedef enum tg_color_depth
+{
+    /** 24-bit direct colors. */
+    TG_COLOR_DEPTH_TRUECOLOR = 0,
+
+    /** The 6x6x6 color cube and the gray ramp of the 256-color palette. */
+    TG_COLOR_DEPTH_256,
+
+    /** The 16 standard and bright indexed colors. */
+    TG_COLOR_DEPTH_16
+} tg_color_depth;
+
+
+
+/**
+ * @brief Dithering applied when quantizing colors to the color depth and
+ *      lumas to the glyph ramp, to trade banding for a fine-grained pattern.
+ * 
+ */
+typedef enum tg_dither
+{
+    /** Every value is snapped to the nearest level. */
+    TG_DITHER_NONE = 0,
+
+    /**
+     * Ordered dithering with an 8x8 Bayer matrix. Each pixel only depends on
+     * its own value and position, so rows are processed in parallel.
+     */
+    TG_DITHER_BAYER,
+
+    /**
+     * Floyd-Steinberg error diffusion. Errors flow down to the next row, so
+     * rows are quantized one after another as they come in.
+     */
+    TG_DITHER_FLOYD_STEINBERG,
+
+    /**
+     * Atkinson error diffusion. Only 3/4 of the error is diffused, which
+     * keeps more contrast than Floyd-Steinberg. Quantized row by row too.
+     */
+    TG_DITHER_ATKINSON
+} tg_dither;
+
+
+
+/**
+ * @name Glyph ramps.
+ *
+ * @brief Some ramps to pass to `tg_ramp_create`, from darkest to lightest.
+ *      `TG_RAMP_BLOCKS` is " ░▒▓█", spelled out in UTF-8 bytes.
+ *
+ * @{
+ */
+#define TG_RAMP_ASCII   " .:-=+*#%@"
+#define TG_RAMP_BLOCKS  " \xe2\x96\x91\xe2\x96\x92\xe2\x96\x93\xe2\x96\x88"
+/** @} */
+
+
+
+/**
+ * @brief A compiled glyph ramp: the glyphs the ASCII mode picks from by
+ *      luma, together with a table mapping every luma to its glyph.
+ * 
+ * A ramp is never modified once created, so it can be reused across renders
+ * and shared between threads.
+ * 
+ */
+typedef struct tg_ramp tg_ramp;
+
+
+
+/**
+ * @brief Compiles a glyph ramp.
+ * 
+ * @param glyphs A UTF-8 string of glyphs, from the one drawn for the darkest
+ *      pixels to the one drawn for the lightest. Each code point is a glyph;
+ *      they should all be one cell wide. At most 256 glyphs are allowed.
+ * @param inverted If non-zero, the glyphs are used in reverse order, which
+ *      suits terminals with light backgrounds.
+ * 
+ * @return The ramp, or NULL if `glyphs` is empty, too long or not valid
+ *      UTF-8, or on allocation failure.
+ */
+tg_ramp *tg_ramp_create(const char *glyphs, int inverted);
+
+
+
+/**
+ * @brief Frees a ramp created by `tg_ramp_create`. NULL is ignored.
+ * 
+ */
+void tg_ramp_free(tg_ramp *ramp);
+
+
+
+/**
+ * @brief Gets the ramp used when no ramp is given, `TG_RAMP_ASCII`.
+ * 
+ */
+const tg_ramp *tg_ramp_default(void);
+
+
+
+/**
+ * @brief Options for the functions rendering images.
+ * 
+ * A zero-initialized structure holds the default options, so callers only
+ * need to set the fields they care about:
+ * 
+ *      tg_render_opts opts = {0};
+ *      opts.threads = TG_THREADS_AUTO;
+ * 
+ */
+typedef struct tg_render_opts
+{
+    /**
+     * Number of threads converting and encoding the image. The image is split
+     * in bands of rows, each encoded into its own buffer; the buffers are
+     * written out in order, so the output does not depend on this value.
+     * 0 and 1 both mean single-threaded, `TG_THREADS_AUTO` one thread per
+     * online CPU.
+     */
+    int threads;
+
+    /**
+     * Maximum number of columns and rows of cells the image may take. The
+     * image is shrunk to fit them, keeping its aspect ratio, by averaging
+     * boxes of pixels into cells; it is never enlarged. 0 means no limit in
+     * that direction, `TG_SIZE_TERMINAL` the size of the terminal. If both
+     * are 0, every pixel becomes a cell, as is.
+     */
+    int columns;
+    int rows;   /**< See `columns`. */
+
+    /**
+     * Height to width ratio of a terminal cell, used to keep the image aspect
+     * ratio when fitting it. 0 means `TG_DEFAULT_CELL_ASPECT`.
+     */
+    double cell_aspect;
+
+    /**
+     * Region of the image to render, in pixels, applied before fitting; the
+     * rest of the image is left out. Panning and zooming come down to moving
+     * and resizing this rectangle. It is clamped to the image. If
+     * `crop_width` or `crop_height` is 0, the whole image is rendered.
+     */
+    int crop_x;
+    int crop_y;         /**< See `crop_x`. */
+    int crop_width;     /**< See `crop_x`. */
+    int crop_height;    /**< See `crop_x`. */
+
+    tg_render_mode mode;    /**< How pixels are turned into cells. */
+    tg_color_depth depth;   /**< The colors the output may use. */
+    tg_dither dither;       /**< Dithering of colors and glyph ramp. */
+
+    /**
+     * The glyph ramp of the ASCII mode. NULL means `tg_ramp_default()`.
+     */
+    const tg_ramp *ramp;
+} tg_render_opts;
+
+
+
+/**
+ * @brief Where rendered output goes.
+ * 
+ * The renderer hands its output to `write` in large chunks, in order. A
+ * NULL sink stands for stdout.
+ * 
+ */
+typedef struct tg_sink
+{
+    /**
+     * Writes `length` bytes of output. Returns 0 on success, non-zero value
+     * otherwise, which stops the rendering.
+     */
+    int (*write)(void *ctx, const char *data, size_t length);
+
+    void *ctx; /**< Sink specific data. */
+} tg_sink;
+
+
+
+/**
+ * @brief Makes a sink writing to a stdio stream.
+ * 
+ * @param file The stream, which must stay open while the sink is in use.
+ * 
+ * @return The sink.
+ */
+tg_sink tg_sink_file(FILE *file);
+
+
+
+/**
+ * @brief Converts an image into glyphs and writes them to a sink.
+ * 
+ * Only the image region selected by the crop options is read, and the image
+ * is not modified, so the same image can be rendered many times, with
+ * different options or by different threads at once.
+ * 
+ * @param image The image.
+ * @param opts The render options, or NULL to use the default ones.
+ * @param sink The sink to write to, or NULL for stdout.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ */
+int tg_render(const tg_image *image, const tg_render_opts *opts, 
+    tg_sink *sink);
+
+
+
+/**
+ * @brief The cells of the last frame of an animation, which the next frame
+ *      is compared against so that only the cells that changed are redrawn.
+ * 
+ * A delta follows a single animation. It assumes that the terminal still
+ * shows the last frame, and that the cursor has stayed below it.
+ * 
+ */
+typedef struct tg_delta tg_delta;
+
+
+
+/**
+ * @brief Creates a delta, with no previous frame yet.
+ * 
+ * @param threshold How far the color of a cell may drift and still count as
+ *      unchanged, 0 to redraw every change. It is a distance between RGB
+ *      colors weighted the way the eye is more sensitive to green than to
+ *      blue, and scaled so that a gray changing by n levels is n away. Colors
+ *      are compared to the ones on screen, so that small changes still add up
+ *      to a redraw. A change of glyph is always redrawn.
+ * 
+ * @return The delta, or NULL on allocation failure.
+ */
+tg_delta *tg_delta_create(int threshold);
+
+
+
+/**
+ * @brief Frees a delta created by `tg_delta_create`. NULL is ignored.
+ * 
+ */
+void tg_delta_free(tg_delta *delta);
+
+
+
+/**
+ * @brief Forgets the previous frame, so that the next one is drawn whole at
+ *      the cursor, as after the screen has been cleared.
+ * 
+ */
+void tg_delta_reset(tg_delta *delta);
+
+
+
+/**
+ * @brief Renders an image as the next frame of an animation, over the
+ *      previous one, redrawing only the cells that changed.
+ * 
+ * The first frame is drawn whole at the cursor, like `tg_render` does, and
+ * so is a frame whose size in cells differs from the previous one, once the
+ * cursor is moved back up and the previous frame cleared. Otherwise only
+ * the changed cells are drawn, reaching them with cursor movements, and
+ * nothing at all is written if none changed. Either way the cursor is left
+ * at the start of the line below the frame.
+ * 
+ * @param image The image.
+ * @param opts The render options, or NULL to use the default ones.
+ * @param delta The delta, which is updated with the new frame. It is reset
+ *      on failure.
+ * @param sink The sink to write to, or NULL for stdout.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ */
+int tg_render_delta(const tg_image *image, const tg_render_opts *opts,
+    tg_delta *delta, tg_sink *sink);
+
+
+
+/**
+ * @brief Gets the size of the terminal stdout is connected to.
+ * 
+ * The size is queried with TIOCGWINSZ. If stdout is not a terminal, the
+ * COLUMNS and LINES environment variables are used instead, and failing that
+ * 80x24.
+ * 
+ * @param columns A pointer to int to store the number of columns in.
+ * @param rows A pointer to int to store the number of rows in.
+ * 
+ * @return 0 if the size comes from the terminal, non-zero value if it is a
+ *      fallback.
+ */
+int tg_terminal_size(int *columns, int *rows);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+
+#endif // TERMGLYPH_RENDER_H
@@ -0,0 +1,129 @@
+/*************************************************************************//**
+ * 
+ * @file video.h
+ * 
+ * @brief Playback of video streams, frame after frame, in place.
+ * 
+ *****************************************************************************/
+#ifndef TERMGLYPH_VIDEO_H
+#define TERMGLYPH_VIDEO_H
+
+#include <stdio.h>
+
+#include "render.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/**
+ * @brief Value for `tg_play_opts.fps` rendering every frame as soon as it is
+ *      read, with no pacing and no frame dropped.
+ * 
+ */
+#define TG_FPS_UNPACED -1.0
+
+
+
+/**
+ * @brief Options for the functions playing videos.
+ * 
+ * A zero-initialized structure holds the default options, which play the
+ * stream at its own frame rate.
+ * 
+ */
+typedef struct tg_play_opts
+{
+    /**
+     * How each frame is rendered. The fitting options apply to every frame
+     * the same way.
+     */
+    tg_render_opts render;
+
+    /**
+     * Frames per second to play the stream at. 0 means the frame rate the
+     * stream declares, or `TG_FPS_UNPACED` if it declares none.
+     *
+     * Frames are shown at their due times, and dropped when rendering has
+     * fallen so far behind that the next frame is already due. Time spent
+     * waiting for the input is not held against rendering, so a producer
+     * slower than real time slows playback down rather than having frames
+     * dropped.
+     */
+    double fps;
+
+    /**
+     * Non-zero to draw every frame whole. By default, only the cells that
+     * changed since the previous frame are redrawn, as `tg_render_delta`
+     * does.
+     */
+    int full_frames;
+
+    /**
+     * How far the color of a cell may drift before it is redrawn, as
+     * `tg_delta_create` takes it. 0 redraws every change.
+     */
+    int threshold;
+} tg_play_opts;
+
+
+
+/**
+ * @brief What happened to the frames of a stream during playback.
+ * 
+ */
+typedef struct tg_play_stats
+{
+    unsigned long frames;   /**< Frames read from the stream. */
+    unsigned long rendered; /**< Frames rendered. */
+    unsigned long dropped;  /**< Frames skipped to keep up. */
+} tg_play_stats;
+
+
+
+/**
+ * @name Video playing functions.
+ * 
+ * @brief Play a video stream, rendering each frame over the previous one
+ *      until the stream ends. The format is told from the stream content:
+ *      YUV4MPEG2 (4:2:0, 4:2:2, 4:4:4 and monochrome, 8-bit), like
+ *      `ffmpeg -f yuv4mpegpipe` writes it, or Netpbm images back to back,
+ *      like `ffmpeg -f image2pipe -vcodec ppm` writes them.
+ * 
+ * Netpbm streams declare no frame rate, so they are played unpaced unless
+ * `opts->fps` sets one. Their frames may change size, in which case the
+ * previous frame is cleared before the next one is drawn.
+ * 
+ * The stream is read as it comes, so it can be a pipe, and frames are
+ * converted as they are rendered. Every frame is drawn over the previous
+ * one, by moving the cursor back up to it, which leaves the cursor below the
+ * last frame at the end.
+ * 
+ * `tg_playvideo` reads stdin when `path` is "-". `opts` may be NULL to use
+ * the default options, `sink` NULL to write to stdout, and `stats` NULL if
+ * they are not needed; otherwise it is filled in even on failure. They
+ * return 0 when the stream ends cleanly, non-zero value otherwise.
+ * 
+ * @{
+ */
+int tg_playvideo(const char *path, const tg_play_opts *opts, tg_sink *sink,
+    tg_play_stats *stats);
+int tg_playvideo_file(FILE *file, const tg_play_opts *opts, tg_sink *sink,
+    tg_play_stats *stats);
+int tg_playvideo_fd(int fd, const tg_play_opts *opts, tg_sink *sink,
+    tg_play_stats *stats);
+/** @} */
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+
+#endif // TERMGLYPH_VIDEO_H
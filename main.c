@@ -1,8 +1,39 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "include/termglyph.h"
 
 
 int main(int argc, char** argv)
 {
-    tg_printppm(argv[1]);
+    tg_render_opts opts = {0};
+    opts.threads = TG_THREADS_AUTO;
+    opts.columns = TG_SIZE_TERMINAL;
+    opts.rows = TG_SIZE_TERMINAL;
+
+    // "--play [path]" plays a video stream instead, such as the output of
+    // ffmpeg -f yuv4mpegpipe or ffmpeg -f image2pipe -vcodec ppm.
+    if (argc > 1 && strcmp(argv[1], "--play") == 0)
+    {
+        tg_play_opts play_opts = {0};
+        play_opts.render = opts;
+        return tg_playvideo(argc > 2 ? argv[2] : "-", &play_opts, NULL, NULL);
+    }
+
+    // TERMGLYPH_CACHE names a directory keeping the rendered output, so that
+    // showing the same image at the same size again skips the rendering.
+    const char *cache_directory = getenv("TERMGLYPH_CACHE");
+    tg_render_cache *cache = cache_directory
+                           ? tg_render_cache_open(cache_directory, 64 << 20)
+                           : NULL;
+    if (cache)
+    {
+        int result = tg_render_cached(cache, argc > 1 ? argv[1] : "-", &opts,
+            NULL);
+        tg_render_cache_close(cache);
+        return result;
+    }
+
+    tg_printppm_opts(argc > 1 ? argv[1] : "-", &opts);
     return 0;
 }
@@ -0,0 +1,460 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+
+
+/**
+ * @brief Size of the BMP file header, before the DIB header.
+ * 
+ */
+#define BMP_FILE_HEADER_SIZE 14
+
+
+
+/**
+ * @brief Size of the largest DIB header, BITMAPV5HEADER. Larger headers
+ *      have their extra bytes skipped.
+ * 
+ */
+#define BMP_MAX_DIB_HEADER_SIZE 124
+
+
+
+/**
+ * @name DIB header sizes and compression methods.
+ * 
+ * @{
+ */
+#define BMP_CORE_HEADER_SIZE 12
+#define BMP_INFO_HEADER_SIZE 40
+#define BMP_COMPRESSION_RGB 0
+#define BMP_COMPRESSION_BITFIELDS 3
+/** @} */
+
+
+
+/**
+ * @brief A color channel packed in a 16 or 32-bit pixel.
+ * 
+ */
+typedef struct bmp_channel
+{
+    uint32_t mask;
+    int shift;          /**< Position of the lowest bit of the mask. */
+    int bits;           /**< Number of bits of the mask. */
+    uint8_t scale[256]; /**< 8-bit values of channels up to 8 bits. */
+} bmp_channel;
+
+
+
+/**
+ * @brief State of a row source reading a BMP image.
+ * 
+ */
+typedef struct bmp_source_state
+{
+    tg_reader reader;
+    int bpp;                    /**< Bits per pixel. */
+    uint8_t palette[256][3];    /**< The palette, in RGB. */
+    bmp_channel channels[3];    /**< The channels of 16 and 32-bit pixels. */
+    size_t row_size;            /**< Bytes in a row, padding included. */
+
+    /**
+     * Bottom-up images store their last row first, so their whole pixel
+     * array is needed: it is read in place when possible, into
+     * `raster_storage` otherwise. NULL for top-down images, which are
+     * streamed.
+     */
+    const uint8_t *raster;
+    uint8_t *raster_storage;
+    uint8_t *raw;               /**< A row of a top-down image. */
+} bmp_source_state;
+
+
+
+/**
+ * @brief Sets up a channel of 16 and 32-bit pixels from its mask.
+ * 
+ * @return 0 on success, non-zero value if the mask is empty or its bits are
+ *      not contiguous.
+ * 
+ * @note This function is private to tg_bmp_source_open.
+ */
+static int bmp_channel_init(bmp_channel *channel, uint32_t mask)
+{
+    if (!mask)
+    {
+        return 1;
+    }
+
+    channel->mask = mask;
+    channel->shift = 0;
+    while (!(mask & 1))
+    {
+        mask >>= 1;
+        channel->shift++;
+    }
+    channel->bits = 0;
+    while (mask & 1)
+    {
+        mask >>= 1;
+        channel->bits++;
+    }
+
+    // Bits left past the first run would make values larger than the bits
+    // counted, past the end of `scale`.
+    if (mask)
+    {
+        return 1;
+    }
+
+    uint32_t max = channel->bits >= 8 ? 255 : (1u << channel->bits) - 1;
+    for (uint32_t value = 0; value < 256; value++)
+    {
+        channel->scale[value] = value > max ? 255
+            : (uint8_t)((value * 255 + max / 2) / max);
+    }
+    return 0;
+}
+
+
+
+/**
+ * @brief Gets the 8-bit value of a channel of a pixel.
+ * 
+ * @note This function is private to bmp_decode_row.
+ */
+static inline uint8_t bmp_channel_value(const bmp_channel *channel,
+    uint32_t pixel)
+{
+    uint32_t value = (pixel & channel->mask) >> channel->shift;
+    return channel->bits > 8 ? (uint8_t)(value >> (channel->bits - 8))
+                             : channel->scale[value];
+}
+
+
+
+/**
+ * @brief Decodes a row of BMP pixels into RGB ones.
+ * 
+ * @note This function is private to bmp_read_row.
+ */
+static void bmp_decode_row(const bmp_source_state *state, const uint8_t *in,
+    int width, uint8_t *rgb)
+{
+    switch (state->bpp)
+    {
+    case 1:
+    case 2:
+    case 4:
+    case 8:
+    {
+        // Indexes are packed most significant first.
+        int bpp = state->bpp;
+        int per_byte = 8 / bpp;
+        int mask = (1 << bpp) - 1;
+        for (int x = 0; x < width; x++)
+        {
+            int shift = 8 - bpp * (x % per_byte + 1);
+            int index = (in[x / per_byte] >> shift) & mask;
+            memcpy(rgb + 3*x, state->palette[index], 3);
+        }
+        break;
+    }
+
+    case 24:
+        for (int x = 0; x < width; x++)
+        {
+            rgb[3*x] = in[3*x + 2];
+            rgb[3*x + 1] = in[3*x + 1];
+            rgb[3*x + 2] = in[3*x];
+        }
+        break;
+
+    default:
+        for (int x = 0; x < width; x++)
+        {
+            uint32_t pixel = state->bpp == 16 ? tg_load_le16(in + 2*x)
+                                              : tg_load_le32(in + 4*x);
+            rgb[3*x] = bmp_channel_value(&state->channels[0], pixel);
+            rgb[3*x + 1] = bmp_channel_value(&state->channels[1], pixel);
+            rgb[3*x + 2] = bmp_channel_value(&state->channels[2], pixel);
+        }
+        break;
+    }
+}
+
+
+
+/**
+ * @brief Reads row `y` of a BMP image.
+ * 
+ * @note This function is private to tg_bmp_source_open, which uses it as
+ *      the `read_row` callback of its row source.
+ */
+static const uint8_t *bmp_read_row(tg_row_source *source, int y,
+    uint8_t *scratch)
+{
+    bmp_source_state *state = (bmp_source_state*)source->ctx;
+
+    const uint8_t *row = state->raster
+        ? state->raster + (size_t)(source->height - 1 - y) * state->row_size
+        : tg_reader_read(&state->reader, state->raw, state->row_size);
+    if (!row)
+    {
+        return NULL;
+    }
+
+    bmp_decode_row(state, row, source->width, scratch);
+    return scratch;
+}
+
+
+
+/**
+ * @brief Closes the source and the reader.
+ * 
+ * @note This function is private to tg_bmp_source_open, which uses it as
+ *      the `close` callback of its row source.
+ */
+static void bmp_close(tg_row_source *source)
+{
+    bmp_source_state *state = (bmp_source_state*)source->ctx;
+    if (!state)
+    {
+        return;
+    }
+
+    tg_reader_close(&state->reader);
+    free(state->raster_storage);
+    free(state->raw);
+    free(state);
+    source->ctx = NULL;
+}
+
+
+
+/**
+ * @brief Reads the headers and the palette of a BMP image, leaving the
+ *      reader on the pixel array.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ * @note This function is private to tg_bmp_source_open.
+ */
+static int bmp_read_header(bmp_source_state *state, int *width, int *height,
+    int *bottom_up)
+{
+    tg_reader *r = &state->reader;
+    uint8_t buffer[BMP_MAX_DIB_HEADER_SIZE];
+
+    // ---------------------------------- 01 ----------------------------------
+    // File header, which tells where the pixel array starts.
+    const uint8_t *file_header = tg_reader_read(r, buffer,
+        BMP_FILE_HEADER_SIZE);
+    if (!file_header || file_header[0] != 'B' || file_header[1] != 'M')
+    {
+        return 1;
+    }
+    uint32_t pixels_offset = tg_load_le32(file_header + 10);
+
+    // ---------------------------------- 02 ----------------------------------
+    // DIB header. Only the core one has 16-bit sizes, and 3-byte palette
+    // entries.
+    const uint8_t *size_bytes = tg_reader_read(r, buffer, 4);
+    uint32_t dib_size = size_bytes ? tg_load_le32(size_bytes) : 0;
+    if (dib_size < BMP_CORE_HEADER_SIZE ||
+        (dib_size > BMP_CORE_HEADER_SIZE && dib_size < BMP_INFO_HEADER_SIZE))
+    {
+        return 1;
+    }
+
+    size_t kept = dib_size < BMP_MAX_DIB_HEADER_SIZE
+                ? dib_size : BMP_MAX_DIB_HEADER_SIZE;
+    uint8_t dib[BMP_MAX_DIB_HEADER_SIZE] = {0};
+    const uint8_t *read = tg_reader_read(r, buffer, kept - 4);
+    if (!read || tg_reader_skip(r, dib_size - kept))
+    {
+        return 1;
+    }
+    memcpy(dib + 4, read, kept - 4);
+
+    int core = dib_size == BMP_CORE_HEADER_SIZE;
+    int64_t signed_height;
+    uint32_t compression = BMP_COMPRESSION_RGB;
+    uint32_t colors = 0;
+    if (core)
+    {
+        *width = (int)tg_load_le16(dib + 4);
+        signed_height = tg_load_le16(dib + 6);
+        state->bpp = (int)tg_load_le16(dib + 10);
+    }
+    else
+    {
+        *width = (int32_t)tg_load_le32(dib + 4);
+        signed_height = (int32_t)tg_load_le32(dib + 8);
+        state->bpp = (int)tg_load_le16(dib + 14);
+        compression = tg_load_le32(dib + 16);
+        colors = tg_load_le32(dib + 32);
+    }
+
+    *bottom_up = signed_height > 0;
+    signed_height = signed_height < 0 ? -signed_height : signed_height;
+    if (*width <= 0 || signed_height <= 0 || signed_height > INT_MAX)
+    {
+        return 1;
+    }
+    *height = (int)signed_height;
+    size_t consumed = BMP_FILE_HEADER_SIZE + dib_size;
+
+    // ---------------------------------- 03 ----------------------------------
+    // Channel masks of 16 and 32-bit pixels. They follow the info header,
+    // and are part of the later ones.
+    uint32_t masks[3];
+    if (compression == BMP_COMPRESSION_BITFIELDS &&
+        (state->bpp == 16 || state->bpp == 32))
+    {
+        const uint8_t *mask_bytes = dib + BMP_INFO_HEADER_SIZE;
+        if (dib_size == BMP_INFO_HEADER_SIZE)
+        {
+            mask_bytes = tg_reader_read(r, buffer, 12);
+            consumed += 12;
+        }
+        if (!mask_bytes)
+        {
+            return 1;
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            masks[c] = tg_load_le32(mask_bytes + 4*c);
+        }
+    }
+    else if (compression == BMP_COMPRESSION_RGB)
+    {
+        masks[0] = state->bpp == 16 ? 0x7c00 : 0x00ff0000;
+        masks[1] = state->bpp == 16 ? 0x03e0 : 0x0000ff00;
+        masks[2] = state->bpp == 16 ? 0x001f : 0x000000ff;
+    }
+    else
+    {
+        // Run-length and embedded JPEG or PNG images are not supported.
+        return 1;
+    }
+
+    if (state->bpp == 16 || state->bpp == 32)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            if (bmp_channel_init(&state->channels[c], masks[c]))
+            {
+                return 1;
+            }
+        }
+    }
+    else if (state->bpp != 1 && state->bpp != 2 && state->bpp != 4 &&
+             state->bpp != 8 && state->bpp != 24)
+    {
+        return 1;
+    }
+
+    // ---------------------------------- 04 ----------------------------------
+    // Palette, in BGR order. Missing entries stay black.
+    if (state->bpp <= 8)
+    {
+        uint32_t max_colors = 1u << state->bpp;
+        colors = colors == 0 || colors > max_colors ? max_colors : colors;
+        size_t entry_size = core ? 3 : 4;
+        for (uint32_t i = 0; i < colors; i++)
+        {
+            const uint8_t *entry = tg_reader_read(r, buffer, entry_size);
+            if (!entry)
+            {
+                return 1;
+            }
+            state->palette[i][0] = entry[2];
+            state->palette[i][1] = entry[1];
+            state->palette[i][2] = entry[0];
+        }
+        consumed += colors * entry_size;
+    }
+
+    if (pixels_offset < consumed)
+    {
+        return 1;
+    }
+    return tg_reader_skip(r, pixels_offset - consumed);
+}
+
+
+
+int tg_bmp_source_open(tg_row_source *source, tg_reader *reader)
+{
+    bmp_source_state *state = (bmp_source_state*)calloc(1,
+        sizeof(bmp_source_state));
+    if (!state)
+    {
+        tg_reader_close(reader);
+        return 1;
+    }
+
+    state->reader = *reader;
+    source->width = 0;
+    source->height = 0;
+    source->read_row = bmp_read_row;
+    source->close = bmp_close;
+    source->ctx = state;
+
+    int width = 0;
+    int height = 0;
+    int bottom_up = 0;
+    if (bmp_read_header(state, &width, &height, &bottom_up))
+    {
+        bmp_close(source);
+        return 1;
+    }
+
+    // Rows are padded to 4 bytes.
+    state->row_size = ((size_t)width * state->bpp + 31) / 32 * 4;
+    if (bottom_up)
+    {
+        // Streams have to be read whole to get to the first row, memory and
+        // mapped files are just pointed at.
+        if ((size_t)height > SIZE_MAX / state->row_size)
+        {
+            bmp_close(source);
+            return 1;
+        }
+        size_t size = state->row_size * height;
+        if (state->reader.f)
+        {
+            state->raster_storage = tg_reader_read_alloc(&state->reader,
+                size);
+            state->raster = state->raster_storage;
+        }
+        else
+        {
+            state->raster = tg_reader_read(&state->reader, NULL, size);
+        }
+        if (!state->raster)
+        {
+            bmp_close(source);
+            return 1;
+        }
+    }
+    else
+    {
+        state->raw = (uint8_t*)malloc(state->row_size);
+        if (!state->raw)
+        {
+            bmp_close(source);
+            return 1;
+        }
+    }
+
+    source->width = width;
+    source->height = height;
+    return 0;
+}
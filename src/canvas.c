@@ -0,0 +1,1571 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/termglyph/canvas.h"
+#include "internal.h"
+
+
+
+/**
+ * @brief Upper bound of the bytes a cursor movement takes.
+ * 
+ */
+#define MOVE_MAX_LENGTH 16
+
+
+
+/**
+ * @brief Upper bound of the bytes a style change takes: a reset followed by
+ *      every style parameter.
+ * 
+ */
+#define STYLE_MAX_LENGTH 32
+
+
+
+/**
+ * @brief Upper bound of the bytes a cell takes in the output: a style
+ *      change, two color changes and the glyph.
+ * 
+ */
+#define CELL_MAX_LENGTH (STYLE_MAX_LENGTH \
+                         + 2 * (TG_DIRECT_COLOR_SEQUENCE_LENGTH - 1) \
+                         + TG_GLYPH_MAX_LENGTH)
+
+
+
+/**
+ * @brief Fewest dirty rows for which presenting looks for shifted rows.
+ * 
+ */
+#define SCROLL_MIN_ROWS 3
+
+
+
+/**
+ * @brief Initial value of row hashes.
+ * 
+ */
+#define ROW_HASH_BASIS 14695981039346656037u
+
+
+
+/**
+ * @brief Most cells written again to move the cursor forward over them,
+ *      past which a relative movement is always shorter.
+ * 
+ */
+#define REPRINT_MAX_CELLS 8
+
+
+
+/**
+ * @brief Length of the buffer on the stack tg_canvas_printf formats into,
+ *      past which it allocates one.
+ * 
+ */
+#define TEXT_STACK_LENGTH 256
+
+
+
+/**
+ * @brief SGR parameter of each style bit, from the lowest bit up.
+ * 
+ */
+static const int STYLE_PARAMETERS[] = { 1, 2, 3, 4, 5, 7, 8, 9, 21 };
+
+
+
+/**
+ * @brief The attributes the terminal applies to the next glyph written, and
+ *      where it writes it.
+ * 
+ */
+typedef struct present_state
+{
+    uint32_t fg;
+    uint32_t bg;
+    uint16_t style;
+    int x;      /**< The cursor column, or -1 if not known. */
+    int y;      /**< The cursor row. */
+} present_state;
+
+
+
+/**
+ * @brief Allocates the cell arrays, front buffer included, and the dirty
+ *      bitmaps for a size, filled with blank cells, all of them dirty.
+ * 
+ * @return 0 on success, non-zero value otherwise, in which case `canvas` is
+ *      left untouched.
+ * 
+ * @note This function is private to the canvas.
+ */
+static int canvas_alloc(tg_canvas *canvas, int columns, int rows)
+{
+    size_t count = (size_t)columns * rows;
+    size_t spans = ((size_t)columns + TG_CANVAS_SPAN_COLUMNS - 1)
+                 / TG_CANVAS_SPAN_COLUMNS;
+    size_t span_words = (spans + 63) / 64;
+
+    uint32_t *codepoints = (uint32_t*)malloc(2 * count * sizeof(uint32_t));
+    uint32_t *fg = (uint32_t*)calloc(2 * count, sizeof(uint32_t));
+    uint32_t *bg = (uint32_t*)calloc(2 * count, sizeof(uint32_t));
+    uint16_t *styles = (uint16_t*)calloc(2 * count, sizeof(uint16_t));
+    uint64_t *dirty_rows = (uint64_t*)calloc(((size_t)rows + 63) / 64,
+        sizeof(uint64_t));
+    uint64_t *dirty_spans = (uint64_t*)calloc(span_words * rows,
+        sizeof(uint64_t));
+    uint64_t *row_hashes = (uint64_t*)malloc(2 * (size_t)rows
+        * sizeof(uint64_t));
+    if (!codepoints || !fg || !bg || !styles || !dirty_rows || !dirty_spans ||
+        !row_hashes)
+    {
+        free(codepoints);
+        free(fg);
+        free(bg);
+        free(styles);
+        free(dirty_rows);
+        free(dirty_spans);
+        free(row_hashes);
+        return 1;
+    }
+
+    for (size_t i = 0; i < 2 * count; i++)
+    {
+        codepoints[i] = ' ';
+    }
+
+    // Each attribute array holds the back buffer followed by the front one.
+    canvas->columns = columns;
+    canvas->rows = rows;
+    canvas->codepoints = codepoints;
+    canvas->fg = fg;
+    canvas->bg = bg;
+    canvas->styles = styles;
+    canvas->front_codepoints = codepoints + count;
+    canvas->front_fg = fg + count;
+    canvas->front_bg = bg + count;
+    canvas->front_styles = styles + count;
+    canvas->dirty_rows = dirty_rows;
+    canvas->dirty_spans = dirty_spans;
+    canvas->span_words = span_words;
+    canvas->row_hashes = row_hashes;
+    tg_canvas_invalidate(canvas);
+    return 0;
+}
+
+
+
+/**
+ * @brief Frees the cell arrays and dirty bitmaps of a canvas.
+ * 
+ * @note This function is private to the canvas.
+ */
+static void canvas_release(tg_canvas *canvas)
+{
+    free(canvas->codepoints);
+    free(canvas->fg);
+    free(canvas->bg);
+    free(canvas->styles);
+    free(canvas->dirty_rows);
+    free(canvas->dirty_spans);
+    free(canvas->row_hashes);
+}
+
+
+
+/**
+ * @brief Marks columns [x0, x1) of a row as dirty.
+ * 
+ * @note This function is private to the canvas.
+ */
+static void canvas_mark(tg_canvas *canvas, int y, int x0, int x1)
+{
+    uint64_t *spans = canvas->dirty_spans + canvas->span_words * y;
+    for (int s = x0 / TG_CANVAS_SPAN_COLUMNS;
+         s <= (x1 - 1) / TG_CANVAS_SPAN_COLUMNS; s++)
+    {
+        spans[s / 64] |= (uint64_t)1 << (s % 64);
+    }
+    canvas->dirty_rows[y / 64] |= (uint64_t)1 << (y % 64);
+}
+
+
+
+/**
+ * @brief Marks columns [x0, x1) of a row as dirty with atomic operations,
+ *      for threads storing into disjoint cells whose marks share words.
+ * 
+ * @note This function is private to the canvas.
+ */
+static void canvas_mark_shared(tg_canvas *canvas, int y, int x0, int x1)
+{
+    uint64_t *spans = canvas->dirty_spans + canvas->span_words * y;
+    for (int s = x0 / TG_CANVAS_SPAN_COLUMNS;
+         s <= (x1 - 1) / TG_CANVAS_SPAN_COLUMNS; s++)
+    {
+        __atomic_fetch_or(&spans[s / 64], (uint64_t)1 << (s % 64),
+            __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_or(&canvas->dirty_rows[y / 64], (uint64_t)1 << (y % 64),
+        __ATOMIC_RELAXED);
+}
+
+
+
+/**
+ * @brief Writes a cell, telling whether it changed.
+ * 
+ * @note This function is private to the canvas.
+ */
+static int canvas_store(tg_canvas *canvas, size_t i,
+    const tg_canvas_cell *cell)
+{
+    if (canvas->codepoints[i] == cell->codepoint &&
+        canvas->fg[i] == cell->fg && canvas->bg[i] == cell->bg &&
+        canvas->styles[i] == cell->style)
+    {
+        return 0;
+    }
+
+    canvas->codepoints[i] = cell->codepoint;
+    canvas->fg[i] = cell->fg;
+    canvas->bg[i] = cell->bg;
+    canvas->styles[i] = cell->style;
+    return 1;
+}
+
+
+
+/**
+ * @brief Clips the end of a span starting at `start` and `length` cells long
+ *      to [0, `limit`].
+ * 
+ * The end is computed on 64 bits, where coordinates far outside the canvas
+ * cannot overflow.
+ * 
+ * @note This function is private to the canvas.
+ */
+static int clip_end(int start, int length, int limit)
+{
+    int64_t end = (int64_t)start + length;
+    return end > limit ? limit : end < 0 ? 0 : (int)end;
+}
+
+
+
+/**
+ * @brief Encodes a code point in UTF-8, as a space if it is not printable
+ *      in a single cell.
+ * 
+ * Presenting counts on every cell moving the cursor by exactly one column,
+ * so wide and zero-width code points are replaced too, like controls.
+ * 
+ * @note This function is private to the canvas.
+ */
+static size_t encode_codepoint(char *out, uint32_t codepoint)
+{
+    if (tg_codepoint_width(codepoint) != 1)
+    {
+        codepoint = ' ';
+    }
+
+    if (codepoint < 0x80)
+    {
+        out[0] = (char)codepoint;
+        return 1;
+    }
+    if (codepoint < 0x800)
+    {
+        out[0] = (char)(0xc0 | codepoint >> 6);
+        out[1] = (char)(0x80 | (codepoint & 0x3f));
+        return 2;
+    }
+    if (codepoint < 0x10000)
+    {
+        out[0] = (char)(0xe0 | codepoint >> 12);
+        out[1] = (char)(0x80 | (codepoint >> 6 & 0x3f));
+        out[2] = (char)(0x80 | (codepoint & 0x3f));
+        return 3;
+    }
+    out[0] = (char)(0xf0 | codepoint >> 18);
+    out[1] = (char)(0x80 | (codepoint >> 12 & 0x3f));
+    out[2] = (char)(0x80 | (codepoint >> 6 & 0x3f));
+    out[3] = (char)(0x80 | (codepoint & 0x3f));
+    return 4;
+}
+
+
+
+/**
+ * @brief Encodes a cell, changing the attributes as needed.
+ * 
+ * @return The number of bytes written, at most `CELL_MAX_LENGTH`.
+ * 
+ * @note This function is private to the canvas.
+ */
+static size_t encode_cell(const tg_canvas *canvas, size_t i,
+    present_state *state, char *out)
+{
+    // Styles are turned off by a reset, which clears the colors too.
+    size_t len = 0;
+    uint16_t style = canvas->styles[i];
+    if (style != state->style)
+    {
+        memcpy(out + len, "\033[0", 3);
+        len += 3;
+        for (size_t b = 0; b < sizeof(STYLE_PARAMETERS) / sizeof(int); b++)
+        {
+            if (style & 1u << b)
+            {
+                len += (size_t)sprintf(out + len, ";%d", STYLE_PARAMETERS[b]);
+            }
+        }
+        out[len++] = 'm';
+        state->style = style;
+        state->fg = TG_COLOR_DEFAULT;
+        state->bg = TG_COLOR_DEFAULT;
+    }
+
+    if (canvas->fg[i] != state->fg)
+    {
+        len += tg_encode_color(out + len, canvas->fg[i],
+            TG_TERMINAL_LAYER_FOREGROUND);
+        state->fg = canvas->fg[i];
+    }
+    if (canvas->bg[i] != state->bg)
+    {
+        len += tg_encode_color(out + len, canvas->bg[i],
+            TG_TERMINAL_LAYER_BACKGROUND);
+        state->bg = canvas->bg[i];
+    }
+
+    len += encode_codepoint(out + len, canvas->codepoints[i]);
+    return len;
+}
+
+
+
+/**
+ * @brief How the cursor reaches its column once on the right row.
+ * 
+ */
+typedef enum horizontal_move
+{
+    HORIZONTAL_NONE,        /**< It already is there. */
+    HORIZONTAL_ABSOLUTE,    /**< Cursor character absolute (CHA). */
+    HORIZONTAL_FORWARD,     /**< Cursor forward (CUF). */
+    HORIZONTAL_BACKWARD,    /**< Cursor backward (CUB). */
+    HORIZONTAL_REPRINT      /**< The cells in between, written again. */
+} horizontal_move;
+
+
+
+/**
+ * @brief How the cursor reaches its row.
+ * 
+ */
+typedef enum vertical_move
+{
+    VERTICAL_ABSOLUTE,      /**< Cursor position (CUP), column included. */
+    VERTICAL_NONE,          /**< It already is there. */
+    VERTICAL_RETURN,        /**< A carriage return, then line feeds. */
+    VERTICAL_RELATIVE       /**< Cursor up (CUU) or down (CUD). */
+} vertical_move;
+
+
+
+/**
+ * @brief Gets the number of decimal digits of a positive number.
+ * 
+ * @note This function is private to the canvas.
+ */
+static size_t decimal_length(int n)
+{
+    size_t length = 1;
+    for (; n >= 10; n /= 10)
+    {
+        length++;
+    }
+    return length;
+}
+
+
+
+/**
+ * @brief Gets the length of a control sequence with a single numeric
+ *      parameter, which is left out when it is the default, 1.
+ * 
+ * @note This function is private to the canvas.
+ */
+static size_t parameter_length(int n)
+{
+    return n == 1 ? 3 : 3 + decimal_length(n);
+}
+
+
+
+/**
+ * @brief Gets the length of the cursor position sequence to a cell.
+ * 
+ * @note This function is private to the canvas.
+ */
+static size_t position_length(int x, int y)
+{
+    return x ? 4 + decimal_length(y + 1) + decimal_length(x + 1)
+             : parameter_length(y + 1);
+}
+
+
+
+/**
+ * @brief Finds the cheapest way to move the cursor from column `from` to
+ *      column `to` of row `y`.
+ * 
+ * @param from The column the cursor is at, or -1 if not known.
+ * 
+ * @return The number of bytes the movement takes.
+ * 
+ * @note This function is private to the canvas.
+ */
+static size_t horizontal_cost(const tg_canvas *canvas,
+    const present_state *state, int y, int from, int to,
+    horizontal_move *move)
+{
+    *move = HORIZONTAL_ABSOLUTE;
+    size_t best = parameter_length(to + 1);
+    if (from < 0)
+    {
+        return best;
+    }
+    if (from == to)
+    {
+        *move = HORIZONTAL_NONE;
+        return 0;
+    }
+    if (to < from)
+    {
+        if (parameter_length(from - to) < best)
+        {
+            *move = HORIZONTAL_BACKWARD;
+            best = parameter_length(from - to);
+        }
+        return best;
+    }
+    if (parameter_length(to - from) < best)
+    {
+        *move = HORIZONTAL_FORWARD;
+        best = parameter_length(to - from);
+    }
+
+    // The cells left of the one drawn next show what the canvas holds, so
+    // they can be written again, as long as it takes no attribute change.
+    if (to - from > REPRINT_MAX_CELLS)
+    {
+        return best;
+    }
+    char glyph[TG_GLYPH_MAX_LENGTH];
+    size_t length = 0;
+    for (size_t i = (size_t)canvas->columns * y + from;
+         i < (size_t)canvas->columns * y + to; i++)
+    {
+        if (canvas->fg[i] != state->fg || canvas->bg[i] != state->bg ||
+            canvas->styles[i] != state->style)
+        {
+            return best;
+        }
+        length += encode_codepoint(glyph, canvas->codepoints[i]);
+    }
+    if (length < best)
+    {
+        *move = HORIZONTAL_REPRINT;
+        best = length;
+    }
+    return best;
+}
+
+
+
+/**
+ * @brief Moves the cursor to a cell with whichever sequence takes the fewest
+ *      bytes, and accounts for it in the statistics.
+ * 
+ * @return The number of bytes written, at most `MOVE_MAX_LENGTH`.
+ * 
+ * @note This function is private to the canvas.
+ */
+static size_t move_cursor(tg_canvas *canvas, present_state *state, int x,
+    int y, char *out)
+{
+    // ---------------------------------- 01 ----------------------------------
+    // Costing. Absolute positioning always works, the other ways need the
+    // cursor row, and some its column too.
+    size_t absolute = position_length(x, y);
+    size_t best = absolute;
+    vertical_move vertical = VERTICAL_ABSOLUTE;
+    horizontal_move horizontal = HORIZONTAL_NONE;
+    horizontal_move move;
+    size_t cost;
+    if (state->y == y)
+    {
+        cost = horizontal_cost(canvas, state, y, state->x, x, &move);
+        if (cost < best)
+        {
+            best = cost;
+            vertical = VERTICAL_NONE;
+            horizontal = move;
+        }
+        cost = 1 + horizontal_cost(canvas, state, y, 0, x, &move);
+        if (cost < best)
+        {
+            best = cost;
+            vertical = VERTICAL_RETURN;
+            horizontal = move;
+        }
+    }
+    else if (state->y >= 0)
+    {
+        int rows = y > state->y ? y - state->y : state->y - y;
+        if (state->x >= 0)
+        {
+            cost = parameter_length(rows)
+                 + horizontal_cost(canvas, state, y, state->x, x, &move);
+            if (cost < best)
+            {
+                best = cost;
+                vertical = VERTICAL_RELATIVE;
+                horizontal = move;
+            }
+        }
+        if (y > state->y)
+        {
+            cost = 1 + (size_t)rows
+                 + horizontal_cost(canvas, state, y, 0, x, &move);
+            if (cost < best)
+            {
+                best = cost;
+                vertical = VERTICAL_RETURN;
+                horizontal = move;
+            }
+        }
+    }
+
+    // ---------------------------------- 02 ----------------------------------
+    // Encoding. Line feeds follow a carriage return, so that the column is
+    // the same whether the terminal turns them into new lines or not.
+    size_t len = 0;
+    int column = state->x;
+    switch (vertical)
+    {
+        case VERTICAL_ABSOLUTE:
+            if (x)
+            {
+                len += (size_t)sprintf(out, "\033[%d;%dH", y + 1, x + 1);
+            }
+            else
+            {
+                len += y ? (size_t)sprintf(out, "\033[%dH", y + 1)
+                         : (size_t)sprintf(out, "\033[H");
+            }
+            column = x;
+            break;
+        case VERTICAL_NONE:
+            break;
+        case VERTICAL_RETURN:
+            out[len++] = '\r';
+            for (int row = state->y; row < y; row++)
+            {
+                out[len++] = '\n';
+            }
+            column = 0;
+            break;
+        case VERTICAL_RELATIVE:
+        {
+            int rows = y > state->y ? y - state->y : state->y - y;
+            char final = y > state->y ? 'B' : 'A';
+            len += rows == 1 ? (size_t)sprintf(out, "\033[%c", final)
+                             : (size_t)sprintf(out, "\033[%d%c", rows, final);
+            break;
+        }
+    }
+
+    int columns = x > column ? x - column : column - x;
+    switch (horizontal)
+    {
+        case HORIZONTAL_NONE:
+            break;
+        case HORIZONTAL_ABSOLUTE:
+            len += x ? (size_t)sprintf(out + len, "\033[%dG", x + 1)
+                     : (size_t)sprintf(out + len, "\033[G");
+            break;
+        case HORIZONTAL_FORWARD:
+        case HORIZONTAL_BACKWARD:
+        {
+            char final = horizontal == HORIZONTAL_FORWARD ? 'C' : 'D';
+            len += columns == 1
+                 ? (size_t)sprintf(out + len, "\033[%c", final)
+                 : (size_t)sprintf(out + len, "\033[%d%c", columns, final);
+            break;
+        }
+        case HORIZONTAL_REPRINT:
+            for (size_t i = (size_t)canvas->columns * y + column;
+                 i < (size_t)canvas->columns * y + x; i++)
+            {
+                len += encode_codepoint(out + len, canvas->codepoints[i]);
+            }
+            break;
+    }
+
+    state->x = x;
+    state->y = y;
+    canvas->stats.moves++;
+    canvas->stats.bytes_saved += absolute - best;
+    return len;
+}
+
+
+
+/**
+ * @brief Makes room for `length` more bytes in the output buffer.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ * @note This function is private to the canvas.
+ */
+static int canvas_reserve(tg_canvas *canvas, size_t used, size_t length)
+{
+    if (canvas->out_capacity - used >= length)
+    {
+        return 0;
+    }
+
+    size_t capacity = canvas->out_capacity ? canvas->out_capacity : 4096;
+    while (capacity - used < length)
+    {
+        capacity *= 2;
+    }
+    char *out = (char*)realloc(canvas->out, capacity);
+    if (!out)
+    {
+        return 1;
+    }
+    canvas->out = out;
+    canvas->out_capacity = capacity;
+    return 0;
+}
+
+
+
+tg_canvas *tg_canvas_create(int columns, int rows)
+{
+    if (columns <= 0 || rows <= 0)
+    {
+        return NULL;
+    }
+
+    tg_canvas *canvas = (tg_canvas*)calloc(1, sizeof(tg_canvas));
+    if (!canvas || canvas_alloc(canvas, columns, rows))
+    {
+        free(canvas);
+        return NULL;
+    }
+    return canvas;
+}
+
+
+
+void tg_canvas_free(tg_canvas *canvas)
+{
+    if (!canvas)
+    {
+        return;
+    }
+
+    canvas_release(canvas);
+    free(canvas->out);
+    free(canvas);
+}
+
+
+
+int tg_canvas_resize(tg_canvas *canvas, int columns, int rows)
+{
+    if (columns <= 0 || rows <= 0)
+    {
+        return 1;
+    }
+
+    tg_canvas resized = *canvas;
+    if (canvas_alloc(&resized, columns, rows))
+    {
+        return 1;
+    }
+
+    int copied_columns = columns < canvas->columns ? columns : canvas->columns;
+    int copied_rows = rows < canvas->rows ? rows : canvas->rows;
+    for (int y = 0; y < copied_rows; y++)
+    {
+        size_t from = (size_t)canvas->columns * y;
+        size_t to = (size_t)columns * y;
+        memcpy(resized.codepoints + to, canvas->codepoints + from,
+            copied_columns * sizeof(uint32_t));
+        memcpy(resized.fg + to, canvas->fg + from,
+            copied_columns * sizeof(uint32_t));
+        memcpy(resized.bg + to, canvas->bg + from,
+            copied_columns * sizeof(uint32_t));
+        memcpy(resized.styles + to, canvas->styles + from,
+            copied_columns * sizeof(uint16_t));
+    }
+
+    // The terminal reflowed or cut what it showed, so it is cleared and
+    // drawn again from scratch: it then shows the blank front buffer.
+    canvas_release(canvas);
+    *canvas = resized;
+    canvas->clear_screen = 1;
+    canvas->front_valid = 1;
+    return 0;
+}
+
+
+
+void tg_canvas_size(const tg_canvas *canvas, int *columns, int *rows)
+{
+    *columns = canvas->columns;
+    *rows = canvas->rows;
+}
+
+
+
+void tg_canvas_set(tg_canvas *canvas, int x, int y,
+    const tg_canvas_cell *cell)
+{
+    if (x < 0 || y < 0 || x >= canvas->columns || y >= canvas->rows)
+    {
+        return;
+    }
+    if (canvas_store(canvas, (size_t)canvas->columns * y + x, cell))
+    {
+        canvas_mark(canvas, y, x, x + 1);
+    }
+}
+
+
+
+int tg_canvas_get(const tg_canvas *canvas, int x, int y,
+    tg_canvas_cell *cell)
+{
+    if (x < 0 || y < 0 || x >= canvas->columns || y >= canvas->rows)
+    {
+        return 1;
+    }
+
+    size_t i = (size_t)canvas->columns * y + x;
+    cell->codepoint = canvas->codepoints[i];
+    cell->fg = canvas->fg[i];
+    cell->bg = canvas->bg[i];
+    cell->style = canvas->styles[i];
+    return 0;
+}
+
+
+
+void tg_canvas_fill(tg_canvas *canvas, int x, int y, int width, int height,
+    const tg_canvas_cell *cell)
+{
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = clip_end(x, width, canvas->columns);
+    int y1 = clip_end(y, height, canvas->rows);
+
+    for (int row = y0; row < y1; row++)
+    {
+        // Only the columns from the first to the last change are marked.
+        int first = canvas->columns;
+        int last = 0;
+        size_t start = (size_t)canvas->columns * row;
+        for (int column = x0; column < x1; column++)
+        {
+            if (canvas_store(canvas, start + column, cell))
+            {
+                first = column < first ? column : first;
+                last = column + 1;
+            }
+        }
+        if (first < last)
+        {
+            canvas_mark(canvas, row, first, last);
+        }
+    }
+}
+
+
+
+void tg_canvas_store_row(tg_canvas *canvas, int x, int y,
+    const tg_canvas_cell *cells, int count)
+{
+    if (y < 0 || y >= canvas->rows)
+    {
+        return;
+    }
+
+    int x0 = x < 0 ? 0 : x;
+    int x1 = clip_end(x, count, canvas->columns);
+    int first = canvas->columns;
+    int last = 0;
+    size_t start = (size_t)canvas->columns * y;
+    for (int column = x0; column < x1; column++)
+    {
+        if (canvas_store(canvas, start + column, &cells[column - x]))
+        {
+            first = column < first ? column : first;
+            last = column + 1;
+        }
+    }
+    if (first < last)
+    {
+        canvas_mark_shared(canvas, y, first, last);
+    }
+}
+
+
+
+int tg_canvas_blit_image(tg_canvas *canvas, int x, int y, int width,
+    int height, const tg_image *image, const tg_render_opts *opts)
+{
+    if (!image || !image->pixels || image->width <= 0 || 
+        image->height <= 0 || width <= 0 || height <= 0)
+    {
+        return 1;
+    }
+
+    // A rectangle entirely outside the canvas has nothing to draw.
+    if (x >= canvas->columns || y >= canvas->rows ||
+        (int64_t)x + width <= 0 || (int64_t)y + height <= 0)
+    {
+        return 0;
+    }
+
+    tg_render_opts tile_opts = {0};
+    if (opts)
+    {
+        tile_opts = *opts;
+    }
+    tile_opts.columns = width;
+    tile_opts.rows = height;
+
+    tg_row_source source;
+    tg_image_source_init(&source, image);
+    tg_cell_target target = { canvas, x, y };
+    return tg_render_source_cells(&source, &tile_opts, &target);
+}
+
+
+
+/**
+ * @brief Decodes the next code point of a UTF-8 string, as U+FFFD if its
+ *      bytes are not well-formed.
+ * 
+ * @param s The string, positioned on the first byte of a code point.
+ * @param length The number of bytes consumed.
+ * 
+ * @note This function is private to tg_canvas_printf.
+ */
+static uint32_t decode_codepoint(const unsigned char *s, size_t *length)
+{
+    *length = s[0] < 0x80 ? 1 
+            : (s[0] & 0xe0) == 0xc0 ? 2 
+            : (s[0] & 0xf0) == 0xe0 ? 3 
+            : (s[0] & 0xf8) == 0xf0 ? 4 : 0;
+    if (*length == 1)
+    {
+        return s[0];
+    }
+
+    uint32_t codepoint = s[0] & (0x7f >> *length);
+    for (size_t i = 1; i < *length; i++)
+    {
+        // This also stops at the null-terminator of a truncated sequence.
+        if ((s[i] & 0xc0) != 0x80)
+        {
+            *length = 0;
+            break;
+        }
+        codepoint = (codepoint << 6) | (s[i] & 0x3f);
+    }
+
+    static const uint32_t min_codepoint[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (!*length || codepoint < min_codepoint[*length] || 
+        codepoint > 0x10ffff || (codepoint >= 0xd800 && codepoint <= 0xdfff))
+    {
+        *length = 1;
+        return 0xfffd;
+    }
+    return codepoint;
+}
+
+
+
+/**
+ * @brief Gets the color of an indexed color sequence, as given by the
+ *      `TG_INDEXED_COLOR` macros.
+ * 
+ * @note This function is private to tg_canvas_printf.
+ */
+static uint32_t indexed_color(const char *sequence)
+{
+    if (strlen(sequence) < TG_INDEXED_COLOR_SEQUENCE_LENGTH - 1 ||
+        sequence[4] < '0' || sequence[4] > '7')
+    {
+        return TG_COLOR_DEFAULT;
+    }
+
+    // Bright colors are 9x rather than 3x, and come after the normal ones.
+    int index = sequence[4] - '0';
+    return TG_COLOR_INDEXED(sequence[3] == '9' ? index + 8 : index);
+}
+
+
+
+/**
+ * @brief Applies an attribute change of a compiled format to the cell
+ *      written next, taking the color from the arguments if it has one.
+ * 
+ * @note This function is private to tg_canvas_printf.
+ */
+static void apply_format_op(tg_canvas_cell *pen, const tg_format_op *op,
+    va_list *colors)
+{
+    uint32_t *color = op->layer == TG_TERMINAL_LAYER_FOREGROUND 
+                    ? &pen->fg : &pen->bg;
+    switch (op->kind)
+    {
+    case TG_FORMAT_DIRECT_COLOR:
+        *color = TG_COLOR_DIRECT(va_arg(*colors, int));
+        break;
+
+    case TG_FORMAT_INDEXED_COLOR:
+        *color = indexed_color(va_arg(*colors, const char*));
+        break;
+
+    case TG_FORMAT_STYLE:
+        pen->style |= op->styles;
+        break;
+
+    case TG_FORMAT_RESET:
+        pen->style &= (uint16_t)~op->styles;
+        pen->fg = op->colors & 1 ? TG_COLOR_DEFAULT : pen->fg;
+        pen->bg = op->colors & 2 ? TG_COLOR_DEFAULT : pen->bg;
+        break;
+    }
+}
+
+
+
+/**
+ * @brief Tells where an attribute change goes in the text of a compiled
+ *      format: the length of the text its plain format gives up to the
+ *      specifier.
+ * 
+ * @param prefix A copy of the plain format, cut at the specifier meanwhile.
+ * @param position Where the specifier was in the plain format.
+ * @param ap The printf arguments, left untouched.
+ * 
+ * @note This function is private to tg_canvas_printf.
+ */
+static int format_op_offset(char *prefix, size_t position, va_list *ap)
+{
+    char cut = prefix[position];
+    prefix[position] = '\0';
+    va_list copy;
+    va_copy(copy, *ap);
+    int offset = vsnprintf(NULL, 0, prefix, copy);
+    va_end(copy);
+    prefix[position] = cut;
+    return offset;
+}
+
+
+
+int tg_canvas_printf(tg_canvas *canvas, int x, int y, const char *format,
+    ...)
+{
+    // ---------------------------------- 01 ----------------------------------
+    // The format is compiled once, like those of tg_printf, into a printf
+    // format without the extended specifiers and their positions in it. The
+    // color arguments come first: `ap` is moved past them for vsnprintf,
+    // while `colors` is left on them, to be read as their changes are made.
+
+    const tg_format *compiled = tg_format_get(format);
+    if (!compiled)
+    {
+        return -1;
+    }
+
+    va_list ap;
+    va_list colors;
+    va_start(ap, format);
+    va_copy(colors, ap);
+    for (int i = 0; i < compiled->op_count; i++)
+    {
+        if (compiled->ops[i].kind == TG_FORMAT_DIRECT_COLOR)
+        {
+            (void)va_arg(ap, int);
+        }
+        else if (compiled->ops[i].kind == TG_FORMAT_INDEXED_COLOR)
+        {
+            (void)va_arg(ap, const char*);
+        }
+    }
+
+    // ---------------------------------- 02 ----------------------------------
+    // The standard specifiers are formatted on the stack, unless the text
+    // does not fit, in which case it is formatted again into a buffer. The
+    // attribute changes are placed by formatting the prefixes of the format
+    // that end on them, rather than by marks in the text, which the
+    // arguments could forge.
+
+    char stack[TEXT_STACK_LENGTH];
+    char *text = stack;
+    va_list args;
+    va_copy(args, ap);
+    int length = vsnprintf(stack, sizeof(stack), compiled->plain, args);
+    va_end(args);
+    if (length >= (int)sizeof(stack))
+    {
+        text = (char*)malloc((size_t)length + 1);
+        if (text)
+        {
+            va_copy(args, ap);
+            vsnprintf(text, (size_t)length + 1, compiled->plain, args);
+            va_end(args);
+        }
+    }
+
+    char prefix_stack[TEXT_STACK_LENGTH];
+    char *prefix = NULL;
+    if (compiled->op_count)
+    {
+        size_t plain_length = strlen(compiled->plain);
+        prefix = plain_length < sizeof(prefix_stack)
+               ? prefix_stack : (char*)malloc(plain_length + 1);
+        if (prefix)
+        {
+            memcpy(prefix, compiled->plain, plain_length + 1);
+        }
+    }
+
+    if (length < 0 || !text || (compiled->op_count && !prefix))
+    {
+        if (text != stack)
+        {
+            free(text);
+        }
+        va_end(colors);
+        va_end(ap);
+        return -1;
+    }
+
+    // ---------------------------------- 03 ----------------------------------
+    // The text is written cell by cell with the attributes the changes set,
+    // and the changed columns of each row are marked once the row is done.
+
+    tg_canvas_cell pen = { ' ', TG_COLOR_DEFAULT, TG_COLOR_DEFAULT, 0 };
+    const unsigned char *s = (const unsigned char*)text;
+    int op = 0;
+    int next = compiled->op_count
+             ? format_op_offset(prefix, compiled->ops[0].position, &ap)
+             : length;
+    // On 64 bits, text starting near the largest coordinates runs past them.
+    int64_t column = x;
+    int64_t row = y;
+    int first = canvas->columns;
+    int last = 0;
+    int written = 0;
+    for (int i = 0; i < length; )
+    {
+        while (op < compiled->op_count && next <= i)
+        {
+            apply_format_op(&pen, &compiled->ops[op++], &colors);
+            next = op < compiled->op_count
+                 ? format_op_offset(prefix, compiled->ops[op].position, &ap)
+                 : length;
+        }
+
+        if (s[i] == '\n')
+        {
+            if (first < last)
+            {
+                canvas_mark(canvas, (int)row, first, last);
+            }
+            first = canvas->columns;
+            last = 0;
+            row++;
+            column = x;
+            i++;
+            continue;
+        }
+
+        size_t consumed;
+        pen.codepoint = decode_codepoint(s + i, &consumed);
+        if (tg_codepoint_width(pen.codepoint) != 1)
+        {
+            pen.codepoint = ' ';
+        }
+        i += (int)consumed;
+        if (column >= 0 && column < canvas->columns && 
+            row >= 0 && row < canvas->rows)
+        {
+            if (canvas_store(canvas, (size_t)canvas->columns * row + column,
+                &pen))
+            {
+                first = column < first ? (int)column : first;
+                last = (int)column + 1;
+            }
+            written++;
+        }
+        column++;
+    }
+    if (first < last)
+    {
+        canvas_mark(canvas, (int)row, first, last);
+    }
+
+    va_end(colors);
+    va_end(ap);
+    if (prefix != prefix_stack)
+    {
+        free(prefix);
+    }
+    if (text != stack)
+    {
+        free(text);
+    }
+    return written;
+}
+
+
+
+void tg_canvas_clear(tg_canvas *canvas)
+{
+    tg_canvas_cell blank = { ' ', TG_COLOR_DEFAULT, TG_COLOR_DEFAULT, 0 };
+    tg_canvas_fill(canvas, 0, 0, canvas->columns, canvas->rows, &blank);
+}
+
+
+
+void tg_canvas_invalidate(tg_canvas *canvas)
+{
+    canvas->front_valid = 0;
+    for (int y = 0; y < canvas->rows; y++)
+    {
+        canvas_mark(canvas, y, 0, canvas->columns);
+    }
+}
+
+
+
+/**
+ * @brief Mixes a cell into a row hash, FNV-1a style over its attributes.
+ * 
+ * @note This function is private to the canvas.
+ */
+static uint64_t hash_cell(uint64_t hash, uint32_t codepoint, uint32_t fg,
+    uint32_t bg, uint16_t style)
+{
+    hash = (hash ^ codepoint) * 1099511628211u;
+    hash = (hash ^ fg) * 1099511628211u;
+    hash = (hash ^ bg) * 1099511628211u;
+    return (hash ^ style) * 1099511628211u;
+}
+
+
+
+/**
+ * @brief Hashes the cells of a row.
+ * 
+ * @note This function is private to the canvas.
+ */
+static uint64_t row_hash(const uint32_t *codepoints, const uint32_t *fg,
+    const uint32_t *bg, const uint16_t *styles, int columns)
+{
+    uint64_t hash = ROW_HASH_BASIS;
+    for (int x = 0; x < columns; x++)
+    {
+        hash = hash_cell(hash, codepoints[x], fg[x], bg[x], styles[x]);
+    }
+    return hash;
+}
+
+
+
+/**
+ * @brief Tells whether row `y` of a canvas holds the same cells as row
+ *      `front_y` of its front buffer.
+ * 
+ * @note This function is private to the canvas.
+ */
+static int rows_equal(const tg_canvas *canvas, int y, int front_y)
+{
+    size_t i = (size_t)canvas->columns * y;
+    size_t j = (size_t)canvas->columns * front_y;
+    size_t columns = (size_t)canvas->columns;
+    return !memcmp(canvas->codepoints + i, canvas->front_codepoints + j,
+               columns * sizeof(uint32_t)) &&
+           !memcmp(canvas->fg + i, canvas->front_fg + j,
+               columns * sizeof(uint32_t)) &&
+           !memcmp(canvas->bg + i, canvas->front_bg + j,
+               columns * sizeof(uint32_t)) &&
+           !memcmp(canvas->styles + i, canvas->front_styles + j,
+               columns * sizeof(uint16_t));
+}
+
+
+
+/**
+ * @brief Scrolls rows [top, bottom) of the front buffer by `shift` rows, up
+ *      if positive and down if negative, blanking the rows exposed, as the
+ *      terminal does within a scroll region.
+ * 
+ * @note This function is private to the canvas.
+ */
+static void front_scroll(tg_canvas *canvas, int top, int bottom, int shift)
+{
+    int count = bottom - top - (shift > 0 ? shift : -shift);
+    int to = shift > 0 ? top : top - shift;
+    int from = shift > 0 ? top + shift : top;
+    int exposed = shift > 0 ? top + count : top;
+    size_t columns = (size_t)canvas->columns;
+
+    memmove(canvas->front_codepoints + columns * to,
+        canvas->front_codepoints + columns * from,
+        columns * count * sizeof(uint32_t));
+    memmove(canvas->front_fg + columns * to, canvas->front_fg + columns * from,
+        columns * count * sizeof(uint32_t));
+    memmove(canvas->front_bg + columns * to, canvas->front_bg + columns * from,
+        columns * count * sizeof(uint32_t));
+    memmove(canvas->front_styles + columns * to,
+        canvas->front_styles + columns * from,
+        columns * count * sizeof(uint16_t));
+
+    for (size_t i = columns * exposed;
+         i < columns * (exposed + (bottom - top - count)); i++)
+    {
+        canvas->front_codepoints[i] = ' ';
+        canvas->front_fg[i] = TG_COLOR_DEFAULT;
+        canvas->front_bg[i] = TG_COLOR_DEFAULT;
+        canvas->front_styles[i] = 0;
+    }
+}
+
+
+
+/**
+ * @brief Looks for a block of rows the terminal shows shifted up or down
+ *      from where the canvas holds them, and scrolls it into place.
+ * 
+ * Every shift is scored by the rows it brings into place that would be
+ * drawn otherwise, minus the rows it blanks that would not. The best one,
+ * if any gains, is scrolled within a scroll region spanning the block and
+ * the rows exposed, which are marked dirty along with the block.
+ * 
+ * @return The number of bytes written, at most `5 * MOVE_MAX_LENGTH`.
+ * 
+ * @note This function is private to the canvas.
+ */
+static size_t canvas_scroll(tg_canvas *canvas, present_state *state,
+    char *out)
+{
+    // ---------------------------------- 01 ----------------------------------
+    // Hashing, only worth it when enough rows changed.
+    int rows = canvas->rows;
+    int dirty = 0;
+    for (size_t w = 0; w < ((size_t)rows + 63) / 64; w++)
+    {
+        dirty += __builtin_popcountll(canvas->dirty_rows[w]);
+    }
+    if (dirty < SCROLL_MIN_ROWS)
+    {
+        return 0;
+    }
+
+    uint64_t *hashes = canvas->row_hashes;
+    uint64_t *front_hashes = canvas->row_hashes + rows;
+    for (int y = 0; y < rows; y++)
+    {
+        size_t i = (size_t)canvas->columns * y;
+        hashes[y] = row_hash(canvas->codepoints + i, canvas->fg + i,
+            canvas->bg + i, canvas->styles + i, canvas->columns);
+        front_hashes[y] = row_hash(canvas->front_codepoints + i,
+            canvas->front_fg + i, canvas->front_bg + i,
+            canvas->front_styles + i, canvas->columns);
+    }
+    uint64_t blank_hash = ROW_HASH_BASIS;
+    for (int x = 0; x < canvas->columns; x++)
+    {
+        blank_hash = hash_cell(blank_hash, ' ', TG_COLOR_DEFAULT,
+            TG_COLOR_DEFAULT, 0);
+    }
+
+    // ---------------------------------- 02 ----------------------------------
+    // Scoring of every shift: runs of rows matching the front buffer rows
+    // `shift` rows below (positive shifts) or above (negative ones).
+    int best_score = 0;
+    int best_shift = 0;
+    int best_first = 0;
+    int best_end = 0;
+    for (int shift = 1 - rows; shift < rows; shift++)
+    {
+        if (!shift)
+        {
+            continue;
+        }
+        int first = shift > 0 ? 0 : -shift;
+        int end = shift > 0 ? rows - shift : rows;
+        int run = first;
+        int gain = 0;
+        for (int y = first; y <= end; y++)
+        {
+            if (y < end && hashes[y] == front_hashes[y + shift])
+            {
+                gain += hashes[y] != front_hashes[y];
+                continue;
+            }
+
+            // The rows the scroll exposes are blanked, a loss if they
+            // already showed what the canvas holds.
+            if (y > run && gain > best_score)
+            {
+                int loss = 0;
+                int exposed = shift > 0 ? y : run + shift;
+                int magnitude = shift > 0 ? shift : -shift;
+                for (int e = exposed; e < exposed + magnitude; e++)
+                {
+                    loss += hashes[e] == front_hashes[e] &&
+                            hashes[e] != blank_hash;
+                }
+                if (gain - loss > best_score)
+                {
+                    best_score = gain - loss;
+                    best_shift = shift;
+                    best_first = run;
+                    best_end = y;
+                }
+            }
+            run = y + 1;
+            gain = 0;
+        }
+    }
+    if (!best_score)
+    {
+        return 0;
+    }
+    for (int y = best_first; y < best_end; y++)
+    {
+        if (!rows_equal(canvas, y, y + best_shift))
+        {
+            return 0;
+        }
+    }
+
+    // ---------------------------------- 03 ----------------------------------
+    // Scrolling. Setting the scroll region moves the cursor home, as does
+    // resetting it.
+    int top = best_shift > 0 ? best_first : best_first + best_shift;
+    int bottom = best_shift > 0 ? best_end + best_shift : best_end;
+    int magnitude = best_shift > 0 ? best_shift : -best_shift;
+    char final = best_shift > 0 ? 'S' : 'T';
+    size_t len = (size_t)sprintf(out, "\033[%d;%dr", top + 1, bottom);
+    len += magnitude == 1 ? (size_t)sprintf(out + len, "\033[%c", final)
+                          : (size_t)sprintf(out + len, "\033[%d%c", magnitude,
+                                final);
+    len += (size_t)sprintf(out + len, "\033[r");
+    state->x = 0;
+    state->y = 0;
+
+    front_scroll(canvas, top, bottom, best_shift);
+    for (int y = top; y < bottom; y++)
+    {
+        canvas_mark(canvas, y, 0, canvas->columns);
+    }
+    canvas->stats.scrolls++;
+    return len;
+}
+
+
+
+void tg_canvas_set_scrolling(tg_canvas *canvas, int enabled)
+{
+    canvas->scrolling = enabled != 0;
+}
+
+
+
+void tg_canvas_set_synchronized(tg_canvas *canvas, int enabled)
+{
+    canvas->synchronized = enabled != 0;
+}
+
+
+
+int tg_canvas_present(tg_canvas *canvas, tg_sink *sink)
+{
+    tg_sink standard_output = tg_sink_file(stdout);
+    sink = sink ? sink : &standard_output;
+
+    // ---------------------------------- 01 ----------------------------------
+    // Encoding. The terminal attributes are assumed to be the default ones,
+    // as every present leaves them, and the cursor position to be unknown.
+    present_state state = { TG_COLOR_DEFAULT, TG_COLOR_DEFAULT, 0, -1, -1 };
+    size_t begin_length = canvas->synchronized
+                        ? sizeof(TG_SYNCHRONIZED_UPDATE_BEGIN) - 1 : 0;
+    if (canvas_reserve(canvas, 0, begin_length + 5 * MOVE_MAX_LENGTH))
+    {
+        return 1;
+    }
+    memcpy(canvas->out, TG_SYNCHRONIZED_UPDATE_BEGIN, begin_length);
+    size_t len = begin_length;
+    if (canvas->clear_screen)
+    {
+        len += (size_t)sprintf(canvas->out + len, "\033[H\033[2J");
+        state.x = 0;
+        state.y = 0;
+    }
+    else if (canvas->scrolling && canvas->front_valid)
+    {
+        len += canvas_scroll(canvas, &state, canvas->out + len);
+    }
+
+    size_t row_words = ((size_t)canvas->rows + 63) / 64;
+    for (size_t w = 0; w < row_words; w++)
+    {
+        uint64_t rows = canvas->dirty_rows[w];
+        while (rows)
+        {
+            int y = (int)(64 * w) + __builtin_ctzll(rows);
+            rows &= rows - 1;
+
+            // Runs of consecutive dirty spans are compared with the front
+            // buffer in one go.
+            const uint64_t *spans = canvas->dirty_spans
+                                  + canvas->span_words * y;
+            int span_count = (canvas->columns + TG_CANVAS_SPAN_COLUMNS - 1)
+                           / TG_CANVAS_SPAN_COLUMNS;
+            int s = 0;
+            while (s < span_count)
+            {
+                if (!(spans[s / 64] >> (s % 64) & 1))
+                {
+                    s++;
+                    continue;
+                }
+                int first = s;
+                while (s < span_count && spans[s / 64] >> (s % 64) & 1)
+                {
+                    s++;
+                }
+
+                int x0 = first * TG_CANVAS_SPAN_COLUMNS;
+                int x1 = s * TG_CANVAS_SPAN_COLUMNS < canvas->columns
+                       ? s * TG_CANVAS_SPAN_COLUMNS : canvas->columns;
+                if (canvas_reserve(canvas, len, (size_t)(x1 - x0)
+                        * (MOVE_MAX_LENGTH + CELL_MAX_LENGTH)))
+                {
+                    tg_canvas_invalidate(canvas);
+                    return 1;
+                }
+                for (int x = x0; x < x1; x++)
+                {
+                    // Cells the terminal already shows are skipped, such as
+                    // ones changed and then changed back since the last
+                    // present.
+                    size_t i = (size_t)canvas->columns * y + x;
+                    if (canvas->front_valid &&
+                        canvas->front_codepoints[i] == canvas->codepoints[i] &&
+                        canvas->front_fg[i] == canvas->fg[i] &&
+                        canvas->front_bg[i] == canvas->bg[i] &&
+                        canvas->front_styles[i] == canvas->styles[i])
+                    {
+                        continue;
+                    }
+
+                    if (state.x != x || state.y != y)
+                    {
+                        len += move_cursor(canvas, &state, x, y,
+                            canvas->out + len);
+                    }
+                    len += encode_cell(canvas, i, &state, canvas->out + len);
+                    canvas->stats.cells++;
+                    canvas->front_codepoints[i] = canvas->codepoints[i];
+                    canvas->front_fg[i] = canvas->fg[i];
+                    canvas->front_bg[i] = canvas->bg[i];
+                    canvas->front_styles[i] = canvas->styles[i];
+
+                    // Past the last column, where the cursor goes depends on
+                    // the terminal.
+                    state.x = x + 1 < canvas->columns ? x + 1 : -1;
+                }
+            }
+        }
+    }
+
+    if (state.style || state.fg != TG_COLOR_DEFAULT ||
+        state.bg != TG_COLOR_DEFAULT)
+    {
+        if (canvas_reserve(canvas, len, TG_TEXT_STYLE_SEQUENCE_LENGTH))
+        {
+            tg_canvas_invalidate(canvas);
+            return 1;
+        }
+        memcpy(canvas->out + len, TG_RESET_ALL_MODES,
+            TG_TEXT_STYLE_SEQUENCE_LENGTH - 1);
+        len += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
+    }
+
+    // A frame with nothing to draw is not written at all.
+    if (len == begin_length)
+    {
+        len = 0;
+    }
+    else if (canvas->synchronized)
+    {
+        if (canvas_reserve(canvas, len,
+                sizeof(TG_SYNCHRONIZED_UPDATE_END) - 1))
+        {
+            tg_canvas_invalidate(canvas);
+            return 1;
+        }
+        memcpy(canvas->out + len, TG_SYNCHRONIZED_UPDATE_END,
+            sizeof(TG_SYNCHRONIZED_UPDATE_END) - 1);
+        len += sizeof(TG_SYNCHRONIZED_UPDATE_END) - 1;
+    }
+
+    // ---------------------------------- 02 ----------------------------------
+    // Output, then cleanup of the marks. If the frame was not written, the
+    // front buffer no longer tells what the terminal shows.
+    if (len && sink->write(sink->ctx, canvas->out, len))
+    {
+        tg_canvas_invalidate(canvas);
+        return 1;
+    }
+
+    if (len)
+    {
+        canvas->stats.frames++;
+        canvas->stats.bytes += len;
+    }
+    memset(canvas->dirty_rows, 0, row_words * sizeof(uint64_t));
+    memset(canvas->dirty_spans, 0,
+        canvas->span_words * canvas->rows * sizeof(uint64_t));
+    canvas->clear_screen = 0;
+    canvas->front_valid = 1;
+    return 0;
+}
+
+
+
+void tg_canvas_stats_get(const tg_canvas *canvas, tg_canvas_stats *stats)
+{
+    *stats = canvas->stats;
+}
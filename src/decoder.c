@@ -0,0 +1,70 @@
+#include <string.h>
+
+#include "internal.h"
+
+
+
+int tg_decoder_source_open(tg_row_source *source, tg_reader *reader)
+{
+    // Formats are told apart by their magic numbers, the shortest first so
+    // that tiny files are still recognized. TGA has none, so it is tried
+    // last, and its header is what rejects anything else.
+    const uint8_t *magic = tg_reader_peek(reader, 2);
+    if (magic && magic[0] == 'P' && magic[1] >= '1' && magic[1] <= '7')
+    {
+        return tg_pnm_source_open(source, reader);
+    }
+    if (magic && magic[0] == 'B' && magic[1] == 'M')
+    {
+        return tg_bmp_source_open(source, reader);
+    }
+
+    magic = tg_reader_peek(reader, 4);
+    if (magic && memcmp(magic, "qoif", 4) == 0)
+    {
+        return tg_qoi_source_open(source, reader);
+    }
+
+    magic = tg_reader_peek(reader, 8);
+    if (magic && memcmp(magic, "farbfeld", 8) == 0)
+    {
+        return tg_farbfeld_source_open(source, reader);
+    }
+
+    if (tg_reader_peek(reader, 1))
+    {
+        return tg_tga_source_open(source, reader);
+    }
+
+    tg_reader_close(reader);
+    return 1;
+}
+
+
+
+int tg_frame_source_open(tg_frame_source *frames, tg_reader *reader)
+{
+    const uint8_t *magic = tg_reader_peek(reader, 2);
+    if (magic && magic[0] == 'P' && magic[1] >= '1' && magic[1] <= '7')
+    {
+        return tg_pnm_frame_source_open(frames, reader);
+    }
+    magic = tg_reader_peek(reader, 9);
+    if (magic && memcmp(magic, "YUV4MPEG2", 9) == 0)
+    {
+        return tg_y4m_frame_source_open(frames, reader);
+    }
+
+    tg_reader_close(reader);
+    return 1;
+}
+
+
+
+void tg_row_source_close(tg_row_source *source)
+{
+    if (source->close)
+    {
+        source->close(source);
+    }
+}
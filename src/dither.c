@@ -0,0 +1,412 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+
+
+/**
+ * @brief 8x8 Bayer threshold matrix, with thresholds from 0 to 63.
+ * 
+ */
+static const uint8_t bayer8[8][8] = {
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+
+
+/**
+ * @brief The xterm default values of the 16 standard and bright colors.
+ * 
+ * Terminals let users change these, so they are only an approximation of
+ * what gets displayed.
+ * 
+ */
+static const uint8_t system_colors[16][3] = {
+    {   0,   0,   0 }, { 205,   0,   0 }, {   0, 205,   0 }, { 205, 205,   0 },
+    {   0,   0, 238 }, { 205,   0, 205 }, {   0, 205, 205 }, { 229, 229, 229 },
+    { 127, 127, 127 }, { 255,   0,   0 }, {   0, 255,   0 }, { 255, 255,   0 },
+    {  92,  92, 255 }, { 255,   0, 255 }, {   0, 255, 255 }, { 255, 255, 255 }
+};
+
+
+
+/** The channel values of the 6x6x6 color cube of the 256-color palette. */
+static const uint8_t cube_levels[6] = { 0, 95, 135, 175, 215, 255 };
+
+
+
+/**
+ * @name Bayer dithering amplitudes.
+ *
+ * @brief How far apart, roughly, two neighbouring palette colors are, which
+ *      is the range Bayer thresholds are spread over.
+ *
+ * @{
+ */
+#define BAYER_SPREAD_256 40
+#define BAYER_SPREAD_16 96
+/** @} */
+
+
+
+/**
+ * @brief Error diffusion weights are expressed in 1/16ths.
+ * 
+ */
+#define ERROR_SHIFT 4
+
+
+
+/**
+ * @brief Number of error channels: red, green, blue and luma.
+ * 
+ */
+#define ERROR_CHANNELS 4
+
+
+
+/**
+ * @brief Padding around each error row, so that the diffusion kernels can
+ *      write past the row ends.
+ * 
+ */
+#define ERROR_PADDING 2
+
+
+
+static inline int clamp_byte(int value)
+{
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+
+
+static inline int squared_distance(int r, int g, int b, const uint8_t c[3])
+{
+    return (r - c[0]) * (r - c[0]) + (g - c[1]) * (g - c[1]) 
+         + (b - c[2]) * (b - c[2]);
+}
+
+
+
+/**
+ * @brief Finds the palette index nearest to a color.
+ * 
+ * @note This function is private to the quantizer.
+ */
+static int nearest_index(const tg_quantizer *q, int r, int g, int b)
+{
+    if (q->depth == TG_COLOR_DEPTH_16)
+    {
+        int best = 0;
+        int best_distance = squared_distance(r, g, b, q->palette[0]);
+        for (int i = 1; i < 16; i++)
+        {
+            int distance = squared_distance(r, g, b, q->palette[i]);
+            if (distance < best_distance)
+            {
+                best = i;
+                best_distance = distance;
+            }
+        }
+        return best;
+    }
+
+    // The 256-color palette is made of a color cube, whose nearest color
+    // comes channel by channel, and a gray ramp, whose nearest color comes
+    // from the average of the channels. The closest of the two wins.
+    int cube = 16 + 36 * q->cube_index[r] + 6 * q->cube_index[g] 
+             + q->cube_index[b];
+
+    int average = (r + g + b) / 3;
+    int gray_step = average < 8 ? 0 : (average - 8 + 5) / 10;
+    int gray = 232 + (gray_step > 23 ? 23 : gray_step);
+
+    return squared_distance(r, g, b, q->palette[gray]) 
+         < squared_distance(r, g, b, q->palette[cube]) ? gray : cube;
+}
+
+
+
+int tg_quantizer_init(tg_quantizer *q, int width, tg_color_depth depth,
+    tg_dither dither, int levels)
+{
+    memset(q, 0, sizeof(tg_quantizer));
+    q->width = width;
+    q->depth = depth;
+    q->dither = dither;
+    q->levels = levels;
+    q->dithers_levels = levels > 1 && dither != TG_DITHER_NONE;
+
+    // ---------------------------------- 01 ----------------------------------
+    // Lookup tables.
+    for (int v = 0; v < 256; v++)
+    {
+        // The cube levels are 40 apart, except for the first step.
+        int index = v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40;
+        q->cube_index[v] = (uint8_t)(index > 5 ? 5 : index);
+    }
+
+    memcpy(q->palette, system_colors, sizeof(system_colors));
+    for (int i = 0; i < 216; i++)
+    {
+        q->palette[16 + i][0] = cube_levels[i / 36];
+        q->palette[16 + i][1] = cube_levels[i / 6 % 6];
+        q->palette[16 + i][2] = cube_levels[i % 6];
+    }
+    for (int i = 0; i < 24; i++)
+    {
+        memset(q->palette[232 + i], 8 + 10 * i, 3);
+    }
+
+    // ---------------------------------- 02 ----------------------------------
+    // Error rows, only needed for error diffusion. Atkinson spreads errors
+    // two rows down, so three rows are kept.
+    if (tg_quantizer_is_serial(q))
+    {
+        size_t row_length = ((size_t)width + 2 * ERROR_PADDING) 
+                          * ERROR_CHANNELS;
+        q->errors = (int32_t*)calloc(3 * row_length, sizeof(int32_t));
+        if (!q->errors)
+        {
+            return 1;
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            q->error_rows[i] = q->errors + i * row_length 
+                             + ERROR_PADDING * ERROR_CHANNELS;
+        }
+    }
+
+    return 0;
+}
+
+
+
+void tg_quantizer_free(tg_quantizer *q)
+{
+    free(q->errors);
+    q->errors = NULL;
+}
+
+
+
+int tg_quantizer_is_serial(const tg_quantizer *q)
+{
+    // Error diffusion has nothing to do when there is nothing to quantize.
+    int quantizes = q->depth != TG_COLOR_DEPTH_TRUECOLOR || q->levels > 1;
+    return quantizes && (q->dither == TG_DITHER_FLOYD_STEINBERG || 
+                         q->dither == TG_DITHER_ATKINSON);
+}
+
+
+
+/**
+ * @brief Quantizes the colors of a row with the Bayer matrix.
+ * 
+ * The threshold only depends on the pixel position, so the row is processed
+ * independently of all the others.
+ * 
+ * @note This function is private to the quantizer.
+ */
+static void bayer_colors(const tg_quantizer *q, const uint8_t *rgb, int y,
+    uint32_t *colors)
+{
+    const uint8_t *thresholds = bayer8[y & 7];
+    int spread = q->depth == TG_COLOR_DEPTH_256 
+               ? BAYER_SPREAD_256 : BAYER_SPREAD_16;
+
+    for (int x = 0; x < q->width; x++)
+    {
+        // Thresholds are centered on 0, from -spread/2 to spread/2.
+        int offset = (2 * thresholds[x & 7] + 1 - 64) * spread / 128;
+        colors[x] = TG_COLOR_INDEXED(nearest_index(q,
+            clamp_byte(rgb[3*x] + offset),
+            clamp_byte(rgb[3*x+1] + offset),
+            clamp_byte(rgb[3*x+2] + offset)));
+    }
+}
+
+
+
+/**
+ * @brief Quantizes the lumas of a row to ramp levels with the Bayer matrix.
+ * 
+ * The level is floor(luma * (levels - 1) / 255 + t), t being the threshold
+ * scaled to [0, 1): on average, the level matches the luma exactly. There is
+ * no dependency between pixels, so the loop vectorizes.
+ * 
+ * @note This function is private to the quantizer.
+ */
+static void bayer_levels(const tg_quantizer *q, const uint8_t *luma, int y,
+    uint8_t *levels)
+{
+    const uint8_t *thresholds = bayer8[y & 7];
+    int top = q->levels - 1;
+
+    for (int x = 0; x < q->width; x++)
+    {
+        int level = (luma[x] * top * 128 + 2 * thresholds[x & 7] + 1) 
+                  / (255 * 128);
+        levels[x] = (uint8_t)(level < top ? level : top);
+    }
+}
+
+
+
+/**
+ * @brief Adds `error * weight` to the error of a pixel.
+ * 
+ */
+static inline void spread_error(int32_t *row, int x, int c, int error,
+    int weight)
+{
+    row[x * ERROR_CHANNELS + c] += error * weight;
+}
+
+
+
+/**
+ * @brief Quantizes a row with error diffusion, carrying the errors over to
+ *      the rows below.
+ * 
+ * @note This function is private to the quantizer.
+ */
+static void quantize_row_diffuse(tg_quantizer *q, const uint8_t *rgb,
+    const uint8_t *luma, uint32_t *colors, uint8_t *levels)
+{
+    int32_t *current = q->error_rows[0];
+    int32_t *next = q->error_rows[1];
+    int32_t *after = q->error_rows[2];
+    int atkinson = q->dither == TG_DITHER_ATKINSON;
+    int palette = q->depth != TG_COLOR_DEPTH_TRUECOLOR;
+    int channels = q->levels > 1 ? ERROR_CHANNELS : 3;
+
+    for (int x = 0; x < q->width; x++)
+    {
+        // ---------------------------------- 01 ------------------------------
+        // Quantization of the values with the errors carried so far.
+        int value[ERROR_CHANNELS];
+        int error[ERROR_CHANNELS] = { 0, 0, 0, 0 };
+        for (int c = 0; c < ERROR_CHANNELS; c++)
+        {
+            int carried = current[x * ERROR_CHANNELS + c];
+            carried = carried >= 0 
+                    ? (carried + 8) >> ERROR_SHIFT 
+                    : -((-carried + 8) >> ERROR_SHIFT);
+            int base = c < 3 ? rgb[3*x + c] : (q->levels > 1 ? luma[x] : 0);
+            value[c] = clamp_byte(base + carried);
+        }
+
+        if (palette)
+        {
+            int index = nearest_index(q, value[0], value[1], value[2]);
+            colors[x] = TG_COLOR_INDEXED(index);
+            for (int c = 0; c < 3; c++)
+            {
+                error[c] = value[c] - q->palette[index][c];
+            }
+        }
+        if (q->levels > 1)
+        {
+            int level = (value[3] * (q->levels - 1) + 127) / 255;
+            levels[x] = (uint8_t)level;
+            error[3] = value[3] - (level * 255 + (q->levels - 1) / 2) 
+                                / (q->levels - 1);
+        }
+
+        // ---------------------------------- 02 ------------------------------
+        // Diffusion of the errors to the neighbouring pixels.
+        for (int c = palette ? 0 : 3; c < channels; c++)
+        {
+            if (atkinson)
+            {
+                spread_error(current, x + 1, c, error[c], 2);
+                spread_error(current, x + 2, c, error[c], 2);
+                spread_error(next, x - 1, c, error[c], 2);
+                spread_error(next, x, c, error[c], 2);
+                spread_error(next, x + 1, c, error[c], 2);
+                spread_error(after, x, c, error[c], 2);
+            }
+            else
+            {
+                spread_error(current, x + 1, c, error[c], 7);
+                spread_error(next, x - 1, c, error[c], 3);
+                spread_error(next, x, c, error[c], 5);
+                spread_error(next, x + 1, c, error[c], 1);
+            }
+        }
+    }
+
+    // The current row is done: it is cleared and recycled as the last one.
+    memset(current - ERROR_PADDING * ERROR_CHANNELS, 0,
+        ((size_t)q->width + 2 * ERROR_PADDING) * ERROR_CHANNELS 
+        * sizeof(int32_t));
+    q->error_rows[0] = next;
+    q->error_rows[1] = after;
+    q->error_rows[2] = current;
+}
+
+
+
+void tg_quantize_row(tg_quantizer *q, const uint8_t *rgb, int y,
+    uint8_t *luma, uint32_t *colors, uint8_t *levels)
+{
+    int serial = tg_quantizer_is_serial(q);
+    int palette = q->depth != TG_COLOR_DEPTH_TRUECOLOR;
+
+    if (q->levels > 0)
+    {
+        tg_luma_row(rgb, luma, (size_t)q->width);
+    }
+
+    // ---------------------------------- 01 ----------------------------------
+    // Colors. Without a palette, they are passed through as they are.
+    if (!palette)
+    {
+        for (int x = 0; x < q->width; x++)
+        {
+            colors[x] = TG_COLOR_DIRECT(TG_RGB(rgb[3*x], rgb[3*x+1], 
+                                               rgb[3*x+2]));
+        }
+    }
+    else if (!serial && q->dither == TG_DITHER_BAYER)
+    {
+        bayer_colors(q, rgb, y, colors);
+    }
+    else if (!serial)
+    {
+        for (int x = 0; x < q->width; x++)
+        {
+            colors[x] = TG_COLOR_INDEXED(nearest_index(q, rgb[3*x], 
+                rgb[3*x+1], rgb[3*x+2]));
+        }
+    }
+
+    // ---------------------------------- 02 ----------------------------------
+    // Glyph ramp levels. Undithered, the luma itself is the level, which the
+    // ramp 256-entry table turns into a glyph in a single lookup.
+    if (q->dithers_levels && !serial)
+    {
+        bayer_levels(q, luma, y, levels);
+    }
+    else if (q->levels > 0 && !q->dithers_levels)
+    {
+        memcpy(levels, luma, (size_t)q->width);
+    }
+
+    // ---------------------------------- 03 ----------------------------------
+    // Error diffusion does colors and levels together, in a single pass.
+    if (serial)
+    {
+        quantize_row_diffuse(q, rgb, luma, colors, levels);
+    }
+}
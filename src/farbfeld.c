@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+
+
+/**
+ * @brief Size of the farbfeld header: magic, width and height.
+ * 
+ */
+#define FARBFELD_HEADER_SIZE 16
+
+
+
+/**
+ * @brief State of a row source reading a farbfeld image.
+ * 
+ */
+typedef struct farbfeld_source_state
+{
+    tg_reader reader;
+    uint8_t *raw;   /**< A row of 16-bit RGBA samples, then 8-bit ones. */
+} farbfeld_source_state;
+
+
+
+/**
+ * @brief Reads the next row of a farbfeld image.
+ * 
+ * @note This function is private to tg_farbfeld_source_open, which uses it
+ *      as the `read_row` callback of its row source.
+ */
+static const uint8_t *farbfeld_read_row(tg_row_source *source, int y,
+    uint8_t *scratch)
+{
+    (void)y; // Rows are requested in order, so the reader position is enough.
+    farbfeld_source_state *state = (farbfeld_source_state*)source->ctx;
+    size_t samples = 4 * (size_t)source->width;
+
+    const uint8_t *raw = tg_reader_read(&state->reader, state->raw,
+        2 * samples);
+    if (!raw)
+    {
+        return NULL;
+    }
+
+    // Samples are 16-bit big-endian ones of full range, like the 65535
+    // maxval Netpbm ones, so they go through the same kernel.
+    tg_narrow_row(raw, state->raw, samples);
+    for (int x = 0; x < source->width; x++)
+    {
+        memcpy(scratch + 3*x, state->raw + 4*x, 3);
+    }
+    return scratch;
+}
+
+
+
+/**
+ * @brief Closes the source and the reader.
+ * 
+ * @note This function is private to tg_farbfeld_source_open, which uses it
+ *      as the `close` callback of its row source.
+ */
+static void farbfeld_close(tg_row_source *source)
+{
+    farbfeld_source_state *state = (farbfeld_source_state*)source->ctx;
+    if (!state)
+    {
+        return;
+    }
+
+    tg_reader_close(&state->reader);
+    free(state->raw);
+    free(state);
+    source->ctx = NULL;
+}
+
+
+
+int tg_farbfeld_source_open(tg_row_source *source, tg_reader *reader)
+{
+    farbfeld_source_state *state = (farbfeld_source_state*)calloc(1,
+        sizeof(farbfeld_source_state));
+    if (!state)
+    {
+        tg_reader_close(reader);
+        return 1;
+    }
+
+    state->reader = *reader;
+    source->width = 0;
+    source->height = 0;
+    source->read_row = farbfeld_read_row;
+    source->close = farbfeld_close;
+    source->ctx = state;
+
+    uint8_t buffer[FARBFELD_HEADER_SIZE];
+    const uint8_t *header = tg_reader_read(&state->reader, buffer,
+        FARBFELD_HEADER_SIZE);
+    if (!header || memcmp(header, "farbfeld", 8) != 0)
+    {
+        farbfeld_close(source);
+        return 1;
+    }
+
+    uint32_t width = tg_load_be32(header + 8);
+    uint32_t height = tg_load_be32(header + 12);
+    if (width == 0 || height == 0 || width > INT32_MAX / 8 ||
+        height > INT32_MAX)
+    {
+        farbfeld_close(source);
+        return 1;
+    }
+
+    state->raw = (uint8_t*)malloc(8 * (size_t)width);
+    if (!state->raw)
+    {
+        farbfeld_close(source);
+        return 1;
+    }
+
+    source->width = (int)width;
+    source->height = (int)height;
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/termglyph/image.h"
+#include "internal.h"
+
+
+
+size_t tg_pixel_format_size(tg_pixel_format format)
+{
+    switch (format)
+    {
+    case TG_PIXEL_FORMAT_RGBA8:
+        return 4;
+    case TG_PIXEL_FORMAT_GRAY8:
+        return 1;
+    case TG_PIXEL_FORMAT_RGB8:
+    default:
+        return 3;
+    }
+}
+
+
+
+void *tg_image_decode(tg_reader *reader, 
+    int (*open)(tg_row_source*, tg_reader*), size_t header_size)
+{
+    tg_row_source source;
+    if (open(&source, reader))
+    {
+        return NULL;
+    }
+
+    // The struct and the pixels share a single allocation, which is what
+    // tg_image_free expects.
+    size_t stride = 3 * (size_t)source.width;
+    char *block = (char*)malloc(
+        header_size + sizeof(tg_image) + stride * source.height);
+    if (block)
+    {
+        tg_image *image = (tg_image*)(block + header_size);
+        uint8_t *pixels = (uint8_t*)(image + 1);
+        image->width = source.width;
+        image->height = source.height;
+        image->stride = stride;
+        image->format = TG_PIXEL_FORMAT_RGB8;
+        image->pixels = pixels;
+
+        for (int y = 0; y < source.height; y++)
+        {
+            // The source reads straight into the image, so it's only a copy
+            // when the row comes back from somewhere else.
+            uint8_t *row = pixels + stride * y;
+            const uint8_t *read = source.read_row(&source, y, row);
+            if (!read)
+            {
+                free(block);
+                block = NULL;
+                break;
+            }
+            if (read != row)
+            {
+                memcpy(row, read, stride);
+            }
+        }
+    }
+
+    tg_row_source_close(&source);
+    return block;
+}
+
+
+
+/**
+ * @brief Decodes an image file into an RGB8 image.
+ * 
+ * @param path Path to the image file, or "-" for stdin.
+ * @param open The decoder opening the image as a row source.
+ * 
+ * @note This function is private to the image loaders.
+ */
+static tg_image *image_load(const char *path, 
+    int (*open)(tg_row_source*, tg_reader*))
+{
+    tg_reader reader;
+    if (tg_reader_open_path(&reader, path))
+    {
+        return NULL;
+    }
+    return (tg_image*)tg_image_decode(&reader, open, 0);
+}
+
+
+
+tg_image *tg_image_load(const char *path)
+{
+    return image_load(path, tg_decoder_source_open);
+}
+
+
+
+tg_image *tg_image_load_ppm(const char *path)
+{
+    return image_load(path, tg_pnm_source_open);
+}
+
+
+
+void tg_image_free(tg_image *image)
+{
+    free(image);
+}
+
+
+
+/**
+ * @brief Gets row `y` of an image as RGB pixels.
+ * 
+ * @note This function is private to tg_image_source_init, which uses it as
+ *      the `read_row` callback of its row source.
+ */
+static const uint8_t *image_read_row(tg_row_source *source, int y,
+    uint8_t *scratch)
+{
+    const tg_image *image = (const tg_image*)source->ctx;
+    const uint8_t *row = image->pixels + image->stride * y;
+
+    switch (image->format)
+    {
+    case TG_PIXEL_FORMAT_RGBA8:
+        for (int x = 0; x < image->width; x++)
+        {
+            scratch[3*x] = row[4*x];
+            scratch[3*x + 1] = row[4*x + 1];
+            scratch[3*x + 2] = row[4*x + 2];
+        }
+        return scratch;
+
+    case TG_PIXEL_FORMAT_GRAY8:
+        for (int x = 0; x < image->width; x++)
+        {
+            scratch[3*x] = scratch[3*x + 1] = scratch[3*x + 2] = row[x];
+        }
+        return scratch;
+
+    case TG_PIXEL_FORMAT_RGB8:
+    default:
+        return row;
+    }
+}
+
+
+
+void tg_image_source_init(tg_row_source *source, const tg_image *image)
+{
+    source->width = image->width;
+    source->height = image->height;
+    source->read_row = image_read_row;
+    source->close = NULL;
+    source->ctx = (void*)image;
+}
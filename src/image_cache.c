@@ -0,0 +1,469 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/termglyph/cache.h"
+#include "internal.h"
+
+
+
+/**
+ * @brief Number of buckets of a new cache. The table doubles whenever it
+ *      holds more entries than buckets.
+ * 
+ */
+#define CACHE_INITIAL_BUCKETS 64
+
+
+
+/**
+ * @brief A decoded image, and what it was decoded from.
+ * 
+ * The entry is the header of the allocation holding the image, so that the
+ * image handed out leads back to it.
+ * 
+ */
+typedef struct cache_entry
+{
+    struct cache_entry *next;   /**< The next entry of the same bucket. */
+    struct cache_entry *newer;  /**< The entry requested right after. */
+    struct cache_entry *older;  /**< The entry requested right before. */
+
+    char *path;                 /**< The path, NULL if not cached. */
+    uint64_t hash;              /**< The hash of `path`. */
+    dev_t device;
+    ino_t inode;
+    struct timespec mtime;
+    off_t size;
+
+    size_t bytes;               /**< Memory the entry takes. */
+
+    /**
+     * One reference per holder of the image, plus one while it is cached.
+     * Only updated atomically.
+     */
+    int refs;
+} cache_entry;
+
+
+
+struct tg_image_cache
+{
+    pthread_mutex_t mutex;      /**< Protects everything below. */
+
+    cache_entry **buckets;
+    size_t bucket_count;
+    cache_entry *newest;        /**< The head of the LRU list. */
+    cache_entry *oldest;        /**< The tail of the LRU list. */
+
+    size_t max_bytes;
+    tg_image_cache_stats stats;
+};
+
+
+
+/**
+ * @brief Hashes a path with FNV-1a.
+ * 
+ * @note This function is private to the image cache.
+ */
+static uint64_t cache_hash(const char *path)
+{
+    uint64_t hash = 14695981039346656037u;
+    for (const unsigned char *c = (const unsigned char*)path; *c; c++)
+    {
+        hash = (hash ^ *c) * 1099511628211u;
+    }
+    return hash;
+}
+
+
+
+/**
+ * @brief Gets the image of an entry.
+ * 
+ * @note This function is private to the image cache.
+ */
+static tg_image *entry_image(cache_entry *entry)
+{
+    return (tg_image*)(entry + 1);
+}
+
+
+
+/**
+ * @brief Drops a reference to an entry, freeing it with the last one.
+ * 
+ * @note This function is private to the image cache.
+ */
+static void entry_unref(cache_entry *entry)
+{
+    if (__atomic_sub_fetch(&entry->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        free(entry->path);
+        free(entry);
+    }
+}
+
+
+
+/**
+ * @brief Tells whether an entry was decoded from the file as it is now.
+ * 
+ * @note This function is private to the image cache.
+ */
+static int entry_is_fresh(const cache_entry *entry, const struct stat *st)
+{
+    return entry->device == st->st_dev && entry->inode == st->st_ino &&
+           entry->size == st->st_size &&
+           entry->mtime.tv_sec == st->st_mtim.tv_sec &&
+           entry->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+
+
+/**
+ * @brief Finds the cached entry of a path. Called with the mutex held.
+ * 
+ * @return The entry, or NULL if the path is not cached.
+ * 
+ * @note This function is private to the image cache.
+ */
+static cache_entry *cache_find(tg_image_cache *cache, const char *path,
+    uint64_t hash)
+{
+    cache_entry *entry = cache->buckets[hash % cache->bucket_count];
+    while (entry && (entry->hash != hash || strcmp(entry->path, path)))
+    {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+
+
+/**
+ * @brief Unlinks an entry from the LRU list. Called with the mutex held.
+ * 
+ * @note This function is private to the image cache.
+ */
+static void cache_unlink(tg_image_cache *cache, cache_entry *entry)
+{
+    if (entry->newer)
+    {
+        entry->newer->older = entry->older;
+    }
+    else
+    {
+        cache->newest = entry->older;
+    }
+
+    if (entry->older)
+    {
+        entry->older->newer = entry->newer;
+    }
+    else
+    {
+        cache->oldest = entry->newer;
+    }
+}
+
+
+
+/**
+ * @brief Links an entry at the head of the LRU list. Called with the mutex
+ *      held.
+ * 
+ * @note This function is private to the image cache.
+ */
+static void cache_link_newest(tg_image_cache *cache, cache_entry *entry)
+{
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest)
+    {
+        cache->newest->newer = entry;
+    }
+    else
+    {
+        cache->oldest = entry;
+    }
+    cache->newest = entry;
+}
+
+
+
+/**
+ * @brief Removes an entry from the cache, dropping the reference the cache
+ *      holds. Called with the mutex held.
+ * 
+ * @note This function is private to the image cache.
+ */
+static void cache_remove(tg_image_cache *cache, cache_entry *entry)
+{
+    cache_entry **link = &cache->buckets[entry->hash % cache->bucket_count];
+    while (*link != entry)
+    {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+
+    cache_unlink(cache, entry);
+    cache->stats.entries--;
+    cache->stats.bytes -= entry->bytes;
+    entry_unref(entry);
+}
+
+
+
+/**
+ * @brief Doubles the number of buckets. Called with the mutex held.
+ * 
+ * The table is left as it is if the allocation fails, which only makes the
+ * chains longer.
+ * 
+ * @note This function is private to the image cache.
+ */
+static void cache_grow(tg_image_cache *cache)
+{
+    size_t count = cache->bucket_count * 2;
+    cache_entry **buckets = (cache_entry**)calloc(count,
+        sizeof(cache_entry*));
+    if (!buckets)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < cache->bucket_count; i++)
+    {
+        cache_entry *entry = cache->buckets[i];
+        while (entry)
+        {
+            cache_entry *next = entry->next;
+            entry->next = buckets[entry->hash % count];
+            buckets[entry->hash % count] = entry;
+            entry = next;
+        }
+    }
+
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_count = count;
+}
+
+
+
+/**
+ * @brief Caches a freshly decoded entry, in place of any entry of the same
+ *      path, then evicts the least recently requested entries until the
+ *      cache fits its memory cap again. Called with the mutex held.
+ * 
+ * @note This function is private to the image cache.
+ */
+static void cache_insert(tg_image_cache *cache, cache_entry *entry)
+{
+    // Another thread may have decoded the same path meanwhile.
+    cache_entry *previous = cache_find(cache, entry->path, entry->hash);
+    if (previous)
+    {
+        cache_remove(cache, previous);
+    }
+
+    __atomic_add_fetch(&entry->refs, 1, __ATOMIC_RELAXED);
+    cache_entry **bucket = &cache->buckets[entry->hash % cache->bucket_count];
+    entry->next = *bucket;
+    *bucket = entry;
+    cache_link_newest(cache, entry);
+    cache->stats.entries++;
+    cache->stats.bytes += entry->bytes;
+
+    while (cache->stats.bytes > cache->max_bytes)
+    {
+        cache_remove(cache, cache->oldest);
+        cache->stats.evictions++;
+    }
+
+    if (cache->stats.entries > cache->bucket_count)
+    {
+        cache_grow(cache);
+    }
+}
+
+
+
+tg_image_cache *tg_image_cache_create(size_t max_bytes)
+{
+    tg_image_cache *cache = (tg_image_cache*)calloc(1,
+        sizeof(tg_image_cache));
+    if (!cache)
+    {
+        return NULL;
+    }
+
+    cache->buckets = (cache_entry**)calloc(CACHE_INITIAL_BUCKETS,
+        sizeof(cache_entry*));
+    if (!cache->buckets || pthread_mutex_init(&cache->mutex, NULL))
+    {
+        free(cache->buckets);
+        free(cache);
+        return NULL;
+    }
+
+    cache->bucket_count = CACHE_INITIAL_BUCKETS;
+    cache->max_bytes = max_bytes;
+    return cache;
+}
+
+
+
+void tg_image_cache_free(tg_image_cache *cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+
+    tg_image_cache_clear(cache);
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache->buckets);
+    free(cache);
+}
+
+
+
+const tg_image *tg_image_cache_get(tg_image_cache *cache, const char *path)
+{
+    // ---------------------------------- 01 ----------------------------------
+    // Lookup. The file is opened first, so that the image decoded on a miss
+    // is the one the key describes, even if the file is replaced meanwhile.
+    int is_stdin = strcmp(path, "-") == 0;
+    int fd = is_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st))
+    {
+        if (fd >= 0 && !is_stdin)
+        {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    uint64_t hash = cache_hash(path);
+    pthread_mutex_lock(&cache->mutex);
+    cache_entry *entry = is_stdin ? NULL : cache_find(cache, path, hash);
+    if (entry && entry_is_fresh(entry, &st))
+    {
+        __atomic_add_fetch(&entry->refs, 1, __ATOMIC_RELAXED);
+        cache_unlink(cache, entry);
+        cache_link_newest(cache, entry);
+        cache->stats.hits++;
+        pthread_mutex_unlock(&cache->mutex);
+        close(fd);
+        return entry_image(entry);
+    }
+    if (entry)
+    {
+        cache_remove(cache, entry);
+        cache->stats.invalidations++;
+    }
+    cache->stats.misses++;
+    pthread_mutex_unlock(&cache->mutex);
+
+    // ---------------------------------- 02 ----------------------------------
+    // Decoding, without holding the mutex, so that requests for other images
+    // are still served meanwhile.
+    tg_reader reader;
+    entry = NULL;
+    if (!tg_reader_open_fd(&reader, fd))
+    {
+        entry = (cache_entry*)tg_image_decode(&reader,
+            tg_decoder_source_open, sizeof(cache_entry));
+    }
+    if (!is_stdin)
+    {
+        close(fd);
+    }
+    if (!entry)
+    {
+        return NULL;
+    }
+
+    tg_image *image = entry_image(entry);
+    memset(entry, 0, sizeof(cache_entry));
+    entry->refs = 1;
+    entry->bytes = sizeof(cache_entry) + sizeof(tg_image)
+                 + image->stride * image->height + strlen(path) + 1;
+    if (is_stdin || entry->bytes > cache->max_bytes)
+    {
+        return image;
+    }
+
+    // ---------------------------------- 03 ----------------------------------
+    // Insertion. An entry which cannot be cached is still handed out.
+    entry->path = strdup(path);
+    if (!entry->path)
+    {
+        return image;
+    }
+    entry->hash = hash;
+    entry->device = st.st_dev;
+    entry->inode = st.st_ino;
+    entry->mtime = st.st_mtim;
+    entry->size = st.st_size;
+
+    pthread_mutex_lock(&cache->mutex);
+    cache_insert(cache, entry);
+    pthread_mutex_unlock(&cache->mutex);
+    return image;
+}
+
+
+
+void tg_image_cache_release(const tg_image *image)
+{
+    if (image)
+    {
+        entry_unref((cache_entry*)image - 1);
+    }
+}
+
+
+
+void tg_image_cache_clear(tg_image_cache *cache)
+{
+    pthread_mutex_lock(&cache->mutex);
+    while (cache->oldest)
+    {
+        cache_remove(cache, cache->oldest);
+    }
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+
+void tg_image_cache_stats_get(tg_image_cache *cache,
+    tg_image_cache_stats *stats)
+{
+    pthread_mutex_lock(&cache->mutex);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+
+int tg_printimage_cached(tg_image_cache *cache, const char *path,
+    const tg_render_opts *opts)
+{
+    const tg_image *image = tg_image_cache_get(cache, path);
+    if (!image)
+    {
+        return 1;
+    }
+
+    int result = tg_render(image, opts, NULL);
+    tg_image_cache_release(image);
+    return result;
+}
@@ -0,0 +1,284 @@
+#include <stdlib.h>
+
+#include "../include/termglyph/integral.h"
+#include "../include/termglyph/print.h"
+#include "internal.h"
+
+
+
+/**
+ * @brief Largest number of pixels whose channel sum is sure to fit in 32
+ *      bits.
+ * 
+ * Sums are stored on 32 bits and wrap around on large images. The sum of a
+ * rectangle is still exact as long as it fits in 32 bits, since the
+ * differences are computed modulo 2^32 too; larger rectangles are split into
+ * strips that fit.
+ * 
+ */
+#define INTEGRAL_MAX_AREA (UINT32_MAX / 255)
+
+
+
+struct tg_integral_image
+{
+    int width;
+    int height;
+    size_t row_length;  /**< Number of sums in a row, 3 * (width + 1). */
+
+    /**
+     * The (height + 1) rows of sums. Row 0 and the first pixel of each row
+     * are all zeros, so that rectangles touching the image edges need no
+     * special case.
+     */
+    uint32_t *sums;
+};
+
+
+
+/**
+ * @brief Allocates an integral image and clears its first row.
+ * 
+ * @note This function is private to the integral image.
+ */
+static tg_integral_image *integral_alloc(int width, int height)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return NULL;
+    }
+
+    tg_integral_image *integral = (tg_integral_image*)malloc(
+        sizeof(tg_integral_image));
+    if (!integral)
+    {
+        return NULL;
+    }
+
+    integral->width = width;
+    integral->height = height;
+    integral->row_length = 3 * ((size_t)width + 1);
+    integral->sums = (uint32_t*)malloc(
+        integral->row_length * ((size_t)height + 1) * sizeof(uint32_t));
+    if (!integral->sums)
+    {
+        free(integral);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < integral->row_length; i++)
+    {
+        integral->sums[i] = 0;
+    }
+    return integral;
+}
+
+
+
+/**
+ * @brief Computes the row of sums below pixel row `y`.
+ * 
+ * @note This function is private to the integral image.
+ */
+static void integral_add_row(tg_integral_image *integral, int y,
+    const uint8_t *row)
+{
+    const uint32_t *above = integral->sums + integral->row_length * y;
+    uint32_t *sums = integral->sums + integral->row_length * (y + 1);
+
+    // Each sum is the one above plus the running sum of the row so far.
+    uint32_t run[3] = { 0, 0, 0 };
+    sums[0] = sums[1] = sums[2] = 0;
+    for (int x = 0; x < integral->width; x++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            run[c] += row[3*x + c];
+            sums[3*(x+1) + c] = above[3*(x+1) + c] + run[c];
+        }
+    }
+}
+
+
+
+tg_integral_image *tg_integral_image_create(const uint8_t *pixels, int width,
+    int height, size_t stride)
+{
+    tg_integral_image *integral = integral_alloc(width, height);
+    if (!integral)
+    {
+        return NULL;
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        integral_add_row(integral, y, pixels + stride * y);
+    }
+    return integral;
+}
+
+
+
+tg_integral_image *tg_integral_image_load_ppm(const char *path)
+{
+    tg_reader reader;
+    tg_row_source source;
+    if (tg_reader_open_path(&reader, path) || 
+        tg_pnm_source_open(&source, &reader))
+    {
+        return NULL;
+    }
+
+    tg_integral_image *integral = integral_alloc(source.width, source.height);
+    uint8_t *scratch = (uint8_t*)malloc(3 * (size_t)source.width);
+
+    for (int y = 0; integral && scratch && y < source.height; y++)
+    {
+        const uint8_t *row = source.read_row(&source, y, scratch);
+        if (!row)
+        {
+            tg_integral_image_free(integral);
+            integral = NULL;
+            break;
+        }
+        integral_add_row(integral, y, row);
+    }
+
+    if (!scratch)
+    {
+        tg_integral_image_free(integral);
+        integral = NULL;
+    }
+
+    free(scratch);
+    tg_row_source_close(&source);
+    return integral;
+}
+
+
+
+void tg_integral_image_free(tg_integral_image *integral)
+{
+    if (!integral)
+    {
+        return;
+    }
+    free(integral->sums);
+    free(integral);
+}
+
+
+
+void tg_integral_image_size(const tg_integral_image *integral, int *width,
+    int *height)
+{
+    *width = integral->width;
+    *height = integral->height;
+}
+
+
+
+void tg_integral_image_average(const tg_integral_image *integral, int x, 
+    int y, int width, int height, uint8_t rgb[3])
+{
+    // Rectangles too large for their sum to fit in 32 bits are summed up in
+    // strips of rows that do.
+    int strip = (int)(INTEGRAL_MAX_AREA / (uint32_t)width);
+    strip = strip < 1 ? 1 : strip;
+
+    uint64_t sum[3] = { 0, 0, 0 };
+    for (int y0 = y; y0 < y + height; y0 += strip)
+    {
+        int y1 = y0 + strip < y + height ? y0 + strip : y + height;
+        const uint32_t *top = integral->sums + integral->row_length * y0;
+        const uint32_t *bottom = integral->sums + integral->row_length * y1;
+
+        for (int c = 0; c < 3; c++)
+        {
+            sum[c] += (uint32_t)(bottom[3*(x + width) + c] - bottom[3*x + c]
+                               - top[3*(x + width) + c] + top[3*x + c]);
+        }
+    }
+
+    uint64_t area = (uint64_t)width * height;
+    for (int c = 0; c < 3; c++)
+    {
+        rgb[c] = (uint8_t)((sum[c] + area / 2) / area);
+    }
+}
+
+
+
+/**
+ * @brief State of a row source reading averages off an integral image.
+ * 
+ */
+typedef struct integral_source_state
+{
+    const tg_integral_image *integral;
+    int *column_start;  /**< Box edges along x, as `tg_box_edges` lays out. */
+    int *row_start;     /**< Box edges along y. */
+} integral_source_state;
+
+
+
+/**
+ * @brief Computes an output row, four lookups per cell and channel.
+ * 
+ * @note This function is private to tg_printintegral, which uses it as the
+ *      `read_row` callback of its row source.
+ */
+static const uint8_t *integral_read_row(tg_row_source *source, int y,
+    uint8_t *scratch)
+{
+    integral_source_state *state = (integral_source_state*)source->ctx;
+    int y0 = state->row_start[y];
+    int y1 = state->row_start[y + 1];
+
+    for (int x = 0; x < source->width; x++)
+    {
+        int x0 = state->column_start[x];
+        int x1 = state->column_start[x + 1];
+        tg_integral_image_average(state->integral, x0, y0, x1 - x0, y1 - y0,
+            scratch + 3*x);
+    }
+    return scratch;
+}
+
+
+
+int tg_printintegral(const tg_integral_image *integral,
+    const tg_render_opts *opts)
+{
+    // The boxes are laid out exactly like the resampler does, so the output
+    // is the same as rendering the original image with the same options.
+    tg_rect region;
+    if (tg_render_region(integral->width, integral->height, opts, &region))
+    {
+        return 1;
+    }
+
+    int columns = 0;
+    int rows = 0;
+    tg_fit_size(region.width, region.height, opts, &columns, &rows);
+
+    integral_source_state state;
+    state.integral = integral;
+    state.column_start = (int*)malloc(((size_t)columns + 1) * sizeof(int));
+    state.row_start = (int*)malloc(((size_t)rows + 1) * sizeof(int));
+
+    int result = 1;
+    if (state.column_start && state.row_start)
+    {
+        tg_box_edges(state.column_start, region.x, region.width, columns);
+        tg_box_edges(state.row_start, region.y, region.height, rows);
+
+        tg_row_source source = { columns, rows, integral_read_row, NULL,
+                                 &state };
+        result = tg_encode_source(&source, opts, NULL, NULL);
+    }
+
+    free(state.row_start);
+    free(state.column_start);
+    return result;
+}
@@ -0,0 +1,1157 @@
+/*************************************************************************//**
+ * 
+ * @file internal.h
+ * 
+ * @brief Declarations shared between the library translation units. Nothing
+ *      in here is part of the public interface.
+ * 
+ *****************************************************************************/
+#ifndef TERMGLYPH_INTERNAL_H
+#define TERMGLYPH_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../include/termglyph/canvas.h"
+#include "../include/termglyph/render.h"
+#include "../include/termglyph/text_attributes.h"
+
+
+
+/**
+ * @brief Defined to 1 when the x86 SIMD kernels are compiled in.
+ * 
+ * They need the GCC/Clang `target` attribute, so that the rest of the library
+ * can still be built for the baseline instruction set.
+ * 
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TG_X86_KERNELS 1
+#else
+#define TG_X86_KERNELS 0
+#endif
+
+
+
+/**
+ * @brief Signature shared by all the luma kernels.
+ * 
+ * @param rgb Packed RGB pixels, 3 bytes per pixel.
+ * @param luma The buffer to store one luma byte per pixel in.
+ * @param count The number of pixels to convert.
+ * 
+ */
+typedef void (*tg_luma_row_fn)(const uint8_t *rgb, uint8_t *luma,
+    size_t count);
+
+
+
+/**
+ * @brief Computes the Rec.709 luma of a run of pixels, using the fastest
+ *      kernel the running CPU supports.
+ * 
+ * Luma is defined as floor((2126*R + 7152*G + 722*B) / 10000), computed in
+ * integer arithmetic. Every kernel gives exactly the same result.
+ * 
+ */
+void tg_luma_row(const uint8_t *rgb, uint8_t *luma, size_t count);
+
+
+
+/**
+ * @name Luma kernels.
+ *
+ * @brief The individual implementations behind `tg_luma_row`. They are only
+ *      exposed for benchmarking and checking them against each other. The
+ *      x86 ones must only be called when the CPU supports them.
+ *
+ * @{
+ */
+void tg_luma_row_scalar(const uint8_t *rgb, uint8_t *luma, size_t count);
+#if TG_X86_KERNELS
+void tg_luma_row_sse2(const uint8_t *rgb, uint8_t *luma, size_t count);
+void tg_luma_row_avx2(const uint8_t *rgb, uint8_t *luma, size_t count);
+#endif
+/** @} */
+
+
+
+/**
+ * @brief Tells whether the running CPU supports the given kernel family.
+ * 
+ * @param feature Either "sse2" or "avx2".
+ * 
+ * @return Non-zero if supported, 0 otherwise.
+ * 
+ */
+int tg_cpu_supports(const char *feature);
+
+
+
+/**
+ * @brief Converts a 24-bit RGB color value into a `tg_direct_color_sequence`.
+ * 
+ * @param direct_color_sequence A `tg_direct_color_sequence` to store the
+ *      conversion result.
+ * @param rgb_value The 24-bit RGB value of the color to convert.
+ * @param terminal_layer The terminal layer of the color to convert.
+ * 
+ */
+void tg_to_direct_color_sequence(
+    tg_direct_color_sequence direct_color_sequence, 
+    const unsigned int rgb_value, 
+    const tg_terminal_layer terminal_layer);
+
+
+
+/**
+ * @brief Kinds of attribute changes an extended format specifier makes.
+ * 
+ */
+typedef enum tg_format_op_kind
+{
+    TG_FORMAT_DIRECT_COLOR,     /**< `#df` and `#db`, taking an int. */
+    TG_FORMAT_INDEXED_COLOR,    /**< `#if` and `#ib`, taking a string. */
+    TG_FORMAT_STYLE,            /**< Enables styles. */
+    TG_FORMAT_RESET             /**< Disables styles, resets colors. */
+} tg_format_op_kind;
+
+
+
+/**
+ * @brief An attribute change of a compiled format.
+ * 
+ */
+typedef struct tg_format_op
+{
+    tg_format_op_kind kind;
+    tg_terminal_layer layer;    /**< The layer a color applies to. */
+    uint16_t styles;            /**< The style bits enabled or disabled. */
+
+    /** The colors reset: 1 for the foreground, 2 for the background. */
+    int colors;
+
+    /** Where the escape sequence of a color goes in `sequences`. */
+    size_t offset;
+
+    /** Where the specifier was in `plain`. */
+    size_t position;
+} tg_format_op;
+
+
+
+/**
+ * @brief A format string of the tg_printf family with its extended
+ *      specifiers resolved, so that it is parsed once however many times it
+ *      is printed.
+ * 
+ */
+typedef struct tg_format
+{
+    const char *key;    /**< The format string compiled, as passed. */
+    char *source;       /**< A copy of the format string. */
+
+    /**
+     * The format for printf, with the escape sequences of the specifiers in
+     * place and a reset at the end. Those of colors are placeholders, of the
+     * right length, to overwrite with the sequences of the arguments.
+     */
+    char *sequences;
+    size_t sequences_length;
+
+    /** The bytes of escape sequences in `sequences`. */
+    size_t escape_length;
+
+    /**
+     * The format for printf, without the specifiers. The text a prefix of it
+     * formats to tells where the attribute changes go in the whole text.
+     */
+    char *plain;
+
+    tg_format_op *ops;  /**< The attribute changes, in order. */
+    int op_count;
+} tg_format;
+
+
+
+/**
+ * @brief Gets the compiled form of a format string, from a per thread cache
+ *      of the recently used ones.
+ * 
+ * The cache is looked up by the address of the format string and checked
+ * against its content, so both literals and buffers rewritten between
+ * calls are fine.
+ * 
+ * @return The compiled format, valid until the next call from the same
+ *      thread, or NULL on failure.
+ * 
+ */
+const tg_format *tg_format_get(const char *format);
+
+
+
+/**
+ * @name Cell colors.
+ *
+ * @brief Colors of cells are stored on 32 bits: the top byte tells the kind
+ *      of color and the rest holds its value, either a 24-bit RGB value or a
+ *      palette index.
+ *
+ * @{
+ */
+#define TG_COLOR_DEFAULT        0x00000000u
+#define TG_COLOR_INDEXED_FLAG   0x01000000u
+#define TG_COLOR_DIRECT_FLAG    0x02000000u
+
+#define TG_COLOR_INDEXED(i)     (TG_COLOR_INDEXED_FLAG | (uint32_t)(uint8_t)(i))
+#define TG_COLOR_DIRECT(rgb)    (TG_COLOR_DIRECT_FLAG | ((uint32_t)(rgb) \
+                                                         & 0xffffffu))
+/** @} */
+
+
+
+/**
+ * @brief Encodes a cell color as an escape sequence, in the shortest form
+ *      the kind of color allows.
+ * 
+ * @param out The buffer to write into, at least
+ *      `TG_DIRECT_COLOR_SEQUENCE_LENGTH - 1` bytes long.
+ * @param color The color.
+ * @param terminal_layer The terminal layer to apply the color to.
+ * 
+ * @return The number of bytes written.
+ * 
+ */
+size_t tg_encode_color(char *out, uint32_t color,
+    tg_terminal_layer terminal_layer);
+
+
+
+/**
+ * @brief Upper bound of the bytes a glyph takes in UTF-8.
+ * 
+ */
+#define TG_GLYPH_MAX_LENGTH 4
+
+
+
+/**
+ * @brief A glyph, stored as its UTF-8 bytes.
+ * 
+ */
+typedef struct tg_glyph
+{
+    char bytes[TG_GLYPH_MAX_LENGTH];
+    uint8_t length;
+} tg_glyph;
+
+
+
+/**
+ * @brief Tells how many columns a terminal advances by when printing a code
+ *      point.
+ * 
+ * @return 0 for combining marks and other zero-width code points, 2 for
+ *      wide ones such as CJK ideographs and most emoji, 1 for the others, and
+ *      -1 for control characters, surrogates and values past U+10FFFF.
+ * 
+ */
+int tg_codepoint_width(uint32_t codepoint);
+
+
+
+struct tg_ramp
+{
+    int levels;                 /**< Number of glyphs. */
+    tg_glyph by_level[256];     /**< The glyphs, from darkest to lightest. */
+    tg_glyph by_luma[256];      /**< The glyph of each luma, undithered. */
+};
+
+
+
+/**
+ * @brief A cell as the terminal shows it.
+ * 
+ */
+typedef struct tg_cell
+{
+    /** The foreground color, `TG_COLOR_DEFAULT` if the glyph is blank. */
+    uint32_t fg;
+    uint32_t bg;        /**< The background color. */
+    tg_glyph glyph;     /**< The glyph. */
+} tg_cell;
+
+
+
+struct tg_delta
+{
+    int threshold;      /**< The perceptual change threshold. */
+    int columns;        /**< Columns of the last frame, 0 if none. */
+    int rows;           /**< Rows of the last frame, 0 if none. */
+    tg_cell *cells;     /**< The cells of the last frame, row by row. */
+    size_t capacity;    /**< Cells allocated in `cells`. */
+};
+
+
+
+/**
+ * @brief Number of columns each bit of the dirty span bitmaps of a canvas
+ *      covers.
+ * 
+ */
+#define TG_CANVAS_SPAN_COLUMNS 8
+
+
+
+struct tg_canvas
+{
+    int columns;
+    int rows;
+
+    /**
+     * @name Cell attributes.
+     *
+     * @brief One array per attribute, `columns * rows` long, row by row.
+     *
+     * @{
+     */
+    uint32_t *codepoints;
+    uint32_t *fg;
+    uint32_t *bg;
+    uint16_t *styles;
+    /** @} */
+
+    /**
+     * @name Front buffer.
+     *
+     * @brief The cells the terminal shows as of the last present, laid out
+     *      like the cell attributes. Only meaningful if `front_valid`.
+     *
+     * @{
+     */
+    uint32_t *front_codepoints;
+    uint32_t *front_fg;
+    uint32_t *front_bg;
+    uint16_t *front_styles;
+    /** @} */
+
+    /** Whether the front buffer matches the screen. */
+    int front_valid;
+
+    /** One bit per row holding dirty spans, 64 rows per word. */
+    uint64_t *dirty_rows;
+
+    /**
+     * One bit per span of `TG_CANVAS_SPAN_COLUMNS` columns holding dirty
+     * cells, `span_words` words per row.
+     */
+    uint64_t *dirty_spans;
+    size_t span_words;
+
+    /** Whether the screen is cleared before the next present. */
+    int clear_screen;
+
+    /** Whether presents are wrapped in synchronized update sequences. */
+    int synchronized;
+
+    /** Whether presents scroll the terminal to follow shifted rows. */
+    int scrolling;
+
+    /**
+     * The hashes of the rows of the canvas, then of the front buffer, `rows`
+     * each, filled by the scroll detection.
+     */
+    uint64_t *row_hashes;
+
+    tg_canvas_stats stats;
+
+    char *out;              /**< The output buffer, kept between presents. */
+    size_t out_capacity;
+};
+
+
+
+/**
+ * @brief Writes a row of cells into a canvas from `(x, y)` on, clipped to
+ *      the canvas, and marks the cells that changed as dirty.
+ * 
+ * Unlike the other canvas functions, it can be called from several threads
+ * at once, as long as they write disjoint cells: the dirty marks are set
+ * atomically.
+ * 
+ */
+void tg_canvas_store_row(tg_canvas *canvas, int x, int y,
+    const tg_canvas_cell *cells, int count);
+
+
+
+/**
+ * @brief A sequence of RGB pixel rows the renderer pulls from.
+ * 
+ * Rows are always requested in increasing order and from a single thread,
+ * so a source can be backed by a stream as well as by pixels in memory.
+ * 
+ */
+typedef struct tg_row_source
+{
+    int width;  /**< Width of the image in pixels. */
+    int height; /**< Height of the image in pixels. */
+
+    /**
+     * Returns a pointer to row `y`, 3 bytes per pixel. The row can either be
+     * read into `scratch`, which is 3 * `width` bytes long, or live anywhere
+     * else, as long as it stays valid until the renderer is done with it.
+     * Returns NULL on failure.
+     */
+    const uint8_t *(*read_row)(struct tg_row_source *source, int y,
+        uint8_t *scratch);
+
+    /**
+     * Releases what the source holds, for the sources opened by decoders.
+     * NULL for the others, which have their own cleanup functions if any.
+     */
+    void (*close)(struct tg_row_source *source);
+
+    void *ctx; /**< Source specific data. */
+} tg_row_source;
+
+
+
+/**
+ * @brief Closes a source opened by a decoder.
+ * 
+ */
+void tg_row_source_close(tg_row_source *source);
+
+
+
+/**
+ * @brief A rectangle of pixels.
+ * 
+ */
+typedef struct tg_rect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+} tg_rect;
+
+
+
+/**
+ * @brief Computes the region of an image selected by the crop options,
+ *      clamped to the image.
+ * 
+ * @param width The image width in pixels.
+ * @param height The image height in pixels.
+ * @param opts The render options, possibly NULL.
+ * @param region A pointer to store the region in.
+ * 
+ * @return 0 on success, non-zero value if the region is empty.
+ * 
+ */
+int tg_render_region(int width, int height, const tg_render_opts *opts,
+    tg_rect *region);
+
+
+
+/**
+ * @brief Gets the number of pixel rows a cell row holds in a render mode.
+ * 
+ */
+int tg_cell_pixel_rows(tg_render_mode mode);
+
+
+
+/**
+ * @brief Computes the size in pixels a region is rendered at, according to
+ *      the fitting options.
+ * 
+ * @param width The region width in pixels.
+ * @param height The region height in pixels.
+ * @param opts The render options, possibly NULL.
+ * @param width_out A pointer to int to store the output width in.
+ * @param height_out A pointer to int to store the output height in.
+ * 
+ */
+void tg_fit_size(int width, int height, const tg_render_opts *opts,
+    int *width_out, int *height_out);
+
+
+
+/**
+ * @brief Converts the rows of a source into glyphs and writes them to a
+ *      sink, cropping and fitting it first as the options require.
+ * 
+ * @param source The row source.
+ * @param opts The render options, or NULL to use the default ones.
+ * @param delta The previous frame to draw over, as `tg_render_delta` does,
+ *      or NULL to draw the whole image at the cursor.
+ * @param sink The sink, or NULL for stdout.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ */
+int tg_render_source(tg_row_source *source, const tg_render_opts *opts,
+    tg_delta *delta, tg_sink *sink);
+
+
+
+/**
+ * @brief Converts the rows of a source into glyphs and writes them to a
+ *      sink, one cell per pixel. The crop and fit options are ignored.
+ * 
+ * @param source The row source, already at the output size.
+ * @param opts The render options, or NULL to use the default ones.
+ * @param delta The previous frame to draw over, or NULL.
+ * @param sink The sink, or NULL for stdout.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ */
+int tg_encode_source(tg_row_source *source, const tg_render_opts *opts,
+    tg_delta *delta, tg_sink *sink);
+
+
+
+/**
+ * @brief Where the renderer stores cells into a canvas: the canvas, and the
+ *      position of the top left cell of the image in it.
+ * 
+ */
+typedef struct tg_cell_target
+{
+    tg_canvas *canvas;
+    int x;
+    int y;
+} tg_cell_target;
+
+
+
+/**
+ * @brief Converts the rows of a source into cells and stores them into a
+ *      canvas, cropping and fitting it first as the options require. Cells
+ *      falling outside the canvas are left out.
+ * 
+ * Bands of rows are stored from several threads at once if the options ask
+ * for it, through `tg_canvas_store_row`.
+ * 
+ * @param source The row source.
+ * @param opts The render options, or NULL to use the default ones.
+ * @param target The canvas and the position in it.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ */
+int tg_render_source_cells(tg_row_source *source, const tg_render_opts *opts,
+    const tg_cell_target *target);
+
+
+
+/**
+ * @brief Size of the buffer a reader streaming a file reads it in.
+ * 
+ */
+#define TG_READER_BUFFER_SIZE 65536
+
+
+
+/**
+ * @brief The bytes of an encoded image, read by the decoders.
+ * 
+ * Regular files and memory are read in place: the whole input is `buffer`,
+ * so the pixel data is never copied. Pipes and stdio streams are read
+ * through `buffer` in blocks, which may read the stream past the end of the
+ * image.
+ * 
+ */
+typedef struct tg_reader
+{
+    const uint8_t *buffer;  /**< The input bytes, or a block of them. */
+    size_t pos;             /**< Position of the next byte in `buffer`. */
+    size_t len;             /**< Number of valid bytes in `buffer`. */
+
+    FILE *f;                /**< The stream, NULL when reading in place. */
+    int owns_file;          /**< Whether `f` is closed with the reader. */
+    uint8_t *storage;       /**< The memory behind `buffer` for streams. */
+
+    void *mapping;          /**< The file mapping, if any. */
+    size_t mapping_size;
+
+    /**
+     * A descriptor given by the caller and read in place, which is moved
+     * past the bytes read when the reader is closed, or -1.
+     */
+    int fd;
+    size_t fd_start;        /**< Offset of `buffer` in the file. */
+} tg_reader;
+
+
+
+/**
+ * @name Reader opening functions.
+ * 
+ * @brief Open a reader on a path ("-" being stdin), a memory block, a stdio
+ *      stream or a file descriptor. Streams and descriptors are left open
+ *      when the reader is closed. They return 0 on success, non-zero value
+ *      otherwise.
+ * 
+ * @{
+ */
+int tg_reader_open_path(tg_reader *reader, const char *path);
+int tg_reader_open_memory(tg_reader *reader, const void *data, 
+    size_t length);
+int tg_reader_open_file(tg_reader *reader, FILE *file);
+int tg_reader_open_fd(tg_reader *reader, int fd);
+/** @} */
+
+
+
+/**
+ * @brief Closes a reader.
+ * 
+ */
+void tg_reader_close(tg_reader *reader);
+
+
+
+/**
+ * @brief Refills the buffer of a reader streaming a file.
+ * 
+ * @return 0 if bytes are available, non-zero value at the end of the input.
+ * 
+ */
+int tg_reader_fill(tg_reader *reader);
+
+
+
+/**
+ * @brief Gets the next byte of a reader.
+ * 
+ * @return The byte, or EOF at the end of the input or on read errors.
+ * 
+ */
+static inline int tg_reader_getc(tg_reader *reader)
+{
+    if (reader->pos == reader->len && tg_reader_fill(reader))
+    {
+        return EOF;
+    }
+    return reader->buffer[reader->pos++];
+}
+
+
+
+/**
+ * @brief Puts back the last byte `tg_reader_getc` returned.
+ * 
+ */
+static inline void tg_reader_ungetc(tg_reader *reader)
+{
+    reader->pos--;
+}
+
+
+
+/**
+ * @brief Gets the next `length` bytes of a reader without consuming them,
+ *      to tell the format of an image from its first bytes.
+ * 
+ * @return The bytes, valid until the next read, or NULL if the input is
+ *      shorter or `length` is larger than `TG_READER_BUFFER_SIZE`.
+ * 
+ */
+const uint8_t *tg_reader_peek(tg_reader *reader, size_t length);
+
+
+
+/**
+ * @brief Skips the next `length` bytes of a reader.
+ * 
+ * @return 0 on success, non-zero value if the input is too short.
+ * 
+ */
+int tg_reader_skip(tg_reader *reader, size_t length);
+
+
+
+/**
+ * @brief Reads the next `length` bytes of a reader.
+ * 
+ * @param reader The reader.
+ * @param out Where to copy the bytes if they can't be handed out in place.
+ * @param length The number of bytes.
+ * 
+ * @return The bytes, either in the reader buffer, and valid as long as the
+ *      reader is open, or in `out`. NULL if the input is too short.
+ * 
+ */
+const uint8_t *tg_reader_read(tg_reader *reader, uint8_t *out, 
+    size_t length);
+
+
+
+/**
+ * @brief Reads the next `length` bytes of a reader into memory that grows as
+ *      they arrive, for sizes taken from a header that may lie.
+ * 
+ * @return The bytes, freed with `free`, or NULL if the input is too short
+ *      or the memory runs out.
+ * 
+ */
+uint8_t *tg_reader_read_alloc(tg_reader *reader, size_t length);
+
+
+
+/**
+ * @name Decoders.
+ * 
+ * @brief Open an image as a row source streaming its pixels in RGB, and
+ *      closed with `tg_row_source_close`. The source takes the reader over,
+ *      and closes it when closed or if opening fails. They return 0 on
+ *      success, non-zero value otherwise.
+ * 
+ * `tg_decoder_source_open` tells the format from the first bytes of the
+ * image; the others expect their own format.
+ * 
+ * @{
+ */
+int tg_decoder_source_open(tg_row_source *source, tg_reader *reader);
+int tg_pnm_source_open(tg_row_source *source, tg_reader *reader);
+int tg_qoi_source_open(tg_row_source *source, tg_reader *reader);
+int tg_bmp_source_open(tg_row_source *source, tg_reader *reader);
+int tg_tga_source_open(tg_row_source *source, tg_reader *reader);
+int tg_farbfeld_source_open(tg_row_source *source, tg_reader *reader);
+/** @} */
+
+
+
+/**
+ * @brief A stream of video frames, handed out one at a time as row sources.
+ * 
+ */
+typedef struct tg_frame_source
+{
+    int width;      /**< The width of the frames, 0 if they may vary. */
+    int height;     /**< The height of the frames, 0 if they may vary. */
+    double fps;     /**< The frame rate of the stream, 0 if unknown. */
+
+    /**
+     * Reads the next frame, and makes `frame` a row source over it, valid
+     * until the next call. Rows are requested in order, and a frame may be
+     * left partly read, or not read at all. Returns 0 on success, 1 at the
+     * end of the stream and -1 on failure.
+     */
+    int (*next_frame)(struct tg_frame_source *frames, tg_row_source *frame);
+
+    /** Frees the source, and closes its reader. */
+    void (*close)(struct tg_frame_source *frames);
+
+    void *ctx;      /**< Source specific data. */
+} tg_frame_source;
+
+
+
+/**
+ * @name Frame decoders.
+ * 
+ * @brief Open a video stream as a frame source, closed with its `close`
+ *      callback. Like the image decoders, the source takes the reader over,
+ *      and closes it if opening fails. They return 0 on success, non-zero
+ *      value otherwise.
+ * 
+ * `tg_frame_source_open` tells the format from the first bytes of the
+ * stream; the others expect their own format.
+ * 
+ * @{
+ */
+int tg_frame_source_open(tg_frame_source *frames, tg_reader *reader);
+int tg_y4m_frame_source_open(tg_frame_source *frames, tg_reader *reader);
+int tg_pnm_frame_source_open(tg_frame_source *frames, tg_reader *reader);
+/** @} */
+
+
+
+/**
+ * @name Byte order helpers.
+ * 
+ * @brief Load unsigned integers stored in little or big-endian order.
+ * 
+ * @{
+ */
+static inline uint32_t tg_load_le16(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8;
+}
+
+static inline uint32_t tg_load_le32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 |
+           (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static inline uint32_t tg_load_be32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
+           (uint32_t)bytes[2] << 8 | bytes[3];
+}
+/** @} */
+
+
+
+/**
+ * @brief Scales 16-bit big-endian samples of full range (maxval 65535) to 8
+ *      bits, rounding to nearest, using the fastest kernel the running CPU
+ *      supports.
+ * 
+ * @param raw The samples, 2 bytes each.
+ * @param out The 8-bit samples. It may be `raw` itself.
+ * @param count The number of samples.
+ * 
+ */
+void tg_narrow_row(const uint8_t *raw, uint8_t *out, size_t count);
+
+
+
+/**
+ * @brief Fixed-point coefficients converting YUV samples to RGB.
+ * 
+ * With Y' = Y - `y_offset`, U' = U - 128 and V' = V - 128, red is
+ * `y` Y' + `v_to_r` V', green `y` Y' + `u_to_g` U' + `v_to_g` V' and blue
+ * `y` Y' + `u_to_b` U', all scaled by 2^13 and rounded.
+ * 
+ */
+typedef struct tg_yuv_matrix
+{
+    int16_t y_offset;   /**< The black level. */
+    int16_t y;
+    int16_t v_to_r;
+    int16_t u_to_g;
+    int16_t v_to_g;
+    int16_t u_to_b;
+} tg_yuv_matrix;
+
+
+
+/**
+ * @brief Gets the BT.601 coefficients, for limited range samples (16 to
+ *      235) or full range ones.
+ * 
+ */
+const tg_yuv_matrix *tg_yuv_matrix_bt601(int full_range);
+
+
+
+/**
+ * @brief Signature shared by all the YUV to RGB kernels.
+ * 
+ * @param m The conversion coefficients.
+ * @param y The luma samples of the row.
+ * @param u The blue difference samples of the row.
+ * @param v The red difference samples of the row.
+ * @param subsampled Whether there is a chroma sample every two pixels, as in
+ *      4:2:0 and 4:2:2, rather than one per pixel.
+ * @param rgb The buffer to store the packed RGB pixels in.
+ * @param count The number of pixels to convert.
+ * 
+ */
+typedef void (*tg_yuv_row_fn)(const tg_yuv_matrix *m, const uint8_t *y,
+    const uint8_t *u, const uint8_t *v, int subsampled, uint8_t *rgb,
+    size_t count);
+
+
+
+/**
+ * @brief Converts a row of YUV pixels to RGB, using the fastest kernel the
+ *      running CPU supports. Every kernel gives exactly the same result.
+ * 
+ */
+void tg_yuv_row(const tg_yuv_matrix *m, const uint8_t *y, const uint8_t *u,
+    const uint8_t *v, int subsampled, uint8_t *rgb, size_t count);
+
+
+
+/**
+ * @name YUV to RGB kernels.
+ * 
+ * @brief The individual implementations behind `tg_yuv_row`, exposed like
+ *      the luma kernels are.
+ * 
+ * @{
+ */
+void tg_yuv_row_scalar(const tg_yuv_matrix *m, const uint8_t *y,
+    const uint8_t *u, const uint8_t *v, int subsampled, uint8_t *rgb,
+    size_t count);
+#if TG_X86_KERNELS
+void tg_yuv_row_sse2(const tg_yuv_matrix *m, const uint8_t *y,
+    const uint8_t *u, const uint8_t *v, int subsampled, uint8_t *rgb,
+    size_t count);
+void tg_yuv_row_avx2(const tg_yuv_matrix *m, const uint8_t *y,
+    const uint8_t *u, const uint8_t *v, int subsampled, uint8_t *rgb,
+    size_t count);
+#endif
+/** @} */
+
+
+
+/**
+ * @brief Initializes a row source reading the pixels of an image.
+ * 
+ * RGB8 rows are handed out in place; the other formats are converted into
+ * the scratch buffer.
+ * 
+ * @param source The source to initialize.
+ * @param image The image, which must outlive the source.
+ * 
+ */
+void tg_image_source_init(tg_row_source *source, const tg_image *image);
+
+
+
+/**
+ * @brief Decodes an image into a new RGB8 image, allocated together with a
+ *      header of the caller's own, which comes first.
+ * 
+ * @param reader The reader, which is closed.
+ * @param open The decoder opening the image as a row source.
+ * @param header_size Bytes to allocate before the image, a multiple of the
+ *      pointer size. With 0, the image can be freed with `tg_image_free`.
+ * 
+ * @return The allocation, to be freed with free(), the image starting
+ *      `header_size` bytes into it, or NULL on failure.
+ * 
+ */
+void *tg_image_decode(tg_reader *reader, 
+    int (*open)(tg_row_source*, tg_reader*), size_t header_size);
+
+
+
+/**
+ * @brief Signature shared by all the mipmap downsampling kernels.
+ * 
+ * @param top A row of RGBA8 pixels, `2 * count` of them.
+ * @param bottom The row below, as long.
+ * @param out The buffer to store `count` RGBA8 pixels in.
+ * @param count The number of output pixels.
+ * 
+ */
+typedef void (*tg_downsample_row_fn)(const uint8_t *top,
+    const uint8_t *bottom, uint8_t *out, size_t count);
+
+
+
+/**
+ * @brief Averages the 2x2 boxes of pixels of two rows into a row half as
+ *      wide, using the fastest kernel the running CPU supports.
+ * 
+ * Each channel of the output is (a + b + c + d + 2) >> 2, alpha included.
+ * Every kernel gives exactly the same result.
+ * 
+ */
+void tg_downsample_row(const uint8_t *top, const uint8_t *bottom,
+    uint8_t *out, size_t count);
+
+
+
+/**
+ * @name Downsampling kernels.
+ *
+ * @brief The individual implementations behind `tg_downsample_row`, exposed
+ *      like the luma kernels are.
+ *
+ * @{
+ */
+void tg_downsample_row_scalar(const uint8_t *top, const uint8_t *bottom,
+    uint8_t *out, size_t count);
+#if TG_X86_KERNELS
+void tg_downsample_row_sse2(const uint8_t *top, const uint8_t *bottom,
+    uint8_t *out, size_t count);
+void tg_downsample_row_avx2(const uint8_t *top, const uint8_t *bottom,
+    uint8_t *out, size_t count);
+#endif
+/** @} */
+
+
+
+/**
+ * @brief Splits `length` pixels starting at `start` into `count` boxes, as
+ *      evenly as integer edges allow.
+ * 
+ * @param edges The `count + 1` box edges: box i covers [edges[i],
+ *      edges[i + 1]).
+ * 
+ */
+void tg_box_edges(int *edges, int start, int length, int count);
+
+
+
+/**
+ * @brief Wraps a row source into one producing a smaller image, each pixel of
+ *      which is the average of a box of source pixels.
+ * 
+ * Source rows are pulled once each, in order, so the resampled source keeps
+ * the streaming behaviour of the one it wraps. Rounding is the same as
+ * `tg_integral_image_average`, so both give the same pixels.
+ * 
+ * @param resampled The source to initialize.
+ * @param source The source to resample.
+ * @param region The region of `source` to resample.
+ * @param width The output width, between 1 and the region width.
+ * @param height The output height, between 1 and the region height.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ */
+int tg_resample_source_init(tg_row_source *resampled, tg_row_source *source,
+    const tg_rect *region, int width, int height);
+
+
+
+/**
+ * @brief Frees the resources of a source initialized by
+ *      `tg_resample_source_init`.
+ * 
+ */
+void tg_resample_source_free(tg_row_source *resampled);
+
+
+
+/**
+ * @brief Quantizes rows of pixels to cell colors for a color depth, and
+ *      lumas to glyph ramp levels, dithering them as requested.
+ * 
+ */
+typedef struct tg_quantizer
+{
+    int width;              /**< Number of pixels in a row. */
+    tg_color_depth depth;
+    tg_dither dither;
+    int levels;             /**< Number of ramp levels, 0 for no ramp. */
+
+    /**
+     * Whether ramp levels are dithered. If they are not, the lumas are output
+     * in place of the levels.
+     */
+    int dithers_levels;
+
+    uint8_t cube_index[256];    /**< Nearest color cube coordinate. */
+    uint8_t palette[256][3];    /**< RGB values of the indexed colors. */
+
+    /**
+     * Errors carried to the current row and the next two, for error
+     * diffusion, in 1/16ths. NULL otherwise.
+     */
+    int32_t *errors;
+    int32_t *error_rows[3];
+} tg_quantizer;
+
+
+
+/**
+ * @brief Initializes a quantizer.
+ * 
+ * @param q The quantizer to initialize.
+ * @param width The number of pixels in a row.
+ * @param depth The color depth to quantize colors to.
+ * @param dither The dithering to apply.
+ * @param levels The number of glyph ramp levels, or 0 not to compute them.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ */
+int tg_quantizer_init(tg_quantizer *q, int width, tg_color_depth depth,
+    tg_dither dither, int levels);
+
+
+
+/**
+ * @brief Frees the resources of a quantizer.
+ * 
+ */
+void tg_quantizer_free(tg_quantizer *q);
+
+
+
+/**
+ * @brief Tells whether the rows must be quantized one after another, in
+ *      order, from a single thread.
+ * 
+ * That is the case of error diffusion. Otherwise, `tg_quantize_row` does not
+ * modify the quantizer and rows can be quantized in parallel.
+ * 
+ */
+int tg_quantizer_is_serial(const tg_quantizer *q);
+
+
+
+/**
+ * @brief Quantizes a row of pixels.
+ * 
+ * @param q The quantizer.
+ * @param rgb The row pixel data, 3 bytes per pixel.
+ * @param y The row position in the image, for ordered dithering.
+ * @param luma A scratch buffer of a row of bytes.
+ * @param colors The row of cell colors to fill.
+ * @param levels The row of ramp levels to fill, if the quantizer has any.
+ *      If it does not dither them, the row is filled with the lumas instead.
+ * 
+ */
+void tg_quantize_row(tg_quantizer *q, const uint8_t *rgb, int y,
+    uint8_t *luma, uint32_t *colors, uint8_t *levels);
+
+
+
+/**
+ * @brief A fixed set of worker threads running parallel loops.
+ * 
+ */
+typedef struct tg_thread_pool tg_thread_pool;
+
+
+
+/**
+ * @brief Resolves a requested thread count into an actual one.
+ * 
+ * @param requested The requested count, possibly `TG_THREADS_AUTO`.
+ * 
+ * @return The number of threads to use, at least 1.
+ * 
+ */
+int tg_thread_count(int requested);
+
+
+
+/**
+ * @brief Creates a thread pool.
+ * 
+ * @param threads The number of threads running the loops, including the one
+ *      calling `tg_thread_pool_run`.
+ * 
+ * @return The pool, or NULL on failure.
+ * 
+ */
+tg_thread_pool *tg_thread_pool_create(int threads);
+
+
+
+/**
+ * @brief Runs `task(ctx, i)` for every i in [0, count) across the pool
+ *      threads and the calling one, and waits for all of them to complete.
+ * 
+ */
+void tg_thread_pool_run(tg_thread_pool *pool,
+    void (*task)(void *ctx, int index), void *ctx, int count);
+
+
+
+/**
+ * @brief Stops the pool threads and frees the pool. NULL is ignored.
+ * 
+ */
+void tg_thread_pool_destroy(tg_thread_pool *pool);
+
+
+
+#endif // TERMGLYPH_INTERNAL_H
@@ -0,0 +1,274 @@
+#include <string.h>
+
+#include "internal.h"
+
+#if TG_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+
+/**
+ * @name Rec.709 fixed-point coefficients.
+ *
+ * @brief The luma coefficients 0.2126, 0.7152 and 0.0722 scaled by
+ *      `LUMA_SCALE`. They all fit in a signed 16-bit integer, which the SIMD
+ *      kernels rely on to use multiply-add instructions.
+ *
+ * @{
+ */
+#define LUMA_R 2126
+#define LUMA_G 7152
+#define LUMA_B 722
+#define LUMA_SCALE 10000
+/** @} */
+
+
+
+/**
+ * @brief Multiplier and shift dividing by `LUMA_SCALE` any weighted sum up
+ *      to 255 * `LUMA_SCALE`, exactly.
+ * 
+ * The SIMD kernels have no integer division, so they compute
+ * floor(s / 10000) as (s * LUMA_DIV_MUL) >> LUMA_DIV_SHIFT in 64-bit lanes.
+ * Exactness over the whole input range has been checked exhaustively.
+ * 
+ */
+#define LUMA_DIV_MUL 13743896
+#define LUMA_DIV_SHIFT 37
+
+
+
+void tg_luma_row_scalar(const uint8_t *rgb, uint8_t *luma, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t s = LUMA_R * rgb[3*i] + LUMA_G * rgb[3*i+1] 
+                   + LUMA_B * rgb[3*i+2];
+        luma[i] = (uint8_t)(s / LUMA_SCALE);
+    }
+}
+
+
+
+#if TG_X86_KERNELS
+
+/**
+ * @brief Deinterleaves 16 packed RGB pixels into separate red, green and blue
+ *      registers, using SSE2 unpacks only.
+ * 
+ * Each round of unpacks interleaves the low and high halves of the three
+ * registers; after four rounds the 48 bytes end up sorted by channel.
+ * 
+ */
+__attribute__((target("sse2")))
+static inline void deinterleave_rgb_sse2(const uint8_t *rgb,
+    __m128i *r, __m128i *g, __m128i *b)
+{
+    __m128i t00 = _mm_loadu_si128((const __m128i*)rgb);
+    __m128i t01 = _mm_loadu_si128((const __m128i*)(rgb + 16));
+    __m128i t02 = _mm_loadu_si128((const __m128i*)(rgb + 32));
+
+    __m128i t10 = _mm_unpacklo_epi8(t00, _mm_unpackhi_epi64(t01, t01));
+    __m128i t11 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t00, t00), t02);
+    __m128i t12 = _mm_unpacklo_epi8(t01, _mm_unpackhi_epi64(t02, t02));
+
+    __m128i t20 = _mm_unpacklo_epi8(t10, _mm_unpackhi_epi64(t11, t11));
+    __m128i t21 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t10, t10), t12);
+    __m128i t22 = _mm_unpacklo_epi8(t11, _mm_unpackhi_epi64(t12, t12));
+
+    __m128i t30 = _mm_unpacklo_epi8(t20, _mm_unpackhi_epi64(t21, t21));
+    __m128i t31 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t20, t20), t22);
+    __m128i t32 = _mm_unpacklo_epi8(t21, _mm_unpackhi_epi64(t22, t22));
+
+    *r = _mm_unpacklo_epi8(t30, _mm_unpackhi_epi64(t31, t31));
+    *g = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t30, t30), t32);
+    *b = _mm_unpacklo_epi8(t31, _mm_unpackhi_epi64(t32, t32));
+}
+
+
+
+/**
+ * @brief Computes the luma of 4 pixels given as (R, G) 16-bit pairs and
+ *      (B, 0) 16-bit pairs.
+ * 
+ */
+__attribute__((target("sse2")))
+static inline __m128i luma4_sse2(__m128i rg, __m128i b0)
+{
+    const __m128i k_rg = _mm_set1_epi32((LUMA_G << 16) | LUMA_R);
+    const __m128i k_b = _mm_set1_epi32(LUMA_B);
+    const __m128i k_div = _mm_set1_epi32(LUMA_DIV_MUL);
+
+    __m128i s = _mm_add_epi32(_mm_madd_epi16(rg, k_rg),
+                              _mm_madd_epi16(b0, k_b));
+
+    // There is no 32-bit high multiply, so even and odd lanes are divided
+    // separately in 64-bit lanes and merged back together.
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(s, k_div), LUMA_DIV_SHIFT);
+    __m128i odd = _mm_srli_epi64(
+        _mm_mul_epu32(_mm_srli_epi64(s, 32), k_div), LUMA_DIV_SHIFT);
+    return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+}
+
+
+
+__attribute__((target("sse2")))
+void tg_luma_row_sse2(const uint8_t *rgb, uint8_t *luma, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i r, g, b;
+        deinterleave_rgb_sse2(rgb + 3*i, &r, &g, &b);
+
+        __m128i r_lo = _mm_unpacklo_epi8(r, zero);
+        __m128i r_hi = _mm_unpackhi_epi8(r, zero);
+        __m128i g_lo = _mm_unpacklo_epi8(g, zero);
+        __m128i g_hi = _mm_unpackhi_epi8(g, zero);
+        __m128i b_lo = _mm_unpacklo_epi8(b, zero);
+        __m128i b_hi = _mm_unpackhi_epi8(b, zero);
+
+        __m128i l0 = luma4_sse2(_mm_unpacklo_epi16(r_lo, g_lo),
+                                _mm_unpacklo_epi16(b_lo, zero));
+        __m128i l1 = luma4_sse2(_mm_unpackhi_epi16(r_lo, g_lo),
+                                _mm_unpackhi_epi16(b_lo, zero));
+        __m128i l2 = luma4_sse2(_mm_unpacklo_epi16(r_hi, g_hi),
+                                _mm_unpacklo_epi16(b_hi, zero));
+        __m128i l3 = luma4_sse2(_mm_unpackhi_epi16(r_hi, g_hi),
+                                _mm_unpackhi_epi16(b_hi, zero));
+
+        // Lumas are at most 255, so the saturating packs are lossless.
+        __m128i l = _mm_packus_epi16(_mm_packs_epi32(l0, l1),
+                                     _mm_packs_epi32(l2, l3));
+        _mm_storeu_si128((__m128i*)(luma + i), l);
+    }
+
+    tg_luma_row_scalar(rgb + 3*i, luma + i, count - i);
+}
+
+
+
+/**
+ * @brief Computes the luma of 8 pixels given as (R, G) 16-bit pairs and
+ *      (B, 0) 16-bit pairs.
+ * 
+ */
+__attribute__((target("avx2")))
+static inline __m256i luma8_avx2(__m256i rg, __m256i b0)
+{
+    const __m256i k_rg = _mm256_set1_epi32((LUMA_G << 16) | LUMA_R);
+    const __m256i k_b = _mm256_set1_epi32(LUMA_B);
+    const __m256i k_div = _mm256_set1_epi32(LUMA_DIV_MUL);
+
+    __m256i s = _mm256_add_epi32(_mm256_madd_epi16(rg, k_rg),
+                                 _mm256_madd_epi16(b0, k_b));
+
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(s, k_div),
+        LUMA_DIV_SHIFT);
+    __m256i odd = _mm256_srli_epi64(
+        _mm256_mul_epu32(_mm256_srli_epi64(s, 32), k_div), LUMA_DIV_SHIFT);
+    return _mm256_or_si256(even, _mm256_slli_epi64(odd, 32));
+}
+
+
+
+__attribute__((target("avx2")))
+void tg_luma_row_avx2(const uint8_t *rgb, uint8_t *luma, size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i r, g, b;
+        deinterleave_rgb_sse2(rgb + 3*i, &r, &g, &b);
+
+        __m256i r16 = _mm256_cvtepu8_epi16(r);
+        __m256i g16 = _mm256_cvtepu8_epi16(g);
+        __m256i b16 = _mm256_cvtepu8_epi16(b);
+
+        // Unpacks work within 128-bit lanes, so `lo` holds pixels 0-3 and
+        // 8-11 and `hi` pixels 4-7 and 12-15. The in-lane pack below puts
+        // them back in order.
+        __m256i lo = luma8_avx2(_mm256_unpacklo_epi16(r16, g16),
+                                _mm256_unpacklo_epi16(b16, zero));
+        __m256i hi = luma8_avx2(_mm256_unpackhi_epi16(r16, g16),
+                                _mm256_unpackhi_epi16(b16, zero));
+        __m256i l16 = _mm256_packs_epi32(lo, hi);
+
+        __m128i l = _mm_packus_epi16(_mm256_castsi256_si128(l16),
+                                     _mm256_extracti128_si256(l16, 1));
+        _mm_storeu_si128((__m128i*)(luma + i), l);
+    }
+
+    tg_luma_row_scalar(rgb + 3*i, luma + i, count - i);
+}
+
+#endif // TG_X86_KERNELS
+
+
+
+int tg_cpu_supports(const char *feature)
+{
+#if TG_X86_KERNELS
+    __builtin_cpu_init();
+    if (strcmp(feature, "sse2") == 0)
+    {
+        return __builtin_cpu_supports("sse2");
+    }
+    if (strcmp(feature, "avx2") == 0)
+    {
+        return __builtin_cpu_supports("avx2");
+    }
+#else
+    (void)feature;
+#endif
+    return 0;
+}
+
+
+
+#if TG_X86_KERNELS
+
+/**
+ * @brief Picks the luma kernel for the running CPU.
+ * 
+ * @note This function is private to tg_luma_row.
+ */
+static tg_luma_row_fn luma_row_resolve(void)
+{
+    if (tg_cpu_supports("avx2"))
+    {
+        return tg_luma_row_avx2;
+    }
+    if (tg_cpu_supports("sse2"))
+    {
+        return tg_luma_row_sse2;
+    }
+    return tg_luma_row_scalar;
+}
+
+#endif // TG_X86_KERNELS
+
+
+
+void tg_luma_row(const uint8_t *rgb, uint8_t *luma, size_t count)
+{
+#if TG_X86_KERNELS
+    // The kernel is resolved on first use. Concurrent first calls resolve it
+    // more than once, but they all store the same pointer.
+    static tg_luma_row_fn kernel = NULL;
+    tg_luma_row_fn resolved = __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+    if (!resolved)
+    {
+        resolved = luma_row_resolve();
+        __atomic_store_n(&kernel, resolved, __ATOMIC_RELAXED);
+    }
+    resolved(rgb, luma, count);
+#else
+    tg_luma_row_scalar(rgb, luma, count);
+#endif
+}
@@ -0,0 +1,472 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "../include/termglyph/mipmap.h"
+#include "internal.h"
+
+#if TG_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+
+/**
+ * @brief Largest number of levels of a pyramid. Halving a size that fits in
+ *      an int 31 times leaves a single pixel.
+ * 
+ */
+#define MIPMAP_MAX_LEVELS 32
+
+
+
+/**
+ * @brief Number of rows of a level built by each task. Levels are built in
+ *      bands of rows, in parallel, each one reading the two rows above each
+ *      of its rows.
+ * 
+ */
+#define BUILD_BAND_ROWS 16
+
+
+
+struct tg_mipmap
+{
+    pthread_mutex_t mutex;      /**< Serializes the building of levels. */
+    int level_count;
+
+    /**
+     * Number of levels built so far, the image included. Only updated with
+     * the mutex held, once the level is complete, and read atomically.
+     */
+    int built;
+
+    tg_image levels[MIPMAP_MAX_LEVELS];
+};
+
+
+
+void tg_downsample_row_scalar(const uint8_t *top, const uint8_t *bottom,
+    uint8_t *out, size_t count)
+{
+    for (size_t i = 0; i < 4 * count; i++)
+    {
+        // Channel c of pixel p comes from the same channel of pixels 2p and
+        // 2p + 1, at 8p + c and 8p + c + 4.
+        size_t j = i + (i & ~(size_t)3);
+        out[i] = (uint8_t)((top[j] + top[j + 4] + bottom[j] + bottom[j + 4]
+                            + 2) >> 2);
+    }
+}
+
+
+
+#if TG_X86_KERNELS
+
+__attribute__((target("sse2")))
+void tg_downsample_row_sse2(const uint8_t *top, const uint8_t *bottom,
+    uint8_t *out, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+
+    // 4 output pixels per round, from two loads of 4 pixels per row.
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i sums[2];
+        for (int k = 0; k < 2; k++)
+        {
+            __m128i t = _mm_loadu_si128((const __m128i*)(top + 8*i + 16*k));
+            __m128i b = _mm_loadu_si128(
+                (const __m128i*)(bottom + 8*i + 16*k));
+
+            // Vertical sums of pixels 0 and 1, then 2 and 3, on 16 bits.
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(t, zero),
+                                       _mm_unpacklo_epi8(b, zero));
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(t, zero),
+                                       _mm_unpackhi_epi8(b, zero));
+
+            // Horizontal sums: pixel 0 with 1, and 2 with 3.
+            __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi),
+                                        _mm_unpackhi_epi64(lo, hi));
+            sums[k] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        }
+        _mm_storeu_si128((__m128i*)(out + 4*i),
+            _mm_packus_epi16(sums[0], sums[1]));
+    }
+
+    tg_downsample_row_scalar(top + 8*i, bottom + 8*i, out + 4*i, count - i);
+}
+
+
+
+__attribute__((target("avx2")))
+void tg_downsample_row_avx2(const uint8_t *top, const uint8_t *bottom,
+    uint8_t *out, size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i two = _mm256_set1_epi16(2);
+
+    // 8 output pixels per round. Unpacks work within 128-bit lanes, so each
+    // lane goes through the same steps as the SSE2 kernel.
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i sums[2];
+        for (int k = 0; k < 2; k++)
+        {
+            __m256i t = _mm256_loadu_si256(
+                (const __m256i*)(top + 8*i + 32*k));
+            __m256i b = _mm256_loadu_si256(
+                (const __m256i*)(bottom + 8*i + 32*k));
+
+            __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(t, zero),
+                                          _mm256_unpacklo_epi8(b, zero));
+            __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(t, zero),
+                                          _mm256_unpackhi_epi8(b, zero));
+            __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi),
+                                           _mm256_unpackhi_epi64(lo, hi));
+            sums[k] = _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+        }
+
+        // The pack leaves pixels 0-1, 4-5, 2-3 and 6-7, 8 bytes each.
+        __m256i packed = _mm256_packus_epi16(sums[0], sums[1]);
+        _mm256_storeu_si256((__m256i*)(out + 4*i),
+            _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+
+    tg_downsample_row_sse2(top + 8*i, bottom + 8*i, out + 4*i, count - i);
+}
+
+
+
+/**
+ * @brief Picks the downsampling kernel for the running CPU.
+ * 
+ * @note This function is private to tg_downsample_row.
+ */
+static tg_downsample_row_fn downsample_row_resolve(void)
+{
+    if (tg_cpu_supports("avx2"))
+    {
+        return tg_downsample_row_avx2;
+    }
+    if (tg_cpu_supports("sse2"))
+    {
+        return tg_downsample_row_sse2;
+    }
+    return tg_downsample_row_scalar;
+}
+
+#endif // TG_X86_KERNELS
+
+
+
+void tg_downsample_row(const uint8_t *top, const uint8_t *bottom,
+    uint8_t *out, size_t count)
+{
+#if TG_X86_KERNELS
+    // Resolved on first use, like the luma kernel.
+    static tg_downsample_row_fn kernel = NULL;
+    tg_downsample_row_fn resolved = __atomic_load_n(&kernel,
+        __ATOMIC_RELAXED);
+    if (!resolved)
+    {
+        resolved = downsample_row_resolve();
+        __atomic_store_n(&kernel, resolved, __ATOMIC_RELAXED);
+    }
+    resolved(top, bottom, out, count);
+#else
+    tg_downsample_row_scalar(top, bottom, out, count);
+#endif
+}
+
+
+
+/**
+ * @brief Widens a row of RGB8 or GRAY8 pixels to RGBA8, the layout the
+ *      kernels work on. Alpha is left at 0.
+ * 
+ * @note This function is private to the mipmap.
+ */
+static void expand_row(tg_pixel_format format, const uint8_t *row,
+    uint8_t *out, size_t count)
+{
+    for (size_t x = 0; x < count; x++)
+    {
+        if (format == TG_PIXEL_FORMAT_GRAY8)
+        {
+            out[4*x] = out[4*x + 1] = out[4*x + 2] = row[x];
+        }
+        else
+        {
+            out[4*x] = row[3*x];
+            out[4*x + 1] = row[3*x + 1];
+            out[4*x + 2] = row[3*x + 2];
+        }
+        out[4*x + 3] = 0;
+    }
+}
+
+
+
+/**
+ * @brief What the tasks building a level share.
+ * 
+ */
+typedef struct build_state
+{
+    const tg_image *above;      /**< The level the new one halves. */
+    tg_image *level;            /**< The level being built. */
+    int failed;                 /**< Set atomically by failing tasks. */
+} build_state;
+
+
+
+/**
+ * @brief Builds a band of rows of a level.
+ * 
+ * @note This function is private to the mipmap, which runs it on its
+ *      thread pool.
+ */
+static void build_band(void *ctx, int index)
+{
+    build_state *state = (build_state*)ctx;
+    const tg_image *above = state->above;
+    tg_image *level = state->level;
+    size_t count = (size_t)level->width;
+
+    // The image itself may have to be widened first; levels never do.
+    uint8_t *scratch = NULL;
+    if (above->format != TG_PIXEL_FORMAT_RGBA8)
+    {
+        scratch = (uint8_t*)malloc(16 * count);
+        if (!scratch)
+        {
+            __atomic_store_n(&state->failed, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    int y0 = index * BUILD_BAND_ROWS;
+    int y1 = y0 + BUILD_BAND_ROWS < level->height
+           ? y0 + BUILD_BAND_ROWS : level->height;
+    for (int y = y0; y < y1; y++)
+    {
+        const uint8_t *top = above->pixels + above->stride * (2 * (size_t)y);
+        const uint8_t *bottom = top + above->stride;
+        if (scratch)
+        {
+            expand_row(above->format, top, scratch, 2 * count);
+            expand_row(above->format, bottom, scratch + 8 * count, 2 * count);
+            top = scratch;
+            bottom = scratch + 8 * count;
+        }
+        tg_downsample_row(top, bottom,
+            (uint8_t*)level->pixels + level->stride * y, count);
+    }
+    free(scratch);
+}
+
+
+
+/**
+ * @brief Builds the levels of a pyramid down to `level`, those that are not
+ *      yet.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ * @note This function is private to the mipmap.
+ */
+static int mipmap_build(tg_mipmap *mipmap, int level, int threads)
+{
+    pthread_mutex_lock(&mipmap->mutex);
+
+    // Another thread may have built the level while this one was waiting.
+    int result = 0;
+    tg_thread_pool *pool = NULL;
+    threads = tg_thread_count(threads);
+    if (mipmap->built <= level && threads > 1)
+    {
+        // Without a pool the bands are built one after another.
+        pool = tg_thread_pool_create(threads);
+    }
+
+    while (!result && mipmap->built <= level)
+    {
+        const tg_image *above = &mipmap->levels[mipmap->built - 1];
+        tg_image *next = &mipmap->levels[mipmap->built];
+        next->width = above->width / 2;
+        next->height = above->height / 2;
+        next->stride = 4 * (size_t)next->width;
+        next->format = TG_PIXEL_FORMAT_RGBA8;
+        uint8_t *pixels = (uint8_t*)malloc(next->stride * next->height);
+        next->pixels = pixels;
+        if (!pixels)
+        {
+            result = 1;
+            break;
+        }
+
+        build_state state = { above, next, 0 };
+        int band_count = (next->height + BUILD_BAND_ROWS - 1)
+                       / BUILD_BAND_ROWS;
+        if (pool)
+        {
+            tg_thread_pool_run(pool, build_band, &state, band_count);
+        }
+        else
+        {
+            for (int i = 0; i < band_count; i++)
+            {
+                build_band(&state, i);
+            }
+        }
+
+        if (state.failed)
+        {
+            free(pixels);
+            next->pixels = NULL;
+            result = 1;
+            break;
+        }
+        __atomic_store_n(&mipmap->built, mipmap->built + 1,
+            __ATOMIC_RELEASE);
+    }
+
+    tg_thread_pool_destroy(pool);
+    pthread_mutex_unlock(&mipmap->mutex);
+    return result;
+}
+
+
+
+tg_mipmap *tg_mipmap_create(const tg_image *image)
+{
+    if (!image || !image->pixels || image->width <= 0 || image->height <= 0)
+    {
+        return NULL;
+    }
+
+    tg_mipmap *mipmap = (tg_mipmap*)calloc(1, sizeof(tg_mipmap));
+    if (!mipmap || pthread_mutex_init(&mipmap->mutex, NULL))
+    {
+        free(mipmap);
+        return NULL;
+    }
+
+    mipmap->levels[0] = *image;
+    mipmap->built = 1;
+    mipmap->level_count = 1;
+    int width = image->width;
+    int height = image->height;
+    while (width >= 2 && height >= 2 &&
+           mipmap->level_count < MIPMAP_MAX_LEVELS)
+    {
+        width /= 2;
+        height /= 2;
+        mipmap->level_count++;
+    }
+    return mipmap;
+}
+
+
+
+void tg_mipmap_free(tg_mipmap *mipmap)
+{
+    if (!mipmap)
+    {
+        return;
+    }
+
+    for (int i = 1; i < mipmap->built; i++)
+    {
+        free((uint8_t*)mipmap->levels[i].pixels);
+    }
+    pthread_mutex_destroy(&mipmap->mutex);
+    free(mipmap);
+}
+
+
+
+int tg_mipmap_level_count(const tg_mipmap *mipmap)
+{
+    return mipmap->level_count;
+}
+
+
+
+const tg_image *tg_mipmap_level(tg_mipmap *mipmap, int level, int threads)
+{
+    if (level < 0 || level >= mipmap->level_count)
+    {
+        return NULL;
+    }
+    if (__atomic_load_n(&mipmap->built, __ATOMIC_ACQUIRE) <= level &&
+        mipmap_build(mipmap, level, threads))
+    {
+        return NULL;
+    }
+    return &mipmap->levels[level];
+}
+
+
+
+int tg_render_mipmap(tg_mipmap *mipmap, const tg_render_opts *opts,
+    tg_sink *sink)
+{
+    // ---------------------------------- 01 ----------------------------------
+    // Level selection. The region and output size are the ones of the image;
+    // the level picked is the smallest one whose part of the region still
+    // has at least one pixel per output pixel.
+    const tg_image *image = &mipmap->levels[0];
+    tg_rect region;
+    if (tg_render_region(image->width, image->height, opts, &region))
+    {
+        return 1;
+    }
+
+    int columns = 0;
+    int rows = 0;
+    tg_fit_size(region.width, region.height, opts, &columns, &rows);
+
+    int level = 0;
+    while (level + 1 < mipmap->level_count &&
+           region.width >> (level + 1) >= columns &&
+           region.height >> (level + 1) >= rows)
+    {
+        level++;
+    }
+
+    image = tg_mipmap_level(mipmap, level, opts ? opts->threads : 0);
+    if (!image)
+    {
+        return 1;
+    }
+
+    // ---------------------------------- 02 ----------------------------------
+    // Rendering, of the region scaled down to the level, as
+    // `tg_render_source` would.
+    tg_rect scaled;
+    scaled.x = region.x >> level;
+    scaled.y = region.y >> level;
+    scaled.width = ((region.x + region.width) >> level) - scaled.x;
+    scaled.height = ((region.y + region.height) >> level) - scaled.y;
+
+    tg_row_source source;
+    tg_image_source_init(&source, image);
+    if (scaled.x == 0 && scaled.y == 0 && columns == image->width &&
+        rows == image->height)
+    {
+        return tg_encode_source(&source, opts, NULL, sink);
+    }
+
+    tg_row_source resampled = {0};
+    if (tg_resample_source_init(&resampled, &source, &scaled, columns, rows))
+    {
+        return 1;
+    }
+    int result = tg_encode_source(&resampled, opts, NULL, sink);
+    tg_resample_source_free(&resampled);
+    return result;
+}
@@ -0,0 +1,870 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+#if TG_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+
+/**
+ * @brief Largest maxval. Binary samples take a byte up to a maxval of 255,
+ *      and two big-endian bytes above.
+ * 
+ */
+#define PNM_MAX_MAXVAL 65535
+
+
+
+/**
+ * @brief Kinds of raster the Netpbm formats store.
+ * 
+ */
+typedef enum pnm_kind
+{
+    PNM_KIND_BITMAP,    /**< P1 and P4, 1 bit per pixel, 1 being black. */
+    PNM_KIND_GRAY,      /**< P2, P5 and PAM with 1 or 2 samples per pixel. */
+    PNM_KIND_RGB        /**< P3, P6 and PAM with 3 or 4 samples per pixel. */
+} pnm_kind;
+
+
+
+/**
+ * @brief State of a row source streaming a Netpbm image.
+ * 
+ */
+typedef struct pnm_source_state
+{
+    tg_reader reader;
+    pnm_kind kind;
+    int plain;              /**< Whether the raster is in ASCII. */
+    int depth;              /**< Samples per pixel, alpha included. */
+    int maxval;
+    uint8_t scale[256];     /**< 8-bit value of every sample up to 255. */
+
+    /**
+     * 8-bit value of every sample, for maxvals between 256 and 65534.
+     * Samples of the common 65535 maxval are scaled in SIMD instead.
+     */
+    uint8_t *wide_scale;
+
+    int scale_maxval;       /**< The maxval the tables are set up for. */
+
+    uint8_t *raw;           /**< A raw binary row. */
+    size_t raw_size;        /**< Bytes in a raw binary row, 0 if RGB8. */
+    size_t raw_capacity;    /**< Bytes allocated for `raw`. */
+
+    int width;              /**< The width of the current image. */
+    int height;             /**< The height of the current image. */
+    int rows_read;          /**< Rows of the current image read so far. */
+} pnm_source_state;
+
+
+
+/**
+ * @brief Checks whether a byte is a Netpbm whitespace.
+ * 
+ * Unlike isspace, the result does not depend on the locale.
+ * 
+ * @note This function is private to the Netpbm loaders.
+ */
+static int pnm_is_space(int c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' ||
+           c == '\r';
+}
+
+
+
+/**
+ * @brief Skips whitespaces and '#'-comments.
+ * 
+ * @return The first byte after them, or EOF.
+ * 
+ * @note This function is private to the Netpbm loaders.
+ */
+static int pnm_skip_space(tg_reader *r)
+{
+    int c = tg_reader_getc(r);
+    while (pnm_is_space(c) || c == '#')
+    {
+        if (c == '#')
+        {
+            // A comment runs up to the end of the line.
+            do
+            {
+                c = tg_reader_getc(r);
+            } while (c != '\n' && c != '\r' && c != EOF);
+        }
+        c = tg_reader_getc(r);
+    }
+    return c;
+}
+
+
+
+/**
+ * @brief Reads an unsigned decimal integer, skipping the whitespaces and
+ *      comments before it.
+ * 
+ * The byte after the digits is consumed if it is a whitespace, which is
+ * what the header requires after maxval; otherwise it is put back.
+ * 
+ * @param r The reader.
+ * @param value_out A pointer to int to store the value in.
+ * 
+ * @return 0 on success, non-zero value if there are no digits, or if the
+ *      value is greater than INT_MAX.
+ * 
+ * @note This function is private to the Netpbm loaders. It replaces
+ *      fscanf, which is slow and depends on the locale.
+ */
+static int pnm_read_uint(tg_reader *r, int *value_out)
+{
+    int c = pnm_skip_space(r);
+    if (c < '0' || c > '9')
+    {
+        return 1;
+    }
+
+    int value = 0;
+    do
+    {
+        if (value > (INT_MAX - (c - '0')) / 10)
+        {
+            return 1;
+        }
+        value = 10 * value + (c - '0');
+        c = tg_reader_getc(r);
+    } while (c >= '0' && c <= '9');
+
+    if (c != EOF && !pnm_is_space(c))
+    {
+        tg_reader_ungetc(r);
+    }
+
+    *value_out = value;
+    return 0;
+}
+
+
+
+/**
+ * @brief Reads the header of a P1 to P6 image, after the magic number.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ * @note This function is private to pnm_begin_image.
+ */
+static int pnm_read_header(pnm_source_state *state, int format, int *width,
+    int *height)
+{
+    if (pnm_read_uint(&state->reader, width) ||
+        pnm_read_uint(&state->reader, height))
+    {
+        return 1;
+    }
+
+    state->plain = format <= 3;
+    switch (format)
+    {
+    case 1:
+    case 4:
+        state->kind = PNM_KIND_BITMAP;
+        state->depth = 1;
+        state->maxval = 1;
+        return 0;
+
+    case 2:
+    case 5:
+        state->kind = PNM_KIND_GRAY;
+        state->depth = 1;
+        break;
+
+    default:
+        state->kind = PNM_KIND_RGB;
+        state->depth = 3;
+        break;
+    }
+
+    return pnm_read_uint(&state->reader, &state->maxval);
+}
+
+
+
+/**
+ * @brief Reads the header of a PAM (P7) image, after the magic number.
+ * 
+ * The header is made of "KEYWORD value" lines, up to an ENDHDR line. Depths
+ * 1 to 4 are supported, whatever the tuple type: gray, gray and alpha, RGB,
+ * and RGB and alpha, alpha being ignored.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ * @note This function is private to pnm_begin_image.
+ */
+static int pam_read_header(pnm_source_state *state, int *width, int *height)
+{
+    tg_reader *r = &state->reader;
+    state->plain = 0;
+    state->depth = 0;
+    state->maxval = 0;
+
+    while (1)
+    {
+        char keyword[16];
+        size_t length = 0;
+        int c = pnm_skip_space(r);
+        while (c != EOF && !pnm_is_space(c))
+        {
+            if (length == sizeof(keyword) - 1)
+            {
+                return 1;
+            }
+            keyword[length++] = (char)c;
+            c = tg_reader_getc(r);
+        }
+        keyword[length] = '\0';
+
+        if (strcmp(keyword, "ENDHDR") == 0)
+        {
+            // The raster starts on the next line.
+            while (c != '\n')
+            {
+                if (c == EOF || !pnm_is_space(c))
+                {
+                    return 1;
+                }
+                c = tg_reader_getc(r);
+            }
+            break;
+        }
+
+        int result = 0;
+        if (strcmp(keyword, "WIDTH") == 0)
+        {
+            result = pnm_read_uint(r, width);
+        }
+        else if (strcmp(keyword, "HEIGHT") == 0)
+        {
+            result = pnm_read_uint(r, height);
+        }
+        else if (strcmp(keyword, "DEPTH") == 0)
+        {
+            result = pnm_read_uint(r, &state->depth);
+        }
+        else if (strcmp(keyword, "MAXVAL") == 0)
+        {
+            result = pnm_read_uint(r, &state->maxval);
+        }
+        else if (strcmp(keyword, "TUPLTYPE") == 0)
+        {
+            // The depth tells all we need, so the tuple type is skipped.
+            while (c != '\n' && c != EOF)
+            {
+                c = tg_reader_getc(r);
+            }
+        }
+        else
+        {
+            return 1;
+        }
+
+        if (result)
+        {
+            return 1;
+        }
+    }
+
+    if (state->depth < 1 || state->depth > 4)
+    {
+        return 1;
+    }
+    state->kind = state->depth <= 2 ? PNM_KIND_GRAY : PNM_KIND_RGB;
+    return 0;
+}
+
+
+
+/**
+ * @brief Scales a sample to 8 bits, rounding to nearest.
+ * 
+ * @note This function is private to the Netpbm loaders.
+ */
+static uint8_t pnm_scale(const pnm_source_state *state, int sample)
+{
+    if (state->maxval <= 255)
+    {
+        return state->scale[sample];
+    }
+    if (state->wide_scale)
+    {
+        return state->wide_scale[sample];
+    }
+    return (uint8_t)((sample * 255 + state->maxval / 2) / state->maxval);
+}
+
+
+
+/**
+ * @brief Signature shared by the kernels scaling 16-bit big-endian samples
+ *      of maxval 65535 to 8 bits.
+ * 
+ * `out` may be `raw` itself: every sample is read before its byte is
+ * written, and never after a later sample is written.
+ * 
+ */
+typedef void (*narrow_fn)(const uint8_t *raw, uint8_t *out, size_t count);
+
+
+
+/**
+ * @brief Scales a sample of maxval 65535 to 8 bits, rounding to nearest.
+ * 
+ * This is (sample * 255 + 32767) / 65535, that is sample / 257 rounded, 
+ * computed with no multiplication nor division so that the SIMD kernels can
+ * use the same steps on 16-bit lanes. The saturated add only affects samples
+ * that scale to 255 anyway.
+ * 
+ */
+static inline uint8_t narrow_sample(unsigned sample)
+{
+    unsigned t = sample + 128 > 65535 ? 65535 : sample + 128;
+    return (uint8_t)((t - (t >> 8)) >> 8);
+}
+
+
+
+static void narrow_scalar(const uint8_t *raw, uint8_t *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = narrow_sample((unsigned)raw[2*i] << 8 | raw[2*i + 1]);
+    }
+}
+
+
+
+#if TG_X86_KERNELS
+
+__attribute__((target("sse2")))
+static inline __m128i narrow8_sse2(__m128i big_endian)
+{
+    __m128i samples = _mm_or_si128(_mm_slli_epi16(big_endian, 8), 
+        _mm_srli_epi16(big_endian, 8));
+    __m128i t = _mm_adds_epu16(samples, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_sub_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+
+
+__attribute__((target("sse2")))
+static void narrow_sse2(const uint8_t *raw, uint8_t *out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i lo = narrow8_sse2(
+            _mm_loadu_si128((const __m128i*)(raw + 2*i)));
+        __m128i hi = narrow8_sse2(
+            _mm_loadu_si128((const __m128i*)(raw + 2*i + 16)));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(lo, hi));
+    }
+
+    narrow_scalar(raw + 2*i, out + i, count - i);
+}
+
+
+
+__attribute__((target("avx2")))
+static inline __m256i narrow16_avx2(__m256i big_endian)
+{
+    const __m256i swap = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    __m256i samples = _mm256_shuffle_epi8(big_endian, swap);
+    __m256i t = _mm256_adds_epu16(samples, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(
+        _mm256_sub_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+
+
+__attribute__((target("avx2")))
+static void narrow_avx2(const uint8_t *raw, uint8_t *out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i lo = narrow16_avx2(
+            _mm256_loadu_si256((const __m256i*)(raw + 2*i)));
+        __m256i hi = narrow16_avx2(
+            _mm256_loadu_si256((const __m256i*)(raw + 2*i + 32)));
+
+        // The pack works within 128-bit lanes, which leaves the quarters
+        // out of order.
+        __m256i packed = _mm256_packus_epi16(lo, hi);
+        _mm256_storeu_si256((__m256i*)(out + i),
+            _mm256_permute4x64_epi64(packed, 0xd8));
+    }
+
+    narrow_scalar(raw + 2*i, out + i, count - i);
+}
+
+#endif // TG_X86_KERNELS
+
+
+
+void tg_narrow_row(const uint8_t *raw, uint8_t *out, size_t count)
+{
+#if TG_X86_KERNELS
+    static narrow_fn kernel = NULL;
+    narrow_fn resolved = __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+    if (!resolved)
+    {
+        resolved = tg_cpu_supports("avx2") ? narrow_avx2
+                 : tg_cpu_supports("sse2") ? narrow_sse2
+                 : narrow_scalar;
+        __atomic_store_n(&kernel, resolved, __ATOMIC_RELAXED);
+    }
+    resolved(raw, out, count);
+#else
+    narrow_scalar(raw, out, count);
+#endif
+}
+
+
+
+/**
+ * @brief Scales a row of 16-bit big-endian samples to 8 bits, using the
+ *      table of the maxval, or `tg_narrow_row` for maxval 65535.
+ * 
+ * @note This function is private to pnm_read_row. `out` may be `raw`.
+ */
+static void pnm_narrow_row(const pnm_source_state *state, const uint8_t *raw,
+    uint8_t *out, size_t count)
+{
+    if (!state->wide_scale)
+    {
+        tg_narrow_row(raw, out, count);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        unsigned sample = (unsigned)raw[2*i] << 8 | raw[2*i + 1];
+        out[i] = sample > (unsigned)state->maxval 
+               ? 255 : state->wide_scale[sample];
+    }
+}
+
+
+
+/**
+ * @brief Reads a row of a plain (ASCII) raster.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ * @note This function is private to the Netpbm loaders.
+ */
+static int pnm_read_plain_row(pnm_source_state *state, int width,
+    uint8_t *rgb)
+{
+    tg_reader *r = &state->reader;
+
+    for (int x = 0; x < width; x++)
+    {
+        int samples[3];
+        switch (state->kind)
+        {
+        case PNM_KIND_BITMAP:
+        {
+            // Bits may or may not be separated by whitespaces.
+            int c = pnm_skip_space(r);
+            if (c != '0' && c != '1')
+            {
+                return 1;
+            }
+            rgb[3*x] = rgb[3*x + 1] = rgb[3*x + 2] = c == '1' ? 0 : 255;
+            continue;
+        }
+
+        case PNM_KIND_GRAY:
+            if (pnm_read_uint(r, &samples[0]) || samples[0] > state->maxval)
+            {
+                return 1;
+            }
+            rgb[3*x] = rgb[3*x + 1] = rgb[3*x + 2] =
+                pnm_scale(state, samples[0]);
+            continue;
+
+        case PNM_KIND_RGB:
+            for (int c = 0; c < 3; c++)
+            {
+                if (pnm_read_uint(r, &samples[c]) ||
+                    samples[c] > state->maxval)
+                {
+                    return 1;
+                }
+                rgb[3*x + c] = pnm_scale(state, samples[c]);
+            }
+            continue;
+        }
+    }
+    return 0;
+}
+
+
+
+/**
+ * @brief Expands a row of a binary raster into RGB pixels.
+ * 
+ * @note This function is private to pnm_read_row.
+ */
+static void pnm_expand_row(const pnm_source_state *state, int width,
+    const uint8_t *raw, uint8_t *rgb)
+{
+    int depth = state->depth;
+
+    if (state->kind == PNM_KIND_BITMAP)
+    {
+        // Bits are packed most significant first, rows padded to a byte.
+        for (int x = 0; x < width; x++)
+        {
+            uint8_t value = (raw[x >> 3] >> (7 - (x & 7))) & 1 ? 0 : 255;
+            rgb[3*x] = rgb[3*x + 1] = rgb[3*x + 2] = value;
+        }
+    }
+    else if (state->kind == PNM_KIND_GRAY)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            uint8_t value = state->scale[raw[depth * x]];
+            rgb[3*x] = rgb[3*x + 1] = rgb[3*x + 2] = value;
+        }
+    }
+    else
+    {
+        for (int x = 0; x < width; x++)
+        {
+            rgb[3*x] = state->scale[raw[depth * x]];
+            rgb[3*x + 1] = state->scale[raw[depth * x + 1]];
+            rgb[3*x + 2] = state->scale[raw[depth * x + 2]];
+        }
+    }
+}
+
+
+
+/**
+ * @brief Reads the next row of a Netpbm image being streamed.
+ * 
+ * @note This function is private to tg_pnm_source_open and
+ *      tg_pnm_frame_source_open, which use it as the `read_row` callback of
+ *      their row sources.
+ */
+static const uint8_t *pnm_read_row(tg_row_source *source, int y,
+    uint8_t *scratch)
+{
+    (void)y; // Rows are requested in order, so the file position is enough.
+    pnm_source_state *state = (pnm_source_state*)source->ctx;
+
+    if (state->plain)
+    {
+        state->rows_read++;
+        return pnm_read_plain_row(state, source->width, scratch) ? NULL
+                                                                  : scratch;
+    }
+
+    // RGB rows with 8-bit samples are already in the pixel format, so they
+    // are handed out as the reader has them, which is in place when reading
+    // memory or a mapped file. Everything else is read as a raw row, then
+    // scaled and expanded into `scratch`.
+    state->rows_read++;
+    if (!state->raw_size)
+    {
+        return tg_reader_read(&state->reader, scratch,
+            3 * (size_t)source->width);
+    }
+
+    const uint8_t *raw = tg_reader_read(&state->reader, state->raw, 
+        state->raw_size);
+    if (!raw)
+    {
+        return NULL;
+    }
+
+    if (state->maxval > 255)
+    {
+        // Wide samples are scaled first, into the raw row unless they are
+        // RGB ones, which are then done. The expansion is left with 8-bit
+        // samples.
+        size_t samples = (size_t)source->width * state->depth;
+        uint8_t *narrow = state->depth == 3 ? scratch : state->raw;
+        pnm_narrow_row(state, raw, narrow, samples);
+        if (narrow == scratch)
+        {
+            return scratch;
+        }
+        raw = state->raw;
+    }
+
+    pnm_expand_row(state, source->width, raw, scratch);
+    return scratch;
+}
+
+
+
+/**
+ * @brief Closes the source and the reader.
+ * 
+ * @note This function is private to tg_pnm_source_open, which uses it as
+ *      the `close` callback of its row source.
+ */
+static void pnm_close(tg_row_source *source)
+{
+    pnm_source_state *state = (pnm_source_state*)source->ctx;
+    if (!state)
+    {
+        return;
+    }
+
+    tg_reader_close(&state->reader);
+    free(state->raw);
+    free(state->wide_scale);
+    free(state);
+    source->ctx = NULL;
+}
+
+
+
+/**
+ * @brief Reads the header of a Netpbm image, and gets the state ready for
+ *      its raster.
+ * 
+ * The tables and the raw row of the previous image are kept when they still
+ * fit, so that a stream of images only allocates when its format changes.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ * @note This function is private to the Netpbm loaders.
+ */
+static int pnm_begin_image(pnm_source_state *state, int *width, int *height)
+{
+    // ---------------------------------- 01 ----------------------------------
+    // Header. The magic number tells the format apart, from P1 to P7.
+    *width = 0;
+    *height = 0;
+    int magic_number_left = tg_reader_getc(&state->reader);
+    int magic_number_right = tg_reader_getc(&state->reader);
+    int format = magic_number_right - '0';
+    int result = magic_number_left != 'P' || format < 1 || format > 7;
+    if (!result)
+    {
+        result = format == 7
+            ? pam_read_header(state, width, height)
+            : pnm_read_header(state, format, width, height);
+    }
+
+    if (result || *width <= 0 || *height <= 0 || state->maxval < 1 ||
+        state->maxval > PNM_MAX_MAXVAL)
+    {
+        return 1;
+    }
+    state->width = *width;
+    state->height = *height;
+    state->rows_read = 0;
+
+    // ---------------------------------- 02 ----------------------------------
+    // Raster. Samples are scaled to 8 bits through a table, which is the
+    // identity for the common maxval of 255. Wide samples have their own
+    // table, except for maxval 65535; once scaled, they go through the
+    // identity one.
+    int wide = state->maxval > 255;
+    if (state->maxval != state->scale_maxval)
+    {
+        for (int sample = 0; sample < 256; sample++)
+        {
+            state->scale[sample] = wide ? (uint8_t)sample
+                : sample > state->maxval ? 255
+                : (uint8_t)((sample * 255 + state->maxval / 2)
+                            / state->maxval);
+        }
+
+        free(state->wide_scale);
+        state->wide_scale = NULL;
+        state->scale_maxval = 0;
+        if (wide && state->maxval < PNM_MAX_MAXVAL)
+        {
+            state->wide_scale = (uint8_t*)malloc((size_t)state->maxval + 1);
+            if (!state->wide_scale)
+            {
+                return 1;
+            }
+            for (int sample = 0; sample <= state->maxval; sample++)
+            {
+                state->wide_scale[sample] = (uint8_t)(
+                    ((uint32_t)sample * 255 + state->maxval / 2)
+                    / state->maxval);
+            }
+        }
+        state->scale_maxval = state->maxval;
+    }
+
+    state->raw_size = 0;
+    if (!state->plain && (state->kind != PNM_KIND_RGB || state->depth != 3 ||
+        state->maxval != 255))
+    {
+        state->raw_size = state->kind == PNM_KIND_BITMAP
+                        ? ((size_t)*width + 7) / 8
+                        : (size_t)*width * state->depth * (wide ? 2 : 1);
+    }
+    if (state->raw_size > state->raw_capacity)
+    {
+        uint8_t *raw = (uint8_t*)realloc(state->raw, state->raw_size);
+        if (!raw)
+        {
+            return 1;
+        }
+        state->raw = raw;
+        state->raw_capacity = state->raw_size;
+    }
+    return 0;
+}
+
+
+
+int tg_pnm_source_open(tg_row_source *source, tg_reader *reader)
+{
+    pnm_source_state *state = (pnm_source_state*)calloc(1,
+        sizeof(pnm_source_state));
+    if (!state)
+    {
+        tg_reader_close(reader);
+        return 1;
+    }
+
+    state->reader = *reader;
+    source->width = 0;
+    source->height = 0;
+    source->read_row = pnm_read_row;
+    source->close = pnm_close;
+    source->ctx = state;
+
+    int width = 0;
+    int height = 0;
+    if (pnm_begin_image(state, &width, &height))
+    {
+        pnm_close(source);
+        return 1;
+    }
+
+    source->width = width;
+    source->height = height;
+    return 0;
+}
+
+
+
+/**
+ * @brief Reads the next image of a stream of concatenated Netpbm images.
+ * 
+ * Whatever the previous frame has left unread, because it was dropped or
+ * its rendering failed, is skipped first.
+ * 
+ * @note This function is private to tg_pnm_frame_source_open, which uses it
+ *      as the `next_frame` callback of its frame source.
+ */
+static int pnm_next_frame(tg_frame_source *frames, tg_row_source *frame)
+{
+    pnm_source_state *state = (pnm_source_state*)frames->ctx;
+    tg_reader *r = &state->reader;
+
+    int rows_left = state->height - state->rows_read;
+    if (rows_left > 0 && !state->plain)
+    {
+        size_t row_size = state->raw_size ? state->raw_size
+                                          : 3 * (size_t)state->width;
+        if (tg_reader_skip(r, row_size * (size_t)rows_left))
+        {
+            return -1;
+        }
+    }
+    else if (rows_left > 0)
+    {
+        // Plain rows have to be parsed to be skipped.
+        uint8_t *scratch = (uint8_t*)malloc(3 * (size_t)state->width);
+        while (scratch && state->rows_read < state->height &&
+            !pnm_read_plain_row(state, state->width, scratch))
+        {
+            state->rows_read++;
+        }
+        free(scratch);
+        if (state->rows_read < state->height)
+        {
+            return -1;
+        }
+    }
+
+    // Some writers put a newline between images. The stream ends cleanly
+    // where an image would start.
+    int c = pnm_skip_space(r);
+    if (c == EOF)
+    {
+        return 1;
+    }
+    tg_reader_ungetc(r);
+
+    if (pnm_begin_image(state, &frame->width, &frame->height))
+    {
+        return -1;
+    }
+    frame->read_row = pnm_read_row;
+    frame->close = NULL;
+    frame->ctx = state;
+    return 0;
+}
+
+
+
+/**
+ * @brief Closes the frame source and the reader.
+ * 
+ * @note This function is private to tg_pnm_frame_source_open, which uses it
+ *      as the `close` callback of its frame source.
+ */
+static void pnm_frames_close(tg_frame_source *frames)
+{
+    tg_row_source source = {0};
+    source.ctx = frames->ctx;
+    pnm_close(&source);
+    frames->ctx = NULL;
+}
+
+
+
+int tg_pnm_frame_source_open(tg_frame_source *frames, tg_reader *reader)
+{
+    pnm_source_state *state = (pnm_source_state*)calloc(1,
+        sizeof(pnm_source_state));
+    if (!state)
+    {
+        tg_reader_close(reader);
+        return 1;
+    }
+
+    // The reader persists from an image to the next, so that what it has
+    // buffered past the end of one is still there for the following one.
+    state->reader = *reader;
+    frames->width = 0;
+    frames->height = 0;
+    frames->fps = 0;
+    frames->next_frame = pnm_next_frame;
+    frames->close = pnm_frames_close;
+    frames->ctx = state;
+    return 0;
+}
@@ -1,4 +1,9 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
 #include "../include/termglyph/print.h"
+#include "internal.h"
 
 
 
@@ -12,9 +17,10 @@
  * @param terminal_layer The terminal layer of the color to convert, either
  *      being `TG_TERMINAL_LAYER_FOREGROUND` or `TG_TERMINAL_LAYER_BACKGROUND`.
  * 
- * @note This function is private to tg_printf.
+ * @note This function is internal to the library. Besides tg_printf, it is
+ *      used by the image renderer.
  */
-static void to_rgbcolor_sequence(
+void tg_to_direct_color_sequence(
     tg_direct_color_sequence direct_color_sequence, 
     const unsigned int rgb_value, 
     const tg_terminal_layer terminal_layer)
@@ -46,509 +52,560 @@ static void to_rgbcolor_sequence(
 
 
 
-int tg_printf(const char *format, ...)
+/**
+ * @brief Number of bits of the slots of the compiled format caches.
+ * 
+ */
+#define FORMAT_CACHE_BITS 6
+
+
+
+/**
+ * @brief Number of compiled formats each thread keeps.
+ * 
+ */
+#define FORMAT_CACHE_SIZE (1 << FORMAT_CACHE_BITS)
+
+
+
+/**
+ * @brief Length of the buffer on the stack tg_printf formats into, past
+ *      which it allocates one.
+ * 
+ */
+#define FORMAT_STACK_LENGTH 256
+
+
+
+/**
+ * @brief A style specifier: its letter, the style bits and sequence it
+ *      enables, and those its reset with `#0` disables.
+ * 
+ */
+typedef struct format_style
 {
-    // ---------------------------------- 01 ----------------------------------
-    // The function uses an internal buffer to store an intermediate format
-    // string obtained by resolving all extended format specifiers and leaving
-    // standard format specifiers to printf. Thus, the first body section is
-    // reserved to calculating the intermediate buffer size and to its
-    // allocation and initialization.
-    
-    // A reset-all-modes sequence will be appended at the end of the buffer, so
-    // its side needs to accomodate for it and thus is initialized as
-    // `TG_TEXT_STYLE_SEQUENCE_LENGTH`.
-    size_t bufsize = TG_TEXT_STYLE_SEQUENCE_LENGTH; // Internal buffer size.
-
-    for (size_t i = 0; format[i]; i++)
+    char letter;
+    uint16_t bits;
+    const char *sequence;
+    uint16_t reset_bits;
+    const char *reset_sequence;
+} format_style;
+
+
+
+/**
+ * @brief The style specifiers. Terminals take SGR 22 as the end of both bold
+ *      and dim, and SGR 24 as the end of both underlines, so their resets
+ *      disable both styles.
+ * 
+ */
+static const format_style FORMAT_STYLES[] = {
+    { 'o', TG_CELL_STYLE_BOLD, TG_TEXT_STYLE_BOLD,
+        TG_CELL_STYLE_BOLD | TG_CELL_STYLE_DIM, TG_TEXT_STYLE_BOLD_RESET },
+    { 'm', TG_CELL_STYLE_DIM, TG_TEXT_STYLE_DIM,
+        TG_CELL_STYLE_BOLD | TG_CELL_STYLE_DIM, TG_TEXT_STYLE_DIM_RESET },
+    { 't', TG_CELL_STYLE_ITALIC, TG_TEXT_STYLE_ITALIC,
+        TG_CELL_STYLE_ITALIC, TG_TEXT_STYLE_ITALIC_RESET },
+    { 'u', TG_CELL_STYLE_UNDERLINE, TG_TEXT_STYLE_UNDERLINE,
+        TG_CELL_STYLE_UNDERLINE | TG_CELL_STYLE_DOUBLE_UNDERLINE,
+        TG_TEXT_STYLE_UNDERLINE_RESET },
+    { 'k', TG_CELL_STYLE_BLINKING, TG_TEXT_STYLE_BLINKING,
+        TG_CELL_STYLE_BLINKING, TG_TEXT_STYLE_BLINKING_RESET },
+    { 'n', TG_CELL_STYLE_INVERSE, TG_TEXT_STYLE_INVERSE,
+        TG_CELL_STYLE_INVERSE, TG_TEXT_STYLE_INVERSE_RESET },
+    { 'w', TG_CELL_STYLE_DOUBLE_UNDERLINE, TG_TEXT_STYLE_DOUBLE_UNDERLINE,
+        TG_CELL_STYLE_UNDERLINE | TG_CELL_STYLE_DOUBLE_UNDERLINE,
+        TG_TEXT_STYLE_DOUBLE_UNDERLINE_RESET },
+    { 'h', TG_CELL_STYLE_HIDDEN, TG_TEXT_STYLE_HIDDEN,
+        TG_CELL_STYLE_HIDDEN, TG_TEXT_STYLE_HIDDEN_RESET },
+    { 's', TG_CELL_STYLE_STRIKETHROUGH, TG_TEXT_STYLE_STRIKETHROUGH,
+        TG_CELL_STYLE_STRIKETHROUGH, TG_TEXT_STYLE_STRIKETHROUGH_RESET },
+};
+
+
+
+/**
+ * @brief The compiled formats of a thread, one per slot, replaced on
+ *      collisions.
+ * 
+ */
+typedef struct format_cache
+{
+    tg_format entries[FORMAT_CACHE_SIZE];
+} format_cache;
+
+
+
+static pthread_key_t format_cache_key;
+static pthread_once_t format_cache_once = PTHREAD_ONCE_INIT;
+static int format_cache_failed;
+
+
+
+/**
+ * @brief Finds the style specifier of a letter.
+ * 
+ * @return The specifier, or NULL if the letter has none.
+ * 
+ * @note This function is private to the compiled formats.
+ */
+static const format_style *format_style_find(char letter)
+{
+    for (size_t i = 0; i < sizeof(FORMAT_STYLES) / sizeof(*FORMAT_STYLES); i++)
     {
-        if (format[i] == '#')
+        if (FORMAT_STYLES[i].letter == letter)
         {
-            // By doing this, every possible extended specifier, even the
-            // invalid ones, are treated as valid absolute color sequences
-            // specifiers. This means the buffer will almost surely be larger
-            // than necessary; however, I chose code simplicty over strict size
-            // optimization. 
-            bufsize += TG_DIRECT_COLOR_SEQUENCE_LENGTH;
+            return &FORMAT_STYLES[i];
         }
-        else // format[i] != '#'
-        {
-            bufsize++;
-        }      
-    }
-
-    char *buffer = (char*)malloc(bufsize);
-    if(!buffer)
-    {
-        return -1;
     }
-    memset(buffer, 0, bufsize); // TBh, just as extra safety meausre.
-
-    // ---------------------------------- 02 ----------------------------------
-    // This body section is dedicated to resolving extended format specifiers.
+    return NULL;
+}
 
-    int bufidx = 0; // Index iterating over the buffer.
-    int ftmidx = 0; // Index iterating over the format string.
 
-    int written = 0; // The function return value.
 
-    // A temporary `rgbocolor_sequence` used for intermediate manipulations.
-    tg_direct_color_sequence direct_color_sequence_temp;
+/**
+ * @brief Compiles a format string.
+ * 
+ * Each specifier becomes an attribute change, with its escape sequence in
+ * the printf format and its position in the plain one. Invalid specifiers are taken
+ * literally, as they have always been: their '#' is copied and parsing goes
+ * on right after it.
+ * 
+ * @return 0 on success, non-zero value otherwise, in which case `compiled`
+ *      is left untouched.
+ * 
+ * @note This function is private to the compiled formats.
+ */
+static int format_compile(tg_format *compiled, const char *format)
+{
+    size_t length = strlen(format);
+    size_t specifiers = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        specifiers += format[i] == '#';
+    }
 
-    va_list ap; // Arguement pointer for variadic arguments.
+    // No specifier takes more bytes than a direct color sequence, and a reset
+    // is appended at the end.
+    size_t capacity = length + TG_TEXT_STYLE_SEQUENCE_LENGTH
+                    + specifiers * (TG_DIRECT_COLOR_SEQUENCE_LENGTH - 1);
+    tg_format result = { format, NULL, NULL, 0, 0, NULL, NULL, 0 };
+    result.source = (char*)malloc(length + 1);
+    result.sequences = (char*)malloc(capacity);
+    result.plain = (char*)malloc(length + 1);
+    result.ops = (tg_format_op*)malloc(
+        sizeof(tg_format_op) * (specifiers ? specifiers : 1));
+    if (!result.source || !result.sequences || !result.plain || !result.ops)
+    {
+        free(result.source);
+        free(result.sequences);
+        free(result.plain);
+        free(result.ops);
+        return 1;
+    }
+    memcpy(result.source, format, length + 1);
 
-    va_start(ap, format);
-    while(bufidx < bufsize && format[ftmidx])
+    size_t plain_length = 0;
+    size_t i = 0;
+    while (format[i])
     {
-        if (format[ftmidx] == '#')
+        if (format[i] != '#' || format[i + 1] == '#')
         {
-            switch (format[ftmidx + 1])
-            {
-            case 'd': // Absolute color sequences.
-                // First part consists in converting the RGB 24-bit value to a
-                // proper ANSI escape sequence.
-                if(format[ftmidx + 2] == 'f') // Absolute foreground color.
-                {
-                    to_rgbcolor_sequence(direct_color_sequence_temp, 
-                        va_arg(ap, int), TG_TERMINAL_LAYER_FOREGROUND);                    
-                }
-                else if(format[ftmidx + 2] == 'b') // Abs. background color.
-                {
-                    to_rgbcolor_sequence(direct_color_sequence_temp, 
-                        va_arg(ap, int), TG_TERMINAL_LAYER_BACKGROUND);
-                }
-                else // Invalid specifier
-                {   
-                    buffer[bufidx++] = format[ftmidx++];
-                    // We ignore the rest of this case-code if the specifier is
-                    // invalid.
-                    break; 
-                }
-
-                // If the specifier is valid, and so we got a rgbcolor
-                // sequence, we now need to insert it into the buffer.
-                strcpy(buffer + bufidx, direct_color_sequence_temp);
-                // Excluding the null-terminator in the count takes a -1.
-                bufidx += TG_DIRECT_COLOR_SEQUENCE_LENGTH - 1;
-                ftmidx += 3; // The specifier length.
-                // Since we do not want ANSI sequences to count towards the
-                // number of written characters, we subtract such sequences
-                // length to `written` every time we insert one of them into
-                // the buffer.
-                written -= TG_DIRECT_COLOR_SEQUENCE_LENGTH - 1;
-                break;
-
-            case 'i': // Relative color sequences.
-                if(format[ftmidx + 2] == 'f') // Relative foreground color.
-                {
-                    strcpy(buffer + bufidx, va_arg(ap, char*));                  
-                }
-                else if(format[ftmidx + 2] == 'b') // Rel. Background color.
-                {
-                    strcpy(buffer + bufidx, va_arg(ap, char*));
-                    // The macros are defined to be the foreground sequcndes by
-                    // default, so they need to be modified for background
-                    // color changes. The following if-else block check whether
-                    // the color is bright or not.
-                    if(*(buffer + bufidx + 3) == '3') // non-bright version
-                    {
-                        *(buffer + bufidx + 3) = '4';
-                    }
-                    else // it's = to '9' -> bright version
-                    {
-                        *(buffer + bufidx + 2) = '1';
-                        *(buffer + bufidx + 3) = '0';
-                    }
-                    
-                }
-                else // Invalid specifier.
-                {  
-                    buffer[bufidx++] = format[ftmidx++];
-                    break;
-                }
+            // Regular characters, and '##' as a literal '#'.
+            result.sequences[result.sequences_length++] = format[i];
+            result.plain[plain_length++] = format[i];
+            i += format[i] == '#' ? 2 : 1;
+            continue;
+        }
 
-                bufidx += TG_INDEXED_COLOR_SEQUENCE_LENGTH - 1;
-                ftmidx += 3;
-                written -= TG_INDEXED_COLOR_SEQUENCE_LENGTH - 1;
-                break;
-
-            case 'o': // bold style
-                strcpy(buffer + bufidx, TG_TEXT_STYLE_BOLD);   
-                bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                ftmidx += 2;
-                written -= TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                break;
-
-            case 'm': // dim style
-                strcpy(buffer + bufidx, TG_TEXT_STYLE_DIM);   
-                bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                ftmidx += 2;
-                written -= TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                break;
-
-            case 't': // italic style
-                strcpy(buffer + bufidx, TG_TEXT_STYLE_ITALIC);   
-                bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                ftmidx += 2;
-                written -= TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                break;
-
-            case 'u': // underline style
-                strcpy(buffer + bufidx, TG_TEXT_STYLE_UNDERLINE);   
-                bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                ftmidx += 2;
-                written -= TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                break;
-
-            case 'k': // blinking style
-                strcpy(buffer + bufidx, TG_TEXT_STYLE_BLINKING);   
-                bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                ftmidx += 2;
-                written -= TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                break;
-
-            case 'n': // inverse style
-                strcpy(buffer + bufidx, TG_TEXT_STYLE_INVERSE);   
-                bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                ftmidx += 2;
-                written -= TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                break;
-
-            case 'w': // double underline style
-            strcpy(buffer + bufidx, TG_TEXT_STYLE_DOUBLE_UNDERLINE);   
-            bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-            ftmidx += 2;
-            written -= TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-            break;
-
-            case 'h': // hidden style
-                strcpy(buffer + bufidx, TG_TEXT_STYLE_HIDDEN);   
-                bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                ftmidx += 2;
-                written -= TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                break;
-
-            case 's': // strikethrough style
-                strcpy(buffer + bufidx, TG_TEXT_STYLE_STRIKETHROUGH);   
-                bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                ftmidx += 2;
-                written -= TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                break;
-
-            case '0': // reset modes
-                switch (format[ftmidx + 2]) // check which specific mode it is
-                {
-                case 'o': // reset bold style
-                    strcpy(buffer + bufidx, TG_TEXT_STYLE_BOLD_RESET);   
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    ftmidx += 3;
-                    break;
-                
-                case 'm': // reset dim style
-                    strcpy(buffer + bufidx, TG_TEXT_STYLE_DIM_RESET);   
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    ftmidx += 3;
-                    break;
-
-                case 't': // reset italic style
-                    strcpy(buffer + bufidx, TG_TEXT_STYLE_ITALIC_RESET);   
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    ftmidx += 3;
-                    break;
-
-                case 'u': // reset underline style
-                    strcpy(buffer + bufidx, TG_TEXT_STYLE_UNDERLINE_RESET);   
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    ftmidx += 3;
-                    break;
-
-                case 'k': // reset blinking style
-                    strcpy(buffer + bufidx, TG_TEXT_STYLE_BLINKING_RESET);   
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    ftmidx += 3;
-                    break;
-                
-                case 'f': // reset foreground color
-                    strcpy(buffer + bufidx, TG_RESET_FOREGROUND_COLOR);   
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    ftmidx += 3;
-                    break;
-
-                case 'b': // reset background color
-                    strcpy(buffer + bufidx, TG_RESET_BACKGROUND_COLOR);   
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    ftmidx += 3;
-                    break;
-
-                case 'c': // reset all colors
-                    strcpy(buffer + bufidx, TG_RESET_FOREGROUND_COLOR);   
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    strcpy(buffer + bufidx, TG_RESET_BACKGROUND_COLOR);   
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    ftmidx += 3;
-                    break;
-
-                case 'n': // reset inverse style
-                    strcpy(buffer + bufidx, TG_TEXT_STYLE_INVERSE_RESET);   
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    ftmidx += 3;
-                    break;
-
-                case 'w': // reset double underline style
-                    strcpy(buffer + bufidx, TG_TEXT_STYLE_DOUBLE_UNDERLINE_RESET);   
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    ftmidx += 3;
-                    break;
-
-                case 'h': // reset hidden style
-                    strcpy(buffer + bufidx, TG_TEXT_STYLE_HIDDEN_RESET);   
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    ftmidx += 3;
-                    break;
-
-                case 's': // reset strikethrough style
-                    strcpy(buffer + bufidx, TG_TEXT_STYLE_STRIKETHROUGH_RESET);   
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    ftmidx += 3;
-                    break;
-
-                default:
-                    // If there is nothing extra, the reset-all-modes sequence
-                    // is considered.
-
-                    strcpy(buffer + bufidx, TG_RESET_ALL_MODES);
-                    bufidx += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                    ftmidx += 2;
-                    break;
-                }
-                written -= TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
-                break;
-                
-            case '#': // case for ##
-                buffer[bufidx++] = '#';
-                ftmidx += 2;
-                break;
-
-            default:
-                buffer[bufidx++] = format[ftmidx++];
-                break;
+        tg_format_op op = { TG_FORMAT_RESET, TG_TERMINAL_LAYER_FOREGROUND, 0,
+            0, result.sequences_length, plain_length };
+        tg_direct_color_sequence placeholder;
+        const char *sequence = NULL;
+        const char *second = NULL;
+        const format_style *style = NULL;
+        char kind = format[i + 1];
+        char layer = kind ? format[i + 2] : '\0';
+        size_t advance = 3;
+
+        if ((kind == 'd' || kind == 'i') && (layer == 'f' || layer == 'b'))
+        {
+            op.layer = layer == 'f' ? TG_TERMINAL_LAYER_FOREGROUND
+                                    : TG_TERMINAL_LAYER_BACKGROUND;
+            if (kind == 'd')
+            {
+                op.kind = TG_FORMAT_DIRECT_COLOR;
+                tg_to_direct_color_sequence(placeholder, 0, op.layer);
+            }
+            else
+            {
+                // A default color sequence, of the length of the indexed
+                // ones, until the argument replaces it.
+                op.kind = TG_FORMAT_INDEXED_COLOR;
+                strcpy(placeholder, "\033[039m");
+                placeholder[3] = (char)op.layer;
+            }
+            sequence = placeholder;
+        }
+        else if (kind == '0')
+        {
+            op.colors = layer == 'f' ? 1 : layer == 'b' ? 2 : 3;
+            if (layer == 'f' || layer == 'b' || layer == 'c')
+            {
+                sequence = layer == 'b' ? TG_RESET_BACKGROUND_COLOR
+                                        : TG_RESET_FOREGROUND_COLOR;
+                second = layer == 'c' ? TG_RESET_BACKGROUND_COLOR : NULL;
+            }
+            else if ((style = format_style_find(layer)))
+            {
+                op.styles = style->reset_bits;
+                op.colors = 0;
+                sequence = style->reset_sequence;
+            }
+            else
+            {
+                // A bare '#0' resets everything.
+                op.styles = 0xffff;
+                sequence = TG_RESET_ALL_MODES;
+                advance = 2;
             }
-            
         }
-        else // format[ftmidx] != '#'
+        else if ((style = format_style_find(kind)))
         {
-            // It's just a regular character (or standard specifier part) so we
-            // copy it as it is.
-            buffer[bufidx++] = format[ftmidx++];
+            op.kind = TG_FORMAT_STYLE;
+            op.styles = style->bits;
+            sequence = style->sequence;
+            advance = 2;
+        }
+        else
+        {
+            result.sequences[result.sequences_length++] = '#';
+            result.plain[plain_length++] = '#';
+            i++;
+            continue;
         }
-    }
-
-    // Adding final reset-all-modes sequence
-    strcpy(buffer + bufidx, TG_RESET_ALL_MODES);
-    written -= TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
 
-    // ---------------------------------- 03 ----------------------------------
-    // Once the buffer string is left with only the standard specifiers, it is
-    // passed to vprintf.
+        for (; sequence; sequence = second, second = NULL)
+        {
+            size_t sequence_length = strlen(sequence);
+            memcpy(result.sequences + result.sequences_length, sequence,
+                sequence_length);
+            result.sequences_length += sequence_length;
+            result.escape_length += sequence_length;
+        }
+        result.ops[result.op_count++] = op;
+        i += advance;
+    }
 
-    // Calls vprintf and updates written
-    written += vprintf(buffer, ap);
+    strcpy(result.sequences + result.sequences_length, TG_RESET_ALL_MODES);
+    result.sequences_length += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
+    result.escape_length += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
+    result.plain[plain_length] = '\0';
 
-    // Cleans and return
-    va_end(ap);
-    free(buffer);
-    return written;
+    *compiled = result;
+    return 0;
 }
 
 
 
-typedef struct tg_rgb_char
+/**
+ * @brief Releases what a compiled format holds, if anything.
+ * 
+ * @note This function is private to the compiled formats.
+ */
+static void format_release(tg_format *compiled)
 {
-    uint8_t r;
-    uint8_t g;
-    uint8_t b;
-    char c;
-} tg_rgb_char;
+    free(compiled->source);
+    free(compiled->sequences);
+    free(compiled->plain);
+    free(compiled->ops);
+}
 
 
 
-#define TG_ASCII_RAMP " .:-=+*#%@"
-#define TG_ASCII_RAMP_LENGTH 10
+/**
+ * @brief Frees the compiled format cache of a thread, when it exits.
+ * 
+ * @note This function is private to the compiled formats.
+ */
+static void format_cache_free(void *ctx)
+{
+    format_cache *cache = (format_cache*)ctx;
+    for (int i = 0; i < FORMAT_CACHE_SIZE; i++)
+    {
+        format_release(&cache->entries[i]);
+    }
+    free(cache);
+}
 
 
 
 /**
- * @brief Reads a token from a ppm image file.
- * 
- * @param f The file opened in bynary mode.
- * 
- * @param token_out A pointer to int to store the reed token in.
+ * @brief Creates the key of the per thread compiled format caches.
  * 
- * @return 0 on success, a non-zero value on failure.
- * 
- * @note This function is private to tg_printppm.
+ * @note This function is private to tg_format_get.
  */
-static int ppm_read_token(FILE *f, int *token_out)
+static void format_cache_create(void)
 {
-    int c = 0;
-    while (1) // Looping up to a token
+    format_cache_failed = pthread_key_create(&format_cache_key,
+        format_cache_free) != 0;
+}
+
+
+
+const tg_format *tg_format_get(const char *format)
+{
+    pthread_once(&format_cache_once, format_cache_create);
+    if (format_cache_failed)
+    {
+        return NULL;
+    }
+
+    format_cache *cache = (format_cache*)pthread_getspecific(format_cache_key);
+    if (!cache)
     {
-        // Get a character
-        c = fgetc(f); 
-        
-        // Check if it's EOF
-        if(c == EOF)
+        cache = (format_cache*)calloc(1, sizeof(format_cache));
+        if (!cache || pthread_setspecific(format_cache_key, cache))
         {
-            return 1;
+            free(cache);
+            return NULL;
         }
-        
-        // Check if it's a whitespace
-        if(isspace((uint8_t)c))
+    }
+
+    // Literals tend to lie next to each other, so the address is hashed
+    // (Fibonacci hashing) for them to spread over the slots.
+    uint64_t hash = (uint64_t)(uintptr_t)format * 11400714819323198485u;
+    tg_format *entry = &cache->entries[hash >> (64 - FORMAT_CACHE_BITS)];
+    if (entry->key == format && !strcmp(entry->source, format))
+    {
+        return entry;
+    }
+
+    tg_format compiled;
+    if (format_compile(&compiled, format))
+    {
+        return NULL;
+    }
+    format_release(entry);
+    *entry = compiled;
+    return entry;
+}
+
+
+
+int tg_printf(const char *format, ...)
+{
+    // ---------------------------------- 01 ----------------------------------
+    // Extended specifiers are resolved once per format string, into a printf
+    // format with their escape sequences in place. The first body section
+    // gets it, and copies it into a buffer, on the stack for most formats,
+    // where the color sequences of the arguments can be filled in.
+
+    const tg_format *compiled = tg_format_get(format);
+    if (!compiled)
+    {
+        return -1;
+    }
+
+    char stack[FORMAT_STACK_LENGTH];
+    char *buffer = compiled->sequences_length < sizeof(stack)
+                 ? stack : (char*)malloc(compiled->sequences_length + 1);
+    if (!buffer)
+    {
+        return -1;
+    }
+    memcpy(buffer, compiled->sequences, compiled->sequences_length + 1);
+
+    // ---------------------------------- 02 ----------------------------------
+    // The color arguments come first, one per color specifier, in order. Their
+    // sequences overwrite the placeholders of the specifiers.
+
+    va_list ap;
+    va_start(ap, format);
+    for (int i = 0; i < compiled->op_count; i++)
+    {
+        const tg_format_op *op = &compiled->ops[i];
+        char *sequence = buffer + op->offset;
+        if (op->kind == TG_FORMAT_DIRECT_COLOR)
         {
-            // If so there's nothing more to do with this character
-            continue;
+            tg_direct_color_sequence direct_color_sequence;
+            tg_to_direct_color_sequence(direct_color_sequence, 
+                va_arg(ap, int), op->layer);
+            memcpy(sequence, direct_color_sequence,
+                TG_DIRECT_COLOR_SEQUENCE_LENGTH - 1);
         }
-
-        // Check if it marks the beginning of a '#'-comment
-        if(c == '#')
+        else if (op->kind == TG_FORMAT_INDEXED_COLOR)
         {
-            // If so, we skip across the whole comment
-            do
+            const char *indexed = va_arg(ap, const char*);
+            for (int k = 0; k < TG_INDEXED_COLOR_SEQUENCE_LENGTH - 1
+                 && indexed[k]; k++)
             {
-                c = fgetc(f);
-                // We also need to make sure we don't pick up an EOF
-                if(c == EOF)
+                sequence[k] = indexed[k];
+            }
+
+            // The macros are defined to be the foreground sequences, so they
+            // need to be modified for background colors: 3x becomes 4x and
+            // the bright 9x becomes 10x.
+            if (op->layer == TG_TERMINAL_LAYER_BACKGROUND)
+            {
+                if (sequence[3] == '3')
+                {
+                    sequence[3] = '4';
+                }
+                else
                 {
-                    return 1;
+                    sequence[2] = '1';
+                    sequence[3] = '0';
                 }
-            } while (c != '\n');    
+            }
         }
-
-        // If we neither pick up an EOF, a whitespace or a comment, it means we
-        // have found a token
-        break;
     }
 
-    // We put back the last read character, still checking if `ungetc` returns
-    // EOF because it is not guaranteed to succeed
-    if(ungetc(c, f) == EOF)
+    // ---------------------------------- 03 ----------------------------------
+    // The buffer is left with only the standard specifiers, so it is passed to
+    // vprintf along with the remaining arguments. The escape sequences do not
+    // count towards the characters written.
+
+    int written = vprintf(buffer, ap);
+    va_end(ap);
+    if (buffer != stack)
     {
-        return 1;
+        free(buffer);
     }
+    return written < 0 ? -1 : written - (int)compiled->escape_length;
+}
+
+
+
+int tg_printppm(const char* path)
+{
+    return tg_printppm_opts(path, NULL);
+}
 
-    // We can now properly read a token, while making sure that fscanf does not
-    // fail in any case
-    if(fscanf(f, "%d", token_out) != 1)
+
+
+/**
+ * @brief Converts the image a reader is positioned on into glyphs, and
+ *      prints them to stdout.
+ * 
+ * @param reader The reader, which is closed.
+ * @param opts The render options, possibly NULL.
+ * @param open The decoder opening the image as a row source.
+ * 
+ * @note This function is private to the tg_printppm and tg_printimage
+ *      families.
+ */
+static int print_reader(tg_reader *reader, const tg_render_opts *opts,
+    int (*open)(tg_row_source*, tg_reader*))
+{
+    // The pixel data is streamed to the renderer, which pulls rows from the
+    // reader as it needs them, so the image is never held in memory as a
+    // whole, nor copied when the reader has it in place already.
+    tg_row_source source;
+    if (open(&source, reader))
     {
         return 1;
     }
 
-    // Return 0 if succeded
-    return 0;
+    int result = tg_render_source(&source, opts, NULL, NULL);
+    tg_row_source_close(&source);
+    return result;
 }
 
 
 
-int tg_printppm(const char* path)
+int tg_printppm_opts(const char *path, const tg_render_opts *opts)
 {
-    // ---------------------------------- 01 ---------------------------------- 
-    // FIle opening.
-    FILE *f = fopen(path, "rb");
-    if (!f)
+    tg_reader reader;
+    if (tg_reader_open_path(&reader, path))
     {
         return 1;
     }
+    return print_reader(&reader, opts, tg_pnm_source_open);
+}
+
 
-    // ---------------------------------- 02 ---------------------------------- 
-    // Reading the file header and possibily reading the pixel data.
 
-    // First thing to check is the magic number (P6).
-    char magic_number_left = fgetc(f);
-    char magic_number_right = fgetc(f);
-    if (magic_number_left != 'P' || magic_number_right != '6')
+int tg_printppm_mem(const void *data, size_t length, 
+    const tg_render_opts *opts)
+{
+    tg_reader reader;
+    if (tg_reader_open_memory(&reader, data, length))
     {
-        fclose(f);
-        return 1; 
+        return 1;
     }
+    return print_reader(&reader, opts, tg_pnm_source_open);
+}
 
-    // Now we can get width, height, maxval and check that maxval is 255.
-    int width = 0;
-    int height = 0;
-    int maxval = 0;
-    if (ppm_read_token(f, &width)  || ppm_read_token(f, &height) || 
-        ppm_read_token(f, &maxval) || maxval != 255)
+
+
+int tg_printppm_file(FILE *file, const tg_render_opts *opts)
+{
+    tg_reader reader;
+    if (tg_reader_open_file(&reader, file))
     {
-        fclose(f);
         return 1;
     }
+    return print_reader(&reader, opts, tg_pnm_source_open);
+}
 
-    // After maxval, an unspecified number of whitespaces can ve present before
-    // the pixel data, so we need to read them out.
-    int c;
-    do {
-        c = fgetc(f);
-        if (c == EOF)
-        {
-            fclose(f);
-            return 1;
-        }
-    } while (isspace((uint8_t)c));
-    // We put back the last byte we got since it must be a pixel data byte for
-    // us to be out of the loop.
-    ungetc(c, f);
-
-    // If everything went fine, we can now proceed to the pixel data reading.
-    uint8_t *pixels = (uint8_t*)malloc(3 * width * height);
-    if (!pixels)
+
+
+int tg_printppm_fd(int fd, const tg_render_opts *opts)
+{
+    tg_reader reader;
+    if (tg_reader_open_fd(&reader, fd))
     {
-        fclose(f);
         return 1;
     }
-    fread(pixels, 3, width * height, f);
-    // We do not need to keep `f` open anymore.
-    fclose(f);
+    return print_reader(&reader, opts, tg_pnm_source_open);
+}
 
-    // ---------------------------------- 03 ----------------------------------
-    // We now proceed to convert the pixel data to...
-    tg_rgb_char *buffer = (tg_rgb_char*)malloc(
-        (width * height + height + 1) * sizeof(tg_rgb_char));
 
-    int j = 0;
-    for (int y = 0; y < height; ++y)
+
+int tg_printimage(const char *path, const tg_render_opts *opts)
+{
+    tg_reader reader;
+    if (tg_reader_open_path(&reader, path))
     {
-        for (int x = 0; x < width; ++x)
-        {
-            int i = y * width + x;
-            buffer[j].r = pixels[3*i];
-            buffer[j].g = pixels[3*i+1];
-            buffer[j].b = pixels[3*i+2];
-            uint8_t luma = 0.2126*buffer[j].r 
-                         + 0.7152*buffer[j].g 
-                         + 0.0722*buffer[j].b;
-            buffer[j].c = TG_ASCII_RAMP[luma * (TG_ASCII_RAMP_LENGTH - 1)/255];
-            j++;
-        }
-        buffer[j].r = 0;
-        buffer[j].g = 0;
-        buffer[j].b = 0;
-        buffer[j].c = '\n';
-        j++;
+        return 1;
     }
-    buffer[j].r = 0;
-    buffer[j].g = 0;
-    buffer[j].b = 0;
-    buffer[j].c = '\0';
+    return print_reader(&reader, opts, tg_decoder_source_open);
+}
+
 
-    for (size_t i = 0; i < width * height + height + 1; i++)
+
+int tg_printimage_mem(const void *data, size_t length, 
+    const tg_render_opts *opts)
+{
+    tg_reader reader;
+    if (tg_reader_open_memory(&reader, data, length))
     {
-        tg_printf("#db%c",
-            TG_RGB(buffer[i].r, buffer[i].g, buffer[i].b),
-            buffer[i].c);
+        return 1;
     }
+    return print_reader(&reader, opts, tg_decoder_source_open);
+}
 
-    free(buffer);
-    free(pixels);
-    return 0;
+
+
+int tg_printimage_file(FILE *file, const tg_render_opts *opts)
+{
+    tg_reader reader;
+    if (tg_reader_open_file(&reader, file))
+    {
+        return 1;
+    }
+    return print_reader(&reader, opts, tg_decoder_source_open);
 }
 
 
+
+int tg_printimage_fd(int fd, const tg_render_opts *opts)
+{
+    tg_reader reader;
+    if (tg_reader_open_fd(&reader, fd))
+    {
+        return 1;
+    }
+    return print_reader(&reader, opts, tg_decoder_source_open);
+}
@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+
+
+/**
+ * @brief Size of the QOI header: magic, width, height, channels and
+ *      colorspace.
+ * 
+ */
+#define QOI_HEADER_SIZE 14
+
+
+
+/**
+ * @brief Largest number of pixels in a QOI image, as the format sets it.
+ * 
+ */
+#define QOI_MAX_PIXELS 400000000u
+
+
+
+/**
+ * @name QOI chunk tags.
+ * 
+ * @brief The 8-bit tags come first, then the 2-bit ones.
+ * 
+ * @{
+ */
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_MASK_2   0xc0
+/** @} */
+
+
+
+/**
+ * @brief State of a row source decoding a QOI image.
+ * 
+ * The decoder state carries over from a row to the next, since runs and
+ * the index don't care about rows.
+ * 
+ */
+typedef struct qoi_source_state
+{
+    tg_reader reader;
+    uint8_t px[4];          /**< The previous pixel, RGBA. */
+    uint8_t index[64][4];   /**< The previously seen pixels, by hash. */
+    uint32_t run;           /**< Repeats of `px` still to output. */
+} qoi_source_state;
+
+
+
+/**
+ * @brief Decodes the next row of a QOI image, a chunk at a time.
+ * 
+ * @note This function is private to tg_qoi_source_open, which uses it as
+ *      the `read_row` callback of its row source.
+ */
+static const uint8_t *qoi_read_row(tg_row_source *source, int y,
+    uint8_t *scratch)
+{
+    (void)y; // Rows are requested in order, and decoding carries over.
+    qoi_source_state *state = (qoi_source_state*)source->ctx;
+    tg_reader *r = &state->reader;
+    uint8_t *px = state->px;
+
+    for (int x = 0; x < source->width; x++)
+    {
+        if (state->run > 0)
+        {
+            state->run--;
+        }
+        else
+        {
+            int tag = tg_reader_getc(r);
+            if (tag == EOF)
+            {
+                return NULL;
+            }
+
+            if (tag == QOI_OP_RGB || tag == QOI_OP_RGBA)
+            {
+                int channels = tag == QOI_OP_RGB ? 3 : 4;
+                for (int c = 0; c < channels; c++)
+                {
+                    int value = tg_reader_getc(r);
+                    if (value == EOF)
+                    {
+                        return NULL;
+                    }
+                    px[c] = (uint8_t)value;
+                }
+            }
+            else if ((tag & QOI_MASK_2) == QOI_OP_INDEX)
+            {
+                memcpy(px, state->index[tag], 4);
+            }
+            else if ((tag & QOI_MASK_2) == QOI_OP_DIFF)
+            {
+                px[0] += ((tag >> 4) & 3) - 2;
+                px[1] += ((tag >> 2) & 3) - 2;
+                px[2] += (tag & 3) - 2;
+            }
+            else if ((tag & QOI_MASK_2) == QOI_OP_LUMA)
+            {
+                int byte = tg_reader_getc(r);
+                if (byte == EOF)
+                {
+                    return NULL;
+                }
+                int dg = (tag & 0x3f) - 32;
+                px[0] += dg - 8 + ((byte >> 4) & 0x0f);
+                px[1] += dg;
+                px[2] += dg - 8 + (byte & 0x0f);
+            }
+            else
+            {
+                // The run includes the current pixel.
+                state->run = (uint32_t)(tag & 0x3f);
+            }
+
+            int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+            memcpy(state->index[hash], px, 4);
+        }
+
+        // Alpha is ignored, like the other formats do.
+        scratch[3*x] = px[0];
+        scratch[3*x + 1] = px[1];
+        scratch[3*x + 2] = px[2];
+    }
+    return scratch;
+}
+
+
+
+/**
+ * @brief Closes the source and the reader.
+ * 
+ * @note This function is private to tg_qoi_source_open, which uses it as
+ *      the `close` callback of its row source.
+ */
+static void qoi_close(tg_row_source *source)
+{
+    qoi_source_state *state = (qoi_source_state*)source->ctx;
+    if (!state)
+    {
+        return;
+    }
+
+    tg_reader_close(&state->reader);
+    free(state);
+    source->ctx = NULL;
+}
+
+
+
+int tg_qoi_source_open(tg_row_source *source, tg_reader *reader)
+{
+    qoi_source_state *state = (qoi_source_state*)calloc(1,
+        sizeof(qoi_source_state));
+    if (!state)
+    {
+        tg_reader_close(reader);
+        return 1;
+    }
+
+    state->reader = *reader;
+    state->px[3] = 255;
+    source->width = 0;
+    source->height = 0;
+    source->read_row = qoi_read_row;
+    source->close = qoi_close;
+    source->ctx = state;
+
+    uint8_t buffer[QOI_HEADER_SIZE];
+    const uint8_t *header = tg_reader_read(&state->reader, buffer,
+        QOI_HEADER_SIZE);
+    if (!header || memcmp(header, "qoif", 4) != 0)
+    {
+        qoi_close(source);
+        return 1;
+    }
+
+    uint32_t width = tg_load_be32(header + 4);
+    uint32_t height = tg_load_be32(header + 8);
+    int channels = header[12];
+    if (width == 0 || height == 0 || height > QOI_MAX_PIXELS / width ||
+        (channels != 3 && channels != 4))
+    {
+        qoi_close(source);
+        return 1;
+    }
+
+    // Pixels are decoded as rows are requested, so the image is never held
+    // in memory. The end marker is not checked, since all the pixels are
+    // known by then.
+    source->width = (int)width;
+    source->height = (int)height;
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/termglyph/render.h"
+#include "internal.h"
+
+
+
+/**
+ * @brief Decodes the next code point of a UTF-8 string into a glyph.
+ * 
+ * @param s The string, positioned on the first byte of a code point.
+ * @param glyph The glyph to store the code point bytes in.
+ * 
+ * @return The number of bytes consumed, or 0 if they are not valid UTF-8.
+ * 
+ * @note This function is private to the ramps.
+ */
+static size_t decode_glyph(const unsigned char *s, tg_glyph *glyph)
+{
+    size_t length = s[0] < 0x80 ? 1 
+                  : (s[0] & 0xe0) == 0xc0 ? 2 
+                  : (s[0] & 0xf0) == 0xe0 ? 3 
+                  : (s[0] & 0xf8) == 0xf0 ? 4 : 0;
+    if (!length)
+    {
+        return 0;
+    }
+
+    uint32_t codepoint = length == 1 ? s[0] : s[0] & (0x7f >> length);
+    for (size_t i = 1; i < length; i++)
+    {
+        // This also stops at the null-terminator of a truncated sequence.
+        if ((s[i] & 0xc0) != 0x80)
+        {
+            return 0;
+        }
+        codepoint = (codepoint << 6) | (s[i] & 0x3f);
+    }
+
+    // Overlong encodings, surrogates and out of range code points are
+    // rejected, so that only well-formed text reaches the terminal.
+    static const uint32_t min_codepoint[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (codepoint < min_codepoint[length] || codepoint > 0x10ffff ||
+        (codepoint >= 0xd800 && codepoint <= 0xdfff) || codepoint < 0x20)
+    {
+        return 0;
+    }
+
+    memcpy(glyph->bytes, s, length);
+    glyph->length = (uint8_t)length;
+    return length;
+}
+
+
+
+/**
+ * @brief Compiles a ramp into `ramp`.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ * @note This function is private to the ramps.
+ */
+static int ramp_compile(tg_ramp *ramp, const char *glyphs, int inverted)
+{
+    const unsigned char *s = (const unsigned char*)glyphs;
+    ramp->levels = 0;
+
+    while (*s)
+    {
+        if (ramp->levels == 256)
+        {
+            return 1;
+        }
+
+        size_t length = decode_glyph(s, &ramp->by_level[ramp->levels]);
+        if (!length)
+        {
+            return 1;
+        }
+        s += length;
+        ramp->levels++;
+    }
+
+    if (ramp->levels == 0)
+    {
+        return 1;
+    }
+
+    if (inverted)
+    {
+        for (int i = 0; i < ramp->levels / 2; i++)
+        {
+            tg_glyph glyph = ramp->by_level[i];
+            ramp->by_level[i] = ramp->by_level[ramp->levels - 1 - i];
+            ramp->by_level[ramp->levels - 1 - i] = glyph;
+        }
+    }
+
+    // The luma table is where the per-pixel multiply and divide used to be.
+    for (int luma = 0; luma < 256; luma++)
+    {
+        ramp->by_luma[luma] = ramp->by_level[luma * (ramp->levels - 1) / 255];
+    }
+
+    return 0;
+}
+
+
+
+tg_ramp *tg_ramp_create(const char *glyphs, int inverted)
+{
+    tg_ramp *ramp = (tg_ramp*)malloc(sizeof(tg_ramp));
+    if (ramp && ramp_compile(ramp, glyphs, inverted))
+    {
+        free(ramp);
+        return NULL;
+    }
+    return ramp;
+}
+
+
+
+void tg_ramp_free(tg_ramp *ramp)
+{
+    free(ramp);
+}
+
+
+
+/** The default ramp, compiled once on first use. */
+static tg_ramp default_ramp;
+static pthread_once_t default_ramp_once = PTHREAD_ONCE_INIT;
+
+
+
+/**
+ * @brief Compiles the default ramp.
+ * 
+ * @note This function is private to tg_ramp_default.
+ */
+static void default_ramp_compile(void)
+{
+    ramp_compile(&default_ramp, TG_RAMP_ASCII, 0);
+}
+
+
+
+const tg_ramp *tg_ramp_default(void)
+{
+    pthread_once(&default_ramp_once, default_ramp_compile);
+    return &default_ramp;
+}
@@ -0,0 +1,290 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+
+
+/**
+ * @brief Opens a reader streaming a stdio stream.
+ * 
+ * @note This function is private to the reader.
+ */
+static int reader_open_stream(tg_reader *reader, FILE *file, int owns_file)
+{
+    memset(reader, 0, sizeof(tg_reader));
+    reader->fd = -1;
+    reader->f = file;
+    reader->owns_file = owns_file;
+    reader->storage = (uint8_t*)malloc(TG_READER_BUFFER_SIZE);
+    reader->buffer = reader->storage;
+    if (!reader->storage)
+    {
+        tg_reader_close(reader);
+        return 1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * @brief Opens a reader on a file descriptor, mapping it when it is a
+ *      regular file and streaming it otherwise.
+ * 
+ * @param reader The reader.
+ * @param fd The descriptor, read from its current offset.
+ * @param owned Whether the reader is responsible for closing `fd`.
+ * 
+ * @note This function is private to the reader.
+ */
+static int reader_open_descriptor(tg_reader *reader, int fd, int owned)
+{
+    struct stat st;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && offset >= 0 &&
+        st.st_size > offset)
+    {
+        void *mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+            fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            // Rows are read once, front to back.
+            madvise(mapping, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+            memset(reader, 0, sizeof(tg_reader));
+            reader->mapping = mapping;
+            reader->mapping_size = (size_t)st.st_size;
+            reader->buffer = (const uint8_t*)mapping + offset;
+            reader->len = (size_t)(st.st_size - offset);
+            reader->fd = owned ? -1 : fd;
+            reader->fd_start = (size_t)offset;
+            if (owned)
+            {
+                close(fd);
+            }
+            return 0;
+        }
+    }
+
+    // Pipes, terminals and whatever can't be mapped are streamed instead.
+    int stream_fd = owned ? fd : dup(fd);
+    FILE *file = stream_fd < 0 ? NULL : fdopen(stream_fd, "rb");
+    if (!file)
+    {
+        if (stream_fd >= 0)
+        {
+            close(stream_fd);
+        }
+        return 1;
+    }
+    return reader_open_stream(reader, file, 1);
+}
+
+
+
+int tg_reader_open_path(tg_reader *reader, const char *path)
+{
+    // The "-" path stands for stdin, so that images can be piped in.
+    if (strcmp(path, "-") == 0)
+    {
+        return tg_reader_open_file(reader, stdin);
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return 1;
+    }
+    return reader_open_descriptor(reader, fd, 1);
+}
+
+
+
+int tg_reader_open_memory(tg_reader *reader, const void *data, size_t length)
+{
+    memset(reader, 0, sizeof(tg_reader));
+    reader->fd = -1;
+    reader->buffer = (const uint8_t*)data;
+    reader->len = data ? length : 0;
+    return !data;
+}
+
+
+
+int tg_reader_open_file(tg_reader *reader, FILE *file)
+{
+    return reader_open_stream(reader, file, 0);
+}
+
+
+
+int tg_reader_open_fd(tg_reader *reader, int fd)
+{
+    return reader_open_descriptor(reader, fd, 0);
+}
+
+
+
+void tg_reader_close(tg_reader *reader)
+{
+    if (reader->fd >= 0)
+    {
+        // The caller's descriptor is left right after the image, as if it
+        // had been read.
+        lseek(reader->fd, (off_t)(reader->fd_start + reader->pos), SEEK_SET);
+    }
+    if (reader->mapping)
+    {
+        munmap(reader->mapping, reader->mapping_size);
+    }
+    if (reader->f && reader->owns_file)
+    {
+        fclose(reader->f);
+    }
+    free(reader->storage);
+    memset(reader, 0, sizeof(tg_reader));
+    reader->fd = -1;
+}
+
+
+
+int tg_reader_fill(tg_reader *reader)
+{
+    if (!reader->f)
+    {
+        return 1;
+    }
+
+    reader->pos = 0;
+    reader->len = fread(reader->storage, 1, TG_READER_BUFFER_SIZE, reader->f);
+    return reader->len == 0;
+}
+
+
+
+const uint8_t *tg_reader_peek(tg_reader *reader, size_t length)
+{
+    if (reader->f && reader->len - reader->pos < length &&
+        length <= TG_READER_BUFFER_SIZE)
+    {
+        // The bytes left are moved to the front, and the buffer topped up.
+        size_t left = reader->len - reader->pos;
+        memmove(reader->storage, reader->buffer + reader->pos, left);
+        reader->pos = 0;
+        reader->len = left;
+        while (reader->len < length)
+        {
+            size_t got = fread(reader->storage + reader->len, 1,
+                TG_READER_BUFFER_SIZE - reader->len, reader->f);
+            if (got == 0)
+            {
+                break;
+            }
+            reader->len += got;
+        }
+    }
+
+    if (reader->len - reader->pos < length)
+    {
+        return NULL;
+    }
+    return reader->buffer + reader->pos;
+}
+
+
+
+int tg_reader_skip(tg_reader *reader, size_t length)
+{
+    while (length > 0)
+    {
+        if (reader->pos == reader->len && tg_reader_fill(reader))
+        {
+            return 1;
+        }
+
+        size_t step = reader->len - reader->pos;
+        step = step < length ? step : length;
+        reader->pos += step;
+        length -= step;
+    }
+    return 0;
+}
+
+
+
+const uint8_t *tg_reader_read(tg_reader *reader, uint8_t *out, size_t length)
+{
+    size_t buffered = reader->len - reader->pos;
+    if (!reader->f)
+    {
+        // Reading in place: the bytes are handed out where they are.
+        if (buffered < length)
+        {
+            return NULL;
+        }
+        reader->pos += length;
+        return reader->buffer + reader->pos - length;
+    }
+
+    if (buffered > length)
+    {
+        buffered = length;
+    }
+    memcpy(out, reader->buffer + reader->pos, buffered);
+    reader->pos += buffered;
+
+    // Whatever is left is read straight into `out`. Rows are large, so
+    // going through the buffer would only add a copy.
+    length -= buffered;
+    if (length && fread(out + buffered, 1, length, reader->f) != length)
+    {
+        return NULL;
+    }
+    return out;
+}
+
+
+
+uint8_t *tg_reader_read_alloc(tg_reader *reader, size_t length)
+{
+    uint8_t *out = NULL;
+    size_t capacity = 0;
+    size_t done = 0;
+    while (done < length)
+    {
+        // Grown by doubling as the bytes arrive, so that a header announcing
+        // more than the input holds fails at its end instead of allocating
+        // what it announced.
+        if (done == capacity)
+        {
+            capacity = capacity ? capacity * 2 : TG_READER_BUFFER_SIZE;
+            capacity = capacity < length ? capacity : length;
+            uint8_t *grown = (uint8_t*)realloc(out, capacity);
+            if (!grown)
+            {
+                free(out);
+                return NULL;
+            }
+            out = grown;
+        }
+
+        size_t step = capacity - done;
+        const uint8_t *bytes = tg_reader_read(reader, out + done, step);
+        if (!bytes)
+        {
+            free(out);
+            return NULL;
+        }
+        if (bytes != out + done)
+        {
+            memcpy(out + done, bytes, step);
+        }
+        done += step;
+    }
+    return out;
+}
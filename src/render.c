@@ -0,0 +1,979 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/termglyph/render.h"
+#include "internal.h"
+
+
+
+/**
+ * @brief The upper half block character, U+2580, in UTF-8.
+ * 
+ */
+#define UPPER_HALF_BLOCK "\xe2\x96\x80"
+
+
+
+/**
+ * @brief Upper bound of the bytes a single cell takes once encoded, that is
+ *      a foreground and a background color sequence followed by a glyph.
+ * 
+ */
+#define CELL_MAX_LENGTH \
+    (2 * (TG_DIRECT_COLOR_SEQUENCE_LENGTH - 1) + TG_GLYPH_MAX_LENGTH)
+
+
+
+/**
+ * @brief Upper bound of the bytes a cursor movement takes, such as
+ *      "\033[<n>E" with n up to 10 digits long.
+ * 
+ */
+#define MOVE_MAX_LENGTH 16
+
+
+
+/**
+ * @brief Number of cell rows in a band, the unit of work handed to a thread.
+ * 
+ */
+#define BAND_ROWS 8
+
+
+
+/**
+ * @brief The output of a band, together with its own scratch memory.
+ * 
+ */
+typedef struct render_band
+{
+    char *out;      /**< The encoded rows. */
+    size_t len;     /**< Bytes in `out`. */
+    uint8_t *luma;  /**< Scratch buffer for a row of lumas. */
+    int first;      /**< The first cell row redrawn in delta mode, or -1. */
+    int last;       /**< The last cell row redrawn in delta mode. */
+
+    /** Scratch buffer for a row of canvas cells, when rendering to one. */
+    tg_canvas_cell *cells;
+} render_band;
+
+
+
+/**
+ * @brief State shared by the threads rendering a batch of bands.
+ * 
+ * A batch is made of a band of cell rows per thread. The pixel rows of the
+ * whole batch are pulled from the source and quantized before its cells are
+ * encoded.
+ * 
+ */
+typedef struct render_state
+{
+    int width;
+    tg_render_mode mode;
+    int pixel_rows;             /**< Pixel rows per cell row. */
+    const tg_ramp *ramp;        /**< The glyphs of the ASCII mode. */
+    tg_quantizer quantizer;
+    int serial;                 /**< Whether quantization is serial. */
+
+    const uint8_t **rows;       /**< The pixel rows of the current batch. */
+    int row_count;              /**< Number of pixel rows in the batch. */
+    int first_row;              /**< Position of the batch in the image. */
+    uint32_t *colors;           /**< Quantized colors of the batch rows. */
+    uint8_t *levels;            /**< Ramp levels of the batch rows. */
+
+    tg_delta *delta;            /**< The previous frame, or NULL. */
+    int incremental;            /**< Whether only changed cells are drawn. */
+
+    /** The canvas cells are stored into instead of being encoded, or NULL. */
+    const tg_cell_target *target;
+
+    render_band *bands;
+} render_state;
+
+
+
+size_t tg_encode_color(char *out, uint32_t color,
+    tg_terminal_layer terminal_layer)
+{
+    int background = terminal_layer == TG_TERMINAL_LAYER_BACKGROUND;
+
+    if (color & TG_COLOR_DIRECT_FLAG)
+    {
+        tg_direct_color_sequence direct_color_sequence;
+        tg_to_direct_color_sequence(direct_color_sequence, color & 0xffffff,
+            terminal_layer);
+        memcpy(out, direct_color_sequence, TG_DIRECT_COLOR_SEQUENCE_LENGTH - 1);
+        return TG_DIRECT_COLOR_SEQUENCE_LENGTH - 1;
+    }
+
+    if (color & TG_COLOR_INDEXED_FLAG)
+    {
+        // The first 16 colors have their own short sequences, 30-37 and
+        // 90-97 for the foreground, 40-47 and 100-107 for the background.
+        int index = color & 0xff;
+        if (index < 8)
+        {
+            return (size_t)sprintf(out, "\033[%dm", 
+                (background ? 40 : 30) + index);
+        }
+        if (index < 16)
+        {
+            return (size_t)sprintf(out, "\033[%dm", 
+                (background ? 100 : 90) + index - 8);
+        }
+        return (size_t)sprintf(out, "\033[%c8;5;%dm", terminal_layer, index);
+    }
+
+    memcpy(out, background ? TG_RESET_BACKGROUND_COLOR 
+                           : TG_RESET_FOREGROUND_COLOR,
+        TG_TEXT_STYLE_SEQUENCE_LENGTH - 1);
+    return TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
+}
+
+
+
+/**
+ * @brief Gets the RGB value of a cell color, which must not be the default
+ *      one.
+ * 
+ * @note This function is private to the renderer.
+ */
+static void color_rgb(const render_state *state, uint32_t color, int rgb[3])
+{
+    if (color & TG_COLOR_DIRECT_FLAG)
+    {
+        rgb[0] = (int)(color >> 16 & 0xff);
+        rgb[1] = (int)(color >> 8 & 0xff);
+        rgb[2] = (int)(color & 0xff);
+        return;
+    }
+
+    const uint8_t *entry = state->quantizer.palette[color & 0xff];
+    rgb[0] = entry[0];
+    rgb[1] = entry[1];
+    rgb[2] = entry[2];
+}
+
+
+
+/**
+ * @brief Tells whether a cell looks the same as it does on screen, within
+ *      the threshold of the delta.
+ * 
+ * @note This function is private to the renderer.
+ */
+static int cells_match(const render_state *state, const tg_cell *shown,
+    const tg_cell *cell)
+{
+    if (shown->glyph.length != cell->glyph.length ||
+        memcmp(shown->glyph.bytes, cell->glyph.bytes, cell->glyph.length))
+    {
+        return 0;
+    }
+
+    uint32_t shown_colors[2] = { shown->fg, shown->bg };
+    uint32_t colors[2] = { cell->fg, cell->bg };
+    for (int i = 0; i < 2; i++)
+    {
+        if (shown_colors[i] == colors[i])
+        {
+            continue;
+        }
+        if (state->delta->threshold <= 0 || 
+            shown_colors[i] == TG_COLOR_DEFAULT || 
+            colors[i] == TG_COLOR_DEFAULT)
+        {
+            return 0;
+        }
+
+        // The "redmean" distance, scaled by 256: red weighs more in reddish
+        // colors and blue in bluish ones. A gray step of n weighs 2303 n^2.
+        int a[3];
+        int b[3];
+        color_rgb(state, shown_colors[i], a);
+        color_rgb(state, colors[i], b);
+        int mean_red = (a[0] + b[0]) / 2;
+        int64_t dr = a[0] - b[0];
+        int64_t dg = a[1] - b[1];
+        int64_t db = a[2] - b[2];
+        int64_t distance = (512 + mean_red) * dr * dr + 1024 * dg * dg 
+                         + (767 - mean_red) * db * db;
+        int64_t threshold = state->delta->threshold;
+        if (distance > 2303 * threshold * threshold)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+
+/**
+ * @brief Turns the quantized pixels under column `x` of a cell row into a
+ *      cell, as the render mode draws it.
+ * 
+ * @param state The render state.
+ * @param top The colors of the cells, or of their top pixels in the vertical
+ *      modes.
+ * @param bottom The colors of the bottom pixels in the vertical modes, NULL
+ *      if the image ends before them.
+ * @param levels The ramp levels of the cells, in the ASCII mode, or their
+ *      lumas when the levels are not dithered.
+ * @param x The column.
+ * @param cell The cell to fill.
+ * 
+ * @note This function is private to the renderer.
+ */
+static void make_cell(const render_state *state, const uint32_t *top,
+    const uint32_t *bottom, const uint8_t *levels, int x, tg_cell *cell)
+{
+    static const tg_glyph blank = { " ", 1 };
+    static const tg_glyph upper_half_block = {
+        UPPER_HALF_BLOCK, sizeof(UPPER_HALF_BLOCK) - 1
+    };
+
+    cell->fg = TG_COLOR_DEFAULT;
+    cell->bg = top[x];
+    cell->glyph = blank;
+
+    switch (state->mode)
+    {
+    case TG_RENDER_MODE_ASCII:
+        // Without dithering the levels are plain lumas, which the ramp maps
+        // to glyphs on its own.
+        cell->glyph = state->quantizer.dithers_levels
+                    ? state->ramp->by_level[levels[x]]
+                    : state->ramp->by_luma[levels[x]];
+        break;
+
+    case TG_RENDER_MODE_BLOCK:
+        break;
+
+    case TG_RENDER_MODE_HALF_BLOCK:
+        // When both halves match, a blank cell does the job without a
+        // foreground change.
+        cell->bg = bottom ? bottom[x] : TG_COLOR_DEFAULT;
+        if (top[x] != cell->bg)
+        {
+            cell->fg = top[x];
+            cell->glyph = upper_half_block;
+        }
+        break;
+    }
+}
+
+
+
+/**
+ * @brief Encodes a row of cells as a string of escape sequences and glyphs.
+ * 
+ * A whole row is terminated by a reset-all-modes sequence and a newline. In
+ * delta mode, only the cells that changed are encoded, each run of them
+ * preceded by a cursor movement to its column, and the row is only
+ * terminated by a reset if colors are left set.
+ * 
+ * @param state The render state.
+ * @param top The colors of the cells, or of their top pixels in the vertical
+ *      modes.
+ * @param bottom The colors of the bottom pixels in the vertical modes, NULL
+ *      if the image ends before them.
+ * @param levels The ramp levels of the cells, in the ASCII mode, or their
+ *      lumas when the levels are not dithered.
+ * @param shown The row of the delta, updated with the cells drawn, or NULL
+ *      without a delta.
+ * @param out The buffer to encode the row into. It must be at least
+ *      `width * CELL_MAX_LENGTH + TG_TEXT_STYLE_SEQUENCE_LENGTH` bytes long,
+ *      and `width * MOVE_MAX_LENGTH` more in delta mode.
+ * 
+ * @return The number of bytes written into `out`, 0 in delta mode if no cell
+ *      changed.
+ * 
+ * @note This function is private to the renderer.
+ */
+static size_t encode_cells(const render_state *state, const uint32_t *top,
+    const uint32_t *bottom, const uint8_t *levels, tg_cell *shown, char *out)
+{
+    size_t len = 0;
+
+    // Color sequences are only needed when a color differs from the previous
+    // cell one, so we keep track of the colors in effect. Every row starts
+    // from the default colors, which keeps rows independent from each other
+    // and the output the same whatever the band split is.
+    uint32_t fg = TG_COLOR_DEFAULT;
+    uint32_t bg = TG_COLOR_DEFAULT;
+    int column = 0;
+
+    for (int x = 0; x < state->width; x++)
+    {
+        tg_cell cell;
+        make_cell(state, top, bottom, levels, x, &cell);
+
+        if (shown)
+        {
+            // A cell that looks the same as on screen is skipped, and kept as
+            // shown, so that changes below the threshold still add up.
+            if (state->incremental && cells_match(state, &shown[x], &cell))
+            {
+                continue;
+            }
+            shown[x] = cell;
+        }
+
+        if (state->incremental && column != x)
+        {
+            len += (size_t)sprintf(out + len, "\033[%dG", x + 1);
+        }
+        column = x + 1;
+
+        if (cell.fg != TG_COLOR_DEFAULT && cell.fg != fg)
+        {
+            len += tg_encode_color(out + len, cell.fg, 
+                TG_TERMINAL_LAYER_FOREGROUND);
+            fg = cell.fg;
+        }
+        if (cell.bg != bg)
+        {
+            len += tg_encode_color(out + len, cell.bg, 
+                TG_TERMINAL_LAYER_BACKGROUND);
+            bg = cell.bg;
+        }
+
+        memcpy(out + len, cell.glyph.bytes, cell.glyph.length);
+        len += cell.glyph.length;
+    }
+
+    // The reset keeps the colors from bleeding into the rest of the terminal
+    // line, or into the next cells drawn in delta mode.
+    if (state->incremental && fg == TG_COLOR_DEFAULT && 
+        bg == TG_COLOR_DEFAULT)
+    {
+        return len;
+    }
+    memcpy(out + len, TG_RESET_ALL_MODES, TG_TEXT_STYLE_SEQUENCE_LENGTH - 1);
+    len += TG_TEXT_STYLE_SEQUENCE_LENGTH - 1;
+    if (!state->incremental)
+    {
+        out[len++] = '\n';
+    }
+
+    return len;
+}
+
+
+
+/**
+ * @brief Stores a row of cells into the canvas of the render target, at its
+ *      position, as canvas cells.
+ * 
+ * @param row The cell row in the image.
+ * 
+ * @note This function is private to the renderer.
+ */
+static void store_cells(const render_state *state, const uint32_t *top,
+    const uint32_t *bottom, const uint8_t *levels, int row,
+    tg_canvas_cell *cells)
+{
+    for (int x = 0; x < state->width; x++)
+    {
+        tg_cell cell;
+        make_cell(state, top, bottom, levels, x, &cell);
+
+        // Glyphs are well-formed UTF-8, as the ramps only take that.
+        const unsigned char *bytes = (const unsigned char*)cell.glyph.bytes;
+        uint32_t codepoint = cell.glyph.length == 1 
+                           ? bytes[0] : bytes[0] & (0x7f >> cell.glyph.length);
+        for (int i = 1; i < cell.glyph.length; i++)
+        {
+            codepoint = (codepoint << 6) | (bytes[i] & 0x3f);
+        }
+
+        cells[x].codepoint = codepoint;
+        cells[x].fg = cell.fg;
+        cells[x].bg = cell.bg;
+        cells[x].style = 0;
+    }
+    tg_canvas_store_row(state->target->canvas, state->target->x,
+        state->target->y + row, cells, state->width);
+}
+
+
+
+/**
+ * @brief Quantizes, unless that is done serially, and encodes the cell rows
+ *      of a band into the band own buffer, or stores them into the target
+ *      canvas.
+ * 
+ * @note This function is private to the renderer, which runs it on the
+ *      thread pool.
+ */
+static void encode_band(void *ctx, int index)
+{
+    render_state *state = (render_state*)ctx;
+    render_band *band = &state->bands[index];
+    size_t width = (size_t)state->width;
+
+    int first = index * BAND_ROWS * state->pixel_rows;
+    int last = first + BAND_ROWS * state->pixel_rows;
+    if (last > state->row_count)
+    {
+        last = state->row_count;
+    }
+
+    if (!state->serial)
+    {
+        for (int y = first; y < last; y++)
+        {
+            tg_quantize_row(&state->quantizer, state->rows[y],
+                state->first_row + y, band->luma, state->colors + y * width,
+                state->levels + y * width);
+        }
+    }
+
+    // In delta mode, room is left at the start of the buffer for the writer
+    // to move the cursor to the first row of the band.
+    size_t base = state->incremental ? MOVE_MAX_LENGTH : 0;
+    band->len = 0;
+    band->first = -1;
+    band->last = -1;
+    for (int y = first; y < last; y += state->pixel_rows)
+    {
+        const uint32_t *bottom = NULL;
+        if (state->pixel_rows == 2 && y + 1 < last)
+        {
+            bottom = state->colors + (y + 1) * width;
+        }
+
+        int cell_row = (state->first_row + y) / state->pixel_rows;
+        if (state->target)
+        {
+            store_cells(state, state->colors + y * width, bottom,
+                state->levels + y * width, cell_row, band->cells);
+            continue;
+        }
+
+        tg_cell *shown = state->delta 
+                       ? state->delta->cells + (size_t)cell_row * width
+                       : NULL;
+        char *out = band->out + base + band->len;
+        if (!state->incremental)
+        {
+            band->len += encode_cells(state, state->colors + y * width, 
+                bottom, state->levels + y * width, shown, out);
+            continue;
+        }
+
+        // A changed row is reached from the previous one of the band, which
+        // is only known to be needed once the row is encoded, after it.
+        char move[MOVE_MAX_LENGTH];
+        size_t move_length = band->first < 0 ? 0 
+            : (size_t)sprintf(move, "\033[%dE", cell_row - band->last);
+        size_t length = encode_cells(state, state->colors + y * width, 
+            bottom, state->levels + y * width, shown, out + move_length);
+        if (length)
+        {
+            memcpy(out, move, move_length);
+            band->len += move_length + length;
+            band->first = band->first < 0 ? cell_row : band->first;
+            band->last = cell_row;
+        }
+    }
+}
+
+
+
+int tg_render_region(int width, int height, const tg_render_opts *opts,
+    tg_rect *region)
+{
+    region->x = 0;
+    region->y = 0;
+    region->width = width;
+    region->height = height;
+    if (!opts || opts->crop_width <= 0 || opts->crop_height <= 0)
+    {
+        return 0;
+    }
+
+    // The crop rectangle is clamped to the image, so that panning past its
+    // edges simply shows less of it.
+    int64_t x0 = opts->crop_x < 0 ? 0 : opts->crop_x;
+    int64_t y0 = opts->crop_y < 0 ? 0 : opts->crop_y;
+    int64_t x1 = (int64_t)opts->crop_x + opts->crop_width;
+    int64_t y1 = (int64_t)opts->crop_y + opts->crop_height;
+    x1 = x1 > width ? width : x1;
+    y1 = y1 > height ? height : y1;
+    if (x1 <= x0 || y1 <= y0)
+    {
+        return 1;
+    }
+
+    region->x = (int)x0;
+    region->y = (int)y0;
+    region->width = (int)(x1 - x0);
+    region->height = (int)(y1 - y0);
+    return 0;
+}
+
+
+
+int tg_cell_pixel_rows(tg_render_mode mode)
+{
+    return mode == TG_RENDER_MODE_HALF_BLOCK ? 2 : 1;
+}
+
+
+
+void tg_fit_size(int width, int height, const tg_render_opts *opts,
+    int *columns_out, int *rows_out)
+{
+    *columns_out = width;
+    *rows_out = height;
+    if (!opts || (opts->columns == 0 && opts->rows == 0))
+    {
+        // No budget, every pixel is a cell.
+        return;
+    }
+
+    int max_columns = opts->columns;
+    int max_rows = opts->rows;
+    if (max_columns == TG_SIZE_TERMINAL || max_rows == TG_SIZE_TERMINAL)
+    {
+        int terminal_columns = 0;
+        int terminal_rows = 0;
+        tg_terminal_size(&terminal_columns, &terminal_rows);
+
+        if (max_columns == TG_SIZE_TERMINAL)
+        {
+            max_columns = terminal_columns;
+        }
+        if (max_rows == TG_SIZE_TERMINAL)
+        {
+            // The last row is left to whatever comes after the image, so
+            // that its first rows do not scroll out of sight.
+            max_rows = terminal_rows > 1 ? terminal_rows - 1 : 1;
+        }
+    }
+
+    double aspect = opts->cell_aspect > 0 
+                  ? opts->cell_aspect : TG_DEFAULT_CELL_ASPECT;
+
+    // In the vertical modes a cell holds more than one pixel row, so both the
+    // budget and the pixel aspect are in pixel rows rather than cell rows.
+    int pixel_rows = tg_cell_pixel_rows(opts->mode);
+    if (max_rows > 0)
+    {
+        max_rows *= pixel_rows;
+    }
+
+    // The size the image would take at its own scale, with rows squeezed so
+    // that pixels taller than wide do not stretch it.
+    double columns = width;
+    double rows = height / aspect * pixel_rows;
+
+    double scale = 1.0;
+    if (max_columns > 0 && columns * scale > max_columns)
+    {
+        scale = max_columns / columns;
+    }
+    if (max_rows > 0 && rows * scale > max_rows)
+    {
+        scale = max_rows / rows;
+    }
+
+    // Boxes are at least one pixel, so the image is never enlarged.
+    int fitted_columns = (int)(columns * scale + 0.5);
+    int fitted_rows = (int)(rows * scale + 0.5);
+    *columns_out = fitted_columns < 1 ? 1 
+                 : fitted_columns > width ? width : fitted_columns;
+    *rows_out = fitted_rows < 1 ? 1 
+              : fitted_rows > height ? height : fitted_rows;
+}
+
+
+
+/**
+ * @brief Writes output to a stdio stream.
+ * 
+ * @note This function is private to tg_sink_file, which uses it as the
+ *      `write` callback of its sink.
+ */
+static int file_sink_write(void *ctx, const char *data, size_t length)
+{
+    return fwrite(data, 1, length, (FILE*)ctx) != length;
+}
+
+
+
+tg_sink tg_sink_file(FILE *file)
+{
+    tg_sink sink = { file_sink_write, file };
+    return sink;
+}
+
+
+
+int tg_render(const tg_image *image, const tg_render_opts *opts, 
+    tg_sink *sink)
+{
+    if (!image || !image->pixels || image->width <= 0 || image->height <= 0)
+    {
+        return 1;
+    }
+
+    tg_row_source source;
+    tg_image_source_init(&source, image);
+    return tg_render_source(&source, opts, NULL, sink);
+}
+
+
+
+tg_delta *tg_delta_create(int threshold)
+{
+    tg_delta *delta = (tg_delta*)calloc(1, sizeof(tg_delta));
+    if (delta)
+    {
+        delta->threshold = threshold;
+    }
+    return delta;
+}
+
+
+
+void tg_delta_free(tg_delta *delta)
+{
+    if (delta)
+    {
+        free(delta->cells);
+        free(delta);
+    }
+}
+
+
+
+void tg_delta_reset(tg_delta *delta)
+{
+    delta->columns = 0;
+    delta->rows = 0;
+}
+
+
+
+int tg_render_delta(const tg_image *image, const tg_render_opts *opts,
+    tg_delta *delta, tg_sink *sink)
+{
+    if (!delta)
+    {
+        return 1;
+    }
+    if (!image || !image->pixels || image->width <= 0 || image->height <= 0)
+    {
+        tg_delta_reset(delta);
+        return 1;
+    }
+
+    tg_row_source source;
+    tg_image_source_init(&source, image);
+    return tg_render_source(&source, opts, delta, sink);
+}
+
+
+
+/**
+ * @brief Encodes a source at its own size, either to a sink or into a
+ *      canvas.
+ * 
+ * @note This function is private to the renderer, which backs both
+ *      tg_encode_source and render_source with it.
+ */
+static int encode_source(tg_row_source *source, const tg_render_opts *opts,
+    tg_delta *delta, tg_sink *sink, const tg_cell_target *target)
+{
+    // ---------------------------------- 01 ----------------------------------
+    // Setup. The image is processed in batches of one band per thread: rows
+    // are pulled from the source for the whole batch, the bands are encoded
+    // in parallel, and their buffers are written out in order. Memory thus
+    // depends on the image width and the thread count, never on its height.
+    tg_render_opts defaults = {0};
+    opts = opts ? opts : &defaults;
+    tg_sink standard_output = tg_sink_file(stdout);
+    sink = sink ? sink : &standard_output;
+
+    int width = source->width;
+    int threads = tg_thread_count(opts->threads);
+
+    render_state state;
+    state.width = width;
+    state.mode = opts->mode;
+    state.pixel_rows = tg_cell_pixel_rows(opts->mode);
+    state.ramp = opts->ramp ? opts->ramp : tg_ramp_default();
+    state.row_count = 0;
+
+    int batch_rows = threads * BAND_ROWS * state.pixel_rows;
+    size_t row_size = 3 * (size_t)width;
+    size_t line_size = (size_t)width * CELL_MAX_LENGTH
+                     + TG_TEXT_STYLE_SEQUENCE_LENGTH;
+
+    // With a delta of the same size, the previous frame is drawn over cell
+    // by cell. Otherwise the new frame is drawn whole, and recorded into the
+    // delta. The delta only gets its size back once the frame is done, so
+    // that it is left reset on failure.
+    int frame_rows = (source->height + state.pixel_rows - 1) 
+                   / state.pixel_rows;
+    int previous_rows = delta ? delta->rows : 0;
+    state.delta = delta;
+    state.incremental = delta && delta->columns == width && 
+                        delta->rows == frame_rows;
+    state.target = target;
+    if (delta)
+    {
+        line_size += (size_t)width * MOVE_MAX_LENGTH + MOVE_MAX_LENGTH;
+        tg_delta_reset(delta);
+    }
+
+    int result = tg_quantizer_init(&state.quantizer, width, opts->depth,
+        opts->dither, opts->mode == TG_RENDER_MODE_ASCII 
+                      ? state.ramp->levels : 0);
+    state.serial = tg_quantizer_is_serial(&state.quantizer);
+
+    uint8_t *scratch = (uint8_t*)malloc(batch_rows * row_size);
+    uint8_t *luma = (uint8_t*)malloc((size_t)width);
+    state.rows = (const uint8_t**)malloc(batch_rows * sizeof(uint8_t*));
+    state.colors = (uint32_t*)malloc(batch_rows * (size_t)width 
+                                                * sizeof(uint32_t));
+    state.levels = (uint8_t*)malloc(batch_rows * (size_t)width);
+    state.bands = (render_band*)calloc(threads, sizeof(render_band));
+    if (!scratch || !luma || !state.rows || !state.colors || !state.levels || 
+        !state.bands)
+    {
+        result = 1;
+    }
+
+    size_t cell_count = (size_t)width * frame_rows;
+    if (!result && delta && delta->capacity < cell_count)
+    {
+        tg_cell *cells = (tg_cell*)realloc(delta->cells, 
+            cell_count * sizeof(tg_cell));
+        result = !cells;
+        delta->cells = cells ? cells : delta->cells;
+        delta->capacity = cells ? cell_count : delta->capacity;
+    }
+
+    // Cells stored into a canvas go through a row of canvas cells instead
+    // of the output buffer.
+    for (int i = 0; i < threads && !result; i++)
+    {
+        render_band *band = &state.bands[i];
+        if (target)
+        {
+            band->cells = (tg_canvas_cell*)malloc((size_t)width 
+                                                  * sizeof(tg_canvas_cell));
+        }
+        else
+        {
+            band->out = (char*)malloc(BAND_ROWS * line_size 
+                                      + (delta ? MOVE_MAX_LENGTH : 0));
+        }
+        band->luma = (uint8_t*)malloc((size_t)width);
+        if ((!band->out && !band->cells) || !band->luma)
+        {
+            result = 1;
+        }
+    }
+
+    tg_thread_pool *pool = NULL;
+    if (!result && threads > 1)
+    {
+        // Without a pool the bands are simply encoded one after another.
+        pool = tg_thread_pool_create(threads);
+    }
+
+    // A previous frame of another size is cleared, from its top down, and
+    // the new one drawn in its place.
+    if (!result && !state.incremental && previous_rows > 0)
+    {
+        char clear[2 * MOVE_MAX_LENGTH];
+        int length = sprintf(clear, "\033[%dA\033[J", previous_rows);
+        result = sink->write(sink->ctx, clear, (size_t)length);
+    }
+
+    // ---------------------------------- 02 ----------------------------------
+    // Batch loop. In delta mode, `cursor_row` is the cell row the cursor is
+    // on, starting below the frame.
+    int cursor_row = frame_rows;
+    for (int y0 = 0; y0 < source->height && !result; y0 += batch_rows)
+    {
+        state.first_row = y0;
+        state.row_count = source->height - y0 < batch_rows 
+                        ? source->height - y0 : batch_rows;
+
+        for (int i = 0; i < state.row_count; i++)
+        {
+            state.rows[i] = source->read_row(source, y0 + i, 
+                scratch + i * row_size);
+            if (!state.rows[i])
+            {
+                result = 1;
+                break;
+            }
+
+            // Error diffusion needs the rows above to be done, so it runs
+            // here, one row at a time as they come in.
+            if (state.serial)
+            {
+                tg_quantize_row(&state.quantizer, state.rows[i], y0 + i, luma,
+                    state.colors + i * (size_t)width, 
+                    state.levels + i * (size_t)width);
+            }
+        }
+        if (result)
+        {
+            break;
+        }
+
+        int cell_rows = (state.row_count + state.pixel_rows - 1) 
+                      / state.pixel_rows;
+        int band_count = (cell_rows + BAND_ROWS - 1) / BAND_ROWS;
+        if (pool)
+        {
+            tg_thread_pool_run(pool, encode_band, &state, band_count);
+        }
+        else
+        {
+            for (int i = 0; i < band_count; i++)
+            {
+                encode_band(&state, i);
+            }
+        }
+
+        // Each band buffer is written as it is, in order, rather than being
+        // merged into a single one first. In delta mode, it is preceded by
+        // the movement of the cursor to its first row, either up from below
+        // the frame or down from the last row drawn.
+        for (int i = 0; i < band_count && !result; i++)
+        {
+            render_band *band = &state.bands[i];
+            char *data = band->out;
+            size_t length = band->len;
+            if (state.incremental && band->first >= 0)
+            {
+                char move[MOVE_MAX_LENGTH];
+                int move_length = cursor_row == frame_rows
+                    ? sprintf(move, "\033[%dF", frame_rows - band->first)
+                    : sprintf(move, "\033[%dE", band->first - cursor_row);
+                data = band->out + MOVE_MAX_LENGTH - move_length;
+                memcpy(data, move, (size_t)move_length);
+                length += (size_t)move_length;
+                cursor_row = band->last;
+            }
+
+            if (length && sink->write(sink->ctx, data, length))
+            {
+                result = 1;
+            }
+        }
+    }
+
+    // The cursor is left below the frame, as a whole frame leaves it.
+    if (!result && cursor_row != frame_rows)
+    {
+        char move[MOVE_MAX_LENGTH];
+        int length = sprintf(move, "\033[%dE", frame_rows - cursor_row);
+        result = sink->write(sink->ctx, move, (size_t)length);
+    }
+    if (!result && delta)
+    {
+        delta->columns = width;
+        delta->rows = frame_rows;
+    }
+
+    // ---------------------------------- 03 ----------------------------------
+    // Cleanup.
+    tg_thread_pool_destroy(pool);
+    for (int i = 0; state.bands && i < threads; i++)
+    {
+        free(state.bands[i].out);
+        free(state.bands[i].cells);
+        free(state.bands[i].luma);
+    }
+    free(state.bands);
+    free(state.levels);
+    free(state.colors);
+    free(state.rows);
+    free(luma);
+    free(scratch);
+    tg_quantizer_free(&state.quantizer);
+    return result;
+}
+
+
+
+int tg_encode_source(tg_row_source *source, const tg_render_opts *opts,
+    tg_delta *delta, tg_sink *sink)
+{
+    return encode_source(source, opts, delta, sink, NULL);
+}
+
+
+
+/**
+ * @brief Renders a source, cropping and fitting it first as the options
+ *      require, either to a sink or into a canvas.
+ * 
+ * @note This function is private to the renderer, which backs both
+ *      tg_render_source and tg_render_source_cells with it.
+ */
+static int render_source(tg_row_source *source, const tg_render_opts *opts,
+    tg_delta *delta, tg_sink *sink, const tg_cell_target *target)
+{
+    // If the image has to be cropped or shrunk, the source is wrapped into a
+    // resampling one, which pulls and averages the original rows as the
+    // encoder asks for output rows.
+    tg_rect region;
+    if (tg_render_region(source->width, source->height, opts, &region))
+    {
+        if (delta)
+        {
+            tg_delta_reset(delta);
+        }
+        return 1;
+    }
+
+    int columns = 0;
+    int rows = 0;
+    tg_fit_size(region.width, region.height, opts, &columns, &rows);
+    if (columns == source->width && rows == source->height)
+    {
+        return encode_source(source, opts, delta, sink, target);
+    }
+
+    tg_row_source resampled = {0};
+    if (tg_resample_source_init(&resampled, source, &region, columns, rows))
+    {
+        if (delta)
+        {
+            tg_delta_reset(delta);
+        }
+        return 1;
+    }
+    int result = encode_source(&resampled, opts, delta, sink, target);
+    tg_resample_source_free(&resampled);
+    return result;
+}
+
+
+
+int tg_render_source(tg_row_source *source, const tg_render_opts *opts,
+    tg_delta *delta, tg_sink *sink)
+{
+    return render_source(source, opts, delta, sink, NULL);
+}
+
+
+
+int tg_render_source_cells(tg_row_source *source, const tg_render_opts *opts,
+    const tg_cell_target *target)
+{
+    return render_source(source, opts, NULL, NULL, target);
+}
@@ -0,0 +1,688 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/termglyph/cache.h"
+#include "internal.h"
+
+
+
+/**
+ * @brief Version of the stored output, part of every key. It is bumped
+ *      whenever the renderer output changes for the same options, so that
+ *      entries written by older versions are never served.
+ * 
+ */
+#define RENDER_CACHE_VERSION 1
+
+
+
+/**
+ * @brief Length of an entry name, the key as hexadecimal digits.
+ * 
+ */
+#define KEY_LENGTH 32
+
+
+
+/**
+ * @brief Age in seconds past which a temporary file is taken for the
+ *      leftover of a process that died while storing an entry.
+ * 
+ */
+#define TEMPORARY_MAX_AGE 3600
+
+
+
+/**
+ * @brief Prefix of the temporary files entries are written to.
+ * 
+ */
+#define TEMPORARY_PREFIX ".tmp."
+
+
+
+struct tg_render_cache
+{
+    char *directory;
+    size_t max_bytes;
+
+    /** Numbers the temporary files of this process. Updated atomically. */
+    unsigned long temporaries;
+
+    /** The statistics, whose fields are updated atomically. */
+    tg_render_cache_stats stats;
+};
+
+
+
+/**
+ * @brief The output of a render, gathered in memory.
+ * 
+ */
+typedef struct output_buffer
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+} output_buffer;
+
+
+
+/**
+ * @brief An entry found in the cache directory.
+ * 
+ */
+typedef struct stored_entry
+{
+    struct timespec used;       /**< When the entry was last used. */
+    off_t size;
+    char name[KEY_LENGTH + 1];
+} stored_entry;
+
+
+
+/**
+ * @brief Rotates a 64-bit value left.
+ * 
+ * @note This function is private to the rendered-output cache.
+ */
+static uint64_t rotate_left(uint64_t value, int bits)
+{
+    return value << bits | value >> (64 - bits);
+}
+
+
+
+/**
+ * @brief Mixes the bits of a 64-bit value, so that each one affects all of
+ *      them.
+ * 
+ * @note This function is private to the rendered-output cache.
+ */
+static uint64_t hash_finalize(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdu;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53u;
+    value ^= value >> 33;
+    return value;
+}
+
+
+
+/**
+ * @brief Hashes bytes into 128 bits, the way MurmurHash3 x64 128 does.
+ * 
+ * Inputs are hashed in full before every lookup, so the hash has to keep up
+ * with reading them from the page cache; it takes two multiplications per
+ * 16 bytes.
+ * 
+ * @note This function is private to the rendered-output cache.
+ */
+static void cache_hash(const void *data, size_t length, uint64_t seed,
+    uint64_t hash[2])
+{
+    const uint64_t c1 = 0x87c37b91114253d5u;
+    const uint64_t c2 = 0x4cf5ad432745937fu;
+    const uint8_t *bytes = (const uint8_t*)data;
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+
+    size_t blocks = length / 16;
+    for (size_t i = 0; i < blocks; i++)
+    {
+        uint64_t k1;
+        uint64_t k2;
+        memcpy(&k1, bytes + 16 * i, 8);
+        memcpy(&k2, bytes + 16 * i + 8, 8);
+
+        h1 ^= rotate_left(k1 * c1, 31) * c2;
+        h1 = (rotate_left(h1, 27) + h2) * 5 + 0x52dce729;
+        h2 ^= rotate_left(k2 * c2, 33) * c1;
+        h2 = (rotate_left(h2, 31) + h1) * 5 + 0x38495ab5;
+    }
+
+    // The last 0 to 15 bytes, little endian.
+    const uint8_t *tail = bytes + 16 * blocks;
+    size_t rest = length % 16;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+    for (size_t i = rest; i > 8; i--)
+    {
+        k2 = k2 << 8 | tail[i - 1];
+    }
+    for (size_t i = rest < 8 ? rest : 8; i > 0; i--)
+    {
+        k1 = k1 << 8 | tail[i - 1];
+    }
+    if (rest > 8)
+    {
+        h2 ^= rotate_left(k2 * c2, 33) * c1;
+    }
+    if (rest > 0)
+    {
+        h1 ^= rotate_left(k1 * c1, 31) * c2;
+    }
+
+    h1 ^= (uint64_t)length;
+    h2 ^= (uint64_t)length;
+    h1 += h2;
+    h2 += h1;
+    h1 = hash_finalize(h1);
+    h2 = hash_finalize(h2);
+    h1 += h2;
+    h2 += h1;
+    hash[0] = h1;
+    hash[1] = h2;
+}
+
+
+
+/**
+ * @brief Computes the name of the entry holding the output of an image
+ *      rendered with some options.
+ * 
+ * Only the options the output depends on are part of the key, as the
+ * renderer resolves them: the terminal size replaces `TG_SIZE_TERMINAL`, the
+ * default cell aspect a zero one, and the glyphs of the ramp the pointer to
+ * it.
+ * 
+ * @note This function is private to the rendered-output cache.
+ */
+static void cache_key(const void *data, size_t length,
+    const tg_render_opts *opts, char name[KEY_LENGTH + 1])
+{
+    tg_render_opts defaults = {0};
+    opts = opts ? opts : &defaults;
+
+    uint64_t record[15] = {0};
+    cache_hash(data, length, 0, record);
+    record[2] = RENDER_CACHE_VERSION;
+    record[3] = (uint64_t)opts->mode;
+    record[4] = (uint64_t)opts->depth;
+    record[5] = (uint64_t)opts->dither;
+
+    int columns = opts->columns;
+    int rows = opts->rows;
+    if (columns == TG_SIZE_TERMINAL || rows == TG_SIZE_TERMINAL)
+    {
+        int terminal_columns = 0;
+        int terminal_rows = 0;
+        tg_terminal_size(&terminal_columns, &terminal_rows);
+        columns = columns == TG_SIZE_TERMINAL ? terminal_columns : columns;
+        if (rows == TG_SIZE_TERMINAL)
+        {
+            // The same row the renderer leaves to what comes after.
+            rows = terminal_rows > 1 ? terminal_rows - 1 : 1;
+        }
+    }
+    record[6] = (uint64_t)(int64_t)columns;
+    record[7] = (uint64_t)(int64_t)rows;
+    record[8] = (uint64_t)(int64_t)opts->crop_x;
+    record[9] = (uint64_t)(int64_t)opts->crop_y;
+    record[10] = (uint64_t)(int64_t)opts->crop_width;
+    record[11] = (uint64_t)(int64_t)opts->crop_height;
+
+    double aspect = opts->cell_aspect > 0
+                  ? opts->cell_aspect : TG_DEFAULT_CELL_ASPECT;
+    memcpy(&record[12], &aspect, sizeof(double));
+
+    if (opts->mode == TG_RENDER_MODE_ASCII)
+    {
+        // The glyphs, spelled out one after another.
+        const tg_ramp *ramp = opts->ramp ? opts->ramp : tg_ramp_default();
+        char glyphs[256 * TG_GLYPH_MAX_LENGTH];
+        size_t glyphs_length = 0;
+        for (int i = 0; i < ramp->levels; i++)
+        {
+            const tg_glyph *glyph = &ramp->by_level[i];
+            memcpy(glyphs + glyphs_length, glyph->bytes, glyph->length);
+            glyphs_length += glyph->length;
+        }
+        cache_hash(glyphs, glyphs_length, (uint64_t)ramp->levels,
+            &record[13]);
+    }
+
+    uint64_t key[2];
+    cache_hash(record, sizeof(record), 0, key);
+    snprintf(name, KEY_LENGTH + 1, "%016llx%016llx",
+        (unsigned long long)key[0], (unsigned long long)key[1]);
+}
+
+
+
+/**
+ * @brief Writes the output stored in an entry to a sink, at once.
+ * 
+ * @return -1 if there is no such entry, otherwise the result of the write.
+ * 
+ * @note This function is private to the rendered-output cache.
+ */
+static int cache_load(tg_render_cache *cache, const char *name,
+    tg_sink *sink)
+{
+    char path[4096];
+    if (snprintf(path, sizeof(path), "%s/%s", cache->directory, name) >=
+        (int)sizeof(path))
+    {
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    struct stat st;
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd,
+            0);
+    }
+    if (mapping == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+
+    // The modification time tells how recently an entry was used, so that
+    // the ones trimmed first are the ones no process asked for in a while.
+    // Entries are never modified, and a failure only makes this one look
+    // older than it is.
+    futimens(fd, NULL);
+    close(fd);
+
+    int result = sink->write(sink->ctx, (const char*)mapping,
+        (size_t)st.st_size);
+    munmap(mapping, (size_t)st.st_size);
+    return result;
+}
+
+
+
+/**
+ * @brief Tells whether a file name is the one of an entry.
+ * 
+ * @note This function is private to the rendered-output cache.
+ */
+static int is_entry_name(const char *name)
+{
+    size_t i = 0;
+    while ((name[i] >= '0' && name[i] <= '9') ||
+           (name[i] >= 'a' && name[i] <= 'f'))
+    {
+        i++;
+    }
+    return i == KEY_LENGTH && name[i] == '\0';
+}
+
+
+
+/**
+ * @brief Orders entries from the least to the most recently used.
+ * 
+ * @note This function is private to the rendered-output cache, which sorts
+ *      entries with it.
+ */
+static int compare_entries(const void *a, const void *b)
+{
+    const struct timespec *ta = &((const stored_entry*)a)->used;
+    const struct timespec *tb = &((const stored_entry*)b)->used;
+    if (ta->tv_sec != tb->tv_sec)
+    {
+        return ta->tv_sec < tb->tv_sec ? -1 : 1;
+    }
+    return (ta->tv_nsec > tb->tv_nsec) - (ta->tv_nsec < tb->tv_nsec);
+}
+
+
+
+/**
+ * @brief Deletes the least recently used entries until the cache fits its
+ *      size cap, and the temporary files left behind by dead processes.
+ * 
+ * Other processes may trim the cache at the same time, so entries may vanish
+ * under this function; they are merely skipped.
+ * 
+ * @note This function is private to the rendered-output cache.
+ */
+static void cache_trim(tg_render_cache *cache)
+{
+    DIR *directory = opendir(cache->directory);
+    if (!directory)
+    {
+        return;
+    }
+    int directory_fd = dirfd(directory);
+    time_t now = time(NULL);
+
+    stored_entry *entries = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t total = 0;
+    struct dirent *dirent;
+    while ((dirent = readdir(directory)))
+    {
+        struct stat st;
+        if (fstatat(directory_fd, dirent->d_name, &st, AT_SYMLINK_NOFOLLOW) ||
+            !S_ISREG(st.st_mode))
+        {
+            continue;
+        }
+
+        if (strncmp(dirent->d_name, TEMPORARY_PREFIX,
+                sizeof(TEMPORARY_PREFIX) - 1) == 0)
+        {
+            if (now - st.st_mtime > TEMPORARY_MAX_AGE)
+            {
+                unlinkat(directory_fd, dirent->d_name, 0);
+            }
+            continue;
+        }
+        if (!is_entry_name(dirent->d_name))
+        {
+            continue;
+        }
+
+        if (count == capacity)
+        {
+            size_t grown = capacity ? 2 * capacity : 64;
+            stored_entry *more = (stored_entry*)realloc(entries,
+                grown * sizeof(stored_entry));
+            if (!more)
+            {
+                break;
+            }
+            entries = more;
+            capacity = grown;
+        }
+        entries[count].used = st.st_mtim;
+        entries[count].size = st.st_size;
+        memcpy(entries[count].name, dirent->d_name, KEY_LENGTH + 1);
+        total += (size_t)st.st_size;
+        count++;
+    }
+
+    if (total > cache->max_bytes)
+    {
+        qsort(entries, count, sizeof(stored_entry), compare_entries);
+        for (size_t i = 0; i < count && total > cache->max_bytes; i++)
+        {
+            total -= (size_t)entries[i].size;
+            if (unlinkat(directory_fd, entries[i].name, 0) == 0)
+            {
+                __atomic_add_fetch(&cache->stats.evictions, 1,
+                    __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    free(entries);
+    closedir(directory);
+}
+
+
+
+/**
+ * @brief Stores the output of a render into an entry, then trims the cache.
+ * 
+ * The output is written to a temporary file of its own, which is renamed to
+ * the entry name once complete, so processes reading the entry meanwhile
+ * either miss it or find all of it. Two processes storing the same entry
+ * write the same bytes, so whichever rename comes last does not matter.
+ * 
+ * @note This function is private to the rendered-output cache.
+ */
+static void cache_store(tg_render_cache *cache, const char *name,
+    const char *data, size_t length)
+{
+    char path[4096];
+    char temporary[4096];
+    unsigned long number = __atomic_fetch_add(&cache->temporaries, 1,
+        __ATOMIC_RELAXED);
+    if (snprintf(path, sizeof(path), "%s/%s", cache->directory, name) >=
+            (int)sizeof(path) ||
+        snprintf(temporary, sizeof(temporary), "%s/" TEMPORARY_PREFIX "%ld.%lu",
+            cache->directory, (long)getpid(), number) >=
+            (int)sizeof(temporary))
+    {
+        return;
+    }
+
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    size_t written = 0;
+    while (written < length)
+    {
+        ssize_t result = write(fd, data + written, length - written);
+        if (result < 0 && errno != EINTR)
+        {
+            break;
+        }
+        written += result > 0 ? (size_t)result : 0;
+    }
+
+    if (close(fd) || written < length || rename(temporary, path))
+    {
+        unlink(temporary);
+        return;
+    }
+
+    __atomic_add_fetch(&cache->stats.stores, 1, __ATOMIC_RELAXED);
+    cache_trim(cache);
+}
+
+
+
+/**
+ * @brief Appends output to a buffer.
+ * 
+ * @note This function is private to the rendered-output cache, which
+ *      renders into a sink with this `write` callback.
+ */
+static int output_write(void *ctx, const char *data, size_t length)
+{
+    output_buffer *output = (output_buffer*)ctx;
+    if (output->capacity - output->length < length)
+    {
+        size_t capacity = output->capacity ? output->capacity : 65536;
+        while (capacity - output->length < length)
+        {
+            capacity *= 2;
+        }
+        char *grown = (char*)realloc(output->data, capacity);
+        if (!grown)
+        {
+            return 1;
+        }
+        output->data = grown;
+        output->capacity = capacity;
+    }
+
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+    return 0;
+}
+
+
+
+/**
+ * @brief Renders the image a reader holds in place, through the cache.
+ * 
+ * @param reader The reader, which is closed.
+ * 
+ * @note This function is private to the tg_render_cached family.
+ */
+static int render_cached_reader(tg_render_cache *cache, tg_reader *reader,
+    const tg_render_opts *opts, tg_sink *sink)
+{
+    // ---------------------------------- 01 ----------------------------------
+    // Lookup.
+    tg_sink standard_output = tg_sink_file(stdout);
+    sink = sink ? sink : &standard_output;
+
+    char name[KEY_LENGTH + 1];
+    cache_key(reader->buffer + reader->pos, reader->len - reader->pos, opts,
+        name);
+    int result = cache_load(cache, name, sink);
+    if (result >= 0)
+    {
+        __atomic_add_fetch(&cache->stats.hits, 1, __ATOMIC_RELAXED);
+        tg_reader_close(reader);
+        return result;
+    }
+    __atomic_add_fetch(&cache->stats.misses, 1, __ATOMIC_RELAXED);
+
+    // ---------------------------------- 02 ----------------------------------
+    // Rendering, into memory, so that the output can be stored as well.
+    output_buffer output = {0};
+    tg_sink buffer_sink = { output_write, &output };
+    tg_row_source source;
+    if (tg_decoder_source_open(&source, reader))
+    {
+        return 1;
+    }
+    result = tg_render_source(&source, opts, NULL, &buffer_sink);
+    tg_row_source_close(&source);
+
+    // ---------------------------------- 03 ----------------------------------
+    // Output and storage.
+    if (!result)
+    {
+        result = sink->write(sink->ctx, output.data, output.length);
+        if (output.length <= cache->max_bytes)
+        {
+            cache_store(cache, name, output.data, output.length);
+        }
+    }
+    free(output.data);
+    return result;
+}
+
+
+
+tg_render_cache *tg_render_cache_open(const char *directory,
+    size_t max_bytes)
+{
+    struct stat st;
+    if ((mkdir(directory, 0755) && errno != EEXIST) ||
+        stat(directory, &st) || !S_ISDIR(st.st_mode))
+    {
+        return NULL;
+    }
+
+    tg_render_cache *cache = (tg_render_cache*)calloc(1,
+        sizeof(tg_render_cache));
+    if (!cache)
+    {
+        return NULL;
+    }
+    cache->directory = strdup(directory);
+    if (!cache->directory)
+    {
+        free(cache);
+        return NULL;
+    }
+    cache->max_bytes = max_bytes;
+    return cache;
+}
+
+
+
+void tg_render_cache_close(tg_render_cache *cache)
+{
+    if (cache)
+    {
+        free(cache->directory);
+        free(cache);
+    }
+}
+
+
+
+int tg_render_cached(tg_render_cache *cache, const char *path,
+    const tg_render_opts *opts, tg_sink *sink)
+{
+    tg_reader reader;
+    if (tg_reader_open_path(&reader, path))
+    {
+        return 1;
+    }
+    if (!reader.f)
+    {
+        // A regular file, mapped as a whole already.
+        return render_cached_reader(cache, &reader, opts, sink);
+    }
+
+    // Streams are read to the end first, since the key covers every byte.
+    char *data = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    int result = 0;
+    do
+    {
+        size_t available = reader.len - reader.pos;
+        if (capacity - length < available)
+        {
+            capacity = 2 * (length + available);
+            char *grown = (char*)realloc(data, capacity);
+            if (!grown)
+            {
+                result = 1;
+                break;
+            }
+            data = grown;
+        }
+        memcpy(data + length, reader.buffer + reader.pos, available);
+        length += available;
+        reader.pos = reader.len;
+    } while (!tg_reader_fill(&reader));
+    tg_reader_close(&reader);
+
+    if (!result)
+    {
+        result = tg_render_cached_mem(cache, data, length, opts, sink);
+    }
+    free(data);
+    return result;
+}
+
+
+
+int tg_render_cached_mem(tg_render_cache *cache, const void *data,
+    size_t length, const tg_render_opts *opts, tg_sink *sink)
+{
+    tg_reader reader;
+    if (tg_reader_open_memory(&reader, data, length))
+    {
+        return 1;
+    }
+    return render_cached_reader(cache, &reader, opts, sink);
+}
+
+
+
+void tg_render_cache_stats_get(tg_render_cache *cache,
+    tg_render_cache_stats *stats)
+{
+    stats->hits = __atomic_load_n(&cache->stats.hits, __ATOMIC_RELAXED);
+    stats->misses = __atomic_load_n(&cache->stats.misses, __ATOMIC_RELAXED);
+    stats->stores = __atomic_load_n(&cache->stats.stores, __ATOMIC_RELAXED);
+    stats->evictions = __atomic_load_n(&cache->stats.evictions,
+        __ATOMIC_RELAXED);
+}
@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+#if TG_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+
+/**
+ * @brief State of a resampling row source.
+ * 
+ * Boxes are laid out by `tg_box_edges` over the source region, so every
+ * region pixel falls in exactly one box.
+ * 
+ */
+typedef struct resample_state
+{
+    tg_row_source *source;  /**< The source being resampled. */
+    tg_rect region;         /**< The region of `source` being resampled. */
+    int next_source_row;    /**< The next row to pull from `source`. */
+    uint32_t *acc;          /**< Per-channel column sums of the current box. */
+    uint8_t *scratch;       /**< Scratch row for `source`. */
+    int *column_start;      /**< First region column of each output column. */
+} resample_state;
+
+
+
+/**
+ * @brief Signature shared by the row accumulation kernels, adding a row of
+ *      bytes to a row of 32-bit sums.
+ * 
+ */
+typedef void (*accumulate_fn)(uint32_t *acc, const uint8_t *row, size_t count);
+
+
+
+static void accumulate_scalar(uint32_t *acc, const uint8_t *row, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        acc[i] += row[i];
+    }
+}
+
+
+
+#if TG_X86_KERNELS
+
+__attribute__((target("sse2")))
+static void accumulate_sse2(uint32_t *acc, const uint8_t *row, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(row + i));
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+
+        __m128i *dst = (__m128i*)(acc + i);
+        _mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst),
+            _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(dst + 1, _mm_add_epi32(_mm_loadu_si128(dst + 1),
+            _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(dst + 2, _mm_add_epi32(_mm_loadu_si128(dst + 2),
+            _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(dst + 3, _mm_add_epi32(_mm_loadu_si128(dst + 3),
+            _mm_unpackhi_epi16(hi, zero)));
+    }
+
+    accumulate_scalar(acc + i, row + i, count - i);
+}
+
+
+
+__attribute__((target("avx2")))
+static void accumulate_avx2(uint32_t *acc, const uint8_t *row, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(row + i));
+        __m256i lo = _mm256_cvtepu8_epi32(bytes);
+        __m256i hi = _mm256_cvtepu8_epi32(_mm_unpackhi_epi64(bytes, bytes));
+
+        __m256i *dst = (__m256i*)(acc + i);
+        _mm256_storeu_si256(dst, 
+            _mm256_add_epi32(_mm256_loadu_si256(dst), lo));
+        _mm256_storeu_si256(dst + 1, 
+            _mm256_add_epi32(_mm256_loadu_si256(dst + 1), hi));
+    }
+
+    accumulate_scalar(acc + i, row + i, count - i);
+}
+
+#endif // TG_X86_KERNELS
+
+
+
+/**
+ * @brief Adds a row of bytes to a row of 32-bit sums, using the fastest
+ *      kernel the running CPU supports.
+ * 
+ * @note This function is private to the resampler.
+ */
+static void accumulate_row(uint32_t *acc, const uint8_t *row, size_t count)
+{
+#if TG_X86_KERNELS
+    static accumulate_fn kernel = NULL;
+    accumulate_fn resolved = __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+    if (!resolved)
+    {
+        resolved = tg_cpu_supports("avx2") ? accumulate_avx2
+                 : tg_cpu_supports("sse2") ? accumulate_sse2
+                 : accumulate_scalar;
+        __atomic_store_n(&kernel, resolved, __ATOMIC_RELAXED);
+    }
+    resolved(acc, row, count);
+#else
+    accumulate_scalar(acc, row, count);
+#endif
+}
+
+
+
+void tg_box_edges(int *edges, int start, int length, int count)
+{
+    for (int i = 0; i <= count; i++)
+    {
+        edges[i] = start + (int)((int64_t)i * length / count);
+    }
+}
+
+
+
+/**
+ * @brief Produces the next output row by pulling and summing up the source
+ *      rows of its box, then averaging the sums horizontally.
+ * 
+ * @note This function is private to the resampler, which uses it as the
+ *      `read_row` callback of its row source.
+ */
+static const uint8_t *resample_read_row(tg_row_source *resampled, int y,
+    uint8_t *scratch)
+{
+    resample_state *state = (resample_state*)resampled->ctx;
+    tg_row_source *source = state->source;
+    tg_rect *region = &state->region;
+
+    // ---------------------------------- 01 ----------------------------------
+    // Vertical pass: every source row of the box is read exactly once and
+    // added to the column sums. The rows above the region are pulled and
+    // dropped, since streamed sources can only be read in order.
+    int first_row = region->y + (int)((int64_t)y * region->height 
+                  / resampled->height);
+    int last_row = region->y + (int)((int64_t)(y + 1) * region->height 
+                 / resampled->height);
+    int box_height = last_row - first_row;
+
+    memset(state->acc, 0, 3 * (size_t)region->width * sizeof(uint32_t));
+    for (; state->next_source_row < last_row; state->next_source_row++)
+    {
+        const uint8_t *row = source->read_row(source, state->next_source_row,
+            state->scratch);
+        if (!row)
+        {
+            return NULL;
+        }
+        if (state->next_source_row >= first_row)
+        {
+            accumulate_row(state->acc, row + 3 * (size_t)region->x, 
+                3 * (size_t)region->width);
+        }
+    }
+
+    // ---------------------------------- 02 ----------------------------------
+    // Horizontal pass: the column sums of each box are added up and divided
+    // by the box area, rounding to nearest.
+    for (int x = 0; x < resampled->width; x++)
+    {
+        int x0 = state->column_start[x];
+        int x1 = state->column_start[x + 1];
+        uint64_t area = (uint64_t)(x1 - x0) * box_height;
+
+        for (int c = 0; c < 3; c++)
+        {
+            uint64_t sum = 0;
+            for (int sx = x0; sx < x1; sx++)
+            {
+                sum += state->acc[3*sx + c];
+            }
+            scratch[3*x + c] = (uint8_t)((sum + area / 2) / area);
+        }
+    }
+
+    return scratch;
+}
+
+
+
+int tg_resample_source_init(tg_row_source *resampled, tg_row_source *source,
+    const tg_rect *region, int width, int height)
+{
+    resample_state *state = (resample_state*)calloc(1, sizeof(resample_state));
+    if (!state)
+    {
+        return 1;
+    }
+
+    state->source = source;
+    state->region = *region;
+    state->acc = (uint32_t*)malloc(3 * (size_t)region->width 
+                                     * sizeof(uint32_t));
+    state->scratch = (uint8_t*)malloc(3 * (size_t)source->width);
+    state->column_start = (int*)malloc(((size_t)width + 1) * sizeof(int));
+
+    resampled->width = width;
+    resampled->height = height;
+    resampled->read_row = resample_read_row;
+    resampled->close = NULL;
+    resampled->ctx = state;
+
+    if (!state->acc || !state->scratch || !state->column_start)
+    {
+        tg_resample_source_free(resampled);
+        return 1;
+    }
+
+    // Column sums only cover the region, so boxes are laid out from 0.
+    tg_box_edges(state->column_start, 0, region->width, width);
+
+    return 0;
+}
+
+
+
+void tg_resample_source_free(tg_row_source *resampled)
+{
+    resample_state *state = (resample_state*)resampled->ctx;
+    if (!state)
+    {
+        return;
+    }
+
+    free(state->column_start);
+    free(state->scratch);
+    free(state->acc);
+    free(state);
+    resampled->ctx = NULL;
+}
@@ -0,0 +1,46 @@
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "../include/termglyph/render.h"
+
+
+
+/**
+ * @brief Reads a positive integer from an environment variable.
+ * 
+ * @return The value, or `fallback` if the variable is not set or invalid.
+ * 
+ * @note This function is private to tg_terminal_size.
+ */
+static int env_size(const char *name, int fallback)
+{
+    const char *value = getenv(name);
+    if (!value)
+    {
+        return fallback;
+    }
+
+    char *end = NULL;
+    long size = strtol(value, &end, 10);
+    return (end != value && *end == '\0' && size > 0 && size < 100000)
+         ? (int)size : fallback;
+}
+
+
+
+int tg_terminal_size(int *columns, int *rows)
+{
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && 
+        ws.ws_col > 0 && ws.ws_row > 0)
+    {
+        *columns = ws.ws_col;
+        *rows = ws.ws_row;
+        return 0;
+    }
+
+    *columns = env_size("COLUMNS", 80);
+    *rows = env_size("LINES", 24);
+    return 1;
+}
@@ -0,0 +1,484 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+
+
+/**
+ * @brief Size of the TGA header, before the image ID.
+ * 
+ */
+#define TGA_HEADER_SIZE 18
+
+
+
+/**
+ * @name TGA image types. Run-length encoded types are the plain ones plus
+ *      `TGA_TYPE_RLE`.
+ * 
+ * @{
+ */
+#define TGA_TYPE_MAPPED 1
+#define TGA_TYPE_TRUECOLOR 2
+#define TGA_TYPE_GRAY 3
+#define TGA_TYPE_RLE 8
+/** @} */
+
+
+
+/**
+ * @name TGA image descriptor bits.
+ * 
+ * @{
+ */
+#define TGA_RIGHT_TO_LEFT 0x10
+#define TGA_TOP_TO_BOTTOM 0x20
+#define TGA_INTERLEAVED 0xc0
+/** @} */
+
+
+
+/**
+ * @brief State of a row source reading a TGA image.
+ * 
+ * Run-length packets may span rows, so the one being unpacked carries over
+ * from a row to the next.
+ * 
+ */
+typedef struct tga_source_state
+{
+    tg_reader reader;
+    int type;                   /**< Image type, without `TGA_TYPE_RLE`. */
+    int rle;                    /**< Whether pixels are run-length encoded. */
+    int pixel_size;             /**< Bytes per pixel. */
+    int right_to_left;          /**< Whether rows are stored mirrored. */
+    uint8_t *palette;           /**< The color map, in RGB. */
+    size_t palette_length;      /**< Entries in `palette`. */
+
+    size_t packet_left;         /**< Pixels left in the current packet. */
+    int packet_run;             /**< Whether the current packet is a run. */
+    uint8_t packet_pixel[4];    /**< The pixel repeated by a run. */
+
+    /**
+     * Bottom-up images store their last row first, so their whole pixel
+     * array is needed: it is read in place when possible, into
+     * `raster_storage` otherwise. NULL for top-down images, which are
+     * streamed.
+     */
+    const uint8_t *raster;
+    uint8_t *raster_storage;
+    uint8_t *raw;               /**< A row of a top-down image. */
+} tga_source_state;
+
+
+
+/**
+ * @brief Converts a true color pixel of 2, 3 or 4 bytes to RGB.
+ * 
+ * @note This function is private to the TGA decoder.
+ */
+static inline void tga_truecolor(const uint8_t *pixel, int size,
+    uint8_t *rgb)
+{
+    if (size == 2)
+    {
+        // 5 bits per channel, as ARRRRRGG GGGBBBBB in little-endian order.
+        uint32_t value = tg_load_le16(pixel);
+        uint32_t r = (value >> 10) & 0x1f;
+        uint32_t g = (value >> 5) & 0x1f;
+        uint32_t b = value & 0x1f;
+        rgb[0] = (uint8_t)((r << 3) | (r >> 2));
+        rgb[1] = (uint8_t)((g << 3) | (g >> 2));
+        rgb[2] = (uint8_t)((b << 3) | (b >> 2));
+        return;
+    }
+
+    // BGR, then alpha for 4-byte pixels.
+    rgb[0] = pixel[2];
+    rgb[1] = pixel[1];
+    rgb[2] = pixel[0];
+}
+
+
+
+/**
+ * @brief Unpacks run-length encoded pixels.
+ * 
+ * @param state The source state.
+ * @param out Where the pixels go, `count` times `pixel_size` bytes.
+ * @param count Number of pixels.
+ * 
+ * @return 0 on success, non-zero value if the data ends first.
+ * 
+ * @note This function is private to the TGA decoder.
+ */
+static int tga_unpack(tga_source_state *state, uint8_t *out, size_t count)
+{
+    tg_reader *r = &state->reader;
+    size_t size = (size_t)state->pixel_size;
+
+    while (count > 0)
+    {
+        if (state->packet_left == 0)
+        {
+            int header = tg_reader_getc(r);
+            if (header == EOF)
+            {
+                return 1;
+            }
+            state->packet_left = (size_t)(header & 0x7f) + 1;
+            state->packet_run = header & 0x80;
+            if (state->packet_run)
+            {
+                const uint8_t *pixel = tg_reader_read(r, state->packet_pixel,
+                    size);
+                if (!pixel)
+                {
+                    return 1;
+                }
+                memmove(state->packet_pixel, pixel, size);
+            }
+        }
+
+        size_t n = state->packet_left < count ? state->packet_left : count;
+        if (state->packet_run)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                memcpy(out + i * size, state->packet_pixel, size);
+            }
+        }
+        else
+        {
+            // Raw packets are read as a block.
+            const uint8_t *pixels = tg_reader_read(r, out, n * size);
+            if (!pixels)
+            {
+                return 1;
+            }
+            memmove(out, pixels, n * size);
+        }
+
+        out += n * size;
+        count -= n;
+        state->packet_left -= n;
+    }
+    return 0;
+}
+
+
+
+/**
+ * @brief Unpacks the whole pixel array of a run-length encoded image.
+ * 
+ * Runs expand up to 128 times, so the array is grown as rows are unpacked
+ * rather than allocated from the header, and a header announcing more rows
+ * than the input holds fails at its end.
+ * 
+ * @return The pixels, freed with `free`, or NULL on failure.
+ * 
+ * @note This function is private to tg_tga_source_open.
+ */
+static uint8_t *tga_unpack_all(tga_source_state *state, int width,
+    int height)
+{
+    size_t row_size = (size_t)width * state->pixel_size;
+    size_t size = row_size * height;
+    uint8_t *out = NULL;
+    size_t capacity = 0;
+    for (int y = 0; y < height; y++)
+    {
+        size_t done = row_size * y;
+        if (done + row_size > capacity)
+        {
+            capacity = capacity ? capacity * 2 : TG_READER_BUFFER_SIZE;
+            capacity = capacity > done + row_size ? capacity
+                                                  : done + row_size;
+            capacity = capacity < size ? capacity : size;
+            uint8_t *grown = (uint8_t*)realloc(out, capacity);
+            if (!grown)
+            {
+                free(out);
+                return NULL;
+            }
+            out = grown;
+        }
+        if (tga_unpack(state, out + done, (size_t)width))
+        {
+            free(out);
+            return NULL;
+        }
+    }
+    return out;
+}
+
+
+
+/**
+ * @brief Reads row `y` of a TGA image.
+ * 
+ * @note This function is private to tg_tga_source_open, which uses it as
+ *      the `read_row` callback of its row source.
+ */
+static const uint8_t *tga_read_row(tg_row_source *source, int y,
+    uint8_t *scratch)
+{
+    tga_source_state *state = (tga_source_state*)source->ctx;
+    int width = source->width;
+    int size = state->pixel_size;
+    size_t row_size = (size_t)width * size;
+
+    const uint8_t *row;
+    if (state->raster)
+    {
+        row = state->raster + (size_t)(source->height - 1 - y) * row_size;
+    }
+    else if (state->rle)
+    {
+        row = tga_unpack(state, state->raw, (size_t)width) ? NULL
+                                                           : state->raw;
+    }
+    else
+    {
+        row = tg_reader_read(&state->reader, state->raw, row_size);
+    }
+    if (!row)
+    {
+        return NULL;
+    }
+
+    for (int x = 0; x < width; x++)
+    {
+        const uint8_t *pixel = row + (size_t)x * size;
+        int out = state->right_to_left ? width - 1 - x : x;
+        uint8_t *rgb = scratch + 3*out;
+
+        if (state->type == TGA_TYPE_GRAY)
+        {
+            // Gray and alpha pixels have the gray first.
+            rgb[0] = rgb[1] = rgb[2] = pixel[0];
+        }
+        else if (state->type == TGA_TYPE_MAPPED)
+        {
+            size_t index = size == 1 ? pixel[0] : tg_load_le16(pixel);
+            if (index >= state->palette_length)
+            {
+                return NULL;
+            }
+            memcpy(rgb, state->palette + 3*index, 3);
+        }
+        else
+        {
+            tga_truecolor(pixel, size, rgb);
+        }
+    }
+    return scratch;
+}
+
+
+
+/**
+ * @brief Closes the source and the reader.
+ * 
+ * @note This function is private to tg_tga_source_open, which uses it as
+ *      the `close` callback of its row source.
+ */
+static void tga_close(tg_row_source *source)
+{
+    tga_source_state *state = (tga_source_state*)source->ctx;
+    if (!state)
+    {
+        return;
+    }
+
+    tg_reader_close(&state->reader);
+    free(state->palette);
+    free(state->raster_storage);
+    free(state->raw);
+    free(state);
+    source->ctx = NULL;
+}
+
+
+
+/**
+ * @brief Reads the header, the image ID and the color map of a TGA image,
+ *      leaving the reader on the pixels.
+ * 
+ * TGA files have no magic number, so every field is checked: this is what
+ * tells them apart from anything else.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ * @note This function is private to tg_tga_source_open.
+ */
+static int tga_read_header(tga_source_state *state, int *width, int *height,
+    int *bottom_up)
+{
+    tg_reader *r = &state->reader;
+    uint8_t buffer[TGA_HEADER_SIZE];
+
+    const uint8_t *header = tg_reader_read(r, buffer, TGA_HEADER_SIZE);
+    if (!header)
+    {
+        return 1;
+    }
+
+    int id_length = header[0];
+    int map_type = header[1];
+    int type = header[2];
+    size_t map_first = tg_load_le16(header + 3);
+    size_t map_length = tg_load_le16(header + 5);
+    int map_bits = header[7];
+    *width = (int)tg_load_le16(header + 12);
+    *height = (int)tg_load_le16(header + 14);
+    int bits = header[16];
+    int descriptor = header[17];
+
+    // ---------------------------------- 01 ----------------------------------
+    // Image type and pixel size.
+    state->rle = type & TGA_TYPE_RLE;
+    state->type = type & ~TGA_TYPE_RLE;
+    state->pixel_size = (bits + 7) / 8;
+    state->right_to_left = descriptor & TGA_RIGHT_TO_LEFT;
+    *bottom_up = !(descriptor & TGA_TOP_TO_BOTTOM);
+
+    int valid_bits;
+    switch (state->type)
+    {
+    case TGA_TYPE_MAPPED:
+        valid_bits = map_type == 1 && (bits == 8 || bits == 16);
+        break;
+    case TGA_TYPE_TRUECOLOR:
+        valid_bits = bits == 15 || bits == 16 || bits == 24 || bits == 32;
+        break;
+    case TGA_TYPE_GRAY:
+        valid_bits = bits == 8 || bits == 16;
+        break;
+    default:
+        return 1;
+    }
+    if (!valid_bits || map_type > 1 || *width == 0 || *height == 0 ||
+        (descriptor & TGA_INTERLEAVED))
+    {
+        return 1;
+    }
+
+    // ---------------------------------- 02 ----------------------------------
+    // Image ID, which is not needed.
+    if (tg_reader_skip(r, (size_t)id_length))
+    {
+        return 1;
+    }
+
+    // ---------------------------------- 03 ----------------------------------
+    // Color map. Entries before the first index don't exist, so they stay
+    // black.
+    if (map_type == 1)
+    {
+        if (map_bits != 15 && map_bits != 16 && map_bits != 24 &&
+            map_bits != 32)
+        {
+            return 1;
+        }
+        int entry_size = (map_bits + 7) / 8;
+
+        if (state->type != TGA_TYPE_MAPPED)
+        {
+            // True color and gray images may still carry one.
+            return tg_reader_skip(r, map_length * entry_size);
+        }
+
+        state->palette_length = map_first + map_length;
+        state->palette = (uint8_t*)calloc(state->palette_length, 3);
+        if (!state->palette)
+        {
+            return 1;
+        }
+        for (size_t i = 0; i < map_length; i++)
+        {
+            uint8_t entry_buffer[4];
+            const uint8_t *entry = tg_reader_read(r, entry_buffer,
+                (size_t)entry_size);
+            if (!entry)
+            {
+                return 1;
+            }
+            tga_truecolor(entry, entry_size,
+                state->palette + 3 * (map_first + i));
+        }
+    }
+    return 0;
+}
+
+
+
+int tg_tga_source_open(tg_row_source *source, tg_reader *reader)
+{
+    tga_source_state *state = (tga_source_state*)calloc(1,
+        sizeof(tga_source_state));
+    if (!state)
+    {
+        tg_reader_close(reader);
+        return 1;
+    }
+
+    state->reader = *reader;
+    source->width = 0;
+    source->height = 0;
+    source->read_row = tga_read_row;
+    source->close = tga_close;
+    source->ctx = state;
+
+    int width = 0;
+    int height = 0;
+    int bottom_up = 0;
+    if (tga_read_header(state, &width, &height, &bottom_up))
+    {
+        tga_close(source);
+        return 1;
+    }
+
+    // Sizes are 16-bit, so none of these overflow.
+    size_t row_size = (size_t)width * state->pixel_size;
+    if (bottom_up)
+    {
+        // Plain pixels of memory and mapped files are just pointed at,
+        // everything else is read whole to get to the first row.
+        size_t size = row_size * height;
+        if (state->rle)
+        {
+            state->raster_storage = tga_unpack_all(state, width, height);
+            state->raster = state->raster_storage;
+        }
+        else if (state->reader.f)
+        {
+            state->raster_storage = tg_reader_read_alloc(&state->reader,
+                size);
+            state->raster = state->raster_storage;
+        }
+        else
+        {
+            state->raster = tg_reader_read(&state->reader, NULL, size);
+        }
+        if (!state->raster)
+        {
+            tga_close(source);
+            return 1;
+        }
+    }
+    else
+    {
+        state->raw = (uint8_t*)malloc(row_size);
+        if (!state->raw)
+        {
+            tga_close(source);
+            return 1;
+        }
+    }
+
+    source->width = width;
+    source->height = height;
+    return 0;
+}
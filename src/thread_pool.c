@@ -0,0 +1,199 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+
+
+/**
+ * @brief Upper bound for the number of threads of a pool.
+ * 
+ */
+#define THREAD_POOL_MAX_THREADS 64
+
+
+
+struct tg_thread_pool
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;   /**< Signaled when a loop starts. */
+    pthread_cond_t done_cond;   /**< Signaled when a loop completes. */
+
+    pthread_t *workers;
+    int worker_count;
+
+    // The loop being run. All of these are protected by `mutex`.
+    void (*task)(void *ctx, int index);
+    void *ctx;
+    int count;          /**< Number of iterations of the loop. */
+    int next;           /**< Next iteration to hand out. */
+    int pending;        /**< Iterations not completed yet. */
+    unsigned generation;/**< Incremented every time a loop starts. */
+    int stop;
+};
+
+
+
+/**
+ * @brief Runs iterations of the current loop until there are none left to
+ *      hand out. Called with the pool mutex held, and returns with it held.
+ * 
+ * @note This function is private to the thread pool.
+ */
+static void pool_drain(tg_thread_pool *pool)
+{
+    while (pool->next < pool->count)
+    {
+        int index = pool->next++;
+        void (*task)(void *ctx, int index) = pool->task;
+        void *ctx = pool->ctx;
+
+        pthread_mutex_unlock(&pool->mutex);
+        task(ctx, index);
+        pthread_mutex_lock(&pool->mutex);
+
+        if (--pool->pending == 0)
+        {
+            pthread_cond_signal(&pool->done_cond);
+        }
+    }
+}
+
+
+
+/**
+ * @brief Entry point of the worker threads.
+ * 
+ * @note This function is private to the thread pool.
+ */
+static void *pool_worker(void *arg)
+{
+    tg_thread_pool *pool = (tg_thread_pool*)arg;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (1)
+    {
+        while (!pool->stop && pool->generation == seen)
+        {
+            pthread_cond_wait(&pool->work_cond, &pool->mutex);
+        }
+        if (pool->stop)
+        {
+            break;
+        }
+
+        seen = pool->generation;
+        pool_drain(pool);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+
+
+int tg_thread_count(int requested)
+{
+    if (requested == TG_THREADS_AUTO)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        requested = cpus > 0 ? (int)cpus : 1;
+    }
+
+    if (requested < 1)
+    {
+        return 1;
+    }
+    return requested > THREAD_POOL_MAX_THREADS 
+         ? THREAD_POOL_MAX_THREADS : requested;
+}
+
+
+
+tg_thread_pool *tg_thread_pool_create(int threads)
+{
+    tg_thread_pool *pool = (tg_thread_pool*)calloc(1, sizeof(tg_thread_pool));
+    if (!pool)
+    {
+        return NULL;
+    }
+
+    // The thread calling `tg_thread_pool_run` takes part in the loops, so one
+    // less worker is needed.
+    pool->workers = (pthread_t*)malloc(
+        (threads > 1 ? threads - 1 : 1) * sizeof(pthread_t));
+    if (!pool->workers)
+    {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    for (int i = 0; i < threads - 1; i++)
+    {
+        if (pthread_create(&pool->workers[i], NULL, pool_worker, pool))
+        {
+            // A pool with fewer workers still works, so we just go on with
+            // the ones we got.
+            break;
+        }
+        pool->worker_count++;
+    }
+
+    return pool;
+}
+
+
+
+void tg_thread_pool_run(tg_thread_pool *pool,
+    void (*task)(void *ctx, int index), void *ctx, int count)
+{
+    pthread_mutex_lock(&pool->mutex);
+
+    pool->task = task;
+    pool->ctx = ctx;
+    pool->count = count;
+    pool->next = 0;
+    pool->pending = count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_cond);
+
+    pool_drain(pool);
+    while (pool->pending > 0)
+    {
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+
+
+void tg_thread_pool_destroy(tg_thread_pool *pool)
+{
+    if (!pool)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->worker_count; i++)
+    {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->workers);
+    free(pool);
+}
@@ -0,0 +1,220 @@
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/termglyph/video.h"
+#include "internal.h"
+
+
+
+/**
+ * @brief Gets the time of a monotonic clock, in seconds.
+ * 
+ * @note This function is private to the video player.
+ */
+static double video_clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+
+
+/**
+ * @brief Sleeps until the monotonic clock reaches `deadline`.
+ * 
+ * @note This function is private to the video player.
+ */
+static void video_sleep_until(double deadline)
+{
+    double delay = deadline - video_clock();
+    if (delay <= 0)
+    {
+        return;
+    }
+
+    struct timespec remaining;
+    remaining.tv_sec = (time_t)delay;
+    remaining.tv_nsec = (long)((delay - (double)remaining.tv_sec) * 1e9);
+    while (nanosleep(&remaining, &remaining) && errno == EINTR)
+    {
+    }
+}
+
+
+
+/**
+ * @brief Gets the number of cell rows a frame takes once rendered.
+ * 
+ * @note This function is private to the video player.
+ */
+static int video_cell_rows(int width, int height, const tg_render_opts *opts)
+{
+    tg_rect region;
+    if (tg_render_region(width, height, opts, &region))
+    {
+        return 0;
+    }
+
+    int columns = 0;
+    int rows = 0;
+    tg_fit_size(region.width, region.height, opts, &columns, &rows);
+    int pixel_rows = tg_cell_pixel_rows(opts->mode);
+    return (rows + pixel_rows - 1) / pixel_rows;
+}
+
+
+
+/**
+ * @brief Plays a video stream, pacing and dropping frames to keep up with
+ *      the frame rate.
+ * 
+ * @param reader The reader, which is closed.
+ * 
+ * @note This function is private to the tg_playvideo family.
+ */
+static int play_reader(tg_reader *reader, const tg_play_opts *opts,
+    tg_sink *sink, tg_play_stats *stats)
+{
+    tg_play_stats unused;
+    stats = stats ? stats : &unused;
+    memset(stats, 0, sizeof(tg_play_stats));
+
+    tg_frame_source frames;
+    if (tg_frame_source_open(&frames, reader))
+    {
+        return 1;
+    }
+
+    tg_play_opts defaults = {0};
+    opts = opts ? opts : &defaults;
+    tg_sink standard_output = tg_sink_file(stdout);
+    sink = sink ? sink : &standard_output;
+
+    tg_delta *delta = NULL;
+    if (!opts->full_frames)
+    {
+        delta = tg_delta_create(opts->threshold);
+        if (!delta)
+        {
+            frames.close(&frames);
+            return 1;
+        }
+    }
+
+    double fps = opts->fps ? opts->fps : frames.fps;
+    double period = fps > 0 ? 1.0 / fps : 0;
+    double start = 0;
+    int previous_rows = 0;
+    int previous_width = 0;
+    int previous_height = 0;
+
+    int result;
+    for (unsigned long i = 0;; i++)
+    {
+        double requested = video_clock();
+        tg_row_source frame;
+        result = frames.next_frame(&frames, &frame);
+        if (result)
+        {
+            break;
+        }
+        stats->frames++;
+
+        // Frame i is due at start + i * period. The time the input kept the
+        // frame waiting past that is not the renderer's fault, so the whole
+        // schedule is pushed back by it instead of counting as lateness.
+        if (period > 0)
+        {
+            double now = video_clock();
+            double due = i == 0 ? now : start + (double)i * period;
+            double waited = now - (requested > due ? requested : due);
+            if (waited > 0)
+            {
+                due += waited;
+            }
+            start = due - (double)i * period;
+
+            if (stats->rendered > 0 && now > due + period)
+            {
+                stats->dropped++;
+                continue;
+            }
+            video_sleep_until(due);
+        }
+
+        // The frame is drawn over the previous one, whose rendering left the
+        // cursor at the start of the line below it. Frames of a Netpbm stream
+        // may change size, in which case the previous one is cleared first
+        // so that none of it is left around a smaller one. The delta does all
+        // that on its own.
+        if (!delta && previous_rows > 0)
+        {
+            int resized = frame.width != previous_width ||
+                          frame.height != previous_height;
+            char move[32];
+            int length = sprintf(move, resized ? "\033[%dA\033[J"
+                                               : "\033[%dA", previous_rows);
+            if (sink->write(sink->ctx, move, (size_t)length))
+            {
+                result = -1;
+                break;
+            }
+        }
+
+        if (tg_render_source(&frame, &opts->render, delta, sink))
+        {
+            result = -1;
+            break;
+        }
+        previous_rows = video_cell_rows(frame.width, frame.height,
+            &opts->render);
+        previous_width = frame.width;
+        previous_height = frame.height;
+        stats->rendered++;
+    }
+
+    tg_delta_free(delta);
+    frames.close(&frames);
+    return result != 1;
+}
+
+
+
+int tg_playvideo(const char *path, const tg_play_opts *opts, tg_sink *sink,
+    tg_play_stats *stats)
+{
+    tg_reader reader;
+    if (tg_reader_open_path(&reader, path))
+    {
+        return 1;
+    }
+    return play_reader(&reader, opts, sink, stats);
+}
+
+
+
+int tg_playvideo_file(FILE *file, const tg_play_opts *opts, tg_sink *sink,
+    tg_play_stats *stats)
+{
+    tg_reader reader;
+    if (tg_reader_open_file(&reader, file))
+    {
+        return 1;
+    }
+    return play_reader(&reader, opts, sink, stats);
+}
+
+
+
+int tg_playvideo_fd(int fd, const tg_play_opts *opts, tg_sink *sink,
+    tg_play_stats *stats)
+{
+    tg_reader reader;
+    if (tg_reader_open_fd(&reader, fd))
+    {
+        return 1;
+    }
+    return play_reader(&reader, opts, sink, stats);
+}
@@ -0,0 +1,386 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+
+
+/**
+ * @brief Longest stream or frame header line accepted.
+ * 
+ */
+#define Y4M_MAX_HEADER_LENGTH 1024
+
+
+
+/**
+ * @brief State of a frame source reading a YUV4MPEG2 stream.
+ * 
+ */
+typedef struct y4m_frame_state
+{
+    tg_reader reader;
+    const tg_yuv_matrix *matrix;
+    int chroma_x_shift;         /**< 1 if chroma is halved horizontally. */
+    int chroma_y_shift;         /**< 1 if chroma is halved vertically. */
+    int chroma_width;
+    int mono;                   /**< Whether there are no chroma planes. */
+    size_t luma_size;           /**< Bytes in the luma plane. */
+    size_t chroma_size;         /**< Bytes in each chroma plane. */
+    size_t frame_size;          /**< Bytes in a frame, every plane included. */
+
+    const uint8_t *frame;       /**< The current frame. */
+    uint8_t *storage;           /**< Frame buffer of streams, reused. */
+    uint8_t *neutral;           /**< Chroma row of monochrome streams. */
+} y4m_frame_state;
+
+
+
+/**
+ * @brief Reads a header line, up to the newline, into a NUL-terminated
+ *      buffer.
+ * 
+ * @return The length of the line, or -1 if the input ends first or the line
+ *      is too long.
+ * 
+ * @note This function is private to the Y4M decoder.
+ */
+static int y4m_read_line(tg_reader *r, char *line)
+{
+    for (int length = 0; length < Y4M_MAX_HEADER_LENGTH; length++)
+    {
+        int c = tg_reader_getc(r);
+        if (c == EOF)
+        {
+            return -1;
+        }
+        if (c == '\n')
+        {
+            line[length] = '\0';
+            return length;
+        }
+        line[length] = (char)c;
+    }
+    return -1;
+}
+
+
+
+/**
+ * @brief Parses a positive decimal integer at the start of a string.
+ * 
+ * @return 0 on success, non-zero value if there are no digits, the value is
+ *      0 or it doesn't fit in an int.
+ * 
+ * @note This function is private to the Y4M decoder.
+ */
+static int y4m_parse_int(const char **text, int *value)
+{
+    const char *p = *text;
+    long result = 0;
+    while (*p >= '0' && *p <= '9')
+    {
+        result = result * 10 + (*p++ - '0');
+        if (result > 0x7fffffff)
+        {
+            return 1;
+        }
+    }
+    if (p == *text || result == 0)
+    {
+        return 1;
+    }
+
+    *text = p;
+    *value = (int)result;
+    return 0;
+}
+
+
+
+/**
+ * @brief Tells whether the value of a header parameter, the `length` bytes
+ *      after its letter, is `expected`.
+ * 
+ * @note This function is private to the Y4M decoder.
+ */
+static int y4m_value_is(const char *value, size_t length,
+    const char *expected)
+{
+    return length - 1 == strlen(expected) &&
+           memcmp(value, expected, length - 1) == 0;
+}
+
+
+
+/**
+ * @brief Parses the stream header parameters, each a letter and a value,
+ *      separated by spaces.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ * 
+ * @note This function is private to tg_y4m_frame_source_open.
+ */
+static int y4m_parse_header(tg_frame_source *frames, y4m_frame_state *state,
+    const char *line)
+{
+    int full_range = 0;
+    int alpha = 0;
+    state->chroma_x_shift = 1;
+    state->chroma_y_shift = 1;
+
+    const char *p = line;
+    while (*p)
+    {
+        if (*p == ' ')
+        {
+            p++;
+            continue;
+        }
+
+        const char *end = strchr(p, ' ');
+        size_t length = end ? (size_t)(end - p) : strlen(p);
+        int numerator = 0;
+        int denominator = 0;
+        const char *value = p + 1;
+
+        switch (*p)
+        {
+        case 'W':
+            if (y4m_parse_int(&value, &frames->width))
+            {
+                return 1;
+            }
+            break;
+
+        case 'H':
+            if (y4m_parse_int(&value, &frames->height))
+            {
+                return 1;
+            }
+            break;
+
+        case 'F':
+            if (y4m_parse_int(&value, &numerator) || *value++ != ':' ||
+                y4m_parse_int(&value, &denominator))
+            {
+                return 1;
+            }
+            frames->fps = (double)numerator / denominator;
+            break;
+
+        case 'C':
+            // The 4:2:0 variants only differ in chroma siting. Deeper
+            // samples, like 420p10, are not supported.
+            if (y4m_value_is(value, length, "420") ||
+                y4m_value_is(value, length, "420jpeg") ||
+                y4m_value_is(value, length, "420paldv") ||
+                y4m_value_is(value, length, "420mpeg2"))
+            {
+                break;
+            }
+            if (y4m_value_is(value, length, "422"))
+            {
+                state->chroma_y_shift = 0;
+                break;
+            }
+            if (y4m_value_is(value, length, "444") ||
+                y4m_value_is(value, length, "444alpha"))
+            {
+                state->chroma_x_shift = 0;
+                state->chroma_y_shift = 0;
+                alpha = y4m_value_is(value, length, "444alpha");
+                break;
+            }
+            if (y4m_value_is(value, length, "mono"))
+            {
+                state->chroma_x_shift = 0;
+                state->chroma_y_shift = 0;
+                state->mono = 1;
+                break;
+            }
+            return 1;
+
+        case 'X':
+            if (y4m_value_is(value, length, "COLORRANGE=FULL"))
+            {
+                full_range = 1;
+            }
+            break;
+
+        default:
+            // Interlacing, pixel aspect ratio and comments don't matter.
+            break;
+        }
+
+        p += length;
+    }
+
+    if (frames->width <= 0 || frames->height <= 0)
+    {
+        return 1;
+    }
+
+    state->matrix = tg_yuv_matrix_bt601(full_range);
+    state->chroma_width = (frames->width + state->chroma_x_shift)
+                        >> state->chroma_x_shift;
+    int chroma_height = (frames->height + state->chroma_y_shift)
+                      >> state->chroma_y_shift;
+
+    state->luma_size = (size_t)frames->width * frames->height;
+    state->chroma_size = state->mono
+                       ? 0 : (size_t)state->chroma_width * chroma_height;
+    state->frame_size = state->luma_size * (alpha ? 2 : 1)
+                      + 2 * state->chroma_size;
+    return 0;
+}
+
+
+
+/**
+ * @brief Converts row `y` of the current frame to RGB.
+ * 
+ * @note This function is private to the Y4M decoder, which uses it as the
+ *      `read_row` callback of its frames.
+ */
+static const uint8_t *y4m_read_row(tg_row_source *source, int y,
+    uint8_t *scratch)
+{
+    y4m_frame_state *state = (y4m_frame_state*)source->ctx;
+    const uint8_t *luma = state->frame + (size_t)y * source->width;
+    const uint8_t *u = state->neutral;
+    const uint8_t *v = state->neutral;
+    if (!state->mono)
+    {
+        size_t offset = (size_t)(y >> state->chroma_y_shift)
+                      * state->chroma_width;
+        u = state->frame + state->luma_size + offset;
+        v = u + state->chroma_size;
+    }
+
+    tg_yuv_row(state->matrix, luma, u, v, state->chroma_x_shift, scratch,
+        (size_t)source->width);
+    return scratch;
+}
+
+
+
+/**
+ * @brief Reads the next frame: its header line, then its planes.
+ * 
+ * @note This function is private to the Y4M decoder, which uses it as the
+ *      `next_frame` callback of its frame source.
+ */
+static int y4m_next_frame(tg_frame_source *frames, tg_row_source *frame)
+{
+    y4m_frame_state *state = (y4m_frame_state*)frames->ctx;
+    tg_reader *r = &state->reader;
+
+    // The stream ends cleanly where a frame would start.
+    if (!tg_reader_peek(r, 1))
+    {
+        return 1;
+    }
+
+    char line[Y4M_MAX_HEADER_LENGTH];
+    if (y4m_read_line(r, line) < 5 || strncmp(line, "FRAME", 5) != 0 ||
+        (line[5] != '\0' && line[5] != ' '))
+    {
+        return -1;
+    }
+
+    // Memory and mapped files are read in place. Streams are read into a
+    // buffer allocated once, which the frames then share.
+    if (r->f && !state->storage)
+    {
+        state->storage = (uint8_t*)malloc(state->frame_size);
+        if (!state->storage)
+        {
+            return -1;
+        }
+    }
+    state->frame = tg_reader_read(r, state->storage, state->frame_size);
+    if (!state->frame)
+    {
+        return -1;
+    }
+
+    frame->width = frames->width;
+    frame->height = frames->height;
+    frame->read_row = y4m_read_row;
+    frame->close = NULL;
+    frame->ctx = state;
+    return 0;
+}
+
+
+
+/**
+ * @brief Closes the frame source and the reader.
+ * 
+ * @note This function is private to the Y4M decoder, which uses it as the
+ *      `close` callback of its frame source.
+ */
+static void y4m_close(tg_frame_source *frames)
+{
+    y4m_frame_state *state = (y4m_frame_state*)frames->ctx;
+    if (!state)
+    {
+        return;
+    }
+
+    tg_reader_close(&state->reader);
+    free(state->storage);
+    free(state->neutral);
+    free(state);
+    frames->ctx = NULL;
+}
+
+
+
+int tg_y4m_frame_source_open(tg_frame_source *frames, tg_reader *reader)
+{
+    y4m_frame_state *state = (y4m_frame_state*)calloc(1,
+        sizeof(y4m_frame_state));
+    if (!state)
+    {
+        tg_reader_close(reader);
+        return 1;
+    }
+
+    state->reader = *reader;
+    frames->width = 0;
+    frames->height = 0;
+    frames->fps = 0;
+    frames->next_frame = y4m_next_frame;
+    frames->close = y4m_close;
+    frames->ctx = state;
+
+    char line[Y4M_MAX_HEADER_LENGTH];
+    if (y4m_read_line(&state->reader, line) < 9 ||
+        strncmp(line, "YUV4MPEG2", 9) != 0 ||
+        y4m_parse_header(frames, state, line + 9))
+    {
+        y4m_close(frames);
+        return 1;
+    }
+
+    if (frames->width > 0x7fffffff / frames->height / 4)
+    {
+        y4m_close(frames);
+        return 1;
+    }
+
+    if (state->mono)
+    {
+        // Gray frames go through the same kernels, with neutral chroma.
+        state->neutral = (uint8_t*)malloc((size_t)frames->width);
+        if (!state->neutral)
+        {
+            y4m_close(frames);
+            return 1;
+        }
+        memset(state->neutral, 128, (size_t)frames->width);
+    }
+    return 0;
+}
@@ -0,0 +1,348 @@
+#include "internal.h"
+
+#if TG_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+
+/**
+ * @brief Fractional bits of the fixed-point YUV to RGB coefficients.
+ * 
+ * With 13 bits, the largest coefficient, 2.017 for blue, still fits in a
+ * signed 16-bit integer, which the SIMD kernels rely on to use multiply-add
+ * instructions.
+ * 
+ */
+#define YUV_SHIFT 13
+#define YUV_ROUND (1 << (YUV_SHIFT - 1))
+
+
+
+/**
+ * @brief BT.601 coefficients for limited range samples, where black is 16,
+ *      white is 235 and chroma spans 16 to 240.
+ * 
+ */
+static const tg_yuv_matrix yuv_bt601_limited =
+    { 16, 9539, 13075, -3209, -6660, 16525 };
+
+
+
+/**
+ * @brief BT.601 coefficients for full range samples, as JPEG uses them.
+ * 
+ */
+static const tg_yuv_matrix yuv_bt601_full =
+    { 0, 8192, 11485, -2819, -5850, 14516 };
+
+
+
+const tg_yuv_matrix *tg_yuv_matrix_bt601(int full_range)
+{
+    return full_range ? &yuv_bt601_full : &yuv_bt601_limited;
+}
+
+
+
+/**
+ * @brief Clamps a fixed-point channel value to a byte, the way the SIMD
+ *      kernels saturating packs do.
+ * 
+ */
+static inline uint8_t yuv_clamp(int32_t value)
+{
+    value >>= YUV_SHIFT;
+    return (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+
+
+void tg_yuv_row_scalar(const tg_yuv_matrix *m, const uint8_t *y,
+    const uint8_t *u, const uint8_t *v, int subsampled, uint8_t *rgb,
+    size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t j = subsampled ? i >> 1 : i;
+        int32_t c = m->y * (y[i] - m->y_offset) + YUV_ROUND;
+        int32_t d = u[j] - 128;
+        int32_t e = v[j] - 128;
+
+        rgb[3*i] = yuv_clamp(c + m->v_to_r * e);
+        rgb[3*i + 1] = yuv_clamp(c + m->u_to_g * d + m->v_to_g * e);
+        rgb[3*i + 2] = yuv_clamp(c + m->u_to_b * d);
+    }
+}
+
+
+
+#if TG_X86_KERNELS
+
+/**
+ * @brief Packs two 16-bit coefficients into every 32-bit lane, in the
+ *      order multiply-add instructions pair them with the samples.
+ * 
+ */
+static inline int32_t yuv_pair(int16_t first, int16_t second)
+{
+    return (int32_t)((uint32_t)(uint16_t)first
+                   | (uint32_t)(uint16_t)second << 16);
+}
+
+
+
+/**
+ * @brief Converts 4 pixels, given as (Y, U) and (V, 1) 16-bit pairs with the
+ *      offsets subtracted, to 32-bit red, green and blue values.
+ * 
+ * The 1 paired with V brings in the rounding term with the same multiply-add.
+ * 
+ */
+__attribute__((target("sse2")))
+static inline void yuv4_sse2(const tg_yuv_matrix *m, __m128i yu, __m128i v1,
+    __m128i *r, __m128i *g, __m128i *b)
+{
+    const __m128i k_r = _mm_set1_epi32(yuv_pair(m->v_to_r, YUV_ROUND));
+    const __m128i k_gyu = _mm_set1_epi32(yuv_pair(m->y, m->u_to_g));
+    const __m128i k_gv = _mm_set1_epi32(yuv_pair(m->v_to_g, YUV_ROUND));
+    const __m128i k_byu = _mm_set1_epi32(yuv_pair(m->y, m->u_to_b));
+    const __m128i k_y = _mm_set1_epi32(yuv_pair(m->y, 0));
+    const __m128i k_round = _mm_set1_epi32(YUV_ROUND);
+
+    __m128i luma = _mm_madd_epi16(yu, k_y);
+    *r = _mm_srai_epi32(_mm_add_epi32(luma, _mm_madd_epi16(v1, k_r)),
+        YUV_SHIFT);
+    *g = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yu, k_gyu),
+        _mm_madd_epi16(v1, k_gv)), YUV_SHIFT);
+    *b = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yu, k_byu), k_round),
+        YUV_SHIFT);
+}
+
+
+
+/**
+ * @brief Converts 8 pixels of 16-bit samples, offsets subtracted, to 8-bit
+ *      red, green and blue values in the low half of their registers.
+ * 
+ */
+__attribute__((target("sse2")))
+static inline void yuv8_sse2(const tg_yuv_matrix *m, __m128i y, __m128i u,
+    __m128i v, __m128i *r, __m128i *g, __m128i *b)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    __m128i r0, g0, b0, r1, g1, b1;
+    yuv4_sse2(m, _mm_unpacklo_epi16(y, u), _mm_unpacklo_epi16(v, one),
+        &r0, &g0, &b0);
+    yuv4_sse2(m, _mm_unpackhi_epi16(y, u), _mm_unpackhi_epi16(v, one),
+        &r1, &g1, &b1);
+
+    // The saturating packs clamp to [0, 255], like yuv_clamp does.
+    *r = _mm_packs_epi32(r0, r1);
+    *g = _mm_packs_epi32(g0, g1);
+    *b = _mm_packs_epi32(b0, b1);
+}
+
+
+
+/**
+ * @brief Loads 16 chroma samples, or 8 and doubles each when chroma is
+ *      subsampled horizontally.
+ * 
+ */
+__attribute__((target("sse2")))
+static inline __m128i yuv_load_chroma_sse2(const uint8_t *chroma,
+    int subsampled)
+{
+    if (subsampled)
+    {
+        __m128i half = _mm_loadl_epi64((const __m128i*)chroma);
+        return _mm_unpacklo_epi8(half, half);
+    }
+    return _mm_loadu_si128((const __m128i*)chroma);
+}
+
+
+
+__attribute__((target("sse2")))
+void tg_yuv_row_sse2(const tg_yuv_matrix *m, const uint8_t *y,
+    const uint8_t *u, const uint8_t *v, int subsampled, uint8_t *rgb,
+    size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i y_offset = _mm_set1_epi16(m->y_offset);
+    const __m128i c_offset = _mm_set1_epi16(128);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        size_t j = subsampled ? i >> 1 : i;
+        __m128i y8 = _mm_loadu_si128((const __m128i*)(y + i));
+        __m128i u8 = yuv_load_chroma_sse2(u + j, subsampled);
+        __m128i v8 = yuv_load_chroma_sse2(v + j, subsampled);
+
+        __m128i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+        yuv8_sse2(m, _mm_sub_epi16(_mm_unpacklo_epi8(y8, zero), y_offset),
+            _mm_sub_epi16(_mm_unpacklo_epi8(u8, zero), c_offset),
+            _mm_sub_epi16(_mm_unpacklo_epi8(v8, zero), c_offset),
+            &r_lo, &g_lo, &b_lo);
+        yuv8_sse2(m, _mm_sub_epi16(_mm_unpackhi_epi8(y8, zero), y_offset),
+            _mm_sub_epi16(_mm_unpackhi_epi8(u8, zero), c_offset),
+            _mm_sub_epi16(_mm_unpackhi_epi8(v8, zero), c_offset),
+            &r_hi, &g_hi, &b_hi);
+
+        // SSE2 has no byte shuffle, so the channels are interleaved from
+        // memory. The arithmetic above is where the time goes anyway.
+        uint8_t planes[3][16];
+        _mm_storeu_si128((__m128i*)planes[0], _mm_packus_epi16(r_lo, r_hi));
+        _mm_storeu_si128((__m128i*)planes[1], _mm_packus_epi16(g_lo, g_hi));
+        _mm_storeu_si128((__m128i*)planes[2], _mm_packus_epi16(b_lo, b_hi));
+        for (int k = 0; k < 16; k++)
+        {
+            rgb[3 * (i + k)] = planes[0][k];
+            rgb[3 * (i + k) + 1] = planes[1][k];
+            rgb[3 * (i + k) + 2] = planes[2][k];
+        }
+    }
+
+    size_t j = subsampled ? i >> 1 : i;
+    tg_yuv_row_scalar(m, y + i, u + j, v + j, subsampled, rgb + 3*i,
+        count - i);
+}
+
+
+
+/**
+ * @brief Converts 8 pixels given as (Y, U) and (V, 1) 16-bit pairs with the
+ *      offsets subtracted, like yuv4_sse2 does with 4.
+ * 
+ */
+__attribute__((target("avx2")))
+static inline void yuv8_avx2(const tg_yuv_matrix *m, __m256i yu, __m256i v1,
+    __m256i *r, __m256i *g, __m256i *b)
+{
+    const __m256i k_r = _mm256_set1_epi32(yuv_pair(m->v_to_r, YUV_ROUND));
+    const __m256i k_gyu = _mm256_set1_epi32(yuv_pair(m->y, m->u_to_g));
+    const __m256i k_gv = _mm256_set1_epi32(yuv_pair(m->v_to_g, YUV_ROUND));
+    const __m256i k_byu = _mm256_set1_epi32(yuv_pair(m->y, m->u_to_b));
+    const __m256i k_y = _mm256_set1_epi32(yuv_pair(m->y, 0));
+    const __m256i k_round = _mm256_set1_epi32(YUV_ROUND);
+
+    __m256i luma = _mm256_madd_epi16(yu, k_y);
+    *r = _mm256_srai_epi32(
+        _mm256_add_epi32(luma, _mm256_madd_epi16(v1, k_r)), YUV_SHIFT);
+    *g = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yu, k_gyu),
+        _mm256_madd_epi16(v1, k_gv)), YUV_SHIFT);
+    *b = _mm256_srai_epi32(
+        _mm256_add_epi32(_mm256_madd_epi16(yu, k_byu), k_round), YUV_SHIFT);
+}
+
+
+
+/**
+ * @brief Packs 16 16-bit values of a channel, in order, to bytes.
+ * 
+ */
+__attribute__((target("avx2")))
+static inline __m128i yuv_pack_avx2(__m256i lo, __m256i hi)
+{
+    // Unpacks work within 128-bit lanes, so `lo` holds pixels 0-3 and 8-11
+    // and `hi` pixels 4-7 and 12-15. The in-lane pack puts them in order.
+    __m256i packed = _mm256_packs_epi32(lo, hi);
+    return _mm_packus_epi16(_mm256_castsi256_si128(packed),
+        _mm256_extracti128_si256(packed, 1));
+}
+
+
+
+__attribute__((target("avx2")))
+void tg_yuv_row_avx2(const tg_yuv_matrix *m, const uint8_t *y,
+    const uint8_t *u, const uint8_t *v, int subsampled, uint8_t *rgb,
+    size_t count)
+{
+    // Shuffles taking every channel to its place in each third of 16 RGB
+    // pixels. -1 clears the byte, which the other channels fill.
+    const __m128i r_to[3] = {
+        _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1,
+            5),
+        _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10,
+            -1),
+        _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15,
+            -1, -1)
+    };
+    const __m128i g_to[3] = {
+        _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1,
+            -1),
+        _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1,
+            10),
+        _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1,
+            15, -1)
+    };
+    const __m128i b_to[3] = {
+        _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4,
+            -1),
+        _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1,
+            -1),
+        _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1,
+            -1, 15)
+    };
+    const __m256i y_offset = _mm256_set1_epi16(m->y_offset);
+    const __m256i c_offset = _mm256_set1_epi16(128);
+    const __m256i one = _mm256_set1_epi16(1);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        size_t j = subsampled ? i >> 1 : i;
+        __m256i y16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(
+            _mm_loadu_si128((const __m128i*)(y + i))), y_offset);
+        __m256i u16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(
+            yuv_load_chroma_sse2(u + j, subsampled)), c_offset);
+        __m256i v16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(
+            yuv_load_chroma_sse2(v + j, subsampled)), c_offset);
+
+        __m256i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+        yuv8_avx2(m, _mm256_unpacklo_epi16(y16, u16),
+            _mm256_unpacklo_epi16(v16, one), &r_lo, &g_lo, &b_lo);
+        yuv8_avx2(m, _mm256_unpackhi_epi16(y16, u16),
+            _mm256_unpackhi_epi16(v16, one), &r_hi, &g_hi, &b_hi);
+
+        __m128i r = yuv_pack_avx2(r_lo, r_hi);
+        __m128i g = yuv_pack_avx2(g_lo, g_hi);
+        __m128i b = yuv_pack_avx2(b_lo, b_hi);
+        for (int k = 0; k < 3; k++)
+        {
+            __m128i out = _mm_or_si128(_mm_shuffle_epi8(r, r_to[k]),
+                _mm_or_si128(_mm_shuffle_epi8(g, g_to[k]),
+                             _mm_shuffle_epi8(b, b_to[k])));
+            _mm_storeu_si128((__m128i*)(rgb + 3*i + 16*k), out);
+        }
+    }
+
+    size_t j = subsampled ? i >> 1 : i;
+    tg_yuv_row_scalar(m, y + i, u + j, v + j, subsampled, rgb + 3*i,
+        count - i);
+}
+
+#endif // TG_X86_KERNELS
+
+
+
+void tg_yuv_row(const tg_yuv_matrix *m, const uint8_t *y, const uint8_t *u,
+    const uint8_t *v, int subsampled, uint8_t *rgb, size_t count)
+{
+#if TG_X86_KERNELS
+    static tg_yuv_row_fn kernel = NULL;
+    tg_yuv_row_fn resolved = __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+    if (!resolved)
+    {
+        resolved = tg_cpu_supports("avx2") ? tg_yuv_row_avx2
+                 : tg_cpu_supports("sse2") ? tg_yuv_row_sse2
+                 : tg_yuv_row_scalar;
+        __atomic_store_n(&kernel, resolved, __ATOMIC_RELAXED);
+    }
+    resolved(m, y, u, v, subsampled, rgb, count);
+#else
+    tg_yuv_row_scalar(m, y, u, v, subsampled, rgb, count);
+#endif
+}
@@ -0,0 +1,365 @@
+#!/usr/bin/env python3
+"""Writes the decoder test fixtures into the directory of this script.
+
+Every encoded image has a P6 reference holding the pixels it must decode
+to. The references are computed from the sample values with the scaling
+formulas of each format, independently of the library. The output is
+deterministic, so running this again leaves the fixtures unchanged.
+"""
+
+import os
+import random
+import struct
+
+WIDTH = 9
+HEIGHT = 3
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def write(name, data):
+    with open(os.path.join(HERE, name), "wb") as f:
+        f.write(data)
+
+
+def ppm(pixels):
+    """P6 reference of a list of rows of RGB tuples."""
+    body = bytes(c for row in pixels for p in row for c in p)
+    return b"P6\n%d %d\n255\n" % (len(pixels[0]), len(pixels)) + body
+
+
+def scale(value, bits):
+    """Scales a value of `bits` bits to 8 bits, rounding to nearest."""
+    top = (1 << bits) - 1
+    return (value * 255 + top // 2) // top
+
+
+rng = random.Random(20240611)
+
+# ---- References ----
+
+# Arbitrary colors, with repeats, also across the end of a row, and small
+# steps, so that run-length and QOI encoders have something to chew on.
+RGB = [[tuple(rng.randrange(256) for _ in range(3)) for _ in range(WIDTH)]
+       for _ in range(HEIGHT)]
+RGB[0][7] = RGB[0][8] = RGB[1][0] = RGB[1][1] = (12, 200, 34)
+RGB[2][3] = tuple(min(c + 1, 255) for c in RGB[2][2])
+RGB[2][4] = tuple(min(c + 5, 255) for c in RGB[2][3])
+
+PALETTE16 = [tuple(rng.randrange(256) for _ in range(3)) for _ in range(16)]
+INDEXES16 = [[(x * 7 + y * 3) % 16 for x in range(WIDTH)]
+             for y in range(HEIGHT)]
+INDEXES16[1][4] = INDEXES16[1][5] = INDEXES16[1][6] = 15
+
+BW = [(0, 0, 0), (255, 255, 255)]
+INDEXES2 = [[(x * y + x + y) % 2 for x in range(WIDTH)]
+            for y in range(HEIGHT)]
+
+RGB555 = [[tuple(rng.randrange(32) for _ in range(3)) for _ in range(WIDTH)]
+          for _ in range(HEIGHT)]
+RGB565 = [[(rng.randrange(32), rng.randrange(64), rng.randrange(32))
+           for _ in range(WIDTH)] for _ in range(HEIGHT)]
+GRAY = [[rng.randrange(256) for _ in range(WIDTH)] for _ in range(HEIGHT)]
+
+
+def mapped(indexes, palette):
+    return [[palette[i] for i in row] for row in indexes]
+
+
+write("rgb.ppm", ppm(RGB))
+write("palette16.ppm", ppm(mapped(INDEXES16, PALETTE16)))
+write("bw.ppm", ppm(mapped(INDEXES2, BW)))
+write("rgb555.ppm", ppm([[tuple(scale(c, 5) for c in p) for p in row]
+                         for row in RGB555]))
+# TGA widens 5-bit channels by repeating their top bits instead.
+write("rgb555_replicated.ppm", ppm([[tuple(c << 3 | c >> 2 for c in p)
+                                     for p in row] for row in RGB555]))
+write("rgb565.ppm", ppm([[(scale(r, 5), scale(g, 6), scale(b, 5))
+                          for r, g, b in row] for row in RGB565]))
+write("gray.ppm", ppm([[(v, v, v) for v in row] for row in GRAY]))
+
+# ---- BMP ----
+
+
+def bmp_rows(rows, bpp, encode):
+    """Packs rows of pixels, padded to 4 bytes."""
+    out = []
+    for row in rows:
+        if bpp <= 8:
+            bits = "".join(format(i, "0%db" % bpp) for i in row)
+            bits += "0" * (-len(bits) % 8)
+            data = bytes(int(bits[i:i + 8], 2) for i in range(0, len(bits), 8))
+        else:
+            data = b"".join(encode(p) for p in row)
+        out.append(data + b"\0" * (-len(data) % 4))
+    return out
+
+
+def bmp(rows, bpp, encode=None, palette=None, colors=0, compression=0,
+        masks=None, header=40, top_down=False, core_palette=False):
+    raster = bmp_rows(rows, bpp, encode)
+    if not top_down:
+        raster.reverse()
+    raster = b"".join(raster)
+    height = -len(rows) if top_down else len(rows)
+
+    if header == 12:
+        dib = struct.pack("<IHHHH", 12, len(rows[0]), height, 1, bpp)
+    else:
+        dib = struct.pack("<IiiHHIIiiII", header, len(rows[0]), height, 1,
+                          bpp, compression, len(raster), 2835, 2835, colors,
+                          0)
+        if header > 40:
+            dib += struct.pack("<III", *masks) + b"\0" * (header - 52)
+    extra = b""
+    if header == 40 and masks:
+        extra = struct.pack("<III", *masks)
+    pal = b""
+    if palette:
+        entry = (lambda c: bytes((c[2], c[1], c[0]))) if core_palette else \
+                (lambda c: bytes((c[2], c[1], c[0], 0)))
+        pal = b"".join(entry(c) for c in palette)
+
+    offset = 14 + len(dib) + len(extra) + len(pal)
+    return (b"BM" + struct.pack("<IHHI", offset + len(raster), 0, 0, offset)
+            + dib + extra + pal + raster)
+
+
+def bgr(p):
+    return bytes((p[2], p[1], p[0]))
+
+
+write("bmp_1bpp.bmp", bmp(INDEXES2, 1, palette=BW))
+write("bmp_4bpp.bmp", bmp(INDEXES16, 4, palette=PALETTE16))
+write("bmp_8bpp.bmp", bmp(INDEXES16, 8, palette=PALETTE16, colors=16))
+# Core headers have no color count, so the palette is full.
+write("bmp_8bpp_core.bmp", bmp(INDEXES16, 8, palette=PALETTE16 + [(0, 0, 0)]
+                               * 240, header=12, core_palette=True))
+write("bmp_16bpp.bmp", bmp(RGB555, 16, lambda p: struct.pack(
+    "<H", p[0] << 10 | p[1] << 5 | p[2])))
+write("bmp_16bpp_565.bmp", bmp(RGB565, 16, lambda p: struct.pack(
+    "<H", p[0] << 11 | p[1] << 5 | p[2]), compression=3,
+    masks=(0xf800, 0x07e0, 0x001f)))
+write("bmp_24bpp.bmp", bmp(RGB, 24, bgr))
+write("bmp_24bpp_top_down.bmp", bmp(RGB, 24, bgr, top_down=True))
+write("bmp_32bpp.bmp", bmp(RGB, 32, lambda p: bgr(p) + b"\xff"))
+# Channels in an unusual order, in the masks following the info header,
+# then in a V5 header.
+write("bmp_32bpp_bitfields.bmp", bmp(RGB, 32, lambda p: bytes(
+    (0x80, p[2], p[0], p[1])), compression=3,
+    masks=(0x00ff0000, 0xff000000, 0x0000ff00)))
+write("bmp_32bpp_v5.bmp", bmp(RGB, 32, lambda p: bytes(
+    (p[0], p[1], p[2], 0)), compression=3, header=124, top_down=True,
+    masks=(0x000000ff, 0x0000ff00, 0x00ff0000)))
+
+# A red mask with two runs of bits, whose values go past the 8-bit table.
+write("bmp_mask_gaps.bmp", bmp([[(0, 0, 0)]], 32, lambda p: b"\xff" * 4,
+                               compression=3,
+                               masks=(0xff00ff00, 0x000000ff, 0x00ff0000)))
+
+# ---- TGA ----
+
+
+def tga(rows, image_type, bits, encode, palette=None, palette_first=0,
+        rle=False, top_down=False, right_to_left=False, image_id=b""):
+    descriptor = (0x20 if top_down else 0) | (0x10 if right_to_left else 0)
+    descriptor |= 8 if bits == 32 else 0
+    ordered = rows if top_down else rows[::-1]
+    if right_to_left:
+        ordered = [row[::-1] for row in ordered]
+    pixels = [encode(p) for row in ordered for p in row]
+
+    if rle:
+        data = b""
+        i = 0
+        while i < len(pixels):
+            run = 1
+            while (i + run < len(pixels) and run < 128
+                   and pixels[i + run] == pixels[i]):
+                run += 1
+            if run > 1:
+                data += bytes((0x80 | (run - 1),)) + pixels[i]
+                i += run
+                continue
+            raw = 1
+            while (i + raw < len(pixels) and raw < 128
+                   and (i + raw + 1 >= len(pixels)
+                        or pixels[i + raw + 1] != pixels[i + raw])):
+                raw += 1
+            data += bytes((raw - 1,)) + b"".join(pixels[i:i + raw])
+            i += raw
+    else:
+        data = b"".join(pixels)
+
+    color_map = b""
+    if palette:
+        color_map = b"".join(bgr(c) for c in palette)
+    header = struct.pack("<BBBHHBHHHHBB", len(image_id), 1 if palette else 0,
+                         image_type | (8 if rle else 0), palette_first,
+                         len(palette) if palette else 0,
+                         24 if palette else 0, 0, 0, len(rows[0]), len(rows),
+                         bits, descriptor)
+    return header + image_id + color_map + data
+
+
+def index8(i):
+    return bytes((i,))
+
+
+write("tga_mapped.tga", tga(INDEXES16, 1, 8, index8, palette=PALETTE16,
+                            image_id=b"termglyph"))
+# Indexes start at 4, entries below it are not stored.
+write("tga_mapped_first.tga", tga([[i + 4 for i in row] for row in INDEXES16],
+                                  1, 8, index8, palette=PALETTE16,
+                                  palette_first=4))
+write("tga_mapped_rle_top_down.tga", tga(INDEXES16, 1, 8, index8,
+                                         palette=PALETTE16, rle=True,
+                                         top_down=True))
+write("tga_24bpp.tga", tga(RGB, 2, 24, bgr))
+write("tga_24bpp_rle.tga", tga(RGB, 2, 24, bgr, rle=True))
+write("tga_24bpp_right_to_left.tga", tga(RGB, 2, 24, bgr,
+                                         right_to_left=True))
+write("tga_32bpp_top_down.tga", tga(RGB, 2, 32, lambda p: bgr(p) + b"\x80",
+                                    top_down=True))
+write("tga_32bpp_rle_top_down.tga", tga(RGB, 2, 32,
+                                        lambda p: bgr(p) + b"\xff",
+                                        rle=True, top_down=True))
+write("tga_16bpp.tga", tga(RGB555, 2, 16, lambda p: struct.pack(
+    "<H", 0x8000 | p[0] << 10 | p[1] << 5 | p[2])))
+write("tga_gray.tga", tga(GRAY, 3, 8, index8))
+write("tga_gray_rle.tga", tga(GRAY, 3, 8, index8, rle=True))
+
+# ---- farbfeld ----
+
+WIDE = [[tuple(rng.randrange(65536) for _ in range(3)) for _ in range(WIDTH)]
+        for _ in range(HEIGHT)]
+WIDE[0][0] = (0, 65535, 128)
+write("farbfeld.ff", b"farbfeld" + struct.pack(">II", WIDTH, HEIGHT)
+      + b"".join(struct.pack(">HHHH", *p, 0xffff) for row in WIDE
+                 for p in row))
+write("farbfeld.ppm", ppm([[tuple((c * 255 + 32767) // 65535 for c in p)
+                            for p in row] for row in WIDE]))
+
+# ---- QOI ----
+
+QOI_END = b"\0" * 7 + b"\1"
+
+
+def qoi(rows, channels, used):
+    """Encodes rows of RGBA tuples as the reference encoder does, adding the
+    ops it used to `used`."""
+    def emit(op, data):
+        used.add(op)
+        return data
+
+    index = [(0, 0, 0, 0)] * 64
+    prev = (0, 0, 0, 255)
+    run = 0
+    data = b""
+    pixels = [p for row in rows for p in row]
+    for i, p in enumerate(pixels):
+        if p == prev:
+            run += 1
+            if run == 62 or i == len(pixels) - 1:
+                data += emit("run", bytes((0xc0 | (run - 1),)))
+                run = 0
+            continue
+        if run:
+            data += emit("run", bytes((0xc0 | (run - 1),)))
+            run = 0
+        h = (p[0] * 3 + p[1] * 5 + p[2] * 7 + p[3] * 11) % 64
+        if index[h] == p:
+            data += emit("index", bytes((h,)))
+        else:
+            index[h] = p
+            d = [(p[c] - prev[c] + 128) % 256 - 128 for c in range(3)]
+            dr_dg, db_dg = d[0] - d[1], d[2] - d[1]
+            if p[3] != prev[3]:
+                data += emit("rgba", b"\xff" + bytes(p))
+            elif all(-2 <= v <= 1 for v in d):
+                data += emit("diff", bytes((0x40 | (d[0] + 2) << 4
+                                            | (d[1] + 2) << 2 | d[2] + 2,)))
+            elif -32 <= d[1] <= 31 and -8 <= dr_dg <= 7 and -8 <= db_dg <= 7:
+                data += emit("luma", bytes((0x80 | d[1] + 32,
+                                            dr_dg + 8 << 4 | db_dg + 8)))
+            else:
+                data += emit("rgb", b"\xfe" + bytes(p[:3]))
+        prev = p
+    return (b"qoif" + struct.pack(">IIBB", len(rows[0]), len(rows), channels,
+                                  0) + data + QOI_END)
+
+
+# Long runs, split at 62 pixels and crossing rows, and colors coming back
+# from the index.
+RUNS = [[(200, 10, 10)] * 70, [(200, 10, 10)] * 5
+        + [PALETTE16[x % 3] for x in range(65)]]
+write("runs.ppm", ppm(RUNS))
+
+used = set()
+write("qoi_rgb.qoi", qoi([[p + (255,) for p in row] for row in RGB], 3,
+                         used))
+write("qoi_rgba.qoi", qoi([[p + ((x * 40 + y) % 3 * 100,)
+                            for x, p in enumerate(row)]
+                           for y, row in enumerate(RGB)], 4, used))
+write("qoi_runs.qoi", qoi([[p + (255,) for p in row] for row in RUNS], 3,
+                          used))
+assert used == {"rgb", "rgba", "index", "diff", "luma", "run"}, used
+
+# ---- Netpbm ----
+
+
+def plain(magic, size, maxval, samples, per_line):
+    """Plain raster, with comments and uneven whitespace in the header."""
+    head = b"%s\n# termglyph\n%d  %d\n" % (magic, *size)
+    if maxval:
+        head += b"#\n%d\n" % maxval
+    lines = [b" ".join(b"%d" % s for s in samples[i:i + per_line])
+             for i in range(0, len(samples), per_line)]
+    return head + b"\n".join(lines) + b"\n"
+
+
+def pam(rows, depth, maxval, tupltype, sample):
+    head = (b"P7\nWIDTH %d\nHEIGHT %d\n# termglyph\nDEPTH %d\nMAXVAL %d\n"
+            b"TUPLTYPE %s\nENDHDR\n" % (len(rows[0]), len(rows), depth,
+                                        maxval, tupltype))
+    return head + b"".join(sample(p) for row in rows for p in row)
+
+
+SIZE = (WIDTH, HEIGHT)
+# PBM bits are 1 for black, which is index 0 of BW.
+BITS = [[1 - i for i in row] for row in INDEXES2]
+GRAY1000 = [[rng.randrange(1001) for _ in range(WIDTH)]
+            for _ in range(HEIGHT)]
+write("gray1000.ppm", ppm([[((v * 255 + 500) // 1000,) * 3 for v in row]
+                           for row in GRAY1000]))
+
+write("pnm_p1.pbm", plain(b"P1", SIZE, 0, [b for row in BITS for b in row],
+                          WIDTH))
+write("pnm_p4.pbm", b"P4\n# termglyph\n%d %d\n" % SIZE + b"".join(
+    bytes(int("".join(map(str, row[i:i + 8])).ljust(8, "0"), 2)
+          for i in range(0, WIDTH, 8)) for row in BITS))
+write("pnm_p2.pgm", plain(b"P2", SIZE, 255, [v for row in GRAY for v in row],
+                          7))
+write("pnm_p5.pgm", b"P5 %d %d 255\n" % SIZE + bytes(v for row in GRAY
+                                                      for v in row))
+write("pnm_p5_wide.pgm", b"P5\n%d %d\n1000\n" % SIZE + b"".join(
+    struct.pack(">H", v) for row in GRAY1000 for v in row))
+write("pnm_p3.ppm", plain(b"P3", SIZE, 255, [c for row in RGB for p in row
+                                            for c in p], 12))
+write("pnm_p6.ppm", b"P6\n# termglyph\n%d\n#\n%d\t255\r" % SIZE + bytes(
+    c for row in RGB for p in row for c in p))
+write("pnm_p6_maxval31.ppm", b"P6\n%d %d\n31\n" % SIZE + bytes(
+    c for row in RGB555 for p in row for c in p))
+write("pnm_p6_16bit.ppm", b"P6\n%d %d\n65535\n" % SIZE + b"".join(
+    struct.pack(">HHH", *p) for row in WIDE for p in row))
+write("pam_rgb.pam", pam(RGB, 3, 255, b"RGB", bytes))
+write("pam_rgb_alpha.pam", pam(RGB, 4, 255, b"RGB_ALPHA",
+                               lambda p: bytes(p) + b"\x7f"))
+write("pam_rgb_alpha_16bit.pam", pam(WIDE, 4, 65535, b"RGB_ALPHA",
+                                     lambda p: struct.pack(">HHHH", *p, 1)))
+write("pam_gray.pam", pam(GRAY, 1, 255, b"GRAYSCALE",
+                          lambda v: bytes((v,))))
+write("pam_gray_alpha.pam", pam(GRAY, 2, 255, b"GRAYSCALE_ALPHA",
+                                lambda v: bytes((v, 255 - v))))
+# Unlike PBM, 0 is black.
+write("pam_bw.pam", pam(INDEXES2, 1, 1, b"BLACKANDWHITE",
+                        lambda i: bytes((i,))))
@@ -0,0 +1,1607 @@
+/*************************************************************************//**
+ * 
+ * @file test_canvas.c
+ * 
+ * @brief Checks that presenting a canvas leaves the terminal showing what
+ *      the canvas holds.
+ * 
+ * Presents are written into a small terminal emulator, which understands the
+ * sequences a present may use: cursor positioning and movements, carriage
+ * returns and line feeds, attributes, screen erasing, scroll regions and
+ * scrolling, and synchronized updates. Anything else fails the test. Like a
+ * terminal, it advances by two columns for wide code points and by none for
+ * combining marks. After each present of random frames, every cell of the
+ * emulated screen must match the canvas.
+ * 
+ * Images blitted into a canvas are checked against what `tg_render` draws
+ * into the emulator for the same options, and so is every frame of
+ * animations drawn with `tg_render_delta`.
+ * 
+ *****************************************************************************/
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "../include/termglyph.h"
+#include "../src/internal.h"
+
+
+
+#define MAX_PARAMETERS 16
+#define FRAMES 300
+#define TILE_COLUMNS 4
+#define TILE_ROWS 3
+#define TILE_WIDTH 13
+#define TILE_HEIGHT 7
+#define TILE_ROUNDS 8
+#define DELTA_WIDTH 40
+#define DELTA_HEIGHT 70
+#define DELTA_FRAMES 24
+
+
+
+/**
+ * @brief A terminal emulator, the size of the canvas presented to it.
+ * 
+ */
+typedef struct emulator
+{
+    int columns;
+    int rows;
+    tg_canvas_cell *cells;
+    tg_canvas_cell pen;     /**< The attributes of the next glyph written. */
+    int x;
+    int y;
+    int pending_wrap;       /**< Whether the last column was just written. */
+    int top;                /**< First row of the scroll region. */
+    int bottom;             /**< Row past the last of the scroll region. */
+
+    /** Whether a line feed returns the carriage too, as ttys make it. */
+    int newline_returns;
+
+    int writes;             /**< Writes received. */
+    int expect_synchronized;
+    char error[128];        /**< The first error met, or empty. */
+} emulator;
+
+
+
+static const tg_canvas_cell BLANK = { ' ', TG_CELL_COLOR_DEFAULT,
+    TG_CELL_COLOR_DEFAULT, 0 };
+
+/**
+ * @brief What the screen shows before anything is drawn, to tell cells
+ *      drawn from cells left alone.
+ * 
+ */
+static const tg_canvas_cell GARBAGE = { '?', TG_CELL_COLOR_INDEXED(1),
+    TG_CELL_COLOR_INDEXED(2), TG_CELL_STYLE_BOLD };
+
+static const int STYLE_PARAMETERS[] = { 1, 2, 3, 4, 5, 7, 8, 9, 21 };
+
+static const uint32_t CODEPOINTS[] = { ' ', 'a', 'b', 'z', '#', 0xe9,
+    0x2588, 0x1d11e, 0, 0x07, 0x9b, 0xd800, 0x65e5, 0x1f600, 0x301, 0x200b };
+
+
+
+static uint32_t random_state;
+
+
+
+void setUp(void)
+{
+    random_state = 2463534242u;
+}
+
+
+
+void tearDown(void)
+{
+}
+
+
+
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+
+
+static int random_below(int n)
+{
+    return (int)(next_random() % (uint32_t)n);
+}
+
+
+
+// ---- Emulator ----
+
+
+
+/**
+ * @brief Tells how many columns a terminal advances by for the code points
+ *      the tests use, -1 for those it does not print.
+ * 
+ */
+static int emulated_width(uint32_t c)
+{
+    if (c < 0x20 || (c >= 0x7f && c < 0xa0) || (c >= 0xd800 && c < 0xe000) ||
+        c > 0x10ffff)
+    {
+        return -1;
+    }
+    if ((c >= 0x300 && c < 0x370) || (c >= 0x200b && c < 0x2010))
+    {
+        return 0;
+    }
+    if ((c >= 0x4e00 && c < 0xa000) || (c >= 0x1f300 && c < 0x1f650))
+    {
+        return 2;
+    }
+    return 1;
+}
+
+
+
+static void emulator_fail(emulator *term, const char *message, int value)
+{
+    if (!term->error[0])
+    {
+        snprintf(term->error, sizeof(term->error), "%s (%d)", message,
+            value);
+    }
+}
+
+
+
+/**
+ * @brief Fills the screen with garbage, as a terminal whose content is not
+ *      known.
+ * 
+ */
+static void emulator_garble(emulator *term)
+{
+    for (int i = 0; i < term->columns * term->rows; i++)
+    {
+        term->cells[i] = GARBAGE;
+    }
+}
+
+
+
+static void emulator_resize(emulator *term, int columns, int rows)
+{
+    free(term->cells);
+    term->columns = columns;
+    term->rows = rows;
+    term->cells = (tg_canvas_cell*)malloc(sizeof(tg_canvas_cell)
+        * (size_t)columns * rows);
+    TEST_ASSERT_NOT_NULL(term->cells);
+    term->top = 0;
+    term->bottom = rows;
+    term->x = 0;
+    term->y = 0;
+    term->pending_wrap = 0;
+    emulator_garble(term);
+}
+
+
+
+/**
+ * @brief Scrolls the rows of the scroll region up by `n` rows, or down if
+ *      `n` is negative, blanking the rows exposed.
+ * 
+ */
+static void emulator_scroll(emulator *term, int n)
+{
+    int height = term->bottom - term->top;
+    for (int k = 0; k < height; k++)
+    {
+        int y = n > 0 ? term->top + k : term->bottom - 1 - k;
+        int from = y + n;
+        for (int x = 0; x < term->columns; x++)
+        {
+            term->cells[term->columns * y + x] =
+                from >= term->top && from < term->bottom
+                ? term->cells[term->columns * from + x] : BLANK;
+        }
+    }
+}
+
+
+
+static void emulator_line_feed(emulator *term)
+{
+    term->pending_wrap = 0;
+    if (term->y == term->bottom - 1)
+    {
+        emulator_scroll(term, 1);
+    }
+    else if (term->y < term->rows - 1)
+    {
+        term->y++;
+    }
+}
+
+
+
+/**
+ * @brief Prints a code point. Combining marks join the glyph before them and
+ *      leave the cursor where it is; wide glyphs cover the next cell too, as
+ *      a NUL.
+ * 
+ */
+static void emulator_put(emulator *term, uint32_t codepoint)
+{
+    int width = emulated_width(codepoint);
+    if (width == 0)
+    {
+        return;
+    }
+    if (term->pending_wrap)
+    {
+        term->x = 0;
+        emulator_line_feed(term);
+    }
+    tg_canvas_cell cell = term->pen;
+    cell.codepoint = codepoint;
+    term->cells[term->columns * term->y + term->x] = cell;
+    if (width == 2 && term->x < term->columns - 1)
+    {
+        cell.codepoint = 0;
+        term->cells[term->columns * term->y + ++term->x] = cell;
+    }
+    if (term->x == term->columns - 1)
+    {
+        term->pending_wrap = 1;
+    }
+    else
+    {
+        term->x++;
+    }
+}
+
+
+
+static int clamp(int value, int low, int high)
+{
+    return value < low ? low : value > high ? high : value;
+}
+
+
+
+/**
+ * @brief Applies the parameters of a select graphic rendition sequence.
+ * 
+ */
+static void emulator_sgr(emulator *term, const int *p, int count)
+{
+    for (int k = 0; k < count; k++)
+    {
+        int n = p[k];
+        int style = -1;
+        for (int b = 0; b < 9; b++)
+        {
+            style = STYLE_PARAMETERS[b] == n ? b : style;
+        }
+
+        if (n == 0)
+        {
+            term->pen = BLANK;
+        }
+        else if (style >= 0)
+        {
+            term->pen.style |= (uint16_t)(1u << style);
+        }
+        else if (n >= 22 && n <= 29 && n != 26)
+        {
+            static const uint16_t resets[] = {
+                TG_CELL_STYLE_BOLD | TG_CELL_STYLE_DIM,
+                TG_CELL_STYLE_ITALIC,
+                TG_CELL_STYLE_UNDERLINE | TG_CELL_STYLE_DOUBLE_UNDERLINE,
+                TG_CELL_STYLE_BLINKING, 0, TG_CELL_STYLE_INVERSE,
+                TG_CELL_STYLE_HIDDEN, TG_CELL_STYLE_STRIKETHROUGH };
+            term->pen.style &= (uint16_t)~resets[n - 22];
+        }
+        else if ((n >= 30 && n <= 37) || (n >= 90 && n <= 97))
+        {
+            term->pen.fg = TG_CELL_COLOR_INDEXED(n < 90 ? n - 30 : n - 82);
+        }
+        else if ((n >= 40 && n <= 47) || (n >= 100 && n <= 107))
+        {
+            term->pen.bg = TG_CELL_COLOR_INDEXED(n < 100 ? n - 40 : n - 92);
+        }
+        else if (n == 39 || n == 49)
+        {
+            *(n == 39 ? &term->pen.fg : &term->pen.bg) =
+                TG_CELL_COLOR_DEFAULT;
+        }
+        else if ((n == 38 || n == 48) && k + 2 < count && p[k + 1] == 5)
+        {
+            *(n == 38 ? &term->pen.fg : &term->pen.bg) =
+                TG_CELL_COLOR_INDEXED(p[k + 2]);
+            k += 2;
+        }
+        else if ((n == 38 || n == 48) && k + 4 < count && p[k + 1] == 2)
+        {
+            *(n == 38 ? &term->pen.fg : &term->pen.bg) =
+                TG_CELL_COLOR_RGB(p[k + 2], p[k + 3], p[k + 4]);
+            k += 4;
+        }
+        else
+        {
+            emulator_fail(term, "unknown SGR parameter", n);
+        }
+    }
+}
+
+
+
+/**
+ * @brief Carries out a control sequence.
+ * 
+ * @param p The parameters, 0 where left out.
+ * 
+ */
+static void emulator_csi(emulator *term, int private_mode, const int *p,
+    int count, char final)
+{
+    int n = p[0] ? p[0] : 1;
+    if (private_mode)
+    {
+        if (count != 1 || p[0] != 2026 || (final != 'h' && final != 'l'))
+        {
+            emulator_fail(term, "unknown private mode", p[0]);
+        }
+        return;
+    }
+
+    term->pending_wrap = 0;
+    switch (final)
+    {
+    case 'H':
+        term->y = clamp(n, 1, term->rows) - 1;
+        term->x = clamp(count > 1 && p[1] ? p[1] : 1, 1, term->columns) - 1;
+        break;
+    case 'G':
+        term->x = clamp(n, 1, term->columns) - 1;
+        break;
+    case 'd':
+        term->y = clamp(n, 1, term->rows) - 1;
+        break;
+    case 'A':
+    case 'F':
+        term->y = clamp(term->y - n, 0, term->rows - 1);
+        term->x = final == 'F' ? 0 : term->x;
+        break;
+    case 'B':
+    case 'E':
+        term->y = clamp(term->y + n, 0, term->rows - 1);
+        term->x = final == 'E' ? 0 : term->x;
+        break;
+    case 'C':
+        term->x = clamp(term->x + n, 0, term->columns - 1);
+        break;
+    case 'D':
+        term->x = clamp(term->x - n, 0, term->columns - 1);
+        break;
+    case 'J':
+        if (p[0] != 0 && p[0] != 2)
+        {
+            emulator_fail(term, "unsupported erase", p[0]);
+        }
+        for (int i = p[0] ? 0 : term->columns * term->y + term->x;
+             i < term->columns * term->rows; i++)
+        {
+            term->cells[i] = BLANK;
+        }
+        break;
+    case 'r':
+    {
+        int top = n;
+        int bottom = count > 1 && p[1] ? p[1] : term->rows;
+        if (top >= bottom || bottom > term->rows)
+        {
+            emulator_fail(term, "bad scroll region", bottom);
+            break;
+        }
+        term->top = top - 1;
+        term->bottom = bottom;
+        term->x = 0;
+        term->y = 0;
+        break;
+    }
+    case 'S':
+        emulator_scroll(term, n);
+        break;
+    case 'T':
+        emulator_scroll(term, -n);
+        break;
+    case 'm':
+        emulator_sgr(term, p, count);
+        break;
+    default:
+        emulator_fail(term, "unknown control sequence", final);
+        break;
+    }
+}
+
+
+
+/**
+ * @brief Takes the output of a present, as the sink it writes to.
+ * 
+ */
+static int emulator_write(void *ctx, const char *data, size_t length)
+{
+    emulator *term = (emulator*)ctx;
+    const unsigned char *s = (const unsigned char*)data;
+    size_t begin_length = sizeof(TG_SYNCHRONIZED_UPDATE_BEGIN) - 1;
+    size_t end_length = sizeof(TG_SYNCHRONIZED_UPDATE_END) - 1;
+    int updates = 0;
+
+    term->writes++;
+    if (term->expect_synchronized &&
+        (length < begin_length + end_length ||
+         memcmp(data, TG_SYNCHRONIZED_UPDATE_BEGIN, begin_length) ||
+         memcmp(data + length - end_length, TG_SYNCHRONIZED_UPDATE_END,
+             end_length)))
+    {
+        emulator_fail(term, "frame not synchronized", (int)length);
+    }
+
+    size_t i = 0;
+    while (i < length)
+    {
+        if (s[i] == '\033')
+        {
+            int p[MAX_PARAMETERS] = {0};
+            int count = 1;
+            int private_mode = 0;
+            if (++i >= length || s[i++] != '[')
+            {
+                emulator_fail(term, "escape not followed by [", (int)i);
+                break;
+            }
+            if (i < length && s[i] == '?')
+            {
+                private_mode = 1;
+                i++;
+            }
+            for (; i < length && ((s[i] >= '0' && s[i] <= '9') ||
+                 s[i] == ';'); i++)
+            {
+                if (s[i] == ';' && count < MAX_PARAMETERS)
+                {
+                    count++;
+                }
+                else if (s[i] != ';')
+                {
+                    p[count - 1] = 10 * p[count - 1] + (s[i] - '0');
+                }
+            }
+            if (i >= length)
+            {
+                emulator_fail(term, "unterminated control sequence", 0);
+                break;
+            }
+            updates += private_mode;
+            emulator_csi(term, private_mode, p, count, (char)s[i++]);
+            continue;
+        }
+
+        if (s[i] == '\r')
+        {
+            term->x = 0;
+            term->pending_wrap = 0;
+            i++;
+            continue;
+        }
+        if (s[i] == '\n')
+        {
+            emulator_line_feed(term);
+            term->x = term->newline_returns ? 0 : term->x;
+            i++;
+            continue;
+        }
+        if (s[i] < 0x20 || s[i] == 0x7f)
+        {
+            emulator_fail(term, "control character", s[i]);
+            i++;
+            continue;
+        }
+
+        // UTF-8, which presents only write well-formed.
+        int extra = s[i] < 0x80 ? 0 : s[i] >= 0xf0 ? 3 : s[i] >= 0xe0 ? 2 : 1;
+        uint32_t codepoint = extra ? s[i] & (0x3f >> extra) : s[i];
+        if (i + (size_t)extra >= length)
+        {
+            emulator_fail(term, "truncated UTF-8", extra);
+            break;
+        }
+        for (int k = 1; k <= extra; k++)
+        {
+            codepoint = codepoint << 6 | (s[i + k] & 0x3f);
+        }
+        i += (size_t)extra + 1;
+        emulator_put(term, codepoint);
+    }
+
+    if (updates != (term->expect_synchronized ? 2 : 0))
+    {
+        emulator_fail(term, "synchronized update sequences", updates);
+    }
+    if (term->pen.fg != TG_CELL_COLOR_DEFAULT ||
+        term->pen.bg != TG_CELL_COLOR_DEFAULT || term->pen.style)
+    {
+        emulator_fail(term, "attributes not reset", term->pen.style);
+    }
+    return 0;
+}
+
+
+
+// ---- Checks ----
+
+
+
+/**
+ * @brief Presents a canvas to the emulator, then checks that every cell
+ *      shows what the canvas holds.
+ * 
+ */
+static void present_and_check(tg_canvas *canvas, emulator *term)
+{
+    tg_sink sink = { emulator_write, term };
+    TEST_ASSERT_EQUAL_INT(0, tg_canvas_present(canvas, &sink));
+    if (term->error[0])
+    {
+        TEST_FAIL_MESSAGE(term->error);
+    }
+
+    char message[96];
+    for (int y = 0; y < term->rows; y++)
+    {
+        for (int x = 0; x < term->columns; x++)
+        {
+            tg_canvas_cell expected;
+            TEST_ASSERT_EQUAL_INT(0, tg_canvas_get(canvas, x, y, &expected));
+            if (emulated_width(expected.codepoint) != 1)
+            {
+                expected.codepoint = ' ';
+            }
+
+            const tg_canvas_cell *shown = &term->cells[term->columns * y + x];
+            snprintf(message, sizeof(message), "cell (%d, %d)", x, y);
+            TEST_ASSERT_EQUAL_HEX32_MESSAGE(expected.codepoint,
+                shown->codepoint, message);
+            TEST_ASSERT_EQUAL_HEX32_MESSAGE(expected.fg, shown->fg, message);
+            TEST_ASSERT_EQUAL_HEX32_MESSAGE(expected.bg, shown->bg, message);
+            TEST_ASSERT_EQUAL_HEX16_MESSAGE(expected.style, shown->style,
+                message);
+        }
+    }
+}
+
+
+
+static uint32_t random_color(void)
+{
+    // Few colors, so that neighbouring cells often share them.
+    switch (random_below(4))
+    {
+    case 0:
+        return TG_CELL_COLOR_DEFAULT;
+    case 1:
+        return TG_CELL_COLOR_INDEXED(random_below(4));
+    case 2:
+        return TG_CELL_COLOR_INDEXED(random_below(256));
+    default:
+        return TG_CELL_COLOR_RGB(random_below(2) * 255, 40, random_below(256));
+    }
+}
+
+
+
+static tg_canvas_cell random_cell(void)
+{
+    tg_canvas_cell cell;
+    cell.codepoint = CODEPOINTS[random_below(sizeof(CODEPOINTS)
+        / sizeof(*CODEPOINTS))];
+    cell.fg = random_color();
+    cell.bg = random_below(2) ? TG_CELL_COLOR_DEFAULT : random_color();
+    cell.style = random_below(4) ? 0 : (uint16_t)random_below(0x200);
+    return cell;
+}
+
+
+
+/**
+ * @brief Shifts the rows of a band of the canvas, as a log scrolling does,
+ *      and writes new rows where the band is exposed.
+ * 
+ */
+static void shift_rows(tg_canvas *canvas, int top, int bottom, int shift)
+{
+    int columns;
+    int rows;
+    tg_canvas_size(canvas, &columns, &rows);
+    for (int k = 0; k < bottom - top; k++)
+    {
+        int y = shift > 0 ? top + k : bottom - 1 - k;
+        int from = y + shift;
+        tg_canvas_cell cell = random_cell();
+        for (int x = 0; x < columns; x++)
+        {
+            if (from >= top && from < bottom)
+            {
+                tg_canvas_get(canvas, x, from, &cell);
+            }
+            tg_canvas_set(canvas, x, y, &cell);
+        }
+    }
+}
+
+
+
+/**
+ * @brief Changes a canvas at random, sometimes a few cells, sometimes most
+ *      of them, or not at all.
+ * 
+ */
+static void random_changes(tg_canvas *canvas, emulator *term, int scrolling)
+{
+    int columns;
+    int rows;
+    tg_canvas_size(canvas, &columns, &rows);
+    tg_canvas_cell cell = random_cell();
+    int x = random_below(columns + 8) - 4;
+    int y = random_below(rows + 8) - 4;
+
+    switch (random_below(scrolling ? 10 : 8))
+    {
+    case 0:
+        break;
+    case 1:
+    case 2:
+        for (int k = random_below(12); k >= 0; k--)
+        {
+            cell = random_cell();
+            tg_canvas_set(canvas, random_below(columns), random_below(rows),
+                &cell);
+        }
+        break;
+    case 3:
+        tg_canvas_fill(canvas, x, y, random_below(columns),
+            random_below(rows), &cell);
+        break;
+    case 4:
+        tg_canvas_printf(canvas, x, y, "#df#o%s#0o #ib%d##\n#0c#u%c\xc3\xa9",
+            TG_RGB(1, 2, 3), TG_INDEXED_COLOR_BRIGHT_CYAN, "text", x, 'q');
+        break;
+    case 5:
+        tg_canvas_printf(canvas, x, y, "#if#n%s#0 #w%s",
+            TG_INDEXED_COLOR_RED, "\xe2\x96\x88\xe2\x96\x88", "end");
+        break;
+    case 6:
+        if (random_below(8))
+        {
+            tg_canvas_fill(canvas, 0, 0, columns, rows, &cell);
+        }
+        else
+        {
+            tg_canvas_clear(canvas);
+        }
+        break;
+    case 7:
+        if (random_below(4))
+        {
+            for (int k = random_below(4); k >= 0; k--)
+            {
+                cell = random_cell();
+                tg_canvas_set(canvas, random_below(columns),
+                    random_below(rows), &cell);
+            }
+        }
+        else
+        {
+            tg_canvas_invalidate(canvas);
+            emulator_garble(term);
+        }
+        break;
+    default:
+    {
+        int top = random_below(rows / 2);
+        int bottom = rows - random_below(rows / 2);
+        int shift = 1 + random_below(3);
+        shift_rows(canvas, top, bottom, random_below(2) ? shift : -shift);
+        break;
+    }
+    }
+}
+
+
+
+static void check_random_frames(int synchronized, int scrolling)
+{
+    emulator term = {0};
+    emulator_resize(&term, 37, 14);
+    term.expect_synchronized = synchronized;
+    tg_canvas *canvas = tg_canvas_create(37, 14);
+    TEST_ASSERT_NOT_NULL(canvas);
+    tg_canvas_set_synchronized(canvas, synchronized);
+    tg_canvas_set_scrolling(canvas, scrolling);
+
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        random_changes(canvas, &term, scrolling);
+        present_and_check(canvas, &term);
+    }
+
+    tg_canvas_stats stats;
+    tg_canvas_stats_get(canvas, &stats);
+    TEST_ASSERT_EQUAL_UINT32(term.writes, stats.frames);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, stats.bytes_saved);
+    if (scrolling)
+    {
+        TEST_ASSERT_GREATER_THAN_UINT32(0, stats.scrolls);
+    }
+    tg_canvas_free(canvas);
+    free(term.cells);
+}
+
+
+
+/**
+ * @brief Fills an image with gradients and some noise, so that most glyphs
+ *      of a ramp and many colors show up.
+ * 
+ */
+static void fill_image(uint8_t *pixels, int width, int height)
+{
+    uint8_t *p = pixels;
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++, p += 3)
+        {
+            int noise = random_below(64) - 32;
+            p[0] = (uint8_t)clamp(255 * x / width + noise, 0, 255);
+            p[1] = (uint8_t)clamp(255 * y / height - noise, 0, 255);
+            p[2] = (uint8_t)clamp(128 + 4 * noise, 0, 255);
+        }
+    }
+}
+
+
+
+/**
+ * @brief Renders an image, cropped as the options say, with `tg_render`
+ *      into an emulator, from its top left corner, and tells the size in
+ *      cells it takes.
+ * 
+ */
+static void render_to_emulator(const tg_image *image,
+    const tg_render_opts *opts, emulator *term, int *columns, int *rows)
+{
+    tg_rect region;
+    TEST_ASSERT_EQUAL_INT(0, tg_render_region(image->width, image->height,
+        opts, &region));
+    tg_fit_size(region.width, region.height, opts, columns, rows);
+    int pixel_rows = tg_cell_pixel_rows(opts->mode);
+    *rows = (*rows + pixel_rows - 1) / pixel_rows;
+
+    // A column and a row more, for the line feed after the last row.
+    emulator_resize(term, *columns + 1, *rows + 1);
+    term->newline_returns = 1;
+    tg_sink sink = { emulator_write, term };
+    TEST_ASSERT_EQUAL_INT(0, tg_render(image, opts, &sink));
+    if (term->error[0])
+    {
+        TEST_FAIL_MESSAGE(term->error);
+    }
+}
+
+
+
+/**
+ * @brief Checks that a canvas holds what an emulator shows from its top left
+ *      corner, without styles, in the `columns` by `rows` cells from
+ *      `(x, y)` on, and `outside` everywhere else.
+ * 
+ * Foreground colors are only compared under glyphs other than a space,
+ * since text output leaves them out there.
+ * 
+ */
+static void check_blit(tg_canvas *canvas, const emulator *rendered,
+    int columns, int rows, int x, int y, const tg_canvas_cell *outside)
+{
+    int canvas_columns;
+    int canvas_rows;
+    tg_canvas_size(canvas, &canvas_columns, &canvas_rows);
+
+    char message[96];
+    for (int cy = 0; cy < canvas_rows; cy++)
+    {
+        for (int cx = 0; cx < canvas_columns; cx++)
+        {
+            int rx = cx - x;
+            int ry = cy - y;
+            tg_canvas_cell expected = *outside;
+            if (rx >= 0 && rx < columns && ry >= 0 && ry < rows)
+            {
+                expected = rendered->cells[rendered->columns * ry + rx];
+                expected.style = 0;
+            }
+
+            tg_canvas_cell cell;
+            tg_canvas_get(canvas, cx, cy, &cell);
+            snprintf(message, sizeof(message), "cell (%d, %d) of a blit at "
+                "(%d, %d)", cx, cy, x, y);
+            TEST_ASSERT_EQUAL_HEX32_MESSAGE(expected.codepoint,
+                cell.codepoint, message);
+            TEST_ASSERT_EQUAL_HEX32_MESSAGE(expected.bg, cell.bg, message);
+            TEST_ASSERT_EQUAL_HEX16_MESSAGE(expected.style, cell.style,
+                message);
+            if (expected.codepoint != ' ')
+            {
+                TEST_ASSERT_EQUAL_HEX32_MESSAGE(expected.fg, cell.fg,
+                    message);
+            }
+        }
+    }
+}
+
+
+
+/**
+ * @brief A tile of a dashboard, blitted from its own thread.
+ * 
+ */
+typedef struct tile_job
+{
+    tg_canvas *canvas;
+    uint8_t *pixels;
+    tg_image image;
+    tg_render_opts opts;
+    int x;
+    int y;
+    int result;
+} tile_job;
+
+
+
+static void *blit_tile(void *ctx)
+{
+    tile_job *job = (tile_job*)ctx;
+    job->result = tg_canvas_blit_image(job->canvas, job->x, job->y,
+        TILE_WIDTH, TILE_HEIGHT, &job->image, &job->opts);
+    return NULL;
+}
+
+
+
+/**
+ * @brief Changes the pixels of an animation for its next frame: inverts a
+ *      rectangle, nudges a few pixels by a level or three, or leaves them.
+ * 
+ */
+static void next_frame(uint8_t *pixels, int width, int height, int frame)
+{
+    if (frame % 5 == 2)
+    {
+        return;
+    }
+
+    if (frame % 4 == 0)
+    {
+        int x0 = random_below(width);
+        int y0 = random_below(height);
+        int x1 = x0 + 1 + random_below(width - x0);
+        int y1 = y0 + 1 + random_below(height - y0);
+        for (int y = y0; y < y1; y++)
+        {
+            for (int x = 3 * x0; x < 3 * x1; x++)
+            {
+                pixels[3 * width * y + x] ^= 0x80;
+            }
+        }
+        return;
+    }
+
+    for (int k = 0; k < 40; k++)
+    {
+        uint8_t *p = pixels + 3 * random_below(width * height)
+                   + random_below(3);
+        int nudge = random_below(3) + 1;
+        *p = (uint8_t)clamp(*p + (random_below(2) ? nudge : -nudge), 0, 255);
+    }
+}
+
+
+
+/**
+ * @brief Tells whether the screen may show the color `shown` for `color`:
+ *      they are equal, or both RGB with channels at most `slack` apart.
+ * 
+ */
+static int colors_near(uint32_t shown, uint32_t color, int slack)
+{
+    uint32_t rgb = TG_CELL_COLOR_RGB(0, 0, 0);
+    if (shown == color)
+    {
+        return 1;
+    }
+    if ((shown & 0xff000000u) != rgb || (color & 0xff000000u) != rgb)
+    {
+        return 0;
+    }
+    return abs(TG_RGB_GET_R(shown) - TG_RGB_GET_R(color)) <= slack &&
+           abs(TG_RGB_GET_G(shown) - TG_RGB_GET_G(color)) <= slack &&
+           abs(TG_RGB_GET_B(shown) - TG_RGB_GET_B(color)) <= slack;
+}
+
+
+
+/**
+ * @brief Checks that an emulator shows, from its top left corner, the
+ *      `columns` by `rows` cells of a full render, with colors at most
+ *      `slack` off, blank cells everywhere else, and the cursor below.
+ * 
+ */
+static void check_delta_frame(const emulator *screen,
+    const emulator *rendered, int columns, int rows, int slack, int frame)
+{
+    char message[64];
+    snprintf(message, sizeof(message), "cursor after frame %d", frame);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, screen->x, message);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(rows, screen->y, message);
+
+    for (int y = 0; y < screen->rows; y++)
+    {
+        for (int x = 0; x < screen->columns; x++)
+        {
+            tg_canvas_cell expected = BLANK;
+            if (x < columns && y < rows)
+            {
+                expected = rendered->cells[rendered->columns * y + x];
+            }
+
+            tg_canvas_cell cell = screen->cells[screen->columns * y + x];
+            snprintf(message, sizeof(message), "cell (%d, %d) of frame %d",
+                x, y, frame);
+            TEST_ASSERT_EQUAL_HEX32_MESSAGE(expected.codepoint,
+                cell.codepoint, message);
+            TEST_ASSERT_EQUAL_HEX16_MESSAGE(expected.style, cell.style,
+                message);
+            TEST_ASSERT_TRUE_MESSAGE(colors_near(cell.bg, expected.bg,
+                slack), message);
+            if (expected.codepoint != ' ')
+            {
+                TEST_ASSERT_TRUE_MESSAGE(colors_near(cell.fg, expected.fg,
+                    slack), message);
+            }
+        }
+    }
+}
+
+
+
+// ---- Tests ----
+
+
+
+static void test_present(void)
+{
+    check_random_frames(0, 0);
+}
+
+
+
+static void test_present_synchronized(void)
+{
+    check_random_frames(1, 0);
+}
+
+
+
+static void test_present_scrolling(void)
+{
+    check_random_frames(0, 1);
+}
+
+
+
+static void test_present_synchronized_scrolling(void)
+{
+    check_random_frames(1, 1);
+}
+
+
+
+/**
+ * @brief Presents write nothing when nothing the terminal shows changed,
+ *      even if cells were written in the meantime.
+ * 
+ */
+static void test_present_unchanged(void)
+{
+    emulator term = {0};
+    emulator_resize(&term, 20, 5);
+    term.expect_synchronized = 1;
+    tg_canvas *canvas = tg_canvas_create(20, 5);
+    TEST_ASSERT_NOT_NULL(canvas);
+    tg_canvas_set_synchronized(canvas, 1);
+    present_and_check(canvas, &term);
+    TEST_ASSERT_EQUAL_INT(1, term.writes);
+
+    present_and_check(canvas, &term);
+    TEST_ASSERT_EQUAL_INT(1, term.writes);
+
+    tg_canvas_cell cell = { 'x', TG_CELL_COLOR_INDEXED(3),
+        TG_CELL_COLOR_DEFAULT, 0 };
+    tg_canvas_cell blank;
+    tg_canvas_get(canvas, 4, 2, &blank);
+    tg_canvas_set(canvas, 4, 2, &cell);
+    tg_canvas_set(canvas, 4, 2, &blank);
+    present_and_check(canvas, &term);
+    TEST_ASSERT_EQUAL_INT(1, term.writes);
+
+    tg_canvas_set(canvas, 4, 2, &cell);
+    present_and_check(canvas, &term);
+    TEST_ASSERT_EQUAL_INT(2, term.writes);
+
+    tg_canvas_free(canvas);
+    free(term.cells);
+}
+
+
+
+/**
+ * @brief Scattered changes are reached with cheaper movements than absolute
+ *      positioning.
+ * 
+ */
+static void test_present_cursor_moves(void)
+{
+    emulator term = {0};
+    emulator_resize(&term, 120, 30);
+    tg_canvas *canvas = tg_canvas_create(120, 30);
+    TEST_ASSERT_NOT_NULL(canvas);
+    present_and_check(canvas, &term);
+
+    tg_canvas_cell cell = { 'o', TG_CELL_COLOR_DEFAULT, TG_CELL_COLOR_DEFAULT,
+        0 };
+    static const int targets[][2] = { { 100, 20 }, { 103, 20 }, { 90, 20 },
+        { 0, 21 }, { 119, 21 }, { 5, 25 }, { 6, 26 }, { 115, 3 },
+        { 60, 29 }, { 61, 28 } };
+    for (size_t k = 0; k < sizeof(targets) / sizeof(*targets); k++)
+    {
+        tg_canvas_set(canvas, targets[k][0], targets[k][1], &cell);
+        present_and_check(canvas, &term);
+
+        // Then several at once.
+        for (size_t j = 0; j <= k; j++)
+        {
+            cell.codepoint = 'a' + (uint32_t)random_below(26);
+            tg_canvas_set(canvas, targets[j][0], targets[j][1], &cell);
+        }
+        present_and_check(canvas, &term);
+    }
+
+    tg_canvas_stats stats;
+    tg_canvas_stats_get(canvas, &stats);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, stats.bytes_saved);
+    tg_canvas_free(canvas);
+    free(term.cells);
+}
+
+
+
+/**
+ * @brief A log scrolling up, then down, is scrolled on the terminal.
+ * 
+ */
+static void test_present_scrolled_log(void)
+{
+    emulator term = {0};
+    emulator_resize(&term, 30, 12);
+    tg_canvas *canvas = tg_canvas_create(30, 12);
+    TEST_ASSERT_NOT_NULL(canvas);
+    tg_canvas_set_scrolling(canvas, 1);
+    for (int y = 0; y < 12; y++)
+    {
+        tg_canvas_printf(canvas, 0, y, "#if line %d",
+            TG_INDEXED_COLOR_GREEN, y);
+    }
+    present_and_check(canvas, &term);
+
+    for (int line = 12; line < 40; line++)
+    {
+        int shift = line < 30 ? 1 : -2;
+        shift_rows(canvas, 2, 12, shift);
+        tg_canvas_printf(canvas, 0, shift > 0 ? 11 : 2, "#df line %d",
+            TG_RGB(200, line, 0), line);
+        present_and_check(canvas, &term);
+    }
+
+    tg_canvas_stats stats;
+    tg_canvas_stats_get(canvas, &stats);
+    TEST_ASSERT_EQUAL_UINT32(28, stats.scrolls);
+    tg_canvas_free(canvas);
+    free(term.cells);
+}
+
+
+
+/**
+ * @brief Resizing clears the screen and draws the canvas again.
+ * 
+ */
+static void test_present_resize(void)
+{
+    emulator term = {0};
+    emulator_resize(&term, 16, 6);
+    tg_canvas *canvas = tg_canvas_create(16, 6);
+    TEST_ASSERT_NOT_NULL(canvas);
+    tg_canvas_set_scrolling(canvas, 1);
+
+    for (int k = 0; k < 40; k++)
+    {
+        if (k % 5 == 4)
+        {
+            int columns = 1 + random_below(50);
+            int rows = 1 + random_below(20);
+            TEST_ASSERT_EQUAL_INT(0, tg_canvas_resize(canvas, columns, rows));
+            emulator_resize(&term, columns, rows);
+        }
+        random_changes(canvas, &term, 1);
+        present_and_check(canvas, &term);
+    }
+    tg_canvas_free(canvas);
+    free(term.cells);
+}
+
+
+
+/**
+ * @brief Wide code points and combining marks are not written as they are,
+ *      since the terminal would not advance by one column for them, and
+ *      every later cell of the row would be off.
+ * 
+ */
+static void test_present_wide_and_combining(void)
+{
+    emulator term = {0};
+    emulator_resize(&term, 12, 3);
+    tg_canvas *canvas = tg_canvas_create(12, 3);
+    TEST_ASSERT_NOT_NULL(canvas);
+    present_and_check(canvas, &term);
+
+    // U+65E5, then e and U+0301, then U+1F600.
+    TEST_ASSERT_EQUAL_INT(3, tg_canvas_printf(canvas, 0, 0,
+        "\xe6\x97\xa5" "ab"));
+    TEST_ASSERT_EQUAL_INT(3, tg_canvas_printf(canvas, 0, 1,
+        "e\xcc\x81x"));
+    TEST_ASSERT_EQUAL_INT(2, tg_canvas_printf(canvas, 4, 1,
+        "#if\xf0\x9f\x98\x80!", TG_INDEXED_COLOR_RED));
+    present_and_check(canvas, &term);
+
+    tg_canvas_cell shown;
+    tg_canvas_get(canvas, 0, 0, &shown);
+    TEST_ASSERT_EQUAL_UINT32(' ', shown.codepoint);
+    tg_canvas_get(canvas, 1, 1, &shown);
+    TEST_ASSERT_EQUAL_UINT32(' ', shown.codepoint);
+
+    // Cells set directly keep their code point, but are shown as a space,
+    // and the cells after them are still reached with relative moves.
+    tg_canvas_cell cell = { 0x65e5, TG_CELL_COLOR_DEFAULT,
+        TG_CELL_COLOR_DEFAULT, 0 };
+    for (int x = 0; x < 12; x += 3)
+    {
+        tg_canvas_set(canvas, x, 2, &cell);
+        cell.codepoint = cell.codepoint == 0x65e5 ? 0x301 : 0x65e5;
+    }
+    present_and_check(canvas, &term);
+    cell.codepoint = 'z';
+    tg_canvas_set(canvas, 2, 2, &cell);
+    tg_canvas_set(canvas, 7, 2, &cell);
+    tg_canvas_set(canvas, 5, 0, &cell);
+    present_and_check(canvas, &term);
+
+    tg_canvas_free(canvas);
+    free(term.cells);
+}
+
+
+
+/**
+ * @brief Checks the code point and foreground color of a row of cells, given
+ *      as a string and the colors of its characters.
+ * 
+ */
+static void check_row(tg_canvas *canvas, int y, const char *expected,
+    const uint32_t *fg)
+{
+    char message[64];
+    for (int x = 0; expected[x]; x++)
+    {
+        tg_canvas_cell cell;
+        snprintf(message, sizeof(message), "cell (%d, %d)", x, y);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(0, tg_canvas_get(canvas, x, y, &cell),
+            message);
+        TEST_ASSERT_EQUAL_HEX32_MESSAGE((unsigned char)expected[x],
+            cell.codepoint, message);
+        TEST_ASSERT_EQUAL_HEX32_MESSAGE(fg[x], cell.fg, message);
+    }
+}
+
+
+
+/**
+ * @brief Attribute changes apply from where their specifier is, whatever
+ *      the arguments format to, unit separators included.
+ * 
+ */
+static void test_printf_attributes(void)
+{
+    const uint32_t D = TG_CELL_COLOR_DEFAULT;
+    const uint32_t R = TG_CELL_COLOR_RGB(255, 0, 0);
+    const uint32_t G = TG_CELL_COLOR_INDEXED(2);
+    tg_canvas *canvas = tg_canvas_create(300, 4);
+    TEST_ASSERT_NOT_NULL(canvas);
+
+    TEST_ASSERT_EQUAL_INT(4, tg_canvas_printf(canvas, 0, 0, "%s#dfZ",
+        TG_RGB(255, 0, 0), "q\x1fr"));
+    check_row(canvas, 0, "q rZ", (const uint32_t[]){ D, D, D, R });
+
+    TEST_ASSERT_EQUAL_INT(7, tg_canvas_printf(canvas, 0, 1,
+        "\x1f%d#if%c\x1f#0f%s", TG_INDEXED_COLOR_GREEN, 42, '\x1f', "ab"));
+    check_row(canvas, 1, " 42  ab", (const uint32_t[]){ D, D, D, G, G, D,
+        D });
+
+    // Arguments longer than the text buffer on the stack, and changes at
+    // the very start and end.
+    char long_text[270];
+    memset(long_text, 'x', sizeof(long_text) - 1);
+    long_text[sizeof(long_text) - 1] = '\0';
+    long_text[100] = '\x1f';
+    TEST_ASSERT_EQUAL_INT(271, tg_canvas_printf(canvas, 0, 2,
+        "#if%s#df%c%c#0", TG_INDEXED_COLOR_GREEN, TG_RGB(255, 0, 0),
+        long_text, 'y', 'z'));
+    tg_canvas_cell cell;
+    for (int x = 0; x < 271; x++)
+    {
+        tg_canvas_get(canvas, x, 2, &cell);
+        TEST_ASSERT_EQUAL_HEX32(x < 269 ? G : R, cell.fg);
+        TEST_ASSERT_EQUAL_HEX32(x == 100 ? ' ' : x < 269 ? 'x'
+                              : x == 269 ? 'y' : 'z', cell.codepoint);
+    }
+
+    tg_canvas_free(canvas);
+}
+
+
+
+/**
+ * @brief Images blitted in every mode, depth and dither, at positions inside
+ *      the canvas, clipped by its edges or outside of it, show what
+ *      `tg_render` draws for the same options.
+ * 
+ */
+static void test_blit_matches_render(void)
+{
+    static const int positions[][2] = { { 0, 0 }, { 5, 3 }, { -7, -2 },
+        { 30, 12 }, { -3, 9 }, { 31, -4 }, { 40, 0 }, { -24, 20 } };
+    size_t position_count = sizeof(positions) / sizeof(*positions);
+    const tg_canvas_cell outside = { '.', TG_CELL_COLOR_INDEXED(5),
+        TG_CELL_COLOR_RGB(1, 2, 3), TG_CELL_STYLE_UNDERLINE };
+
+    uint8_t *pixels = (uint8_t*)malloc(3 * 57 * 41);
+    TEST_ASSERT_NOT_NULL(pixels);
+    fill_image(pixels, 57, 41);
+    tg_image image = { 57, 41, 3 * 57, TG_PIXEL_FORMAT_RGB8, pixels };
+    tg_ramp *blocks = tg_ramp_create(TG_RAMP_BLOCKS, 0);
+    TEST_ASSERT_NOT_NULL(blocks);
+
+    emulator screen = {0};
+    emulator_resize(&screen, 40, 16);
+    emulator rendered = {0};
+    tg_canvas *canvas = tg_canvas_create(40, 16);
+    TEST_ASSERT_NOT_NULL(canvas);
+
+    size_t k = 0;
+    for (int mode = 0; mode < 3; mode++)
+    {
+        for (int depth = 0; depth < 3; depth++)
+        {
+            for (int dither = 0; dither < 4; dither++, k++)
+            {
+                tg_render_opts opts = {0};
+                opts.mode = (tg_render_mode)mode;
+                opts.depth = (tg_color_depth)depth;
+                opts.dither = (tg_dither)dither;
+                opts.columns = 24;
+                opts.rows = 10;
+                opts.ramp = k % 2 ? blocks : NULL;
+                opts.threads = k % 3 ? 1 : 4;
+
+                int columns;
+                int rows;
+                render_to_emulator(&image, &opts, &rendered, &columns,
+                    &rows);
+
+                const int *at = positions[k % position_count];
+                tg_canvas_fill(canvas, 0, 0, 40, 16, &outside);
+                TEST_ASSERT_EQUAL_INT(0, tg_canvas_blit_image(canvas, at[0],
+                    at[1], 24, 10, &image, &opts));
+                check_blit(canvas, &rendered, columns, rows, at[0], at[1],
+                    &outside);
+                present_and_check(canvas, &screen);
+            }
+        }
+    }
+
+    tg_canvas_free(canvas);
+    free(rendered.cells);
+    free(screen.cells);
+    tg_ramp_free(blocks);
+    free(pixels);
+}
+
+
+
+/**
+ * @brief Tiles blitted from several threads at once, whose dirty marks
+ *      share words, give the same canvas as blitting them one by one, and
+ *      the next present draws every change.
+ * 
+ */
+static void test_blit_tiles_threads(void)
+{
+    enum { TILE_COUNT = TILE_COLUMNS * TILE_ROWS };
+    int columns = TILE_COLUMNS * TILE_WIDTH;
+    int rows = TILE_ROWS * TILE_HEIGHT;
+
+    emulator term = {0};
+    emulator_resize(&term, columns, rows);
+    tg_canvas *canvas = tg_canvas_create(columns, rows);
+    tg_canvas *reference = tg_canvas_create(columns, rows);
+    TEST_ASSERT_NOT_NULL(canvas);
+    TEST_ASSERT_NOT_NULL(reference);
+    present_and_check(canvas, &term);
+
+    tile_job jobs[TILE_COUNT];
+    pthread_t threads[TILE_COUNT];
+    for (int t = 0; t < TILE_COUNT; t++)
+    {
+        int width = 20 + 3 * t;
+        jobs[t].pixels = (uint8_t*)malloc(3 * (size_t)width * 30);
+        TEST_ASSERT_NOT_NULL(jobs[t].pixels);
+        jobs[t].image = (tg_image){ width, 30, 3 * (size_t)width,
+            TG_PIXEL_FORMAT_RGB8, jobs[t].pixels };
+        jobs[t].canvas = canvas;
+        jobs[t].x = t % TILE_COLUMNS * TILE_WIDTH;
+        jobs[t].y = t / TILE_COLUMNS * TILE_HEIGHT;
+    }
+
+    for (int round = 0; round < TILE_ROUNDS; round++)
+    {
+        for (int t = 0; t < TILE_COUNT; t++)
+        {
+            fill_image(jobs[t].pixels, jobs[t].image.width,
+                jobs[t].image.height);
+            tg_render_opts opts = {0};
+            opts.mode = (tg_render_mode)((t + round) % 3);
+            opts.depth = (tg_color_depth)(round % 3);
+            opts.dither = (tg_dither)((t + round / 2) % 4);
+            opts.threads = t % 3 ? 1 : 2;
+            jobs[t].opts = opts;
+            TEST_ASSERT_EQUAL_INT(0, tg_canvas_blit_image(reference,
+                jobs[t].x, jobs[t].y, TILE_WIDTH, TILE_HEIGHT,
+                &jobs[t].image, &opts));
+        }
+
+        for (int t = 0; t < TILE_COUNT; t++)
+        {
+            TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[t], NULL,
+                blit_tile, &jobs[t]));
+        }
+        for (int t = 0; t < TILE_COUNT; t++)
+        {
+            pthread_join(threads[t], NULL);
+            TEST_ASSERT_EQUAL_INT(0, jobs[t].result);
+        }
+
+        for (int y = 0; y < rows; y++)
+        {
+            for (int x = 0; x < columns; x++)
+            {
+                tg_canvas_cell cell;
+                tg_canvas_cell expected;
+                tg_canvas_get(canvas, x, y, &cell);
+                tg_canvas_get(reference, x, y, &expected);
+                TEST_ASSERT_EQUAL_MEMORY(&expected, &cell, sizeof(cell));
+            }
+        }
+        present_and_check(canvas, &term);
+    }
+
+    for (int t = 0; t < TILE_COUNT; t++)
+    {
+        free(jobs[t].pixels);
+    }
+    tg_canvas_free(reference);
+    tg_canvas_free(canvas);
+    free(term.cells);
+}
+
+
+
+/**
+ * @brief Rectangles and text far outside the canvas, up to the extreme
+ *      coordinates, are clipped without overflowing.
+ * 
+ */
+static void test_clipping_extremes(void)
+{
+    static const int coordinates[] = { INT_MIN, INT_MIN + 1, -1000000, -3,
+        0, 2, 5, 1000000, INT_MAX - 1, INT_MAX };
+    static const int lengths[] = { INT_MIN, -1, 0, 1, 3, 1000000,
+        INT_MAX - 1, INT_MAX };
+    size_t coordinate_count = sizeof(coordinates) / sizeof(*coordinates);
+    size_t length_count = sizeof(lengths) / sizeof(*lengths);
+
+    tg_canvas *canvas = tg_canvas_create(7, 5);
+    TEST_ASSERT_NOT_NULL(canvas);
+    tg_canvas_cell cell = { 'x', TG_CELL_COLOR_DEFAULT, TG_CELL_COLOR_DEFAULT,
+        0 };
+    tg_canvas_cell shown;
+    for (size_t a = 0; a < coordinate_count * length_count; a++)
+    {
+        int x = coordinates[a % coordinate_count];
+        int width = lengths[a / coordinate_count];
+        for (size_t b = 0; b < coordinate_count * length_count; b++)
+        {
+            int y = coordinates[b % coordinate_count];
+            int height = lengths[b / coordinate_count];
+            tg_canvas_clear(canvas);
+            tg_canvas_fill(canvas, x, y, width, height, &cell);
+
+            for (int cy = 0; cy < 5; cy++)
+            {
+                for (int cx = 0; cx < 7; cx++)
+                {
+                    int inside = cx >= x && cx < (int64_t)x + width &&
+                                 cy >= y && cy < (int64_t)y + height;
+                    tg_canvas_get(canvas, cx, cy, &shown);
+                    TEST_ASSERT_EQUAL_UINT32(inside ? 'x' : ' ',
+                        shown.codepoint);
+                }
+            }
+        }
+
+        tg_canvas_printf(canvas, x, coordinates[a % coordinate_count],
+            "abc\ndef");
+    }
+    tg_canvas_free(canvas);
+}
+
+
+
+/**
+ * @brief Animations drawn with `tg_render_delta` leave the screen showing
+ *      what a full render of each frame draws, through changes large and
+ *      small, frames without changes, and a change of size and back.
+ * 
+ * With a threshold, colors may lag behind by what it lets through: a
+ * redmean distance of n at most keeps every channel within sqrt(4.5) n,
+ * which is just under 17 n / 8.
+ * 
+ */
+static void test_render_delta(void)
+{
+    static const struct
+    {
+        tg_render_opts opts;
+        int threshold;
+    } variants[] = {
+        { { .threads = 1 }, 0 },
+        { { .threads = 8 }, 0 },
+        { { .threads = 8, .mode = TG_RENDER_MODE_HALF_BLOCK,
+            .depth = TG_COLOR_DEPTH_256, .dither = TG_DITHER_BAYER }, 0 },
+        { { .threads = 1, .mode = TG_RENDER_MODE_BLOCK,
+            .depth = TG_COLOR_DEPTH_16,
+            .dither = TG_DITHER_FLOYD_STEINBERG }, 0 },
+        { { .threads = 8, .depth = TG_COLOR_DEPTH_256,
+            .dither = TG_DITHER_ATKINSON }, 0 },
+        { { .threads = 1, .mode = TG_RENDER_MODE_HALF_BLOCK }, 12 },
+        { { .threads = 8, .dither = TG_DITHER_BAYER }, 12 },
+        { { .threads = 8, .mode = TG_RENDER_MODE_BLOCK }, 5 },
+    };
+
+    size_t size = 3 * (size_t)DELTA_WIDTH * DELTA_HEIGHT;
+    uint8_t *pixels = (uint8_t*)malloc(size);
+    TEST_ASSERT_NOT_NULL(pixels);
+    tg_image image = { DELTA_WIDTH, DELTA_HEIGHT, 3 * DELTA_WIDTH,
+        TG_PIXEL_FORMAT_RGB8, pixels };
+    emulator rendered = {0};
+
+    for (size_t v = 0; v < sizeof(variants) / sizeof(*variants); v++)
+    {
+        tg_render_opts opts = variants[v].opts;
+        tg_delta *delta = tg_delta_create(variants[v].threshold);
+        TEST_ASSERT_NOT_NULL(delta);
+        fill_image(pixels, DELTA_WIDTH, DELTA_HEIGHT);
+
+        // Room for the largest frame and the line feed after it, cleared.
+        emulator screen = {0};
+        emulator_resize(&screen, DELTA_WIDTH + 1, DELTA_HEIGHT + 1);
+        for (int i = 0; i < screen.columns * screen.rows; i++)
+        {
+            screen.cells[i] = BLANK;
+        }
+        screen.newline_returns = 1;
+        tg_sink sink = { emulator_write, &screen };
+
+        for (int frame = 0; frame < DELTA_FRAMES; frame++)
+        {
+            next_frame(pixels, DELTA_WIDTH, DELTA_HEIGHT, frame);
+
+            // A few frames are cropped, and so smaller.
+            int cropped = frame >= 9 && frame < 15;
+            opts.crop_x = cropped ? 3 : 0;
+            opts.crop_y = cropped ? 5 : 0;
+            opts.crop_width = cropped ? DELTA_WIDTH - 7 : 0;
+            opts.crop_height = cropped ? DELTA_HEIGHT - 13 : 0;
+
+            TEST_ASSERT_EQUAL_INT(0, tg_render_delta(&image, &opts, delta,
+                &sink));
+            if (screen.error[0])
+            {
+                TEST_FAIL_MESSAGE(screen.error);
+            }
+
+            int columns;
+            int rows;
+            render_to_emulator(&image, &opts, &rendered, &columns, &rows);
+            check_delta_frame(&screen, &rendered, columns, rows,
+                17 * variants[v].threshold / 8, frame);
+        }
+
+        free(screen.cells);
+        tg_delta_free(delta);
+    }
+
+    free(rendered.cells);
+    free(pixels);
+}
+
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_present);
+    RUN_TEST(test_present_synchronized);
+    RUN_TEST(test_present_scrolling);
+    RUN_TEST(test_present_synchronized_scrolling);
+    RUN_TEST(test_present_unchanged);
+    RUN_TEST(test_present_cursor_moves);
+    RUN_TEST(test_present_scrolled_log);
+    RUN_TEST(test_present_resize);
+    RUN_TEST(test_present_wide_and_combining);
+    RUN_TEST(test_printf_attributes);
+    RUN_TEST(test_blit_matches_render);
+    RUN_TEST(test_blit_tiles_threads);
+    RUN_TEST(test_clipping_extremes);
+    RUN_TEST(test_render_delta);
+    return UNITY_END();
+}
@@ -0,0 +1,488 @@
+/*************************************************************************//**
+ * 
+ * @file test_decoders.c
+ * 
+ * @brief Checks the image decoders against the fixtures of
+ *      `tests/fixtures`, and that malformed files fail cleanly.
+ * 
+ * Each fixture is decoded both from memory, where pixels are read in place,
+ * and from a stdio stream, where they are buffered, then compared pixel for
+ * pixel with a P6 reference. Every truncation of every fixture must fail,
+ * and random corruptions must either decode or fail, without reading out
+ * of bounds; run the test under a sanitizer to catch those.
+ * 
+ *****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "../include/termglyph.h"
+#include "../src/internal.h"
+
+
+
+/**
+ * @brief Widest image whose rows are decoded, past which corrupted sizes
+ *      are only opened.
+ * 
+ */
+#define MAX_WIDTH 65536
+
+#define MUTATIONS 300
+
+
+
+/**
+ * @brief A fixture and the P6 reference it decodes to.
+ * 
+ */
+typedef struct fixture
+{
+    const char *file;
+    const char *reference;
+    size_t trailer; /**< Bytes at the end decoding does not need. */
+} fixture;
+
+
+
+static const fixture FIXTURES[] = {
+    { "bmp_1bpp.bmp", "bw.ppm", 0 },
+    { "bmp_4bpp.bmp", "palette16.ppm", 0 },
+    { "bmp_8bpp.bmp", "palette16.ppm", 0 },
+    { "bmp_8bpp_core.bmp", "palette16.ppm", 0 },
+    { "bmp_16bpp.bmp", "rgb555.ppm", 0 },
+    { "bmp_16bpp_565.bmp", "rgb565.ppm", 0 },
+    { "bmp_24bpp.bmp", "rgb.ppm", 0 },
+    { "bmp_24bpp_top_down.bmp", "rgb.ppm", 0 },
+    { "bmp_32bpp.bmp", "rgb.ppm", 0 },
+    { "bmp_32bpp_bitfields.bmp", "rgb.ppm", 0 },
+    { "bmp_32bpp_v5.bmp", "rgb.ppm", 0 },
+    { "tga_mapped.tga", "palette16.ppm", 0 },
+    { "tga_mapped_first.tga", "palette16.ppm", 0 },
+    { "tga_mapped_rle_top_down.tga", "palette16.ppm", 0 },
+    { "tga_24bpp.tga", "rgb.ppm", 0 },
+    { "tga_24bpp_rle.tga", "rgb.ppm", 0 },
+    { "tga_24bpp_right_to_left.tga", "rgb.ppm", 0 },
+    { "tga_32bpp_top_down.tga", "rgb.ppm", 0 },
+    { "tga_32bpp_rle_top_down.tga", "rgb.ppm", 0 },
+    { "tga_16bpp.tga", "rgb555_replicated.ppm", 0 },
+    { "tga_gray.tga", "gray.ppm", 0 },
+    { "tga_gray_rle.tga", "gray.ppm", 0 },
+    { "farbfeld.ff", "farbfeld.ppm", 0 },
+    { "qoi_rgb.qoi", "rgb.ppm", 8 },
+    { "qoi_rgba.qoi", "rgb.ppm", 8 },
+    { "qoi_runs.qoi", "runs.ppm", 8 },
+    // Cuts inside the last sample of a plain raster still leave a number.
+    { "pnm_p1.pbm", "bw.ppm", 1 },
+    { "pnm_p4.pbm", "bw.ppm", 0 },
+    { "pnm_p2.pgm", "gray.ppm", 2 },
+    { "pnm_p5.pgm", "gray.ppm", 0 },
+    { "pnm_p5_wide.pgm", "gray1000.ppm", 0 },
+    { "pnm_p3.ppm", "rgb.ppm", 3 },
+    { "pnm_p6.ppm", "rgb.ppm", 0 },
+    { "pnm_p6_maxval31.ppm", "rgb555.ppm", 0 },
+    { "pnm_p6_16bit.ppm", "farbfeld.ppm", 0 },
+    { "pam_rgb.pam", "rgb.ppm", 0 },
+    { "pam_rgb_alpha.pam", "rgb.ppm", 0 },
+    { "pam_rgb_alpha_16bit.pam", "farbfeld.ppm", 0 },
+    { "pam_gray.pam", "gray.ppm", 0 },
+    { "pam_gray_alpha.pam", "gray.ppm", 0 },
+    { "pam_bw.pam", "bw.ppm", 0 },
+};
+
+#define FIXTURE_COUNT (sizeof(FIXTURES) / sizeof(*FIXTURES))
+
+
+
+/**
+ * @brief A byte of a fixture overwritten to make it invalid.
+ * 
+ */
+typedef struct corruption
+{
+    const char *file;
+    size_t offset;
+    uint8_t value;
+    const char *what;
+} corruption;
+
+
+
+static const corruption CORRUPTIONS[] = {
+    { "bmp_24bpp.bmp", 0, 'X', "bad magic" },
+    { "bmp_24bpp.bmp", 14, 20, "DIB header size between core and info" },
+    { "bmp_24bpp.bmp", 18, 0, "zero width" },
+    { "bmp_24bpp.bmp", 28, 7, "7 bits per pixel" },
+    { "bmp_24bpp.bmp", 30, 1, "run-length compression" },
+    { "bmp_24bpp.bmp", 10, 20, "pixels overlapping the headers" },
+    { "bmp_32bpp_bitfields.bmp", 63, 0, "empty blue mask" },
+    { "tga_24bpp.tga", 2, 4, "unknown image type" },
+    { "tga_24bpp.tga", 16, 12, "12 bits per pixel" },
+    { "tga_24bpp.tga", 12, 0, "zero width" },
+    { "tga_24bpp.tga", 17, 0x40, "interleaved rows" },
+    { "tga_mapped.tga", 1, 0, "mapped image without a color map" },
+    { "tga_mapped.tga", 7, 12, "12-bit color map entries" },
+    { "tga_mapped.tga", 75, 200, "index past the color map" },
+    { "farbfeld.ff", 7, 'X', "bad magic" },
+    { "farbfeld.ff", 11, 0, "zero width" },
+    { "qoi_rgb.qoi", 0, 'Q', "bad magic" },
+    { "qoi_rgb.qoi", 7, 0, "zero width" },
+    { "qoi_rgb.qoi", 12, 5, "5 channels" },
+    { "qoi_rgb.qoi", 4, 0x40, "too many pixels" },
+    { "pnm_p6.ppm", 1, '8', "bad magic" },
+    { "pnm_p6.ppm", 15, '0', "zero width" },
+    { "pnm_p6_16bit.ppm", 7, '7', "maxval past 65535" },
+    { "pnm_p3.ppm", 26, '9', "sample past maxval" },
+    { "pnm_p1.pbm", 20, '2', "bit neither 0 nor 1" },
+    { "pam_rgb.pam", 38, '5', "depth 5" },
+    { "pam_rgb.pam", 40, 'X', "unknown keyword" },
+};
+
+
+
+static uint32_t random_state;
+
+
+
+void setUp(void)
+{
+    random_state = 2463534242u;
+}
+
+
+
+void tearDown(void)
+{
+}
+
+
+
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+
+
+/**
+ * @brief Reads a fixture whole, failing the test if it can't.
+ * 
+ */
+static uint8_t *read_fixture(const char *name, size_t *length)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", TERMGLYPH_FIXTURES_DIR, name);
+    FILE *f = fopen(path, "rb");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, name);
+
+    fseek(f, 0, SEEK_END);
+    *length = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = (uint8_t*)malloc(*length);
+    TEST_ASSERT_NOT_NULL(data);
+    TEST_ASSERT_EQUAL_size_t(*length, fread(data, 1, *length, f));
+    fclose(f);
+    return data;
+}
+
+
+
+/**
+ * @brief Decodes an image with the decoder its content selects.
+ * 
+ * @param data The image file.
+ * @param length Its length, exactly as allocated, so that reading past it
+ *      is caught by sanitizers.
+ * @param stream Whether to read it through a stdio stream rather than in
+ *      place.
+ * @param image Where to store the decoded image, with packed RGB8 pixels to
+ *      free, or NULL to only decode it.
+ * 
+ * @return 0 on success, non-zero value otherwise.
+ */
+static int decode(const uint8_t *data, size_t length, int stream,
+    tg_image *image)
+{
+    tg_reader reader;
+    FILE *f = NULL;
+    if (stream)
+    {
+        f = length ? fmemopen((void*)data, length, "rb") : NULL;
+        if (!f || tg_reader_open_file(&reader, f))
+        {
+            if (f)
+            {
+                fclose(f);
+            }
+            return 1;
+        }
+    }
+    else if (tg_reader_open_memory(&reader, data, length))
+    {
+        return 1;
+    }
+
+    tg_row_source source;
+    if (tg_decoder_source_open(&source, &reader))
+    {
+        // Failing to open closes the reader already.
+        if (f)
+        {
+            fclose(f);
+        }
+        return 1;
+    }
+
+    int failed = 0;
+    uint8_t *pixels = NULL;
+    if (source.width <= MAX_WIDTH)
+    {
+        size_t row_size = 3 * (size_t)source.width;
+        uint8_t *scratch = (uint8_t*)malloc(row_size);
+        pixels = image ? (uint8_t*)malloc(row_size * source.height) : NULL;
+        failed = !scratch || (image && !pixels);
+        for (int y = 0; y < source.height && !failed; y++)
+        {
+            const uint8_t *row = source.read_row(&source, y, scratch);
+            failed = !row;
+            if (row && pixels)
+            {
+                memcpy(pixels + row_size * y, row, row_size);
+            }
+        }
+        free(scratch);
+    }
+    tg_row_source_close(&source);
+    if (f)
+    {
+        fclose(f);
+    }
+
+    if (failed || !image)
+    {
+        free(pixels);
+        return failed;
+    }
+    image->width = source.width;
+    image->height = source.height;
+    image->stride = 3 * (size_t)source.width;
+    image->format = TG_PIXEL_FORMAT_RGB8;
+    image->pixels = pixels;
+    return 0;
+}
+
+
+
+/**
+ * @brief Decodes a fixture and compares it with its reference.
+ * 
+ */
+static void check_fixture(const fixture *fx, int stream)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", TERMGLYPH_FIXTURES_DIR,
+        fx->reference);
+    tg_image *reference = tg_image_load_ppm(path);
+    TEST_ASSERT_NOT_NULL_MESSAGE(reference, fx->reference);
+
+    size_t length;
+    uint8_t *data = read_fixture(fx->file, &length);
+    tg_image image;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, decode(data, length, stream, &image),
+        fx->file);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(reference->width, image.width, fx->file);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(reference->height, image.height,
+        fx->file);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference->pixels, image.pixels,
+        3 * (size_t)image.width * image.height, fx->file);
+
+    free((void*)image.pixels);
+    free(data);
+    tg_image_free(reference);
+}
+
+
+
+static void test_fixtures_from_memory(void)
+{
+    for (size_t i = 0; i < FIXTURE_COUNT; i++)
+    {
+        check_fixture(&FIXTURES[i], 0);
+    }
+}
+
+
+
+static void test_fixtures_from_stream(void)
+{
+    for (size_t i = 0; i < FIXTURE_COUNT; i++)
+    {
+        check_fixture(&FIXTURES[i], 1);
+    }
+}
+
+
+
+/**
+ * @brief Cuts every fixture at every length short of its pixels, which must
+ *      all fail.
+ * 
+ */
+static void test_truncated_fail(void)
+{
+    char message[128];
+    for (size_t i = 0; i < FIXTURE_COUNT; i++)
+    {
+        size_t length;
+        uint8_t *data = read_fixture(FIXTURES[i].file, &length);
+        for (size_t cut = 0; cut < length - FIXTURES[i].trailer; cut++)
+        {
+            // A copy of the exact length, for sanitizers to see overreads.
+            uint8_t *copy = (uint8_t*)malloc(cut ? cut : 1);
+            TEST_ASSERT_NOT_NULL(copy);
+            memcpy(copy, data, cut);
+            snprintf(message, sizeof(message), "%s cut at %zu",
+                FIXTURES[i].file, cut);
+            TEST_ASSERT_NOT_EQUAL_INT_MESSAGE(0, decode(copy, cut, 0, NULL),
+                message);
+            TEST_ASSERT_NOT_EQUAL_INT_MESSAGE(0, decode(copy, cut, 1, NULL),
+                message);
+            free(copy);
+        }
+        free(data);
+    }
+}
+
+
+
+static void test_corrupted_headers_fail(void)
+{
+    char message[128];
+    for (size_t i = 0; i < sizeof(CORRUPTIONS) / sizeof(*CORRUPTIONS); i++)
+    {
+        const corruption *c = &CORRUPTIONS[i];
+        size_t length;
+        uint8_t *data = read_fixture(c->file, &length);
+        snprintf(message, sizeof(message), "%s: %s", c->file, c->what);
+        TEST_ASSERT_LESS_THAN_size_t_MESSAGE(length, c->offset, message);
+        TEST_ASSERT_NOT_EQUAL_INT_MESSAGE(c->value, data[c->offset],
+            message);
+        data[c->offset] = c->value;
+
+        TEST_ASSERT_NOT_EQUAL_INT_MESSAGE(0, decode(data, length, 0, NULL),
+            message);
+        TEST_ASSERT_NOT_EQUAL_INT_MESSAGE(0, decode(data, length, 1, NULL),
+            message);
+        free(data);
+    }
+}
+
+
+
+/**
+ * @brief A BITFIELDS mask made of two runs of bits used to index the 8-bit
+ *      scale table with values far past its end.
+ * 
+ */
+static void test_bmp_mask_gaps_fail(void)
+{
+    size_t length;
+    uint8_t *data = read_fixture("bmp_mask_gaps.bmp", &length);
+    TEST_ASSERT_NOT_EQUAL_INT(0, decode(data, length, 0, NULL));
+    TEST_ASSERT_NOT_EQUAL_INT(0, decode(data, length, 1, NULL));
+    free(data);
+}
+
+
+
+/**
+ * @brief Bottom-up images whose headers announce far more pixels than
+ *      follow, which are read whole from streams before their first row.
+ *      They must fail at the end of the input rather than allocate what the
+ *      header announces.
+ * 
+ */
+static void test_forged_sizes_fail(void)
+{
+    static const char *const BMP_FILES[] = { "bmp_24bpp.bmp" };
+    static const char *const TGA_FILES[] = { "tga_24bpp.tga",
+        "tga_24bpp_rle.tga" };
+
+    size_t length;
+    for (size_t i = 0; i < sizeof(BMP_FILES) / sizeof(*BMP_FILES); i++)
+    {
+        uint8_t *data = read_fixture(BMP_FILES[i], &length);
+        // Width and height, 0x00ffffff each.
+        memcpy(data + 18, "\xff\xff\xff\x00\xff\xff\xff\x00", 8);
+        TEST_ASSERT_NOT_EQUAL_INT_MESSAGE(0, decode(data, length, 0, NULL),
+            BMP_FILES[i]);
+        TEST_ASSERT_NOT_EQUAL_INT_MESSAGE(0, decode(data, length, 1, NULL),
+            BMP_FILES[i]);
+        free(data);
+    }
+    for (size_t i = 0; i < sizeof(TGA_FILES) / sizeof(*TGA_FILES); i++)
+    {
+        uint8_t *data = read_fixture(TGA_FILES[i], &length);
+        // Width and height, 65535 each.
+        memcpy(data + 12, "\xff\xff\xff\xff", 4);
+        TEST_ASSERT_NOT_EQUAL_INT_MESSAGE(0, decode(data, length, 0, NULL),
+            TGA_FILES[i]);
+        TEST_ASSERT_NOT_EQUAL_INT_MESSAGE(0, decode(data, length, 1, NULL),
+            TGA_FILES[i]);
+        free(data);
+    }
+}
+
+
+
+/**
+ * @brief Overwrites a few random bytes of every fixture, mostly in the
+ *      headers. The result does not matter, only that decoding gets there.
+ * 
+ */
+static void test_mutations_fail_cleanly(void)
+{
+    for (size_t i = 0; i < FIXTURE_COUNT; i++)
+    {
+        size_t length;
+        uint8_t *data = read_fixture(FIXTURES[i].file, &length);
+        uint8_t *copy = (uint8_t*)malloc(length);
+        TEST_ASSERT_NOT_NULL(copy);
+        for (int m = 0; m < MUTATIONS; m++)
+        {
+            memcpy(copy, data, length);
+            int count = 1 + (int)(next_random() % 3);
+            for (int k = 0; k < count; k++)
+            {
+                size_t span = next_random() % 4 ? 64 : length;
+                size_t offset = next_random() % (span < length ? span
+                                                               : length);
+                copy[offset] = (uint8_t)next_random();
+            }
+            decode(copy, length, m % 2, NULL);
+        }
+        free(copy);
+        free(data);
+    }
+}
+
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fixtures_from_memory);
+    RUN_TEST(test_fixtures_from_stream);
+    RUN_TEST(test_truncated_fail);
+    RUN_TEST(test_corrupted_headers_fail);
+    RUN_TEST(test_bmp_mask_gaps_fail);
+    RUN_TEST(test_forged_sizes_fail);
+    RUN_TEST(test_mutations_fail_cleanly);
+    return UNITY_END();
+}
@@ -0,0 +1,395 @@
+/*************************************************************************//**
+ * 
+ * @file test_kernels.c
+ * 
+ * @brief Checks that the SIMD kernels are bit-exact with the scalar ones,
+ *      and that rendering gives the same output with every thread count.
+ * 
+ * Kernels the running CPU does not support are reported as ignored.
+ * 
+ *****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "../include/termglyph.h"
+#include "../src/internal.h"
+
+
+
+#define COLOR_COUNT (1u << 24)
+#define ROW_PIXELS 4096
+#define NOISE_WIDTH 523
+#define NOISE_HEIGHT 301
+
+
+
+/**
+ * @brief A sink keeping the output in memory.
+ * 
+ */
+typedef struct memory_sink
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+} memory_sink;
+
+
+
+static uint32_t random_state;
+
+
+
+void setUp(void)
+{
+    random_state = 2463534242u;
+}
+
+
+
+void tearDown(void)
+{
+}
+
+
+
+static uint8_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return (uint8_t)random_state;
+}
+
+
+
+static int memory_write(void *ctx, const char *data, size_t length)
+{
+    memory_sink *sink = (memory_sink*)ctx;
+    if (sink->length + length > sink->capacity)
+    {
+        size_t capacity = 2 * (sink->length + length);
+        char *grown = (char*)realloc(sink->data, capacity);
+        if (!grown)
+        {
+            return 1;
+        }
+        sink->data = grown;
+        sink->capacity = capacity;
+    }
+    memcpy(sink->data + sink->length, data, length);
+    sink->length += length;
+    return 0;
+}
+
+
+
+/**
+ * @brief Checks a luma kernel against the exact integer definition of the
+ *      luma over every RGB color, then at every alignment and tail length.
+ * 
+ */
+static void check_luma_kernel(tg_luma_row_fn kernel)
+{
+    uint8_t *rgb = (uint8_t*)malloc(3 * (size_t)COLOR_COUNT);
+    uint8_t *expected = (uint8_t*)malloc(COLOR_COUNT);
+    uint8_t *luma = (uint8_t*)malloc(COLOR_COUNT);
+    TEST_ASSERT_NOT_NULL(rgb);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(luma);
+
+    for (uint32_t c = 0; c < COLOR_COUNT; c++)
+    {
+        rgb[3*c] = (uint8_t)(c >> 16);
+        rgb[3*c+1] = (uint8_t)(c >> 8);
+        rgb[3*c+2] = (uint8_t)c;
+        expected[c] = (uint8_t)((2126 * rgb[3*c] + 7152 * rgb[3*c+1]
+                               + 722 * rgb[3*c+2]) / 10000);
+    }
+
+    kernel(rgb, luma, COLOR_COUNT);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, luma, COLOR_COUNT);
+
+    // Short runs exercise the scalar tails and unaligned starts.
+    for (size_t offset = 0; offset < 64; offset++)
+    {
+        for (size_t count = 1; count < 64; count++)
+        {
+            kernel(rgb + 3*offset, luma, count);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected + offset, luma, count);
+        }
+    }
+
+    free(luma);
+    free(expected);
+    free(rgb);
+}
+
+
+
+/**
+ * @brief Checks a downsampling kernel against the scalar one, at every
+ *      alignment and tail length, then over a long row.
+ * 
+ */
+static void check_downsample_kernel(tg_downsample_row_fn kernel)
+{
+    // Rows of 2 * ROW_PIXELS pixels, plus room for the offsets.
+    size_t row_size = 8 * (size_t)ROW_PIXELS + 16;
+    uint8_t *top = (uint8_t*)malloc(row_size);
+    uint8_t *bottom = (uint8_t*)malloc(row_size);
+    uint8_t *expected = (uint8_t*)malloc(4 * (size_t)ROW_PIXELS);
+    uint8_t *out = (uint8_t*)malloc(4 * (size_t)ROW_PIXELS);
+    TEST_ASSERT_NOT_NULL(top);
+    TEST_ASSERT_NOT_NULL(bottom);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(out);
+
+    for (size_t i = 0; i < row_size; i++)
+    {
+        top[i] = next_random();
+        bottom[i] = next_random();
+    }
+
+    for (size_t offset = 0; offset < 16; offset++)
+    {
+        for (size_t count = 1; count < 64; count++)
+        {
+            tg_downsample_row_scalar(top + offset, bottom + offset, expected,
+                count);
+            kernel(top + offset, bottom + offset, out, count);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, out, 4 * count);
+        }
+    }
+
+    tg_downsample_row_scalar(top, bottom, expected, ROW_PIXELS);
+    kernel(top, bottom, out, ROW_PIXELS);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, out, 4 * (size_t)ROW_PIXELS);
+
+    free(out);
+    free(expected);
+    free(bottom);
+    free(top);
+}
+
+
+
+/**
+ * @brief Checks a YUV kernel against the scalar one, with both matrices and
+ *      with full and subsampled chroma, at every alignment and tail length,
+ *      then over a long row.
+ * 
+ */
+static void check_yuv_kernel(tg_yuv_row_fn kernel)
+{
+    // Planes of ROW_PIXELS samples, plus room for the offsets.
+    size_t plane_size = (size_t)ROW_PIXELS + 16;
+    uint8_t *y = (uint8_t*)malloc(plane_size);
+    uint8_t *u = (uint8_t*)malloc(plane_size);
+    uint8_t *v = (uint8_t*)malloc(plane_size);
+    uint8_t *expected = (uint8_t*)malloc(3 * (size_t)ROW_PIXELS);
+    uint8_t *out = (uint8_t*)malloc(3 * (size_t)ROW_PIXELS);
+    TEST_ASSERT_NOT_NULL(y);
+    TEST_ASSERT_NOT_NULL(u);
+    TEST_ASSERT_NOT_NULL(v);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(out);
+
+    // Random samples go past the limited range, and so exercise clamping.
+    for (size_t i = 0; i < plane_size; i++)
+    {
+        y[i] = next_random();
+        u[i] = next_random();
+        v[i] = next_random();
+    }
+
+    for (int full_range = 0; full_range <= 1; full_range++)
+    {
+        const tg_yuv_matrix *m = tg_yuv_matrix_bt601(full_range);
+        for (int subsampled = 0; subsampled <= 1; subsampled++)
+        {
+            for (size_t offset = 0; offset < 16; offset++)
+            {
+                for (size_t count = 1; count < 64; count++)
+                {
+                    tg_yuv_row_scalar(m, y + offset, u + offset, v + offset,
+                        subsampled, expected, count);
+                    kernel(m, y + offset, u + offset, v + offset, subsampled,
+                        out, count);
+                    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, out, 3 * count);
+                }
+            }
+
+            tg_yuv_row_scalar(m, y, u, v, subsampled, expected, ROW_PIXELS);
+            kernel(m, y, u, v, subsampled, out, ROW_PIXELS);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, out,
+                3 * (size_t)ROW_PIXELS);
+        }
+    }
+
+    free(out);
+    free(expected);
+    free(v);
+    free(u);
+    free(y);
+}
+
+
+
+static void test_luma_scalar(void)
+{
+    check_luma_kernel(tg_luma_row_scalar);
+}
+
+
+
+static void test_luma_sse2(void)
+{
+#if TG_X86_KERNELS
+    if (tg_cpu_supports("sse2"))
+    {
+        check_luma_kernel(tg_luma_row_sse2);
+        return;
+    }
+#endif
+    TEST_IGNORE_MESSAGE("SSE2 not supported");
+}
+
+
+
+static void test_luma_avx2(void)
+{
+#if TG_X86_KERNELS
+    if (tg_cpu_supports("avx2"))
+    {
+        check_luma_kernel(tg_luma_row_avx2);
+        return;
+    }
+#endif
+    TEST_IGNORE_MESSAGE("AVX2 not supported");
+}
+
+
+
+static void test_downsample_sse2(void)
+{
+#if TG_X86_KERNELS
+    if (tg_cpu_supports("sse2"))
+    {
+        check_downsample_kernel(tg_downsample_row_sse2);
+        return;
+    }
+#endif
+    TEST_IGNORE_MESSAGE("SSE2 not supported");
+}
+
+
+
+static void test_downsample_avx2(void)
+{
+#if TG_X86_KERNELS
+    if (tg_cpu_supports("avx2"))
+    {
+        check_downsample_kernel(tg_downsample_row_avx2);
+        return;
+    }
+#endif
+    TEST_IGNORE_MESSAGE("AVX2 not supported");
+}
+
+
+
+static void test_yuv_sse2(void)
+{
+#if TG_X86_KERNELS
+    if (tg_cpu_supports("sse2"))
+    {
+        check_yuv_kernel(tg_yuv_row_sse2);
+        return;
+    }
+#endif
+    TEST_IGNORE_MESSAGE("SSE2 not supported");
+}
+
+
+
+static void test_yuv_avx2(void)
+{
+#if TG_X86_KERNELS
+    if (tg_cpu_supports("avx2"))
+    {
+        check_yuv_kernel(tg_yuv_row_avx2);
+        return;
+    }
+#endif
+    TEST_IGNORE_MESSAGE("AVX2 not supported");
+}
+
+
+
+/**
+ * @brief Renders pseudo-random pixels, so that nearly every cell needs its
+ *      own color sequence, on an image whose height is not a multiple of the
+ *      band height, and checks that every thread count gives the same bytes.
+ * 
+ */
+static void test_render_threads(void)
+{
+    size_t size = 3 * (size_t)NOISE_WIDTH * NOISE_HEIGHT;
+    uint8_t *pixels = (uint8_t*)malloc(size);
+    TEST_ASSERT_NOT_NULL(pixels);
+    for (size_t i = 0; i < size; i++)
+    {
+        pixels[i] = next_random();
+    }
+    tg_image image = { NOISE_WIDTH, NOISE_HEIGHT, 3 * NOISE_WIDTH,
+        TG_PIXEL_FORMAT_RGB8, pixels };
+
+    // Error diffusion is serial, so it goes through another path.
+    static const tg_render_opts variants[] = {
+        { .mode = TG_RENDER_MODE_ASCII },
+        { .mode = TG_RENDER_MODE_HALF_BLOCK },
+        { .mode = TG_RENDER_MODE_ASCII, .depth = TG_COLOR_DEPTH_256,
+          .dither = TG_DITHER_FLOYD_STEINBERG },
+    };
+    for (size_t v = 0; v < sizeof(variants) / sizeof(*variants); v++)
+    {
+        tg_render_opts opts = variants[v];
+        opts.threads = 1;
+        memory_sink reference = {0};
+        tg_sink sink = { memory_write, &reference };
+        TEST_ASSERT_EQUAL_INT(0, tg_render(&image, &opts, &sink));
+
+        for (int threads = 2; threads <= 16; threads++)
+        {
+            memory_sink output = {0};
+            sink.ctx = &output;
+            opts.threads = threads;
+            TEST_ASSERT_EQUAL_INT(0, tg_render(&image, &opts, &sink));
+            TEST_ASSERT_EQUAL_size_t(reference.length, output.length);
+            TEST_ASSERT_EQUAL_MEMORY(reference.data, output.data,
+                reference.length);
+            free(output.data);
+        }
+        free(reference.data);
+    }
+    free(pixels);
+}
+
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_luma_scalar);
+    RUN_TEST(test_luma_sse2);
+    RUN_TEST(test_luma_avx2);
+    RUN_TEST(test_downsample_sse2);
+    RUN_TEST(test_downsample_avx2);
+    RUN_TEST(test_yuv_sse2);
+    RUN_TEST(test_yuv_avx2);
+    RUN_TEST(test_render_threads);
+    return UNITY_END();
+}
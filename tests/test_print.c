@@ -0,0 +1,305 @@
+/*************************************************************************//**
+ * 
+ * @file test_print.c
+ * 
+ * @brief Checks the exact bytes `tg_printf` writes for every specifier, and
+ *      the number of characters it returns.
+ * 
+ * Standard output is redirected into a temporary file around each call, and
+ * restored before anything is checked.
+ * 
+ *****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unity.h"
+
+#include "../include/termglyph.h"
+
+
+
+#define CAPTURE_LENGTH 4096
+
+#define END TG_RESET_ALL_MODES
+
+
+
+/**
+ * @brief A style specifier and the sequences it and its reset write.
+ * 
+ */
+typedef struct style_case
+{
+    char letter;
+    const char *sequence;
+    const char *reset;
+} style_case;
+
+
+
+static const style_case STYLES[] = {
+    { 'o', TG_TEXT_STYLE_BOLD, TG_TEXT_STYLE_BOLD_RESET },
+    { 'm', TG_TEXT_STYLE_DIM, TG_TEXT_STYLE_DIM_RESET },
+    { 't', TG_TEXT_STYLE_ITALIC, TG_TEXT_STYLE_ITALIC_RESET },
+    { 'u', TG_TEXT_STYLE_UNDERLINE, TG_TEXT_STYLE_UNDERLINE_RESET },
+    { 'w', TG_TEXT_STYLE_DOUBLE_UNDERLINE,
+        TG_TEXT_STYLE_DOUBLE_UNDERLINE_RESET },
+    { 'k', TG_TEXT_STYLE_BLINKING, TG_TEXT_STYLE_BLINKING_RESET },
+    { 'n', TG_TEXT_STYLE_INVERSE, TG_TEXT_STYLE_INVERSE_RESET },
+    { 'h', TG_TEXT_STYLE_HIDDEN, TG_TEXT_STYLE_HIDDEN_RESET },
+    { 's', TG_TEXT_STYLE_STRIKETHROUGH, TG_TEXT_STYLE_STRIKETHROUGH_RESET },
+};
+
+
+
+/**
+ * @brief An indexed color and its background sequence.
+ * 
+ */
+typedef struct indexed_case
+{
+    const char *color;
+    const char *background;
+} indexed_case;
+
+
+
+static const indexed_case INDEXED[] = {
+    { TG_INDEXED_COLOR_BLACK, "\033[040m" },
+    { TG_INDEXED_COLOR_RED, "\033[041m" },
+    { TG_INDEXED_COLOR_GREEN, "\033[042m" },
+    { TG_INDEXED_COLOR_YELLOW, "\033[043m" },
+    { TG_INDEXED_COLOR_BLUE, "\033[044m" },
+    { TG_INDEXED_COLOR_MAGENTA, "\033[045m" },
+    { TG_INDEXED_COLOR_CYAN, "\033[046m" },
+    { TG_INDEXED_COLOR_WHITE, "\033[047m" },
+    { TG_INDEXED_COLOR_BRIGHT_BLACK, "\033[100m" },
+    { TG_INDEXED_COLOR_BRIGHT_RED, "\033[101m" },
+    { TG_INDEXED_COLOR_BRIGHT_GREEN, "\033[102m" },
+    { TG_INDEXED_COLOR_BRIGHT_YELLOW, "\033[103m" },
+    { TG_INDEXED_COLOR_BRIGHT_BLUE, "\033[104m" },
+    { TG_INDEXED_COLOR_BRIGHT_MAGENTA, "\033[105m" },
+    { TG_INDEXED_COLOR_BRIGHT_CYAN, "\033[106m" },
+    { TG_INDEXED_COLOR_BRIGHT_WHITE, "\033[107m" },
+};
+
+
+
+static FILE *capture_file;
+static int saved_stdout = -1;
+static char captured[CAPTURE_LENGTH];
+
+
+
+void setUp(void)
+{
+}
+
+
+
+void tearDown(void)
+{
+}
+
+
+
+/**
+ * @brief Redirects standard output into a temporary file.
+ * 
+ */
+static void capture_begin(void)
+{
+    fflush(stdout);
+    capture_file = tmpfile();
+    TEST_ASSERT_NOT_NULL(capture_file);
+    saved_stdout = dup(STDOUT_FILENO);
+    TEST_ASSERT_NOT_EQUAL_INT(-1, saved_stdout);
+    TEST_ASSERT_NOT_EQUAL_INT(-1,
+        dup2(fileno(capture_file), STDOUT_FILENO));
+}
+
+
+
+/**
+ * @brief Restores standard output, and reads what was written meanwhile into
+ *      `captured`, as a string.
+ * 
+ */
+static void capture_end(void)
+{
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    rewind(capture_file);
+    size_t length = fread(captured, 1, CAPTURE_LENGTH - 1, capture_file);
+    captured[length] = '\0';
+    fclose(capture_file);
+}
+
+
+
+#define CHECK_PRINTF(expected, count, ...)                          \
+    do                                                              \
+    {                                                               \
+        capture_begin();                                            \
+        int result = tg_printf(__VA_ARGS__);                        \
+        capture_end();                                              \
+        TEST_ASSERT_EQUAL_STRING(expected, captured);               \
+        TEST_ASSERT_EQUAL_INT(count, result);                       \
+    } while (0)
+
+
+
+static void test_plain(void)
+{
+    CHECK_PRINTF("" END, 0, "");
+    CHECK_PRINTF("x = 42, 3.50" END, 12, "x = %d, %.2f", 42, 3.5);
+}
+
+
+
+static void test_direct_colors(void)
+{
+    CHECK_PRINTF("\033[38;2;001;022;255ma" END, 1, "#dfa", TG_RGB(1, 22, 255));
+    CHECK_PRINTF("\033[48;2;000;000;000mb" END, 1, "#dbb", TG_RGB(0, 0, 0));
+
+    // The same format, from the cache, takes the new arguments.
+    CHECK_PRINTF("\033[38;2;255;128;007m\033[48;2;010;200;099m7" END, 1,
+        "#df#db%d", TG_RGB(255, 128, 7), TG_RGB(10, 200, 99), 7);
+    CHECK_PRINTF("\033[38;2;000;000;000m\033[48;2;255;255;255m8" END, 1,
+        "#df#db%d", TG_RGB(0, 0, 0), TG_RGB(255, 255, 255), 8);
+}
+
+
+
+static void test_indexed_colors(void)
+{
+    char expected[64];
+    for (size_t i = 0; i < sizeof(INDEXED) / sizeof(*INDEXED); i++)
+    {
+        snprintf(expected, sizeof(expected), "%s%s#" END, INDEXED[i].color,
+            INDEXED[i].background);
+        CHECK_PRINTF(expected, 1, "#if#ib##", INDEXED[i].color,
+            INDEXED[i].color);
+    }
+}
+
+
+
+static void test_color_resets(void)
+{
+    CHECK_PRINTF(TG_RESET_FOREGROUND_COLOR "f" END, 1, "#0ff");
+    CHECK_PRINTF(TG_RESET_BACKGROUND_COLOR "b" END, 1, "#0bb");
+
+    // Both sequences count as escapes, only the text is counted.
+    CHECK_PRINTF(TG_RESET_FOREGROUND_COLOR TG_RESET_BACKGROUND_COLOR
+        "colors!" END, 7, "#0ccolors!");
+    CHECK_PRINTF("a" TG_RESET_FOREGROUND_COLOR TG_RESET_BACKGROUND_COLOR
+        "12345" END, 6, "a#0c%d", 12345);
+}
+
+
+
+static void test_styles(void)
+{
+    char format[16];
+    char expected[64];
+    for (size_t i = 0; i < sizeof(STYLES) / sizeof(*STYLES); i++)
+    {
+        snprintf(format, sizeof(format), "#%ca#0%cb", STYLES[i].letter,
+            STYLES[i].letter);
+        snprintf(expected, sizeof(expected), "%sa%sb" END, STYLES[i].sequence,
+            STYLES[i].reset);
+        CHECK_PRINTF(expected, 2, format);
+    }
+}
+
+
+
+static void test_literal_hash(void)
+{
+    CHECK_PRINTF("#" END, 1, "##");
+    CHECK_PRINTF("a#df 5#" END, 7, "a##df %d##", 5);
+    CHECK_PRINTF("##" END, 2, "####");
+}
+
+
+
+static void test_bare_reset(void)
+{
+    CHECK_PRINTF(END "a" END, 1, "#0a");
+    CHECK_PRINTF("a" END END, 1, "a#0");
+
+    // A reset followed by a letter with no meaning after it.
+    CHECK_PRINTF(END "x" END, 1, "#0x");
+}
+
+
+
+static void test_invalid_and_trailing(void)
+{
+    CHECK_PRINTF("#x" END, 2, "#x");
+    CHECK_PRINTF("#dz #i" END, 6, "#dz #i");
+    CHECK_PRINTF("#d" END, 2, "#d");
+    CHECK_PRINTF("a#" END, 2, "a#");
+    CHECK_PRINTF("#" END, 1, "#");
+    CHECK_PRINTF("9#" END, 2, "%d#", 9);
+}
+
+
+
+static void test_mixed(void)
+{
+    CHECK_PRINTF("\033[38;2;255;000;000m" TG_TEXT_STYLE_BOLD "hi"
+        TG_RESET_FOREGROUND_COLOR TG_INDEXED_COLOR_GREEN " 3#" END, 5,
+        "#df#o%s#0f#if %d##", TG_RGB(255, 0, 0), TG_INDEXED_COLOR_GREEN,
+        "hi", 3);
+}
+
+
+
+/**
+ * @brief A format longer than the buffer on the stack, which is then
+ *      allocated.
+ * 
+ */
+static void test_long_format(void)
+{
+    char format[1024];
+    char expected[2048];
+    size_t length = 0;
+    size_t expected_length = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        memcpy(format + length, "#ox", 3);
+        length += 3;
+        memcpy(expected + expected_length, TG_TEXT_STYLE_BOLD "x",
+            TG_TEXT_STYLE_SEQUENCE_LENGTH);
+        expected_length += TG_TEXT_STYLE_SEQUENCE_LENGTH;
+    }
+    format[length] = '\0';
+    memcpy(expected + expected_length, END, sizeof(END));
+    CHECK_PRINTF(expected, 100, format);
+}
+
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_plain);
+    RUN_TEST(test_direct_colors);
+    RUN_TEST(test_indexed_colors);
+    RUN_TEST(test_color_resets);
+    RUN_TEST(test_styles);
+    RUN_TEST(test_literal_hash);
+    RUN_TEST(test_bare_reset);
+    RUN_TEST(test_invalid_and_trailing);
+    RUN_TEST(test_mixed);
+    RUN_TEST(test_long_format);
+    return UNITY_END();
+}